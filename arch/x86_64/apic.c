@@ -4,6 +4,7 @@
 #include "arch/x86_64/apic.h"
 #include "arch/x86_64/io.h"
 #include "arch/x86_64/msr.h"
+#include "arch/x86_64/timer.h"
 #include "include/barrier.h"
 #include "kernel/klog.h"
 
@@ -337,10 +338,11 @@ int is_bsp(void) {
 }
 
 /**
- * apic_timer_init - Initialize APIC Timer for periodic interrupts
+ * apic_timer_init - Initialize APIC Timer
  *
- * Configures the Local APIC timer to generate periodic interrupts
- * at approximately 1000 Hz (1ms period).
+ * With CONFIG_NO_HZ the timer is set up as a one-shot clockevent
+ * (TSC-deadline when available) that the scheduler reprograms for each
+ * expiry. Otherwise it generates periodic interrupts.
  *
  * The APIC timer runs at the bus clock frequency. The actual frequency
  * varies by CPU, but dividing by 1 and using a reasonable initial count
@@ -352,10 +354,15 @@ void apic_timer_init(void) {
     /* Set divide configuration register (divide by 1) */
     lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV_BY_1);
 
-    /* Configure timer LVT (periodic mode, masked initially) */
+    /* Configure timer LVT (masked initially) */
     lvt_value = TIMER_VECTOR;              /* Interrupt vector */
-    lvt_value |= LAPIC_TIMER_LVT_PERIODIC; /* Periodic mode */
     lvt_value |= LAPIC_TIMER_LVT_MASK;     /* Mask timer initially */
+#if CONFIG_NO_HZ
+    lapic_write(LAPIC_TIMER_LVT, lvt_value | LAPIC_TIMER_LVT_ONESHOT);
+    lvt_value |= timer_oneshot_init();     /* One-shot or TSC-deadline */
+#else
+    lvt_value |= LAPIC_TIMER_LVT_PERIODIC; /* Periodic mode */
+#endif
     lapic_write(LAPIC_TIMER_LVT, lvt_value);
 
     /* NOTE: Timer is NOT started here. timer_start() will unmask and start it. */
@@ -76,6 +76,10 @@
 #define LAPIC_TIMER_LVT_ONESHOT   0x00000  /* One-shot mode */
 #define LAPIC_TIMER_LVT_TSCDEADLINE 0x40000 /* TSC deadline mode */
 
+/* TSC-deadline timer: CPUID.01H:ECX[24] and its deadline MSR */
+#define CPUID_FEAT_ECX_TSC_DEADLINE (1U << 24)
+#define IA32_TSC_DEADLINE_MSR       0x6E0
+
 /* APIC Timer Divide Configuration */
 #define LAPIC_TIMER_DIV_BY_1   0xB    /* Divide by 1 */
 #define LAPIC_TIMER_DIV_BY_2   0x0    /* Divide by 2 */
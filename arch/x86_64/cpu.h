@@ -47,4 +47,115 @@ static inline void arch_cpuid(uint32_t leaf, uint32_t *eax,
     if (edx) *edx = d;
 }
 
+/**
+ * arch_cpuid_count - Execute CPUID with a sub-leaf
+ * @leaf: CPUID leaf (EAX value)
+ * @subleaf: CPUID sub-leaf (ECX value)
+ * @eax: Output EAX register value
+ * @ebx: Output EBX register value
+ * @ecx: Output ECX register value
+ * @edx: Output EDX register value
+ *
+ * For leaves that enumerate several sub-leaves, such as 0xD (XSAVE).
+ */
+static inline void arch_cpuid_count(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+                                    uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    uint32_t a, b, c, d;
+    asm volatile ("cpuid"
+                  : "=a"(a), "=b"(b), "=c"(c), "=d"(d)
+                  : "a"(leaf), "c"(subleaf));
+    if (eax) *eax = a;
+    if (ebx) *ebx = b;
+    if (ecx) *ecx = c;
+    if (edx) *edx = d;
+}
+
+/**
+ * arch_bsf - Find the lowest set bit
+ * @word: Value to scan (must be non-zero)
+ *
+ * Executes BSF. The result is undefined for @word == 0.
+ *
+ * Returns: Bit index of the least significant set bit
+ */
+static inline unsigned long arch_bsf(uint64_t word) {
+    uint64_t index;
+    asm ("bsf %1, %0" : "=r"(index) : "rm"(word));
+    return index;
+}
+
+/* CPUID.1:ECX MONITOR/MWAIT support */
+#define CPUID_FEAT_ECX_MONITOR      (1U << 3)
+
+/* CPUID.5:ECX MONITOR/MWAIT extensions */
+#define CPUID5_ECX_EMX              (1U << 0)   /* MWAIT extensions enumerated */
+#define CPUID5_ECX_IBE              (1U << 1)   /* Interrupts break MWAIT, even masked */
+
+/**
+ * arch_monitor - Arm address monitoring hardware
+ * @addr: Address whose cache line is watched
+ *
+ * Executes MONITOR. A later MWAIT returns when the line is written.
+ */
+static inline void arch_monitor(const volatile void *addr) {
+    asm volatile ("monitor" :: "a"(addr), "c"(0), "d"(0) : "memory");
+}
+
+/**
+ * arch_safe_mwait - Enable interrupts and wait on the monitored line
+ * @hint: MWAIT hint (target C-state, 0 for C1)
+ *
+ * Like sti;hlt, STI takes effect only after MWAIT has started, so an
+ * interrupt cannot slip in between. Returns on a write to the monitored
+ * line or an interrupt, with interrupts enabled.
+ */
+static inline void arch_safe_mwait(uint32_t hint) {
+    asm volatile ("sti; mwait" :: "a"(hint), "c"(0) : "memory");
+}
+
+/* CPUID.1:ECX XSAVE/XRSTOR and XCR0 support */
+#define CPUID_FEAT_ECX_XSAVE        (1U << 26)
+
+/* CPUID.(EAX=0DH,ECX=1):EAX XSAVE extensions */
+#define CPUIDD_EAX_XSAVEOPT         (1U << 0)
+#define CPUIDD_EAX_XSAVES           (1U << 3)
+
+/**
+ * arch_xgetbv - Read an extended control register
+ * @index: XCR number (0 = XCR0, the enabled XSAVE features)
+ *
+ * Requires CR4.OSXSAVE.
+ */
+static inline uint64_t arch_xgetbv(uint32_t index) {
+    uint32_t lo, hi;
+    asm volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * arch_xsetbv - Write an extended control register
+ * @index: XCR number
+ * @value: New value
+ *
+ * Requires CR4.OSXSAVE.
+ */
+static inline void arch_xsetbv(uint32_t index, uint64_t value) {
+    asm volatile ("xsetbv" :: "a"((uint32_t)value), "d"((uint32_t)(value >> 32)),
+                  "c"(index) : "memory");
+}
+
+/**
+ * arch_rdtsc - Read the Time Stamp Counter
+ *
+ * Executes RDTSC. Not serializing; callers that need ordering against
+ * surrounding loads/stores must add their own fences.
+ *
+ * Returns: 64-bit TSC value
+ */
+static inline uint64_t arch_rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 #endif /* EMERGENCE_ARCH_X86_64_CPU_H */
@@ -0,0 +1,460 @@
+/* Emergence Kernel - x86-64 FPU/SIMD extended state
+ *
+ * Each thread that has used the FPU owns a page holding its x87/SSE/AVX
+ * state in XSAVE format (FXSAVE on CPUs without XSAVE). A thread's state
+ * is allocated and loaded on its first FPU instruction, which traps with
+ * #NM because CR0.TS is set while it runs without loaded state.
+ *
+ * On a switch the outgoing thread's registers are always saved, so its
+ * state can resume on any CPU. XSAVEOPT/XSAVES skip components that are
+ * unmodified since they were loaded from the same area, which makes that
+ * save cheap for threads that did not touch the FPU in their slice.
+ * The incoming thread's state is then either restored right away (eager,
+ * the default) or on its next FPU instruction (CONFIG_FPU_LAZY). Either
+ * way the restore is skipped if this CPU's registers still hold it.
+ *
+ * The kernel itself is built without SSE. Code that wants vector
+ * registers brackets them with kernel_fpu_begin()/kernel_fpu_end().
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arch/x86_64/fpu.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/cr.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/idt.h"
+#include "arch/x86_64/include/cpu_context.h"
+#include "kernel/thread.h"
+#include "kernel/pmm.h"
+#include "kernel/klog.h"
+#include "include/preempt.h"
+#include "include/string.h"
+
+/* Control register bits */
+#define CR0_MP              (1ULL << 1)     /* WAIT/FWAIT honours CR0.TS */
+#define CR0_EM              (1ULL << 2)     /* x87 emulation (must be clear) */
+#define CR0_TS              (1ULL << 3)     /* Task switched: FPU use traps #NM */
+#define CR0_NE              (1ULL << 5)     /* Native x87 error reporting */
+#define CR4_OSFXSR          (1ULL << 9)     /* FXSAVE/FXRSTOR and SSE */
+#define CR4_OSXMMEXCPT      (1ULL << 10)    /* Unmasked SIMD exceptions raise #XM */
+#define CR4_OSXSAVE         (1ULL << 18)    /* XSAVE and XCR0 */
+
+/* XCR0 state components the kernel manages */
+#define XFEATURE_MASK_FP        (1ULL << 0)
+#define XFEATURE_MASK_SSE       (1ULL << 1)
+#define XFEATURE_MASK_YMM       (1ULL << 2)
+#define XFEATURE_MASK_OPMASK    (1ULL << 5)
+#define XFEATURE_MASK_ZMM_Hi256 (1ULL << 6)
+#define XFEATURE_MASK_Hi16_ZMM  (1ULL << 7)
+#define XFEATURE_MASK_SUPPORTED (XFEATURE_MASK_FP | XFEATURE_MASK_SSE | \
+                                 XFEATURE_MASK_YMM | XFEATURE_MASK_OPMASK | \
+                                 XFEATURE_MASK_ZMM_Hi256 | XFEATURE_MASK_Hi16_ZMM)
+
+/* FXSAVE area size (legacy region of the XSAVE area) */
+#define FXSAVE_SIZE         512
+
+/* Default MXCSR: all SIMD exceptions masked, round to nearest */
+#define MXCSR_DEFAULT       0x1F80
+
+enum fpu_method {
+    FPU_FXSAVE,
+    FPU_XSAVE,
+    FPU_XSAVEOPT,
+    FPU_XSAVES,
+};
+
+static const char *const fpu_method_names[] = {
+    [FPU_FXSAVE] = "fxsave",
+    [FPU_XSAVE] = "xsave",
+    [FPU_XSAVEOPT] = "xsaveopt",
+    [FPU_XSAVES] = "xsaves",
+};
+
+/* Per-CPU FPU register ownership */
+struct fpu_cpu {
+    struct thread *owner;           /* Thread whose state the registers hold */
+    int ts;                         /* Mirror of CR0.TS */
+    int in_kernel_fpu;              /* Inside kernel_fpu_begin()/end() */
+};
+
+static DEFINE_PER_CPU(struct fpu_cpu, cpu_fpu);
+
+static enum fpu_method fpu_method;
+static uint64_t xfeatures;          /* Enabled XCR0 components */
+static size_t xstate_size;          /* Bytes of a saved state */
+
+/* Initial state copied into a thread's area on its first FPU use */
+static uint8_t init_fpstate[PAGE_SIZE] __attribute__((aligned(64)));
+
+static const uint32_t mxcsr_default = MXCSR_DEFAULT;
+
+static inline struct fpu_cpu *this_fpu_cpu(void) {
+    return this_cpu_ptr(&cpu_fpu);
+}
+
+/* CR0.TS writes are serializing, so only touch it when it changes */
+static inline void fpu_clts(struct fpu_cpu *fc) {
+    if (fc->ts) {
+        asm volatile ("clts" ::: "memory");
+        fc->ts = 0;
+    }
+}
+
+static inline void fpu_stts(struct fpu_cpu *fc) {
+    if (!fc->ts) {
+        arch_cr0_write(arch_cr0_read() | CR0_TS);
+        fc->ts = 1;
+    }
+}
+
+/* Save the FPU registers to @state (CR0.TS clear) */
+static inline void fpu_save_state(void *state) {
+    uint32_t lo = (uint32_t)xfeatures;
+    uint32_t hi = (uint32_t)(xfeatures >> 32);
+
+    switch (fpu_method) {
+    case FPU_XSAVES:
+        asm volatile ("xsaves64 (%0)" :: "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_XSAVEOPT:
+        asm volatile ("xsaveopt64 (%0)" :: "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_XSAVE:
+        asm volatile ("xsave64 (%0)" :: "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    default:
+        asm volatile ("fxsave64 (%0)" :: "r"(state) : "memory");
+        break;
+    }
+}
+
+/* Load the FPU registers from @state (CR0.TS clear) */
+static inline void fpu_restore_state(const void *state) {
+    uint32_t lo = (uint32_t)xfeatures;
+    uint32_t hi = (uint32_t)(xfeatures >> 32);
+
+    switch (fpu_method) {
+    case FPU_XSAVES:
+        asm volatile ("xrstors64 (%0)" :: "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    case FPU_XSAVEOPT:
+    case FPU_XSAVE:
+        asm volatile ("xrstor64 (%0)" :: "r"(state), "a"(lo), "d"(hi) : "memory");
+        break;
+    default:
+        asm volatile ("fxrstor64 (%0)" :: "r"(state) : "memory");
+        break;
+    }
+}
+
+/* Load @t's state into this CPU's registers and record the ownership */
+static void fpu_load(struct fpu_cpu *fc, struct thread *t, int cpu) {
+    fpu_clts(fc);
+    fpu_restore_state(t->fpu.state);
+    fc->owner = t;
+    t->fpu.last_cpu = cpu;
+}
+
+/* The registers still hold @t's state: nothing ran FPU code since it left */
+static inline int fpu_regs_valid(struct fpu_cpu *fc, struct thread *t, int cpu) {
+    return fc->owner == t && t->fpu.last_cpu == cpu;
+}
+
+/**
+ * fpu_init_cpu - Enable the FPU on this CPU
+ *
+ * Clears CR0.EM, sets CR4.OSFXSR/OSXMMEXCPT and, with XSAVE, CR4.OSXSAVE
+ * and XCR0. Leaves CR0.TS set so the first FPU instruction traps.
+ */
+void fpu_init_cpu(void) {
+    struct fpu_cpu *fc = this_fpu_cpu();
+    uint64_t cr0, cr4;
+
+    cr0 = arch_cr0_read();
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE | CR0_TS;
+    arch_cr0_write(cr0);
+
+    cr4 = arch_cr4_read() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (fpu_method != FPU_FXSAVE) {
+        cr4 |= CR4_OSXSAVE;
+    }
+    arch_cr4_write(cr4);
+
+    if (fpu_method != FPU_FXSAVE) {
+        arch_xsetbv(0, xfeatures);
+    }
+
+    fc->owner = NULL;
+    fc->ts = 1;
+    fc->in_kernel_fpu = 0;
+}
+
+/**
+ * fpu_init - Set up extended state management
+ *
+ * Picks the best save instruction: XSAVES (compacted, init and modified
+ * optimizations), XSAVEOPT (modified optimization), XSAVE, or FXSAVE on
+ * CPUs without XSAVE. Enables the x87, SSE, AVX and AVX-512 components
+ * the CPU supports; AMX and supervisor states are left off, so the state
+ * fits a page. Captures the initial state new FPU users start from.
+ */
+void fpu_init(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+
+    arch_cpuid(0, &max_leaf, NULL, NULL, NULL);
+    arch_cpuid(1, NULL, NULL, &ecx, NULL);
+
+    fpu_method = FPU_FXSAVE;
+    xfeatures = XFEATURE_MASK_FP | XFEATURE_MASK_SSE;
+    xstate_size = FXSAVE_SIZE;
+
+    if ((ecx & CPUID_FEAT_ECX_XSAVE) && max_leaf >= 0xD) {
+        arch_cpuid_count(0xD, 0, &eax, NULL, NULL, &edx);
+        xfeatures = (((uint64_t)edx << 32) | eax) & XFEATURE_MASK_SUPPORTED;
+
+        /* AVX-512 state is only usable as a whole */
+        if ((xfeatures & (XFEATURE_MASK_OPMASK | XFEATURE_MASK_ZMM_Hi256 |
+                          XFEATURE_MASK_Hi16_ZMM)) !=
+            (XFEATURE_MASK_OPMASK | XFEATURE_MASK_ZMM_Hi256 | XFEATURE_MASK_Hi16_ZMM)) {
+            xfeatures &= ~(XFEATURE_MASK_OPMASK | XFEATURE_MASK_ZMM_Hi256 |
+                           XFEATURE_MASK_Hi16_ZMM);
+        }
+
+        arch_cpuid_count(0xD, 1, &eax, NULL, NULL, NULL);
+        if (eax & CPUIDD_EAX_XSAVES) {
+            fpu_method = FPU_XSAVES;
+        } else if (eax & CPUIDD_EAX_XSAVEOPT) {
+            fpu_method = FPU_XSAVEOPT;
+        } else {
+            fpu_method = FPU_XSAVE;
+        }
+    }
+
+    fpu_init_cpu();
+
+    /* Sizes depend on XCR0, so read them once it is set */
+    if (fpu_method == FPU_XSAVES) {
+        arch_cpuid_count(0xD, 1, NULL, &ebx, NULL, NULL);
+        xstate_size = ebx;
+    } else if (fpu_method != FPU_FXSAVE) {
+        arch_cpuid_count(0xD, 0, NULL, &ebx, NULL, NULL);
+        xstate_size = ebx;
+    }
+
+    if (xstate_size > PAGE_SIZE) {
+        klog_error("FPU", "XSAVE area of %lu bytes does not fit a page",
+                   (unsigned long)xstate_size);
+    }
+
+    /* Snapshot a freshly initialized FPU as the template for new threads */
+    fpu_clts(this_fpu_cpu());
+    asm volatile ("fninit");
+    asm volatile ("ldmxcsr %0" :: "m"(mxcsr_default));
+    fpu_save_state(init_fpstate);
+    fpu_stts(this_fpu_cpu());
+
+    klog_info("FPU", "Extended state: %s, xfeatures=0x%lx, %lu bytes, %s restore",
+              fpu_method_names[fpu_method], (unsigned long)xfeatures,
+              (unsigned long)xstate_size,
+              CONFIG_FPU_LAZY ? "lazy" : "eager");
+}
+
+/**
+ * fpu_state_size - Get the size of a saved FPU state
+ *
+ * Returns: Bytes of the XSAVE (or FXSAVE) area of a thread
+ */
+size_t fpu_state_size(void) {
+    return xstate_size;
+}
+
+/**
+ * fpu_save_method - Get the name of the save instruction in use
+ */
+const char *fpu_save_method(void) {
+    return fpu_method_names[fpu_method];
+}
+
+/**
+ * fpu_thread_init - Initialize a new thread's FPU state
+ * @t: Thread
+ *
+ * The state area is allocated on the thread's first FPU instruction.
+ */
+void fpu_thread_init(struct thread *t) {
+    t->fpu.state = NULL;
+    t->fpu.last_cpu = -1;
+}
+
+/**
+ * fpu_thread_copy - Give a forked thread a copy of its parent's FPU state
+ * @dst: New thread
+ * @src: Thread being forked, normally the current one
+ *
+ * Returns: 0 on success, -1 if the state area could not be allocated
+ */
+int fpu_thread_copy(struct thread *dst, struct thread *src) {
+    struct fpu_cpu *fc;
+    irq_flags_t flags;
+    void *state;
+
+    fpu_thread_init(dst);
+    if (src->fpu.state == NULL) {
+        return 0;
+    }
+
+    state = pmm_alloc(0);
+    if (state == NULL) {
+        return -1;
+    }
+
+    /* Flush live registers first so the copy is current */
+    flags = irq_save(1);
+    fc = this_fpu_cpu();
+    if (fc->owner == src && !fc->ts && !fc->in_kernel_fpu) {
+        fpu_save_state(src->fpu.state);
+    }
+    memcpy(state, src->fpu.state, xstate_size);
+    irq_restore(flags);
+
+    dst->fpu.state = state;
+    return 0;
+}
+
+/**
+ * fpu_thread_free - Release a thread's FPU state
+ * @t: Thread being destroyed (not running)
+ *
+ * A CPU may still name @t as owner; that is harmless, since a thread
+ * reusing the structure starts with last_cpu == -1 and never matches.
+ */
+void fpu_thread_free(struct thread *t) {
+    if (t->fpu.state != NULL) {
+        pmm_free(t->fpu.state, 0);
+        t->fpu.state = NULL;
+    }
+    t->fpu.last_cpu = -1;
+}
+
+/**
+ * fpu_switch - Switch FPU state between threads
+ * @prev: Thread being switched out (NULL for the boot context)
+ * @next: Thread being switched in
+ *
+ * Called by __schedule() with interrupts disabled, before the register
+ * switch.
+ */
+void fpu_switch(struct thread *prev, struct thread *next) {
+    int cpu = smp_get_cpu_index();
+    struct fpu_cpu *fc = this_fpu_cpu();
+
+    /* prev owns live registers: keep its state in memory for any CPU */
+    if (prev != NULL && fc->owner == prev && !fc->ts) {
+        fpu_save_state(prev->fpu.state);
+    }
+
+    if (next->fpu.state == NULL) {
+        fpu_stts(fc);
+    } else if (fpu_regs_valid(fc, next, cpu)) {
+        fpu_clts(fc);
+    } else if (!CONFIG_FPU_LAZY) {
+        fpu_load(fc, next, cpu);
+    } else {
+        fpu_stts(fc);
+    }
+}
+
+/**
+ * device_not_available_handler - Handle #NM
+ *
+ * Raised by an FPU instruction while CR0.TS is set: the current thread
+ * has no state loaded. Allocates its state on first use and loads it.
+ * Kernel code outside kernel_fpu_begin()/end() must not use the FPU, so
+ * this only comes from user mode or such a section in a thread.
+ */
+void device_not_available_handler(void) {
+    int cpu = smp_get_cpu_index();
+    struct fpu_cpu *fc = this_fpu_cpu();
+    thread_t *t = thread_get_current();
+
+    if (t == NULL) {
+        /* No thread context (early boot): the registers belong to nobody */
+        fc->owner = NULL;
+        fpu_clts(fc);
+        return;
+    }
+
+    if (t->fpu.state == NULL) {
+        void *state = pmm_alloc(0);
+
+        if (state == NULL) {
+            klog_error("FPU", "No memory for FPU state of thread '%s' (tid=%d)",
+                       t->name, t->tid);
+            while (1) {
+                arch_cpu_halt();
+            }
+        }
+        memcpy(state, init_fpstate, xstate_size);
+        t->fpu.state = state;
+    }
+
+    fpu_load(fc, t, cpu);
+}
+
+/**
+ * kernel_fpu_begin - Start using SSE/AVX registers in kernel code
+ *
+ * Saves the current thread's live FPU state and disables preemption
+ * until kernel_fpu_end(). The registers start out initialized (FNINIT,
+ * default MXCSR). Sections do not nest and must not be entered from
+ * interrupt handlers.
+ */
+void kernel_fpu_begin(void) {
+    struct fpu_cpu *fc;
+    uint64_t flags;
+
+    preempt_disable();
+    flags = arch_disable_interrupts();
+    fc = this_fpu_cpu();
+
+    if (fc->in_kernel_fpu) {
+        klog_error("FPU", "Nested kernel_fpu_begin()");
+    }
+    fc->in_kernel_fpu = 1;
+
+    if (fc->owner != NULL && !fc->ts) {
+        fpu_save_state(fc->owner->fpu.state);
+    }
+    fc->owner = NULL;
+    fpu_clts(fc);
+    arch_restore_interrupts(flags);
+
+    asm volatile ("fninit");
+    asm volatile ("ldmxcsr %0" :: "m"(mxcsr_default));
+}
+
+/**
+ * kernel_fpu_end - Stop using SSE/AVX registers in kernel code
+ *
+ * Reloads the current thread's state (eager) or arms the #NM trap
+ * (lazy), then re-enables preemption.
+ */
+void kernel_fpu_end(void) {
+    int cpu = smp_get_cpu_index();
+    struct fpu_cpu *fc = this_fpu_cpu();
+    thread_t *t = thread_get_current();
+    uint64_t flags;
+
+    flags = arch_disable_interrupts();
+    if (!CONFIG_FPU_LAZY && t != NULL && t->fpu.state != NULL) {
+        fpu_load(fc, t, cpu);
+    } else {
+        fpu_stts(fc);
+    }
+    fc->in_kernel_fpu = 0;
+    arch_restore_interrupts(flags);
+
+    preempt_enable();
+}
@@ -0,0 +1,51 @@
+/* Emergence Kernel - x86-64 FPU/SIMD extended state */
+
+#ifndef EMERGENCE_ARCH_X86_64_FPU_H
+#define EMERGENCE_ARCH_X86_64_FPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct thread;
+
+/* Per-thread FPU state
+ *
+ * Layout:
+ *   0-7:       state (8 bytes)
+ *   8-11:      last_cpu (4 bytes)
+ *   12-15:     padding (4 bytes)
+ * Total: 16 bytes
+ */
+struct fpu {
+    void *state;                    /* XSAVE/FXSAVE area, NULL until first use */
+    int last_cpu;                   /* CPU that last loaded it (-1 = none) */
+};
+
+/* Detect XSAVE features, size the state area and enable FPU/SSE on the BSP */
+void fpu_init(void);
+
+/* Enable FPU/SSE/XSAVE with the BSP's feature set on this CPU */
+void fpu_init_cpu(void);
+
+/* Size in bytes of a thread's saved state */
+size_t fpu_state_size(void);
+
+/* Save/restore instruction in use ("xsaves", "xsaveopt", "xsave" or "fxsave") */
+const char *fpu_save_method(void);
+
+/* Thread lifetime: no state until the first FPU instruction traps */
+void fpu_thread_init(struct thread *t);
+int fpu_thread_copy(struct thread *dst, struct thread *src);
+void fpu_thread_free(struct thread *t);
+
+/* Save @prev's registers and load (eager) or arm the #NM trap for (lazy) @next */
+void fpu_switch(struct thread *prev, struct thread *next);
+
+/* #NM (device not available) handler: load the current thread's state */
+void device_not_available_handler(void);
+
+/* Let kernel code use SSE/AVX registers; not from interrupt handlers */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif /* EMERGENCE_ARCH_X86_64_FPU_H */
@@ -0,0 +1,87 @@
+/* Emergence Kernel - Per-CPU GDT and TSS
+ *
+ * boot.S brings the BSP up on one GDT and TSS. Each CPU then loads its
+ * own copy of the GDT, whose TSS descriptor points at the CPU's own TSS,
+ * so the stacks ring 3 enters the kernel on are never shared:
+ *
+ *   RSP0  Running thread's kernel stack, set on every context switch
+ *   IST1  This CPU's #DF stack, usable even after a kernel stack overflow
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arch/x86_64/include/gdt.h"
+#include "arch/x86_64/smp.h"
+#include "include/percpu.h"
+#include "include/string.h"
+
+/* Segment descriptors boot.S sets up (null, kernel CS/DS, user CS/DS) */
+#define GDT_BOOT_ENTRIES    5
+
+/* GDT_BOOT_ENTRIES plus the two quadwords of the TSS descriptor */
+#define GDT_ENTRIES         (GDT_BOOT_ENTRIES + 2)
+
+/* #DF stack (IST1), one per CPU */
+#define DOUBLE_FAULT_STACK_SIZE 4096
+
+/* Boot GDT (boot.S) */
+extern uint64_t gdt64[];
+
+static DEFINE_PER_CPU(uint64_t[GDT_ENTRIES], cpu_gdt) __attribute__((aligned(16)));
+static DEFINE_PER_CPU(tss_t, cpu_tss) __attribute__((aligned(16)));
+
+static uint8_t double_fault_stacks[SMP_MAX_CPUS][DOUBLE_FAULT_STACK_SIZE]
+    __attribute__((aligned(16)));
+
+/* Encode a 64-bit available-TSS descriptor for @tss into @desc[0..1] */
+static void gdt_set_tss_desc(uint64_t *desc, const tss_t *tss)
+{
+    uint64_t base = (uint64_t)tss;
+    uint64_t limit = sizeof(*tss) - 1;
+
+    desc[0] = (limit & 0xFFFF) |
+              ((base & 0xFFFFFF) << 16) |
+              GDT_TYPE_TSS | GDT_S_SYSTEM | GDT_DPL_0 | GDT_PRESENT |
+              (((limit >> 16) & 0xF) << 48) |
+              (((base >> 24) & 0xFF) << 56);
+    desc[1] = base >> 32;
+}
+
+/**
+ * gdt_init_cpu - Load this CPU's own GDT and TSS
+ * @cpu: This CPU's index
+ * @stack_top: Stack ring 3 enters on until the first context switch
+ *
+ * Must run after smp_set_gs_base(). Segment selectors are unchanged,
+ * so the loaded segment registers stay valid.
+ */
+void gdt_init_cpu(int cpu, void *stack_top)
+{
+    uint64_t *gdt = *this_cpu_ptr(&cpu_gdt);
+    tss_t *tss = this_cpu_ptr(&cpu_tss);
+    tss_pointer_t gdtr;
+
+    memset(tss, 0, sizeof(*tss));
+    tss->rsp0 = (uint64_t)stack_top & ~0xFULL;
+    tss->ist1 = (uint64_t)&double_fault_stacks[cpu][DOUBLE_FAULT_STACK_SIZE];
+    tss->iomap_base = sizeof(*tss);     /* Beyond the limit: no I/O bitmap */
+
+    memcpy(gdt, gdt64, GDT_BOOT_ENTRIES * sizeof(uint64_t));
+    gdt_set_tss_desc(&gdt[GDT_TSS / 8], tss);
+
+    gdtr.limit = GDT_ENTRIES * sizeof(uint64_t) - 1;
+    gdtr.base = (uint64_t)gdt;
+    __asm__ volatile ("lgdt %0" : : "m"(gdtr) : "memory");
+    __asm__ volatile ("ltr %w0" : : "r"((uint16_t)GDT_TSS) : "memory");
+}
+
+/**
+ * tss_set_rsp0 - Set the stack ring 3 interrupts and exceptions enter on
+ * @stack_top: Top of the running thread's kernel stack
+ *
+ * Called by the scheduler on every switch, with interrupts disabled.
+ */
+void tss_set_rsp0(void *stack_top)
+{
+    this_cpu_ptr(&cpu_tss)->rsp0 = (uint64_t)stack_top & ~0xFULL;
+}
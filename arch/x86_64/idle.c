@@ -0,0 +1,113 @@
+/* Emergence Kernel - x86-64 CPU idle driver
+ *
+ * An idle CPU either halts (HLT), which only an interrupt ends, or arms
+ * MONITOR on the word another CPU writes to hand it work and waits with
+ * MWAIT. The latter is ended by a plain store to that word, so a remote
+ * wakeup needs no IPI and skips the interrupt entry/exit on both sides.
+ *
+ * Both are entered with interrupts disabled after the caller has checked
+ * for work, and use the STI shadow so an interrupt arriving between the
+ * check and the sleep still ends it.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arch/x86_64/idle.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/include/cpu_context.h"
+#include "include/barrier.h"
+#include "kernel/klog.h"
+
+/* MONITOR/MWAIT available (CPUID) */
+static int mwait_supported;
+
+/* Idle CPUs wait with MWAIT rather than HLT */
+static int mwait_enabled;
+
+/**
+ * idle_init - Select the idle method
+ *
+ * MWAIT needs CPUID.1:ECX.MONITOR and, if leaf 5 exists, must not be
+ * disabled there. Hypervisors often hide it unless the guest owns its
+ * physical CPUs (QEMU/KVM: -overcommit cpu-pm=on), in which case idle
+ * falls back to HLT.
+ */
+void idle_init(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+
+    arch_cpuid(0, &max_leaf, NULL, NULL, NULL);
+    arch_cpuid(1, &eax, &ebx, &ecx, &edx);
+    mwait_supported = (ecx & CPUID_FEAT_ECX_MONITOR) != 0;
+
+    if (mwait_supported && max_leaf >= 5) {
+        arch_cpuid(5, &eax, &ebx, &ecx, &edx);
+        /* Smallest monitor line size of zero means MONITOR is unusable */
+        if ((eax & 0xFFFF) == 0) {
+            mwait_supported = 0;
+        }
+    }
+
+    mwait_enabled = CONFIG_IDLE_MWAIT && mwait_supported;
+    klog_info("IDLE", "Idle method: %s%s", mwait_enabled ? "MWAIT" : "HLT",
+              (!mwait_enabled && mwait_supported) ? " (MWAIT disabled)" : "");
+}
+
+/**
+ * idle_mwait_supported - Check for MONITOR/MWAIT support
+ *
+ * Returns: 1 if the CPU supports it, 0 otherwise
+ */
+int idle_mwait_supported(void) {
+    return mwait_supported;
+}
+
+/**
+ * idle_uses_mwait - Check whether idle() waits with MWAIT
+ *
+ * Returns: 1 if a store to the word passed to idle_enter() wakes the
+ *          CPU, 0 if only an interrupt does
+ */
+int idle_uses_mwait(void) {
+    return mwait_enabled;
+}
+
+/**
+ * idle_enter_hlt - Halt until the next interrupt
+ *
+ * Called with interrupts disabled; returns with them enabled.
+ */
+void idle_enter_hlt(void) {
+    arch_safe_halt();
+}
+
+/**
+ * idle_enter_mwait - Wait until @flag is written or an interrupt arrives
+ * @flag: Word another CPU sets to wake this one
+ *
+ * Called with interrupts disabled; returns with them enabled. Re-checks
+ * @flag after arming the monitor, so a store that raced with the
+ * caller's last check is not slept through.
+ */
+void idle_enter_mwait(volatile int *flag) {
+    arch_monitor(flag);
+    if (READ_ONCE(*flag)) {
+        arch_enable_interrupts();
+        return;
+    }
+    arch_safe_mwait(0);
+}
+
+/**
+ * idle_enter - Idle with the selected method
+ * @flag: Word another CPU sets to wake this one (only watched with MWAIT)
+ *
+ * Called with interrupts disabled; returns with them enabled, possibly
+ * spuriously, so the caller re-checks for work.
+ */
+void idle_enter(volatile int *flag) {
+    if (mwait_enabled) {
+        idle_enter_mwait(flag);
+    } else {
+        idle_enter_hlt();
+    }
+}
@@ -0,0 +1,24 @@
+/* Emergence Kernel - x86-64 CPU idle driver */
+
+#ifndef EMERGENCE_ARCH_X86_64_IDLE_H
+#define EMERGENCE_ARCH_X86_64_IDLE_H
+
+#include <stdint.h>
+
+/* Select MWAIT or HLT for idle (CONFIG_IDLE_MWAIT and CPUID) */
+void idle_init(void);
+
+/* Check whether the CPU can wait on a cache line with MONITOR/MWAIT */
+int idle_mwait_supported(void);
+
+/* Check whether idle CPUs wait with MWAIT, so a store to the watched word wakes them */
+int idle_uses_mwait(void);
+
+/* Sleep until an interrupt or, with MWAIT, a write to @flag (interrupts off on entry, on on return) */
+void idle_enter(volatile int *flag);
+
+/* The two idle methods, for callers that pick one explicitly */
+void idle_enter_hlt(void);
+void idle_enter_mwait(volatile int *flag);
+
+#endif /* EMERGENCE_ARCH_X86_64_IDLE_H */
@@ -9,6 +9,8 @@
 #include "arch/x86_64/serial.h"
 #include "kernel/monitor/monitor.h"
 #include "arch/x86_64/power.h"
+#include "kernel/stack.h"
+#include "include/string.h"
 
 /* IDT array - 256 entries for x86-64 */
 static idt_entry_t idt[IDT_ENTRIES];
@@ -20,6 +22,7 @@ idt_ptr_t idt_ptr;
 /* External ISR assembly wrappers */
 extern void timer_isr(void);
 extern void ipi_isr(void);
+extern void resched_isr(void);
 extern void divide_error_isr(void);
 extern void debug_isr(void);
 extern void nmi_isr(void);
@@ -154,10 +157,15 @@ void idt_init(void) {
     idt_set_gate(18, (uint64_t)machine_check_isr, kernel_cs, IDT_GATE_INTERRUPT_USER);
     idt_set_gate(19, (uint64_t)simd_isr, kernel_cs, IDT_GATE_INTERRUPT_USER);
 
+    /* A guard page hit leaves no stack to deliver #PF on, which escalates
+     * to #DF: #DF runs on each CPU's own IST1 stack (gdt.c) */
+    idt[8].ist = 1;
+
     /* Set up interrupt handlers (32+) */
     idt_set_gate(TIMER_VECTOR, (uint64_t)timer_isr, kernel_cs, IDT_GATE_INTERRUPT);
     /* Vector 33 is for IPI (Inter-Processor Interrupt) */
     idt_set_gate(33, (uint64_t)ipi_isr, kernel_cs, IDT_GATE_INTERRUPT);  /* IPI */
+    idt_set_gate(RESCHED_VECTOR, (uint64_t)resched_isr, kernel_cs, IDT_GATE_INTERRUPT);
     /* More interrupt handlers can be added here */
 
     /* Set up IDT pointer */
@@ -172,15 +180,16 @@ void idt_init(void) {
 extern uint64_t unpriv_pml4_phys;
 
 /**
- * page_fault_handler - Handle page fault with kmap demand paging support
+ * page_fault_handler - Handle page fault with kmap and user demand paging
  * @fault_addr: Faulting virtual address from CR2
  * @error_code: Page fault error code from stack
  * @fault_ip: Instruction pointer where fault occurred
  *
  * NOTE: This handler runs in outer kernel mode (unprivileged).
  * It first attempts to handle the fault via kmap demand paging for
- * pageable kernel regions. If the fault cannot be handled, it logs
- * the fault and initiates shutdown.
+ * pageable kernel regions, then via the current process's address
+ * space (vm_fault()). If the fault cannot be handled, it logs the
+ * fault and initiates shutdown.
  *
  * IMPORTANT: This handler must be very simple to avoid causing additional
  * faults (double faults). Avoid complex functions that might fault.
@@ -190,6 +199,12 @@ void page_fault_handler(uint64_t fault_addr, uint64_t error_code, uint64_t fault
     extern int kmap_handle_page_fault(uint64_t fault_addr, uint64_t error_code);
     int ret = kmap_handle_page_fault(fault_addr, error_code);
 
+    /* Then demand paging of the current process's address space */
+    if (ret != 0) {
+        extern int vm_handle_page_fault(uint64_t fault_addr, uint64_t error_code);
+        ret = vm_handle_page_fault(fault_addr, error_code);
+    }
+
     if (ret == 0) {
         /* Page fault was handled successfully, return to continue execution */
         return;
@@ -200,6 +215,9 @@ void page_fault_handler(uint64_t fault_addr, uint64_t error_code, uint64_t fault
 
     /* Log diagnostic information */
     extern void serial_puts(const char *str);
+    if (stack_is_guard(fault_addr)) {
+        serial_puts("KERNEL STACK OVERFLOW: guard page hit\n");
+    }
     serial_puts("PAGE FAULT: addr=0x");
     extern void serial_put_hex(uint64_t val);
     serial_put_hex(fault_addr);
@@ -218,3 +236,33 @@ void page_fault_handler(uint64_t fault_addr, uint64_t error_code, uint64_t fault
     arch_halt();
     while (1) arch_halt();
 }
+
+/**
+ * double_fault_handler - Report a double fault
+ * @fault_addr: CR2, the address of the last page fault
+ * @fault_ip: Instruction pointer where fault occurred
+ *
+ * Runs on the IST1 stack. A double fault with CR2 in a stack guard area
+ * is a kernel stack overflow: the #PF it caused could not be delivered on
+ * the exhausted stack.
+ */
+void double_fault_handler(uint64_t fault_addr, uint64_t fault_ip) {
+    extern void serial_puts(const char *str);
+    extern void serial_put_hex(uint64_t val);
+
+    if (stack_is_guard(fault_addr)) {
+        serial_puts("KERNEL STACK OVERFLOW: addr=0x");
+    } else {
+        serial_puts("DOUBLE FAULT: cr2=0x");
+    }
+    serial_put_hex(fault_addr);
+    serial_puts(" ip=0x");
+    serial_put_hex(fault_ip);
+    serial_puts("\n");
+
+    extern void system_shutdown(void);
+    system_shutdown();
+
+    disable_interrupts_raw();
+    while (1) arch_halt();
+}
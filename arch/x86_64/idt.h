@@ -4,6 +4,7 @@
 #define EMERGENCE_ARCH_X86_64_IDT_H
 
 #include <stdint.h>
+#include "include/preempt.h"
 
 /* IDT Entry (64-bit gate descriptor) - 16 bytes total */
 typedef struct {
@@ -33,6 +34,7 @@ typedef struct {
 #define IRQ_BASE           32      /* First user IRQ vector */
 #define TIMER_VECTOR       32      /* Timer interrupt vector */
 #define IPI_VECTOR         33      /* IPI interrupt vector */
+#define RESCHED_VECTOR     34      /* Reschedule IPI vector */
 
 /* Interrupt flags type for saving/restoring interrupt state */
 typedef unsigned long irq_flags_t;
@@ -95,10 +97,12 @@ static inline void enable_interrupts(void) {
  *
  * Increments nesting counter and disables interrupts.
  * Nested calls are safe - interrupts only re-enabled when
- * nesting depth returns to zero.
+ * nesting depth returns to zero. Also disables preemption.
  */
 static inline void irq_disable(void) {
     int *depth = smp_get_irq_nest_depth_ptr();
+
+    preempt_disable();
     if (depth) {
         (*depth)++;
         if (*depth == 1) {
@@ -115,6 +119,7 @@ static inline void irq_disable(void) {
  *
  * Decrements nesting counter and enables interrupts if depth reaches zero.
  * Safe for nested calls - only actually enables at outermost level.
+ * Preemption point once interrupts are back on.
  */
 static inline void irq_enable(void) {
     int *depth = smp_get_irq_nest_depth_ptr();
@@ -127,6 +132,7 @@ static inline void irq_enable(void) {
         /* Fallback: enable interrupts without nesting */
         asm volatile ("sti" : : : "memory");
     }
+    preempt_enable();
 }
 
 /**
@@ -136,7 +142,8 @@ static inline void irq_enable(void) {
  * Returns: Current RFLAGS value (scalar)
  *
  * Saves RFLAGS using PUSHF. If @disable is non-zero, also
- * disables interrupts with nesting support.
+ * disables interrupts with nesting support. Must be paired with
+ * irq_restore(), which undoes the disable.
  */
 static inline irq_flags_t irq_save(int disable) {
     irq_flags_t flags;
@@ -156,6 +163,7 @@ static inline irq_flags_t irq_save(int disable) {
  * 2) No nested interrupt disables remain active
  *
  * Nesting-aware: Only enables interrupts when nesting depth is zero.
+ * Re-enables preemption taken by irq_save(1), after interrupts are back.
  */
 static inline void irq_restore(irq_flags_t flags) {
     int *depth = smp_get_irq_nest_depth_ptr();
@@ -171,6 +179,7 @@ static inline void irq_restore(irq_flags_t flags) {
             asm volatile ("sti" : : : "memory");
         }
     }
+    preempt_enable();
 }
 
 #endif /* EMERGENCE_ARCH_X86_64_IDT_H */
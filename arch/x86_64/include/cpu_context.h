@@ -110,13 +110,13 @@ static inline void arch_context_init(cpu_context_t *ctx, void *stack_top,
  * arch_get_current_thread - Get current thread from per-CPU data
  *
  * On x86_64, per-CPU data is accessed via the GS segment.
- * The current thread pointer is stored at offset 48 in the per-CPU area.
+ * The current thread pointer is the per-CPU variable current_thread.
  *
  * Returns: Pointer to current thread, or NULL if none
  */
 static inline void *arch_get_current_thread(void) {
     void *current;
-    __asm__ volatile ("mov %%gs:48, %0" : "=r"(current));
+    __asm__ volatile ("mov %%gs:current_thread, %0" : "=r"(current));
     return current;
 }
 
@@ -124,10 +124,10 @@ static inline void *arch_get_current_thread(void) {
  * arch_set_current_thread - Set current thread in per-CPU data
  * @t: Thread pointer to store
  *
- * Stores the thread pointer at GS offset 48 in the per-CPU area.
+ * Stores the thread pointer in this CPU's current_thread.
  */
 static inline void arch_set_current_thread(void *t) {
-    __asm__ volatile ("mov %0, %%gs:48" :: "r"(t));
+    __asm__ volatile ("mov %0, %%gs:current_thread" :: "r"(t) : "memory");
 }
 
 /**
@@ -140,6 +140,17 @@ static inline void arch_cpu_halt(void) {
     __asm__ volatile ("hlt");
 }
 
+/**
+ * arch_safe_halt - Enable interrupts and halt atomically
+ *
+ * STI only takes effect after the following instruction, so no interrupt
+ * can slip in between the two. Idle loops that check for work with
+ * interrupts disabled use this to avoid sleeping through a wakeup.
+ */
+static inline void arch_safe_halt(void) {
+    __asm__ volatile ("sti; hlt" ::: "memory");
+}
+
 /**
  * arch_enable_interrupts - Enable CPU interrupts
  *
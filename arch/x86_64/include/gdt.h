@@ -47,4 +47,10 @@ typedef struct {
     uint16_t iomap_base;
 } __attribute__((packed)) tss_t;
 
+/* Load this CPU's own GDT and TSS (gdt.c) */
+void gdt_init_cpu(int cpu, void *stack_top);
+
+/* Stack ring 3 interrupts and exceptions enter on: the running thread's */
+void tss_set_rsp0(void *stack_top);
+
 #endif /* GDT_H */
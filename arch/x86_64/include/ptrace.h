@@ -0,0 +1,82 @@
+/* Emergence Kernel - x86_64 saved user registers
+ *
+ * syscall_entry saves the caller's registers as a struct pt_regs at the
+ * top of the kernel entry stack. The last five words are laid out like
+ * the frame the CPU pushes for an interrupt from ring 3, so the same
+ * frame describes a thread's user state however it entered the kernel:
+ *
+ *   entry stack top ->  ss, rsp, rflags, cs, rip     (interrupt frame)
+ *                       orig_rax                     (syscall number)
+ *                       rdi ... r15                  (general registers)
+ *
+ * SYSCALL leaves the return RIP in RCX and RFLAGS in R11, so the saved
+ * rcx and r11 hold those values too. Only the layout is shared with
+ * assembly: the PT_REGS_* offsets below, checked against the structure
+ * in syscall.c.
+ */
+
+#ifndef _ARCH_X86_64_PTRACE_H
+#define _ARCH_X86_64_PTRACE_H
+
+/* Byte offsets of the fields of struct pt_regs */
+#define PT_REGS_R15         0
+#define PT_REGS_R14         8
+#define PT_REGS_R13         16
+#define PT_REGS_R12         24
+#define PT_REGS_RBP         32
+#define PT_REGS_RBX         40
+#define PT_REGS_R11         48
+#define PT_REGS_R10         56
+#define PT_REGS_R9          64
+#define PT_REGS_R8          72
+#define PT_REGS_RAX         80
+#define PT_REGS_RCX         88
+#define PT_REGS_RDX         96
+#define PT_REGS_RSI         104
+#define PT_REGS_RDI         112
+#define PT_REGS_ORIG_RAX    120
+#define PT_REGS_RIP         128
+#define PT_REGS_CS          136
+#define PT_REGS_RFLAGS      144
+#define PT_REGS_RSP         152
+#define PT_REGS_SS          160
+#define PT_REGS_SIZE        168
+
+/* Selectors saved for ring 3: user code and data, RPL 3 */
+#define PT_REGS_USER_CS     0x1b
+#define PT_REGS_USER_SS     0x23
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+struct pt_regs {
+    /* Callee-saved registers */
+    uint64_t r15;
+    uint64_t r14;
+    uint64_t r13;
+    uint64_t r12;
+    uint64_t rbp;
+    uint64_t rbx;
+    /* Caller-saved registers */
+    uint64_t r11;
+    uint64_t r10;
+    uint64_t r9;
+    uint64_t r8;
+    uint64_t rax;                   /* Return value on the way out */
+    uint64_t rcx;
+    uint64_t rdx;
+    uint64_t rsi;
+    uint64_t rdi;
+    uint64_t orig_rax;              /* Syscall number */
+    /* Interrupt frame */
+    uint64_t rip;
+    uint64_t cs;
+    uint64_t rflags;
+    uint64_t rsp;
+    uint64_t ss;
+};
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* _ARCH_X86_64_PTRACE_H */
@@ -2,6 +2,7 @@
 #define SYSCALL_H
 
 #include <stdint.h>
+#include "include/percpu.h"
 
 /* GDT segment selectors (from gdt.h) */
 #define GDT_KERNEL_CS   0x08
@@ -17,10 +18,51 @@
 #define SYS_getpid      4
 #define SYS_fork        5
 #define SYS_wait        6
+#define SYS_sched_setscheduler  7
+#define SYS_sched_setaffinity   8
+#define SYS_sched_getaffinity   9
+#define SYS_nanosleep           10
+#define SYS_vfork               11
+#define SYS_spawn               12
+#define SYS_execve              13
+#define SYS_clock_gettime       14
+#define SYS_getcpu              15
+#define SYS_ioring_setup        16
+#define SYS_ioring_enter        17
+
+/* Size of the syscall table: one more than the highest number */
+#define NR_syscalls             18
+
+/* Time interval for SYS_nanosleep */
+struct timespec {
+    int64_t tv_sec;                 /* Seconds */
+    int64_t tv_nsec;                /* Nanoseconds, 0 to 999999999 */
+};
+
+/* Per-CPU syscall stack, for CPUs running a thread without a kernel stack */
+#define SYSCALL_STACK_SIZE      16384
+
+/* Top of the stack syscall_entry switches to on this CPU */
+DECLARE_PER_CPU(uint64_t, syscall_entry_rsp);
+
+/* Per-syscall counters, kept per CPU with CONFIG_SYSCALL_STATS */
+struct syscall_stat {
+    uint64_t count;                 /* Calls that returned */
+    uint64_t cycles;                /* TSC cycles spent in the handler */
+};
+
+struct pt_regs;
 
 /* Function prototypes */
 void syscall_init(void);
-void syscall_handler(uint64_t nr, uint64_t a1, uint64_t a2, uint64_t a3);
+void syscall_set_entry_stack(void *stack_top);
+void syscall_handler(struct pt_regs *regs);
+struct pt_regs *syscall_current_regs(void);
+void ret_to_user(const struct pt_regs *regs) __attribute__((noreturn));
+int64_t syscall_dispatch(uint64_t nr, uint64_t a1, uint64_t a2, uint64_t a3,
+                         uint64_t a4, uint64_t a5, uint64_t a6);
+void syscall_get_stats(unsigned int nr, struct syscall_stat *stat);
+void syscall_dump_stats(void);
 void enter_user_mode(void);
 void enter_syscall_test_mode(void);
 
@@ -15,11 +15,13 @@
  * Note: GCC's address_space attribute causes warnings, so we use a simple marker */
 #define __user
 
-/* Error codes for user access operations */
+/* Error codes for user access operations, already negative: return EFAULT,
+ * not -EFAULT */
 #define EFAULT  -14      /* Bad address */
 #define ENOMEM  -12      /* Out of memory */
 #define EINVAL  -22      /* Invalid argument */
 #define ENOENT  -2       /* No such file or directory */
+#define ESRCH   -3       /* No such process */
 
 /* User memory region bounds
  * TODO: Make these dynamic per-process when full VM is implemented
@@ -36,7 +38,7 @@
  * Returns: Number of bytes NOT copied (0 = success), or negative error code
  *
  * This function validates that the user pointer is within valid user space
- * range before performing the copy. If validation fails, returns -EFAULT.
+ * range before performing the copy. If validation fails, returns EFAULT.
  *
  * Usage:
  *   long err = copy_from_user(kernel_buf, user_ptr, size);
@@ -74,7 +76,9 @@ long copy_to_user(void __user *dst, const void *src, size_t n);
  * Returns: Length of string (excluding null) on success, or negative error code
  *
  * Safely copies a string from user space, ensuring the destination is
- * always null-terminated. Returns -EFAULT if user pointer is invalid.
+ * always null-terminated. Returns EFAULT if user pointer is invalid.
+ * The range is probed a page at a time as the string is read, so only
+ * the pages the string occupies need to be valid.
  */
 long strncpy_from_user(char *dst, const char __user *src, size_t count);
 
@@ -83,7 +87,7 @@ long strncpy_from_user(char *dst, const char __user *src, size_t count);
  * @addr: Start of user address range
  * @n: Length of range in bytes
  *
- * Returns: 0 if readable, -EFAULT if not readable
+ * Returns: 0 if readable, EFAULT if not readable
  *
  * Validates that the address range falls within user space bounds.
  * Does NOT perform actual memory access - just checks address ranges.
@@ -98,7 +102,7 @@ int probe_user_read(const void __user *addr, size_t n);
  * @addr: Start of user address range
  * @n: Length of range in bytes
  *
- * Returns: 0 if writable, -EFAULT if not writable
+ * Returns: 0 if writable, EFAULT if not writable
  *
  * Similar to probe_user_read but validates write permissions.
  */
@@ -144,7 +148,7 @@ static inline void user_access_end(void)
  * @x: Variable to store result
  * @ptr: User pointer to read from
  *
- * Returns: 0 on success, -EFAULT on fault
+ * Returns: 0 on success, EFAULT on fault
  *
  * MUST be used between user_access_begin() and user_access_end().
  * This is an optimized version that skips validation checks.
@@ -154,7 +158,7 @@ static inline void user_access_end(void)
     typeof(ptr) __ptr = (ptr);                      \
     typeof(x) __val;                                \
     if (probe_user_read(__ptr, sizeof(__val))) {    \
-        __ret = -EFAULT;                            \
+        __ret = EFAULT;                             \
     } else {                                        \
         __val = *(typeof(__val) *)__ptr;            \
         (x) = __val;                                \
@@ -167,7 +171,7 @@ static inline void user_access_end(void)
  * @x: Value to store
  * @ptr: User pointer to write to
  *
- * Returns: 0 on success, -EFAULT on fault
+ * Returns: 0 on success, EFAULT on fault
  *
  * MUST be used between user_access_begin() and user_access_end().
  */
@@ -175,7 +179,7 @@ static inline void user_access_end(void)
     long __ret = 0;                                 \
     typeof(ptr) __ptr = (ptr);                      \
     if (probe_user_write(__ptr, sizeof(x))) {       \
-        __ret = -EFAULT;                            \
+        __ret = EFAULT;                             \
     } else {                                        \
         *(typeof(x) *)__ptr = (x);                  \
     }                                               \
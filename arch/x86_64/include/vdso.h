@@ -0,0 +1,90 @@
+/* Emergence Kernel - x86_64 vDSO
+ *
+ * Three pages at the same address in every user address space answer
+ * getpid, clock_gettime and getcpu without entering the kernel:
+ *
+ *   VDSO_VVAR_BASE  ->  struct vdso_data   shared, read-only: TSC calibration
+ *   VDSO_TEXT_BASE  ->  code               shared, read/execute
+ *   VDSO_PROC_BASE  ->  struct vdso_proc   per address space, read-only: PID
+ *
+ * The code finds its data RIP-relative, so it runs wherever the three
+ * pages sit next to each other. Programs call the entry points below
+ * with the SysV ABI; each falls back to the syscall of the same name
+ * when it cannot answer from the pages.
+ */
+
+#ifndef _ARCH_X86_64_VDSO_H
+#define _ARCH_X86_64_VDSO_H
+
+/* User layout: the top of the mmap-free gap below the stack */
+#define VDSO_VVAR_BASE          0x7fff00000000
+#define VDSO_TEXT_BASE          (VDSO_VVAR_BASE + 0x1000)
+#define VDSO_PROC_BASE          (VDSO_VVAR_BASE + 0x2000)
+
+/* Entry points, at fixed offsets into the text page */
+#define VDSO_OFF_GETPID         0x00    /* long getpid(void) */
+#define VDSO_OFF_CLOCK_GETTIME  0x10    /* int clock_gettime(int clk, struct timespec *ts) */
+#define VDSO_OFF_GETCPU         0x20    /* int getcpu(unsigned *cpu, unsigned *node) */
+
+#define VDSO_GETPID             (VDSO_TEXT_BASE + VDSO_OFF_GETPID)
+#define VDSO_CLOCK_GETTIME      (VDSO_TEXT_BASE + VDSO_OFF_CLOCK_GETTIME)
+#define VDSO_GETCPU             (VDSO_TEXT_BASE + VDSO_OFF_GETCPU)
+
+/* Clocks: only the TSC-based monotonic clock exists (no wall clock) */
+#define CLOCK_MONOTONIC         1
+
+/* Byte offsets of the fields of struct vdso_data and struct vdso_proc */
+#define VDSO_DATA_SEQ           0
+#define VDSO_DATA_FLAGS         4
+#define VDSO_DATA_TSC_EPOCH     8
+#define VDSO_DATA_NS_MULT       16
+#define VDSO_PROC_PID           0
+
+/* vdso_data.flags */
+#define VDSO_F_RDTSCP           (1 << 0)    /* TSC_AUX holds the CPU index */
+
+/* IA32_TSC_AUX, read by RDTSCP */
+#define MSR_IA32_TSC_AUX        0xC0000103
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+struct address_space;
+
+/*
+ * Readers retry while @seq is odd or changes under them, so the clock
+ * fields are always seen as a consistent set.
+ */
+struct vdso_data {
+    uint32_t seq;                   /* Odd while the fields below change */
+    uint32_t flags;                 /* VDSO_F_* */
+    uint64_t tsc_epoch;             /* TSC at CLOCK_MONOTONIC zero */
+    uint64_t ns_mult;               /* ns = cycles * ns_mult >> 32 */
+};
+
+struct vdso_proc {
+    int64_t pid;                    /* Process the address space belongs to */
+};
+
+/* Allocate the shared pages (BSP, after the PMM) */
+void vdso_init(void);
+
+/* Point this CPU's TSC_AUX at its index for getcpu */
+void vdso_init_cpu(int cpu);
+
+/* Publish a TSC calibration (tsc_init()) */
+void vdso_update_clock(uint64_t tsc_epoch, uint64_t ns_mult);
+
+/* Map the vDSO into an address space owned by @pid */
+int vdso_map(struct address_space *as, int pid);
+
+/* Change the PID an address space reports (vfork borrowing it) */
+void vdso_set_pid(struct address_space *as, int pid);
+
+/* Kernel address of the text page, for calling it from ring 0 */
+void *vdso_text(void);
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* _ARCH_X86_64_VDSO_H */
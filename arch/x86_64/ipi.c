@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include "arch/x86_64/ipi.h"
 #include "arch/x86_64/apic.h"
+#include "arch/x86_64/idt.h"
 #include "kernel/device.h"
 #include "arch/x86_64/smp.h"
 #include "kernel/klog.h"
@@ -12,6 +13,9 @@
 static volatile int ipi_count = 0;
 static volatile int ipi_active = 0;
 
+/* Reschedule IPIs received, per CPU */
+static DEFINE_PER_CPU(uint64_t, resched_ipi_count);
+
 /**
  * ipi_isr_handler - IPI interrupt handler
  *
@@ -32,6 +36,41 @@ void ipi_isr_handler(void) {
      * for consistency with timer_isr and robustness */
 }
 
+/**
+ * resched_isr_handler - Reschedule IPI handler
+ *
+ * Called from resched_isr. There is nothing to do here: the sender has
+ * already set this CPU's need_resched, and the ISR switches threads in
+ * scheduler_irq_exit() after the EOI.
+ */
+void resched_isr_handler(void) {
+    this_cpu_inc(resched_ipi_count);
+}
+
+/**
+ * smp_send_reschedule - Kick another CPU into its scheduler
+ * @cpu: Target CPU index
+ *
+ * Must be called with interrupts disabled, since the ICR is written in
+ * two steps.
+ */
+void smp_send_reschedule(int cpu) {
+    lapic_send_ipi(smp_get_apic_id_by_index(cpu), LAPIC_ICR_DM_FIXED, RESCHED_VECTOR);
+}
+
+/**
+ * ipi_get_resched_count - Get the number of reschedule IPIs a CPU took
+ * @cpu: CPU index
+ *
+ * Returns: Reschedule IPIs received, or 0 if @cpu is invalid
+ */
+uint64_t ipi_get_resched_count(int cpu) {
+    if (cpu < 0 || cpu >= SMP_MAX_CPUS) {
+        return 0;
+    }
+    return per_cpu(resched_ipi_count, cpu);
+}
+
 /**
  * ipi_device_probe - Probe function for IPI device
  * @dev: Device to probe
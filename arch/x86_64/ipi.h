@@ -15,4 +15,13 @@ int ipi_driver_init(void);
 /* IPI interrupt handler (called from ISR) */
 void ipi_isr_handler(void);
 
+/* Reschedule IPI handler (called from ISR) */
+void resched_isr_handler(void);
+
+/* Send a reschedule IPI to the CPU with index @cpu */
+void smp_send_reschedule(int cpu);
+
+/* Number of reschedule IPIs received by the CPU with index @cpu */
+uint64_t ipi_get_resched_count(int cpu);
+
 #endif /* EMERGENCE_ARCH_X86_64_IPI_H */
@@ -11,6 +11,9 @@
 #include "arch/x86_64/cpu.h"
 #include "arch/x86_64/cr.h"
 #include "arch/x86_64/timer.h"
+#include "arch/x86_64/tsc.h"
+#include "arch/x86_64/idle.h"
+#include "arch/x86_64/fpu.h"
 #include "arch/x86_64/ipi.h"
 #include "arch/x86_64/serial.h"
 #include "arch/x86_64/io.h"
@@ -18,7 +21,11 @@
 #include "arch/x86_64/multiboot2.h"
 #include "kernel/test.h"
 #include "kernel/klog.h"
+#include "kernel/timer.h"
+#include "kernel/workqueue.h"
+#include "arch/x86_64/include/gdt.h"
 #include "arch/x86_64/include/syscall.h"
+#include "arch/x86_64/include/vdso.h"
 
 /* Test wrapper headers */
 #include "tests/testcases.h"
@@ -28,14 +35,16 @@ extern void thread_init(void);
 extern void scheduler_init(void);
 extern void process_init(void);
 extern void kmap_init(void);
+extern void vm_init(void);
+extern int initramfs_init(void);
 
 /* External monitor functions */
 extern void monitor_init(void);
 extern uint64_t monitor_get_unpriv_cr3(void);
 extern uint64_t monitor_pml4_phys;
 
-/* External per-CPU data for GS-base setup */
-extern per_cpu_data_t per_cpu_data[];
+/* Top of the BSP boot stack (boot.S) */
+extern uint8_t nk_boot_stack_top[];
 
 /* Architecture-independent halt function */
 void kernel_halt(void) {
@@ -51,6 +60,9 @@ void kernel_halt(void) {
  * interrupts, and monitor context. Called only on BSP after APs are ready.
  */
 static void run_tests(void) {
+    /* Idle wakeup benchmark (BSP side - releases the APs waiting for it) */
+    test_idle_bsp_setup();
+
     /* Spinlock tests (BSP setup - handles spinlock_test_start flag) */
     test_spinlock_bsp_setup();
 
@@ -95,6 +107,14 @@ void kernel_main(uint32_t multiboot_info_addr) {
     int cpu_id;
     int skip_cr3_switch = 0;
 
+    /* Set up per-CPU areas and point GS at the BSP's before anything
+     * takes a lock: spin locks keep the preemption count there */
+    setup_per_cpu_areas();
+    smp_set_gs_base(0);
+
+    /* Own GDT and TSS; ring 3 enters on the boot stack until the first switch */
+    gdt_init_cpu(0, nk_boot_stack_top);
+
     /* Initialize serial driver early for debug output */
     serial_driver_init();
 
@@ -148,10 +168,19 @@ void kernel_main(uint32_t multiboot_info_addr) {
     /* Initialize KMAP subsystem (kernel virtual memory mapping management) */
     kmap_init();
 
+    /* Initialize VM subsystem (address space caches, requires slab allocator) */
+    vm_init();
+
+    /* Shared vDSO pages, mapped into every user address space */
+    vdso_init();
+
     /* Initialize Process subsystem (requires slab allocator) */
     process_init();
     klog_info("KERN", "Process subsystem initialized");
 
+    /* Locate the initramfs module that process_execve() loads programs from */
+    initramfs_init();
+
     /* Initialize Thread subsystem (requires slab allocator) */
     thread_init();
     klog_info("KERN", "Thread subsystem initialized");
@@ -169,21 +198,43 @@ void kernel_main(uint32_t multiboot_info_addr) {
     /* Initialize SMP subsystem (detects CPU count from ACPI/CPUID) */
     smp_init();
 
+    /* Calibrate the TSC (sched_clock() source for scheduler accounting) */
+    tsc_init();
+
+    /* Pick MWAIT or HLT for idle CPUs */
+    idle_init();
+
+    /* Enable SSE/AVX and size the per-thread XSAVE area */
+    fpu_init();
+
     /* Initialize Scheduler (requires smp_init for CPU count) */
     scheduler_init();
     klog_info("KERN", "Scheduler initialized");
 
+    /* Per-CPU timer wheels and hrtimer queues (requires tsc_init) */
+    timers_init();
+
     /* Scheduler Tests */
     extern void test_sched(void);
     test_sched();
 
+    /* Process Tests (before the APs and the monitor, like the scheduler's) */
+    test_process();
+
+    /* vDSO Tests */
+    test_vdso();
+
+    /* Submission/Completion Ring Tests (the SQ poller must not run yet) */
+    test_ioring();
+
+    /* Per-CPU and unbound worker threads. After the scheduler tests,
+     * which count on runqueues holding only their own threads. */
+    workqueue_init();
+
     /* BSP specific initialization - must complete BEFORE starting APs */
     /* Get CPU ID first to determine if we're BSP or AP */
     cpu_id = smp_get_cpu_index();
 
-    /* Set GS base for this CPU to point to per_cpu_data */
-    smp_set_gs_base(&per_cpu_data[cpu_id]);
-
     if (cpu_id == 0) {
         klog_info("SMP", "BSP initializing");
         idt_init();
@@ -20,6 +20,38 @@ static char kernel_cmdline[1024];
 static uint32_t stored_mbi_addr = 0;
 static uint32_t stored_mbi_size = 0;
 
+/* Boot modules (initramfs, ...), reserved by pmm_init() */
+static struct {
+    uint64_t start;
+    uint64_t end;
+    char cmdline[64];
+} modules[MULTIBOOT_MAX_MODULES];
+static int nr_modules = 0;
+
+/* Parse multiboot2 module tag */
+static void parse_module(multiboot_tag_module_t *tag) {
+    size_t i = 0;
+
+    if (nr_modules == MULTIBOOT_MAX_MODULES) {
+        klog_warn("KERN", "Ignoring boot module at %p: too many modules",
+                  (void *)(uint64_t)tag->mod_start);
+        return;
+    }
+
+    modules[nr_modules].start = tag->mod_start;
+    modules[nr_modules].end = tag->mod_end;
+    while (i < sizeof(modules[0].cmdline) - 1 && tag->cmdline[i] != '\0') {
+        modules[nr_modules].cmdline[i] = tag->cmdline[i];
+        i++;
+    }
+    modules[nr_modules].cmdline[i] = '\0';
+
+    klog_debug("KERN", "Found module '%s' at %p, size %lX bytes",
+               modules[nr_modules].cmdline, (void *)modules[nr_modules].start,
+               modules[nr_modules].end - modules[nr_modules].start);
+    nr_modules++;
+}
+
 /* Parse multiboot2 command line tag */
 static void parse_cmdline(multiboot_tag_cmdline_t *tag) {
     const char *src = tag->cmdline;
@@ -219,6 +251,10 @@ void multiboot2_parse(uint32_t mbi_addr) {
                 parse_cmdline((multiboot_tag_cmdline_t *)tag);
                 break;
 
+            case MULTIBOOT_TAG_MODULE:
+                parse_module((multiboot_tag_module_t *)tag);
+                break;
+
             case MULTIBOOT_TAG_MMAP:
                 klog_debug("PMM", "Found memory map tag");
                 parse_memory_map((multiboot_tag_mmap_t *)tag);
@@ -294,6 +330,31 @@ void multiboot_get_info(uint32_t *addr, uint32_t *size) {
     }
 }
 
+/**
+ * multiboot_get_module - Get a boot module loaded by the boot loader
+ * @index: Module number, in the order the boot loader listed them
+ * @start: Returns the physical start address (may be NULL)
+ * @end: Returns the physical end address, exclusive (may be NULL)
+ * @cmdline: Returns the module's command line (may be NULL)
+ *
+ * Returns: 0 on success, -1 if there is no such module
+ */
+int multiboot_get_module(int index, uint64_t *start, uint64_t *end, const char **cmdline) {
+    if (index < 0 || index >= nr_modules) {
+        return -1;
+    }
+    if (start != NULL) {
+        *start = modules[index].start;
+    }
+    if (end != NULL) {
+        *end = modules[index].end;
+    }
+    if (cmdline != NULL) {
+        *cmdline = modules[index].cmdline;
+    }
+    return 0;
+}
+
 /* Accessor function to get kernel command line */
 const char *multiboot_get_cmdline(void) {
     klog_debug("KERN", "Parsing kernel command line...");
@@ -74,6 +74,18 @@ typedef struct multiboot_tag_cmdline {
     char cmdline[];
 } multiboot_tag_cmdline_t;
 
+/* Boot module tag structure */
+typedef struct multiboot_tag_module {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start;             /* Physical start address */
+    uint32_t mod_end;               /* Physical end address (exclusive) */
+    char cmdline[];
+} multiboot_tag_module_t;
+
+/* Boot modules remembered by multiboot2_parse() */
+#define MULTIBOOT_MAX_MODULES   8
+
 /* Multiboot2 header structure (for parsing the info structure) */
 typedef struct multiboot_info {
     uint32_t total_size;
@@ -85,5 +97,6 @@ void multiboot2_parse(uint32_t mbi_addr);
 void multiboot_get_info(uint32_t *addr, uint32_t *size);
 const char *multiboot_get_cmdline(void);
 const char *cmdline_get_value(const char *key);
+int multiboot_get_module(int index, uint64_t *start, uint64_t *end, const char **cmdline);
 
 #endif /* _KERNEL_MULTIBOOT2_H */
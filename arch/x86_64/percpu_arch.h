@@ -0,0 +1,50 @@
+/* Emergence Kernel - x86_64 per-CPU variable access
+ *
+ * Each CPU's GS base holds its __per_cpu_offset[] entry, so %gs:var
+ * addresses that CPU's copy of var: the variable's link address is the
+ * displacement and the access is one instruction. The kernel is linked
+ * below 2 GB, so every link address fits the sign-extended 32-bit
+ * displacement.
+ *
+ * The name is pasted into the instruction rather than passed as an
+ * operand because -mcmodel=large does not allow symbol addresses as
+ * immediates.
+ */
+
+#ifndef _ARCH_X86_64_PERCPU_H
+#define _ARCH_X86_64_PERCPU_H
+
+/**
+ * this_cpu_read - Read this CPU's copy of a scalar per-CPU variable
+ * @var: Name of the variable
+ */
+#define this_cpu_read(var) ({                                          \
+    __typeof__(var) __ret;                                              \
+    asm volatile ("mov %%gs:" #var ", %0" : "=r"(__ret) : : "memory");  \
+    __ret;                                                              \
+})
+
+/**
+ * this_cpu_write - Write this CPU's copy of a scalar per-CPU variable
+ * @var: Name of the variable
+ * @val: Value to store
+ */
+#define this_cpu_write(var, val) do {                                   \
+    __typeof__(var) __val = (val);                                      \
+    asm volatile ("mov %0, %%gs:" #var : : "r"(__val) : "memory");      \
+} while (0)
+
+/**
+ * this_cpu_add - Add to this CPU's copy of a scalar per-CPU variable
+ * @var: Name of the variable
+ * @val: Amount to add (may be negative)
+ *
+ * A single read-modify-write: safe against interrupts on this CPU, but
+ * not atomic with respect to other CPUs.
+ */
+#define this_cpu_add(var, val) do {                                     \
+    __typeof__(var) __val = (__typeof__(var))(val);                     \
+    asm volatile ("add %0, %%gs:" #var : : "r"(__val) : "memory", "cc"); \
+} while (0)
+
+#endif /* _ARCH_X86_64_PERCPU_H */
@@ -7,15 +7,24 @@
 
 /* PIT I/O Ports */
 #define PIT_CH0_DATA      0x40   /* Channel 0 data port */
+#define PIT_CH2_DATA      0x42   /* Channel 2 data port */
 #define PIT_COMMAND      0x43   /* Command register */
+#define PIT_PORT_B        0x61   /* System control port B (channel 2 gate) */
 
 /* PIT Command Bits */
 #define PIT_CHANNEL_0     0x00   /* Select channel 0 */
+#define PIT_CHANNEL_2     0x80   /* Select channel 2 */
 #define PIT_ACCESS_LATCH  0x00   /* Latch count value */
 #define PIT_ACCESS_LOHI  0x30   /* Access mode: low then high byte */
 #define PIT_MODE_SQUARE  0x06   /* Square wave mode */
+#define PIT_MODE_ONESHOT  0x00   /* Interrupt on terminal count */
 #define PIT_FREQ_DIVISOR  0x00   /* Use 16-bit binary count */
 
+/* Port B bits */
+#define PIT_PORT_B_GATE2  0x01   /* Channel 2 gate */
+#define PIT_PORT_B_SPKR   0x02   /* Speaker data enable */
+#define PIT_PORT_B_OUT2   0x20   /* Channel 2 output (read-only) */
+
 /* PIT Frequency */
 #define PIT_FREQUENCY    1193182 /* Base frequency (1.193182 MHz) */
 
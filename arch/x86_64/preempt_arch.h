@@ -0,0 +1,52 @@
+/* Emergence Kernel - x86_64 preempt_count access
+ *
+ * The count is the per-CPU variable __preempt_count (smp.c), reached
+ * through the GS base, so each operation is a single instruction on this
+ * CPU's copy. The GS base is set before any lock is taken (kernel_main()
+ * and ap_start()).
+ */
+
+#ifndef _ARCH_X86_64_PREEMPT_H
+#define _ARCH_X86_64_PREEMPT_H
+
+/**
+ * arch_preempt_count - Read this CPU's preemption count
+ */
+static inline int arch_preempt_count(void) {
+    int count;
+
+    asm volatile ("movl %%gs:__preempt_count, %0" : "=r"(count));
+    return count;
+}
+
+/**
+ * arch_preempt_count_add - Add to this CPU's preemption count
+ * @val: Amount to add (may be negative)
+ */
+static inline void arch_preempt_count_add(int val) {
+    asm volatile ("addl %0, %%gs:__preempt_count" : : "ir"(val) : "memory", "cc");
+}
+
+/**
+ * arch_preempt_count_dec_and_test - Decrement the count
+ *
+ * Returns: Non-zero if the count dropped to zero
+ */
+static inline int arch_preempt_count_dec_and_test(void) {
+    unsigned char zero;
+
+    asm volatile ("decl %%gs:__preempt_count; sete %0" : "=qm"(zero) : : "memory", "cc");
+    return zero;
+}
+
+/**
+ * arch_irqs_enabled - Check whether interrupts are enabled on this CPU
+ */
+static inline int arch_irqs_enabled(void) {
+    unsigned long flags;
+
+    asm volatile ("pushf; pop %0" : "=rm"(flags) : : "memory");
+    return (flags & (1UL << 9)) != 0;
+}
+
+#endif /* _ARCH_X86_64_PREEMPT_H */
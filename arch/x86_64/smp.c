@@ -6,10 +6,14 @@
 #include "include/spinlock.h"
 #include "include/atomic.h"
 #include "include/barrier.h"
+#include "include/string.h"
 #include "arch/x86_64/apic.h"
 #include "arch/x86_64/cpu.h"
 #include "arch/x86_64/cr.h"
 #include "arch/x86_64/idt.h"
+#include "arch/x86_64/fpu.h"
+#include "arch/x86_64/include/gdt.h"
+#include "arch/x86_64/include/vdso.h"
 #include "kernel/klog.h"
 
 /* Test wrapper headers */
@@ -29,8 +33,24 @@ uint8_t ok_cpu_stacks[SMP_MAX_CPUS][CPU_STACK_SIZE] __attribute__((aligned(16)))
 /* Per-CPU information */
 static smp_cpu_info_t cpu_info[SMP_MAX_CPUS];
 
-/* Per-CPU data for monitor trampoline (GS-base indexed) */
-per_cpu_data_t per_cpu_data[SMP_MAX_CPUS];
+/* Per-CPU data for monitor trampoline (GS-relative) */
+DEFINE_PER_CPU(per_cpu_data_t, per_cpu_data);
+_Static_assert(offsetof(per_cpu_data_t, saved_rsp) == 0 &&
+               offsetof(per_cpu_data_t, saved_cr0) == 32,
+               "per_cpu_data_t offsets must match monitor_call.S");
+
+DEFINE_PER_CPU(int, cpu_number);
+DEFINE_PER_CPU(int, irq_nest_depth);
+DEFINE_PER_CPU(uint64_t, this_cpu_off);
+
+/* Running thread (cpu_context.h, context.S) and preemption count
+ * (preempt_arch.h); only reached through %gs */
+DEFINE_PER_CPU(struct thread *, current_thread);
+DEFINE_PER_CPU(int, __preempt_count);
+
+/* Every CPU's copy of the .data..percpu template */
+static uint8_t per_cpu_areas[SMP_MAX_CPUS][PER_CPU_AREA_SIZE] __attribute__((aligned(4096)));
+uint64_t __per_cpu_offset[SMP_MAX_CPUS];
 
 /* Lock for ready_cpus counter - prevents race conditions during AP startup */
 static spinlock_t ready_cpus_lock = SPIN_LOCK_UNLOCKED;
@@ -48,9 +68,6 @@ static volatile atomic_int next_cpu_id = 0;
 extern volatile int bsp_init_done;
 #define bsp_init_complete bsp_init_done  /* Alias for compatibility */
 
-/* Current CPU index (for each CPU) */
-static volatile int current_cpu_index = 0;
-
 /* External symbols */
 extern void ap_start(void);
 
@@ -67,19 +84,6 @@ uint8_t smp_get_apic_id(void) {
     return 0;
 }
 
-/**
- * smp_get_cpu_index - Get current CPU's index
- *
- * Returns: CPU index (0-3)
- *
- * NOTE: Returns the global current_cpu_index variable.
- * This works correctly because the BSP always returns 0, and APs
- * call this before setting current_cpu_index to their own value.
- */
-int smp_get_cpu_index(void) {
-    return current_cpu_index;
-}
-
 /**
  * smp_get_apic_id_by_index - Get APIC ID by CPU index
  * @cpu_index: CPU index
@@ -108,11 +112,7 @@ int smp_get_cpu_count(void) {
  * Returns: Pointer to irq_nest_depth for current CPU
  */
 int* smp_get_irq_nest_depth_ptr(void) {
-    int idx = smp_get_cpu_index();
-    if (idx >= 0 && idx < SMP_MAX_CPUS) {
-        return &cpu_info[idx].irq_nest_depth;
-    }
-    return NULL;
+    return this_cpu_ptr(&irq_nest_depth);
 }
 
 /**
@@ -135,7 +135,6 @@ void smp_mark_cpu_ready(int cpu_index) {
  */
 void smp_init(void) {
     /* BSP is CPU 0 */
-    current_cpu_index = 0;
     next_cpu_id = 1;
 
     ready_cpus = 0;
@@ -152,37 +151,43 @@ void smp_init(void) {
         cpu_info[i].apic_id = acpi_get_apic_id_by_index(i);
         cpu_info[i].state = (i == 0) ? CPU_ONLINE : CPU_OFFLINE;
         cpu_info[i].stack_top = NULL;
-        cpu_info[i].irq_nest_depth = 0;
     }
 
     /* Fallback: if ACPI didn't provide APIC IDs, use CPU indices */
     if (cpu_info[0].apic_id == 0 && acpi_get_apic_count() == 0) {
         for (int i = 0; i < SMP_MAX_CPUS; i++) {
             cpu_info[i].apic_id = i;
-            cpu_info[i].irq_nest_depth = 0;
         }
     }
+}
 
-    /* Initialize per-CPU data for monitor trampoline */
-    for (int i = 0; i < SMP_MAX_CPUS; i++) {
-        per_cpu_data[i].saved_rsp = 0;
-        per_cpu_data[i].saved_cr3 = 0;
-        per_cpu_data[i].cpu_index = i;
-        per_cpu_data[i].saved_rax = 0;
-        per_cpu_data[i].saved_rdx = 0;
-        per_cpu_data[i].saved_cr0 = 0;
+/**
+ * setup_per_cpu_areas - Give every CPU its copy of the per-CPU template
+ *
+ * Called by the BSP first thing in kernel_main(), before any per-CPU
+ * variable is used, so each copy starts from the template's initial
+ * values. Also fills in each copy's cpu_number and this_cpu_off.
+ */
+void setup_per_cpu_areas(void) {
+    size_t size = (size_t)(__per_cpu_end - __per_cpu_start);
+
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        memcpy(per_cpu_areas[cpu], __per_cpu_start, size);
+        __per_cpu_offset[cpu] = (uint64_t)per_cpu_areas[cpu] - (uint64_t)__per_cpu_start;
+        per_cpu(cpu_number, cpu) = cpu;
+        per_cpu(this_cpu_off, cpu) = __per_cpu_offset[cpu];
     }
 }
 
 /**
- * smp_set_gs_base - Set GS segment base to per-CPU data
- * @cpu_data: Pointer to this CPU's per_cpu_data
+ * smp_set_gs_base - Point GS at this CPU's per-CPU area
+ * @cpu_index: This CPU's index
  *
- * Uses WRMSR to set IA32_GS_BASE MSR (0xC0000101).
- * This allows assembly code to access per_cpu_data via %gs:offset.
+ * Uses WRMSR to set IA32_GS_BASE MSR (0xC0000101) to the CPU's
+ * __per_cpu_offset[] entry, so %gs:var reaches its copy of var.
  */
-void smp_set_gs_base(per_cpu_data_t *cpu_data) {
-    uint64_t addr = (uint64_t)cpu_data;
+void smp_set_gs_base(int cpu_index) {
+    uint64_t addr = __per_cpu_offset[cpu_index];
     uint32_t low = (uint32_t)(addr & 0xFFFFFFFF);
     uint32_t high = (uint32_t)(addr >> 32);
 
@@ -192,19 +197,6 @@ void smp_set_gs_base(per_cpu_data_t *cpu_data) {
           "d"(high));
 }
 
-/**
- * smp_get_per_cpu_data - Get current CPU's per_cpu_data
- *
- * Returns: Pointer to current CPU's per_cpu_data structure
- */
-per_cpu_data_t *smp_get_per_cpu_data(void) {
-    int idx = smp_get_cpu_index();
-    if (idx >= 0 && idx < SMP_MAX_CPUS) {
-        return &per_cpu_data[idx];
-    }
-    return &per_cpu_data[0];  /* Fallback to BSP */
-}
-
 /**
  * smp_start_all_aps - Start all Application Processors
  *
@@ -308,20 +300,23 @@ void ap_start(void) {
         while (1) { arch_halt(); }
     }
 
-    /* Set current CPU index with memory barrier to ensure visibility */
-    current_cpu_index = my_index;
-    smp_mb();  /* Ensure write is visible before continuing */
+    /* Set GS base to this CPU's per-CPU area
+     * This enables the monitor trampoline to use GS-relative addressing,
+     * and must precede the first lock: spin locks update preempt_count */
+    smp_set_gs_base(my_index);
 
     /* Set up stack */
     cpu_info[my_index].stack_top = &ok_cpu_stacks[my_index][CPU_STACK_SIZE];
     asm volatile ("mov %0, %%rsp" : : "r"(cpu_info[my_index].stack_top));
 
-    /* Initialize interrupt nesting depth */
-    cpu_info[my_index].irq_nest_depth = 0;
+    /* Own GDT and TSS, so ring 3 entries never share the BSP's stacks */
+    gdt_init_cpu(my_index, cpu_info[my_index].stack_top);
+
+    /* Enable the FPU features the BSP selected */
+    fpu_init_cpu();
 
-    /* Set GS base to point to this CPU's per_cpu_data
-     * This enables the monitor trampoline to use GS-relative addressing */
-    smp_set_gs_base(&per_cpu_data[my_index]);
+    /* CPU index for the vDSO's getcpu */
+    vdso_init_cpu(my_index);
 
     /* Load shared page table with CR0.WP protection */
     uint64_t unpriv_cr3 = monitor_get_unpriv_cr3();
@@ -353,6 +348,10 @@ void ap_start(void) {
         cpu_relax();
     }
 
+    /* Idle wakeup benchmark - CPU 1 wakes the BSP until it is done
+     * The wrapper is an empty stub when CONFIG_TESTS_IDLE=0 */
+    idle_test_ap_entry();
+
     /* Poll for spin lock test mode - BSP will set this flag
      * The wrapper handles the CONFIG guard internally */
     extern volatile int spinlock_test_start;
@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include "arch/x86_64/apic.h"
+#include "include/percpu.h"
 
 /* Maximum number of CPUs supported by the kernel */
 #define SMP_MAX_CPUS    4
@@ -24,27 +25,29 @@ typedef enum {
     CPU_READY         /* CPU completed initialization */
 } smp_cpu_state_t;
 
-/* Per-CPU data for monitor trampoline and scheduler
- * Must be at fixed offsets for assembly access via GS segment */
+/* Per-CPU save area of the monitor trampoline
+ * Reached from assembly as %gs:per_cpu_data+offset */
 typedef struct {
     uint64_t saved_rsp;     /* Offset 0: Saved RSP during monitor call */
     uint64_t saved_cr3;     /* Offset 8: Saved CR3 (kept for future use) */
-    int cpu_index;          /* Offset 16: CPU index for debugging */
-    uint64_t saved_rax;     /* Offset 24: Saved return value (result) from monitor call */
-    uint64_t saved_rdx;     /* Offset 32: Saved return value (error) from monitor call */
-    uint64_t saved_cr0;     /* Offset 40: Saved CR0.WP state for NK entry/exit */
-    struct thread *current_thread;  /* Offset 48: Currently running thread */
-    struct thread *idle_thread;     /* Offset 56: Per-CPU idle thread */
+    uint64_t saved_rax;     /* Offset 16: Saved return value (result) from monitor call */
+    uint64_t saved_rdx;     /* Offset 24: Saved return value (error) from monitor call */
+    uint64_t saved_cr0;     /* Offset 32: Saved CR0.WP state for NK entry/exit */
 } per_cpu_data_t;
 
-/* Per-CPU data array - indexed by CPU index */
-extern per_cpu_data_t per_cpu_data[SMP_MAX_CPUS];
+DECLARE_PER_CPU(per_cpu_data_t, per_cpu_data);
 
-/* Set GS base to point to current CPU's per_cpu_data */
-void smp_set_gs_base(per_cpu_data_t *cpu_data);
+/* Index of the CPU this copy belongs to */
+DECLARE_PER_CPU(int, cpu_number);
 
-/* Get current CPU's per_cpu_data via GS base */
-per_cpu_data_t *smp_get_per_cpu_data(void);
+/* Interrupt disable nesting depth (irq_disable()/irq_save()) */
+DECLARE_PER_CPU(int, irq_nest_depth);
+
+/* Per-CPU area size: the .data..percpu template must fit (linker.ld) */
+#define PER_CPU_AREA_SIZE   0x8000
+
+/* Set GS base to this CPU's __per_cpu_offset[] entry */
+void smp_set_gs_base(int cpu_index);
 
 /* Per-CPU information */
 typedef struct {
@@ -52,7 +55,6 @@ typedef struct {
     uint8_t cpu_index;         /* CPU index (0, 1, 2, 3) */
     smp_cpu_state_t state;     /* Current state */
     void *stack_top;           /* Top of this CPU's stack */
-    int irq_nest_depth;        /* Interrupt disable nesting depth */
 } smp_cpu_info_t;
 
 /* SMP function prototypes */
@@ -63,8 +65,14 @@ void smp_init(void);
 /* Get current CPU's APIC ID */
 uint8_t smp_get_apic_id(void);
 
-/* Get current CPU's index */
-int smp_get_cpu_index(void);
+/**
+ * smp_get_cpu_index - Get current CPU's index
+ *
+ * Returns: CPU index (0 to SMP_MAX_CPUS - 1)
+ */
+static inline int smp_get_cpu_index(void) {
+    return this_cpu_read(cpu_number);
+}
 
 /* Get APIC ID by CPU index */
 uint8_t smp_get_apic_id_by_index(int cpu_index);
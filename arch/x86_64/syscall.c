@@ -1,8 +1,10 @@
 #include <stdint.h>
 #include <stddef.h>
-#include "syscall.h"
+#include "arch/x86_64/include/syscall.h"
 #include "arch/x86_64/include/gdt.h"
 #include "arch/x86_64/include/uaccess.h"
+#include "arch/x86_64/include/ptrace.h"
+#include "arch/x86_64/include/vdso.h"
 #include "arch/x86_64/serial.h"
 #include "arch/x86_64/power.h"
 #include "kernel/monitor/monitor.h"  /* For g_unpriv_pd_ptr */
@@ -13,14 +15,23 @@
 #include "kernel/scheduler.h"
 #include "kernel/vm.h"
 #include "kernel/pmm.h"
+#include "kernel/ioring.h"
 #include "arch/x86_64/smp.h"
-
-/* External: kernel stack top from boot.S */
-extern uint64_t nk_boot_stack_top;
+#include "arch/x86_64/tsc.h"
+#include "arch/x86_64/cpu.h"
 
 /* External: halt CPU from main.c */
 extern void kernel_halt(void);
 
+/* Per-call logging, compiled in only with CONFIG_DEBUG_SYSCALL: even a
+ * filtered klog_debug() costs a call and its argument setup. if (0)
+ * still type-checks the arguments. */
+#if CONFIG_DEBUG_SYSCALL
+#define syscall_dbg(...)    klog_debug("SYSCALL", __VA_ARGS__)
+#else
+#define syscall_dbg(...)    do { if (0) klog_debug("SYSCALL", __VA_ARGS__); } while (0)
+#endif
+
 /* MSR addresses */
 #define MSR_IA32_STAR        0xC0000081
 #define MSR_IA32_LSTAR       0xC0000082
@@ -31,6 +42,48 @@ extern void kernel_halt(void);
 /* External syscall entry assembly function */
 extern void syscall_entry(void);
 
+_Static_assert(offsetof(struct pt_regs, rax) == PT_REGS_RAX &&
+               offsetof(struct pt_regs, orig_rax) == PT_REGS_ORIG_RAX &&
+               offsetof(struct pt_regs, rip) == PT_REGS_RIP &&
+               offsetof(struct pt_regs, rflags) == PT_REGS_RFLAGS &&
+               offsetof(struct pt_regs, rsp) == PT_REGS_RSP &&
+               sizeof(struct pt_regs) == PT_REGS_SIZE,
+               "struct pt_regs must match the PT_REGS_* offsets syscall_entry uses");
+
+/* Stack syscall_entry switches to (see syscall_set_entry_stack()), and
+ * where it parks the user RSP while switching */
+DEFINE_PER_CPU(uint64_t, syscall_entry_rsp);
+DEFINE_PER_CPU(uint64_t, syscall_user_rsp);
+
+/* Entry stacks for CPUs whose running thread has no kernel stack of its own */
+static uint8_t syscall_stacks[SMP_MAX_CPUS][SYSCALL_STACK_SIZE] __attribute__((aligned(16)));
+
+/**
+ * syscall_set_entry_stack - Choose the stack syscalls on this CPU enter on
+ * @stack_top: Top of the running thread's kernel stack, or NULL for this
+ *             CPU's own syscall stack
+ *
+ * Called by the scheduler on every switch, with interrupts disabled.
+ */
+void syscall_set_entry_stack(void *stack_top) {
+    if (stack_top == NULL) {
+        stack_top = syscall_stacks[smp_get_cpu_index()] + SYSCALL_STACK_SIZE;
+    }
+    this_cpu_write(syscall_entry_rsp, (uint64_t)stack_top & ~0xFULL);
+}
+
+/**
+ * syscall_current_regs - Get the registers the current syscall saved
+ *
+ * Only valid inside a syscall made from ring 3: syscall_entry builds
+ * the frame at the top of this CPU's entry stack.
+ *
+ * Returns: The caller's struct pt_regs
+ */
+struct pt_regs *syscall_current_regs(void) {
+    return (struct pt_regs *)this_cpu_read(syscall_entry_rsp) - 1;
+}
+
 /* External jump_to_user_mode assembly function */
 extern void jump_to_user_mode(uint64_t user_rip, uint64_t user_rsp, uint64_t user_rflags);
 
@@ -76,7 +129,7 @@ static uint64_t user_stack_size = 16384;
 
 /* Per-CPU buffer for sys_write - eliminates SMP race condition */
 #define SYS_WRITE_BUF_SIZE 4096
-static char sys_write_buf[SMP_MAX_CPUS][SYS_WRITE_BUF_SIZE];
+static DEFINE_PER_CPU(char[SYS_WRITE_BUF_SIZE], sys_write_buf);
 
 /* Pre-allocate user stack before switching to unprivileged page tables
  * This is called from main.c before CR3 switch */
@@ -111,12 +164,12 @@ static int64_t sys_write(uint64_t fd, const char *buf, uint64_t count) {
 
     /* Get per-CPU buffer */
     cpu = smp_get_cpu_index();
-    kernel_buf = sys_write_buf[cpu];
+    kernel_buf = *this_cpu_ptr(&sys_write_buf);
 
     (void)fd;  /* Only stdout for now */
 
-    klog_debug("SYSCALL", "sys_write: fd=%d, buf=%p, count=%d (CPU=%d)",
-               (int)fd, buf, (int)count, cpu);
+    syscall_dbg("sys_write: fd=%d, buf=%p, count=%d (CPU=%d)",
+                (int)fd, buf, (int)count, cpu);
 
     /* Validate arguments */
     if (buf == 0) {
@@ -165,6 +218,8 @@ static void sys_exit(int64_t exit_code) {
         if (p->parent == NULL || p->parent->pid == 1) {
             klog_info("USER", "Test process exited with code: %d", (int)exit_code);
 
+            syscall_dump_stats();
+
             /* Print success message for test framework */
             if (exit_code == 0) {
                 klog_info("TEST", "PASSED: syscall");
@@ -194,7 +249,7 @@ static void sys_exit(int64_t exit_code) {
  * Returns: 0 on success
  */
 static int64_t sys_yield(void) {
-    klog_debug("SYSCALL", "sys_yield");
+    syscall_dbg("sys_yield");
 
     /* Yield to next runnable thread */
     thread_yield();
@@ -221,7 +276,7 @@ static int64_t sys_getpid(void) {
         return -1;
     }
 
-    klog_info("USER", "sys_getpid: returning PID=%d", p->pid);
+    syscall_dbg("sys_getpid: returning PID=%d", p->pid);
 
     return p->pid;
 }
@@ -237,7 +292,7 @@ static int64_t sys_fork(void) {
     process_t *child;
     thread_t *current = thread_get_current();
 
-    klog_debug("SYSCALL", "sys_fork");
+    syscall_dbg("sys_fork");
 
     if (current == NULL || current->process == NULL) {
         klog_error("SYSCALL", "sys_fork: no current process");
@@ -253,17 +308,104 @@ static int64_t sys_fork(void) {
 
     /* If we're the parent, return child PID */
     if (process_get_current() == current->process) {
-        klog_info("SYSCALL", "sys_fork: parent PID=%d returning child PID=%d",
-                  current->process->pid, child->pid);
+        syscall_dbg("sys_fork: parent PID=%d returning child PID=%d",
+                    current->process->pid, child->pid);
         return child->pid;
     }
 
     /* If we're the child, return 0 */
-    klog_info("SYSCALL", "sys_fork: child PID=%d returning 0",
-              process_get_current()->pid);
+    syscall_dbg("sys_fork: child PID=%d returning 0", process_get_current()->pid);
     return 0;
 }
 
+/**
+ * sys_vfork - Create a child that borrows the caller's address space
+ *
+ * The caller sleeps until the child exits or releases the memory. The
+ * child returns from this syscall straight from the caller's saved
+ * registers, without running it.
+ *
+ * Returns: In parent: child PID > 0
+ *          In child: 0
+ *          On error: negative error code
+ */
+static int64_t sys_vfork(void) {
+    process_t *child;
+    thread_t *current = thread_get_current();
+
+    if (current == NULL || current->process == NULL) {
+        klog_error("SYSCALL", "sys_vfork: no current process");
+        return -1;  /* EPERM */
+    }
+
+    child = process_vfork(syscall_current_regs());
+    if (child == NULL) {
+        return -12;  /* ENOMEM */
+    }
+
+    return child->pid;
+}
+
+/**
+ * sys_spawn - Start a child process running a fresh image
+ * @image: User pointer to a flat binary (see process_spawn())
+ * @size: Image size in bytes
+ * @argv: User pointer to a NULL-terminated argument vector (may be NULL)
+ *
+ * Unlike fork followed by exec, never copies the caller's address space.
+ *
+ * Returns: Child PID, or negative error code
+ */
+static int64_t sys_spawn(const void *image, uint64_t size, const char *const *argv) {
+    process_t *current = process_get_current();
+    process_t *child;
+
+    if (current == NULL) {
+        klog_error("SYSCALL", "sys_spawn: no current process");
+        return -1;  /* EPERM */
+    }
+    if (size == 0 || size > SPAWN_IMAGE_MAX) {
+        return -22;  /* EINVAL */
+    }
+    if (probe_user_read(image, size) != 0) {
+        return EFAULT;
+    }
+
+    child = process_spawn(current->name, image, size, argv, SPAWN_USER);
+    if (child == NULL) {
+        return -12;  /* ENOMEM */
+    }
+
+    return child->pid;
+}
+
+/* Longest initramfs path sys_execve accepts, including the NUL */
+#define EXECVE_PATH_MAX  256
+
+/**
+ * sys_execve - Replace the calling program with one from the initramfs
+ * @path: User pointer to the executable's path
+ * @argv: User pointer to a NULL-terminated argument vector (may be NULL)
+ *
+ * Returns: Only on failure, with a negative error code
+ */
+static int64_t sys_execve(const char *path, const char *const *argv) {
+    /* One spare byte: strncpy_from_user() stops a byte short of the
+     * buffer, so a copy that fills the rest was truncated */
+    char kpath[EXECVE_PATH_MAX + 1];
+    long len;
+
+    len = strncpy_from_user(kpath, path, sizeof(kpath));
+    if (len < 0) {
+        return len;
+    }
+    if (len >= EXECVE_PATH_MAX) {
+        return -36;  /* ENAMETOOLONG */
+    }
+
+    return process_execve(kpath, argv, SPAWN_USER);
+}
+
 /**
  * sys_wait - Wait for a child process to exit
  * @pid: PID to wait for (-1 = any child)
@@ -274,62 +416,412 @@ static int64_t sys_fork(void) {
 static int64_t sys_wait(uint64_t pid, int *status) {
     int ret;
 
-    klog_debug("SYSCALL", "sys_wait: pid=%d, status=%p", (int)pid, status);
+    syscall_dbg("sys_wait: pid=%d, status=%p", (int)pid, status);
 
     /* Validate status pointer if provided */
     if (status != NULL) {
         if (probe_user_write(status, sizeof(int)) != 0) {
             klog_warn("SYSCALL", "sys_wait: invalid status pointer %p", status);
-            return -EFAULT;
+            return EFAULT;
         }
     }
 
     /* Call process_wait */
     ret = process_wait((int)pid, status);
 
-    klog_debug("SYSCALL", "sys_wait: returning %d", ret);
+    syscall_dbg("sys_wait: returning %d", ret);
+
+    return ret;
+}
+
+/**
+ * sys_sched_setscheduler - Set the scheduling policy of a thread
+ * @tid: Thread ID (0 = calling thread)
+ * @policy: SCHED_NORMAL, SCHED_FIFO or SCHED_RR
+ * @prio: RT priority (0..99), 0 for SCHED_NORMAL
+ *
+ * Returns: 0 on success, or negative error code
+ */
+static int64_t sys_sched_setscheduler(uint64_t tid, uint64_t policy, uint64_t prio) {
+    thread_t *t;
+    int64_t ret = 0;
+
+    syscall_dbg("sys_sched_setscheduler: tid=%d, policy=%d, prio=%d",
+                (int)tid, (int)policy, (int)prio);
+
+    if (tid == 0) {
+        t = thread_get_current();
+    } else {
+        t = thread_find_by_tid((int)tid);
+    }
+
+    if (t == NULL) {
+        return ESRCH;
+    }
+
+    if (sched_setscheduler(t, (int)policy, (int)prio) != 0) {
+        ret = EINVAL;
+    }
+
+    if (tid != 0) {
+        thread_put(t);
+    }
+    return ret;
+}
+
+/**
+ * sys_sched_setaffinity - Restrict the CPUs a thread may run on
+ * @tid: Thread ID (0 = calling thread)
+ * @len: Size of the user mask in bytes
+ * @user_mask: User pointer to a cpumask_t
+ *
+ * Returns: 0 on success, or negative error code
+ */
+static int64_t sys_sched_setaffinity(uint64_t tid, uint64_t len, const cpumask_t *user_mask) {
+    cpumask_t mask;
+    thread_t *t;
+    int64_t ret = 0;
+
+    syscall_dbg("sys_sched_setaffinity: tid=%d, len=%d, mask=%p",
+                (int)tid, (int)len, user_mask);
+
+    if (len < sizeof(cpumask_t)) {
+        return EINVAL;
+    }
+    if (copy_from_user(&mask, user_mask, sizeof(mask)) != 0) {
+        return EFAULT;
+    }
+
+    if (tid == 0) {
+        t = thread_get_current();
+    } else {
+        t = thread_find_by_tid((int)tid);
+    }
+
+    if (t == NULL) {
+        return ESRCH;
+    }
+
+    if (sched_setaffinity(t, mask) != 0) {
+        ret = EINVAL;
+    }
+
+    if (tid != 0) {
+        thread_put(t);
+    }
+    return ret;
+}
+
+/**
+ * sys_sched_getaffinity - Get the CPUs a thread may run on
+ * @tid: Thread ID (0 = calling thread)
+ * @len: Size of the user buffer in bytes
+ * @user_mask: User pointer receiving a cpumask_t
+ *
+ * Returns: Number of bytes written, or negative error code
+ */
+static int64_t sys_sched_getaffinity(uint64_t tid, uint64_t len, cpumask_t *user_mask) {
+    cpumask_t mask;
+    thread_t *t;
+
+    syscall_dbg("sys_sched_getaffinity: tid=%d, len=%d, mask=%p",
+                (int)tid, (int)len, user_mask);
+
+    if (len < sizeof(cpumask_t)) {
+        return EINVAL;
+    }
 
+    if (tid == 0) {
+        t = thread_get_current();
+    } else {
+        t = thread_find_by_tid((int)tid);
+    }
+
+    if (t == NULL) {
+        return ESRCH;
+    }
+
+    mask = sched_getaffinity(t);
+    if (tid != 0) {
+        thread_put(t);
+    }
+
+    if (copy_to_user(user_mask, &mask, sizeof(mask)) != 0) {
+        return EFAULT;
+    }
+
+    return sizeof(cpumask_t);
+}
+
+/**
+ * sys_nanosleep - Sleep for a time interval
+ * @user_req: User pointer to the struct timespec to sleep for
+ * @user_rem: User pointer receiving the time left, or NULL
+ *
+ * The sleep is not interruptible, so the time left is always zero.
+ *
+ * Returns: 0 on success, or negative error code
+ */
+static int64_t sys_nanosleep(const struct timespec *user_req, struct timespec *user_rem) {
+    struct timespec req;
+    uint64_t ns;
+
+    syscall_dbg("sys_nanosleep: req=%p, rem=%p", user_req, user_rem);
+
+    if (copy_from_user(&req, user_req, sizeof(req)) != 0) {
+        return EFAULT;
+    }
+    if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= (int64_t)NSEC_PER_SEC) {
+        return EINVAL;
+    }
+
+    if ((uint64_t)req.tv_sec >= UINT64_MAX / NSEC_PER_SEC) {
+        ns = UINT64_MAX / 2;
+    } else {
+        ns = (uint64_t)req.tv_sec * NSEC_PER_SEC + (uint64_t)req.tv_nsec;
+    }
+    thread_sleep_ns(ns);
+
+    if (user_rem != NULL) {
+        struct timespec rem = { 0, 0 };
+
+        if (copy_to_user(user_rem, &rem, sizeof(rem)) != 0) {
+            return EFAULT;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * sys_clock_gettime - Read a clock
+ * @clk: Clock ID (only CLOCK_MONOTONIC exists)
+ * @user_ts: User pointer to store the time
+ *
+ * The vDSO's clock_gettime falls back to this before the TSC is
+ * calibrated, and for clocks it does not know.
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+static int64_t sys_clock_gettime(uint64_t clk, struct timespec *user_ts) {
+    struct timespec ts;
+    uint64_t ns;
+
+    if (clk != CLOCK_MONOTONIC) {
+        return EINVAL;
+    }
+
+    ns = sched_clock();
+    ts.tv_sec = (int64_t)(ns / NSEC_PER_SEC);
+    ts.tv_nsec = (int64_t)(ns % NSEC_PER_SEC);
+    if (copy_to_user(user_ts, &ts, sizeof(ts)) != 0) {
+        return EFAULT;
+    }
+    return 0;
+}
+
+/**
+ * sys_getcpu - Get the CPU the caller runs on
+ * @user_cpu: User pointer to store the CPU index (may be NULL)
+ * @user_node: User pointer to store the NUMA node, always 0 (may be NULL)
+ *
+ * The vDSO's getcpu falls back to this on CPUs without RDTSCP.
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+static int64_t sys_getcpu(unsigned int *user_cpu, unsigned int *user_node) {
+    unsigned int cpu = (unsigned int)smp_get_cpu_index();
+    unsigned int node = 0;
+
+    if (user_cpu != NULL && copy_to_user(user_cpu, &cpu, sizeof(cpu)) != 0) {
+        return EFAULT;
+    }
+    if (user_node != NULL && copy_to_user(user_node, &node, sizeof(node)) != 0) {
+        return EFAULT;
+    }
+    return 0;
+}
+
+/**
+ * sys_ioring_setup - Create the caller's submission/completion rings
+ * @entries: SQ entries (1 to IORING_MAX_ENTRIES)
+ * @flags: IORING_SETUP_*
+ *
+ * Returns: User address of the ring block, or negative error code
+ */
+static int64_t sys_ioring_setup(uint64_t entries, uint64_t flags) {
+    syscall_dbg("sys_ioring_setup: entries=%lu, flags=%lx",
+                (unsigned long)entries, (unsigned long)flags);
+
+    if (entries > UINT32_MAX || flags > UINT32_MAX) {
+        return EINVAL;
+    }
+    return ioring_setup(process_get_current(), (uint32_t)entries, (uint32_t)flags);
+}
+
+/**
+ * sys_ioring_enter - Run queued SQEs and collect completions
+ * @to_submit: Most SQEs to run
+ * @min_complete: CQEs to wait for with IORING_ENTER_GETEVENTS
+ * @flags: IORING_ENTER_*
+ *
+ * Returns: Number of SQEs run, or negative error code
+ */
+static int64_t sys_ioring_enter(uint64_t to_submit, uint64_t min_complete, uint64_t flags) {
+    syscall_dbg("sys_ioring_enter: to_submit=%lu, min_complete=%lu, flags=%lx",
+                (unsigned long)to_submit, (unsigned long)min_complete, (unsigned long)flags);
+
+    if (flags > UINT32_MAX) {
+        return EINVAL;
+    }
+    /* Larger counts only mean "everything" */
+    if (to_submit > UINT32_MAX) {
+        to_submit = UINT32_MAX;
+    }
+    if (min_complete > UINT32_MAX) {
+        min_complete = UINT32_MAX;
+    }
+    return ioring_enter(process_get_current(), (uint32_t)to_submit,
+                        (uint32_t)min_complete, (uint32_t)flags);
+}
+
+/*
+ * Syscall table, indexed by number. Every handler takes at most six
+ * integer or pointer arguments, which the SysV ABI passes in the same
+ * registers whatever their declared types, so each is called through
+ * the six-argument syscall_fn_t. Unused numbers are NULL (ENOSYS).
+ */
+typedef int64_t (*syscall_fn_t)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+
+static const syscall_fn_t sys_call_table[NR_syscalls] = {
+    [SYS_write]                 = (syscall_fn_t)sys_write,
+    [SYS_exit]                  = (syscall_fn_t)sys_exit,
+    [SYS_yield]                 = (syscall_fn_t)sys_yield,
+    [SYS_getpid]                = (syscall_fn_t)sys_getpid,
+    [SYS_fork]                  = (syscall_fn_t)sys_fork,
+    [SYS_wait]                  = (syscall_fn_t)sys_wait,
+    [SYS_sched_setscheduler]    = (syscall_fn_t)sys_sched_setscheduler,
+    [SYS_sched_setaffinity]     = (syscall_fn_t)sys_sched_setaffinity,
+    [SYS_sched_getaffinity]     = (syscall_fn_t)sys_sched_getaffinity,
+    [SYS_nanosleep]             = (syscall_fn_t)sys_nanosleep,
+    [SYS_vfork]                 = (syscall_fn_t)sys_vfork,
+    [SYS_spawn]                 = (syscall_fn_t)sys_spawn,
+    [SYS_execve]                = (syscall_fn_t)sys_execve,
+    [SYS_clock_gettime]         = (syscall_fn_t)sys_clock_gettime,
+    [SYS_getcpu]                = (syscall_fn_t)sys_getcpu,
+    [SYS_ioring_setup]          = (syscall_fn_t)sys_ioring_setup,
+    [SYS_ioring_enter]          = (syscall_fn_t)sys_ioring_enter,
+};
+
+#if CONFIG_SYSCALL_STATS
+/* Calls and TSC cycles spent in each handler, on each CPU */
+DEFINE_PER_CPU(struct syscall_stat[NR_syscalls], syscall_stats);
+
+static const char *const sys_call_names[NR_syscalls] = {
+    [SYS_write] = "write", [SYS_exit] = "exit", [SYS_yield] = "yield",
+    [SYS_getpid] = "getpid", [SYS_fork] = "fork", [SYS_wait] = "wait",
+    [SYS_sched_setscheduler] = "sched_setscheduler",
+    [SYS_sched_setaffinity] = "sched_setaffinity",
+    [SYS_sched_getaffinity] = "sched_getaffinity",
+    [SYS_nanosleep] = "nanosleep", [SYS_vfork] = "vfork",
+    [SYS_spawn] = "spawn", [SYS_execve] = "execve",
+    [SYS_clock_gettime] = "clock_gettime", [SYS_getcpu] = "getcpu",
+    [SYS_ioring_setup] = "ioring_setup", [SYS_ioring_enter] = "ioring_enter",
+};
+#endif
+
+/**
+ * syscall_dispatch - Run a system call by number
+ * @nr: Syscall number
+ * @a1: First argument (and so on up to @a6)
+ *
+ * Shared by the SYSCALL instruction and ring submissions (kernel/ioring.h),
+ * which are counted in the statistics alike.
+ *
+ * Returns: The handler's result, or -ENOSYS for an unknown number
+ */
+int64_t syscall_dispatch(uint64_t nr, uint64_t a1, uint64_t a2, uint64_t a3,
+                         uint64_t a4, uint64_t a5, uint64_t a6) {
+    int64_t ret;
+#if CONFIG_SYSCALL_STATS
+    uint64_t start = arch_rdtsc();
+    struct syscall_stat *st;
+#endif
+
+    if (nr >= NR_syscalls || sys_call_table[nr] == NULL) {
+        syscall_dbg("Unknown syscall: %lu", (unsigned long)nr);
+        return -38;  /* ENOSYS */
+    }
+
+    syscall_dbg("Syscall %lu args: %lx %lx %lx", (unsigned long)nr, a1, a2, a3);
+
+    ret = sys_call_table[nr](a1, a2, a3, a4, a5, a6);
+
+#if CONFIG_SYSCALL_STATS
+    /* The handler may have slept and moved: charge the CPU it returns on */
+    st = &this_cpu_ptr(&syscall_stats)[0][nr];
+    st->count++;
+    st->cycles += arch_rdtsc() - start;
+#endif
     return ret;
 }
 
-/* Syscall dispatcher */
-void syscall_handler(uint64_t nr, uint64_t a1, uint64_t a2, uint64_t a3) {
-    /* Debug: syscall was called! */
-    klog_debug("SYSCALL", "Syscall %x args: %x %x %x", nr, a1, a2, a3);
-
-    int64_t result;
-
-    switch (nr) {
-        case 1: /* SYS_write */
-            result = sys_write(a1, (const char *)a2, a3);
-            /* Return value in RAX */
-            __asm__ volatile ("mov %0, %%rax" : : "r"(result) : "rax");
-            klog_debug("SYSCALL", "Write returned: %d", (int)result);
-            break;
-        case 2: /* SYS_exit */
-            sys_exit(a1);
-            break;
-        case 3: /* SYS_yield */
-            result = sys_yield();
-            __asm__ volatile ("mov %0, %%rax" : : "r"(result) : "rax");
-            break;
-        case 4: /* SYS_getpid */
-            result = sys_getpid();
-            __asm__ volatile ("mov %0, %%rax" : : "r"(result) : "rax");
-            break;
-        case 5: /* SYS_fork */
-            result = sys_fork();
-            __asm__ volatile ("mov %0, %%rax" : : "r"(result) : "rax");
-            break;
-        case 6: /* SYS_wait */
-            result = sys_wait(a1, (int *)a2);
-            __asm__ volatile ("mov %0, %%rax" : : "r"(result) : "rax");
-            break;
-        default:
-            klog_warn("SYSCALL", "Unknown syscall: %x", nr);
-            __asm__ volatile ("mov $-38, %%rax" ::: "rax");  /* ENOSYS */
-            break;
+/**
+ * syscall_handler - Dispatch a system call
+ * @regs: Caller's registers: number in orig_rax, arguments in rdi, rsi,
+ *        rdx, r10, r8 and r9
+ *
+ * Stores the result in @regs->rax, which syscall_entry returns to the
+ * caller. Called with interrupts disabled; handlers that block return
+ * with them disabled again.
+ */
+void syscall_handler(struct pt_regs *regs) {
+    regs->rax = (uint64_t)syscall_dispatch(regs->orig_rax, regs->rdi, regs->rsi, regs->rdx,
+                                           regs->r10, regs->r8, regs->r9);
+}
+
+/**
+ * syscall_get_stats - Sum a syscall's counters over all CPUs
+ * @nr: Syscall number
+ * @stat: Returns the totals (zero without CONFIG_SYSCALL_STATS)
+ *
+ * Calls that never return (exit, a successful execve) are not counted.
+ */
+void syscall_get_stats(unsigned int nr, struct syscall_stat *stat) {
+    stat->count = 0;
+    stat->cycles = 0;
+#if CONFIG_SYSCALL_STATS
+    if (nr >= NR_syscalls) {
+        return;
+    }
+    for (int cpu = 0; cpu < smp_get_cpu_count(); cpu++) {
+        stat->count += per_cpu(syscall_stats, cpu)[nr].count;
+        stat->cycles += per_cpu(syscall_stats, cpu)[nr].cycles;
+    }
+#else
+    (void)nr;
+#endif
+}
+
+/**
+ * syscall_dump_stats - Log per-syscall call counts and average cost
+ *
+ * One SYSCALLSTAT line per syscall that has been called.
+ */
+void syscall_dump_stats(void) {
+#if CONFIG_SYSCALL_STATS
+    struct syscall_stat stat;
+
+    for (unsigned int nr = 0; nr < NR_syscalls; nr++) {
+        syscall_get_stats(nr, &stat);
+        if (stat.count == 0) {
+            continue;
+        }
+        klog_info("SYSCALL", "SYSCALLSTAT nr=%u name=%s count=%lu avg_cycles=%lu",
+                  nr, sys_call_names[nr], (unsigned long)stat.count,
+                  (unsigned long)(stat.cycles / stat.count));
     }
+#endif
 }
 
 /* Initialize SYSCALL MSRs */
@@ -411,6 +903,14 @@ void syscall_init(void) {
         : : "c"(MSR_IA32_FMASK), "a"(fmask & 0xFFFFFFFF), "d"(fmask >> 32)
     );
 
+    /* CPUs that have not switched threads yet enter on their own stack */
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (per_cpu(syscall_entry_rsp, cpu) == 0) {
+            per_cpu(syscall_entry_rsp, cpu) =
+                (uint64_t)(syscall_stacks[cpu] + SYSCALL_STACK_SIZE);
+        }
+    }
+
     klog_info("SYSCALL", "Syscall initialized");
 }
 
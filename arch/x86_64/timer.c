@@ -1,8 +1,25 @@
-/* Emergence Kernel - Local APIC Timer Driver */
+/* Emergence Kernel - Local APIC Timer Driver
+ *
+ * With CONFIG_NO_HZ the LAPIC timer does not tick periodically. It runs in
+ * TSC-deadline mode when the CPU supports it, otherwise in one-shot count
+ * mode calibrated against the TSC, and each expiry is programmed from
+ * scheduler_next_event_ns(): the running thread's slice end, a 100 Hz
+ * bookkeeping tick, or nothing at all on an idle CPU. Pending kernel
+ * timers (kernel/timer.c) pull the expiry earlier.
+ *
+ * Without CONFIG_NO_HZ the timer is periodic, so kernel timers only fire
+ * on tick boundaries.
+ */
 
 #include <stdint.h>
 #include "arch/x86_64/timer.h"
 #include "arch/x86_64/apic.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/msr.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/tsc.h"
+#include "include/kernel/scheduler.h"
+#include "kernel/timer.h"
 #include "kernel/klog.h"
 
 /* Mathematician quotes (≤8 words each) */
@@ -22,8 +39,10 @@ volatile int apic_timer_count = 0;  /* Exported for test verification */
 static volatile int apic_timer_active = 0;
 static volatile int apic_timer_interrupt_count = 0;  /* Interrupt counter for delaying quotes */
 
-/* Forward declarations */
-void timer_stop(void);  /* Declared in timer.h, need forward declaration here */
+/* One-shot clockevent state */
+static int timer_tsc_deadline;                          /* TSC-deadline mode in use */
+static uint64_t lapic_timer_khz = TIMER_DEFAULT_KHZ;    /* One-shot count rate */
+static DEFINE_PER_CPU(int, tick_stopped);               /* Per-CPU tick stopped */
 
 /**
  * apic_timer_handler - APIC Timer interrupt handler
@@ -37,8 +56,10 @@ void apic_timer_handler(void) {
         /* Increment interrupt counter */
         apic_timer_interrupt_count++;
 
+        /* Expired timers first: their wakeups feed the scheduler tick */
+        run_local_timers();
+
         /* Call scheduler tick for preemptive scheduling */
-        extern void scheduler_tick(void);
         scheduler_tick();
 
         /* Increment quote counter every INTERRUPTS_PER_QUOTE interrupts */
@@ -60,6 +81,11 @@ void apic_timer_handler(void) {
                 timer_stop();  /* Mask the timer interrupt in hardware */
             }
         }
+
+#if CONFIG_NO_HZ
+        /* One-shot: nothing fires again unless we program it */
+        timer_tick_rearm();
+#endif
     }
 }
 
@@ -90,36 +116,38 @@ void timer_handler(void) {
  * Resets the counters, unmask and start the APIC timer.
  */
 void timer_start(void) {
+    uint32_t lvt;
+
     apic_timer_count = 0;
     apic_timer_interrupt_count = 0;  /* Reset interrupt counter */
     apic_timer_active = 1;
 
-    /* Unmask and start the timer by setting initial count */
-    extern uint32_t lapic_read(uint32_t offset);
-    extern void lapic_write(uint32_t offset, uint32_t value);
-
     /* Unmask the timer */
-    uint32_t lvt = lapic_read(0x320);  /* LAPIC_TIMER_LVT */
-    lvt &= ~0x10000;  /* Clear mask bit */
-    lapic_write(0x320, lvt);
+    lvt = lapic_read(LAPIC_TIMER_LVT);
+    lvt &= ~LAPIC_TIMER_LVT_MASK;
+    lapic_write(LAPIC_TIMER_LVT, lvt);
 
+#if CONFIG_NO_HZ
+    this_cpu_write(tick_stopped, 0);
+    timer_program_oneshot(SCHED_TICK_NS);
+#else
     /* Set initial count to start the timer (use slower frequency for testing)
      * 10000000 = ~10Hz at 100MHz bus (much slower to avoid serial corruption) */
-    lapic_write(0x380, 10000000);  /* LAPIC_TIMER_ICR */
+    lapic_write(LAPIC_TIMER_ICR, 10000000);
+#endif
 }
 
 /**
  * timer_stop - Stop the APIC timer
  *
- * Masks the timer interrupt to stop periodic interrupts.
+ * Masks the timer interrupt to stop periodic interrupts. The LVT mode
+ * bits are preserved so timer_start() resumes in the same mode.
  */
 void timer_stop(void) {
-    /* Mask the timer interrupt in the LVT */
-    /* Write the timer vector with the mask bit set */
-    extern uint32_t lapic_read(uint32_t offset);
-    extern void lapic_write(uint32_t offset, uint32_t value);
-
-    lapic_write(0x320, TIMER_VECTOR | 0x10000);  /* Mask timer interrupt */
+    lapic_write(LAPIC_TIMER_LVT, lapic_read(LAPIC_TIMER_LVT) | LAPIC_TIMER_LVT_MASK);
+#if CONFIG_NO_HZ
+    timer_cancel();
+#endif
     apic_timer_active = 0;
 }
 
@@ -131,3 +159,150 @@ void timer_stop(void) {
 int timer_is_active(void) {
     return apic_timer_active;
 }
+
+/* ============================================================================
+ * One-shot clockevent (NO_HZ)
+ * ============================================================================ */
+
+/**
+ * timer_calibrate_lapic - Measure the LAPIC timer rate against the TSC
+ *
+ * Lets the timer count down from its maximum for TIMER_CALIBRATE_MS with
+ * the LVT masked. Requires tsc_init() and a divide-by-1 DCR.
+ */
+static void timer_calibrate_lapic(void) {
+    uint64_t cycles = tsc_ns_to_cycles(TIMER_CALIBRATE_MS * NSEC_PER_MSEC);
+    uint64_t start;
+    uint32_t elapsed;
+
+    lapic_write(LAPIC_TIMER_ICR, 0xFFFFFFFF);
+    start = arch_rdtsc();
+    while (arch_rdtsc() - start < cycles) {
+        __asm__ volatile ("pause");
+    }
+    elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CCR);
+    lapic_write(LAPIC_TIMER_ICR, 0);
+
+    if (elapsed == 0) {
+        klog_warn("TIMER", "LAPIC timer calibration failed, assuming %lu kHz",
+                  (unsigned long)TIMER_DEFAULT_KHZ);
+        return;
+    }
+
+    lapic_timer_khz = elapsed / TIMER_CALIBRATE_MS;
+}
+
+/**
+ * timer_oneshot_init - Select the one-shot clockevent mode
+ *
+ * Prefers TSC-deadline mode: the deadline is absolute, needs no
+ * calibration and is programmed with a single MSR write. Otherwise the
+ * count-down mode is calibrated against the TSC. Called with the timer
+ * LVT masked in one-shot mode.
+ *
+ * Returns: LVT timer mode bits to use
+ */
+uint32_t timer_oneshot_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    arch_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (ecx & CPUID_FEAT_ECX_TSC_DEADLINE) {
+        timer_tsc_deadline = 1;
+        klog_info("TIMER", "NO_HZ: using TSC-deadline timer");
+        return LAPIC_TIMER_LVT_TSCDEADLINE;
+    }
+
+    timer_calibrate_lapic();
+    klog_info("TIMER", "NO_HZ: using one-shot LAPIC timer (%lu kHz)",
+              (unsigned long)lapic_timer_khz);
+    return LAPIC_TIMER_LVT_ONESHOT;
+}
+
+/**
+ * timer_has_tsc_deadline - Check whether the TSC-deadline mode is in use
+ *
+ * Returns: 1 for TSC-deadline, 0 for one-shot count mode
+ */
+int timer_has_tsc_deadline(void) {
+    return timer_tsc_deadline;
+}
+
+/**
+ * timer_program_oneshot - Fire the timer once
+ * @delta_ns: Nanoseconds from now
+ *
+ * Replaces any pending expiry on this CPU.
+ */
+void timer_program_oneshot(uint64_t delta_ns) {
+    uint64_t count;
+
+    if (timer_tsc_deadline) {
+        arch_msr_write(IA32_TSC_DEADLINE_MSR, arch_rdtsc() + tsc_ns_to_cycles(delta_ns));
+        return;
+    }
+
+    count = delta_ns * lapic_timer_khz / NSEC_PER_MSEC;
+    if (count == 0) {
+        count = 1;
+    } else if (count > 0xFFFFFFFF) {
+        count = 0xFFFFFFFF;
+    }
+    lapic_write(LAPIC_TIMER_ICR, (uint32_t)count);
+}
+
+/**
+ * timer_cancel - Disarm a pending one-shot on this CPU
+ */
+void timer_cancel(void) {
+    if (timer_tsc_deadline) {
+        arch_msr_write(IA32_TSC_DEADLINE_MSR, 0);
+    } else {
+        lapic_write(LAPIC_TIMER_ICR, 0);
+    }
+}
+
+/**
+ * timer_tick_rearm - Program this CPU's next tick, or stop it
+ *
+ * Takes the earlier of the scheduler's next tick and this CPU's next
+ * kernel timer expiry. Called after each tick, after every context
+ * switch, before an idle CPU halts and when a timer is added ahead of the
+ * current expiry. Does nothing while the timer is stopped.
+ */
+void timer_tick_rearm(void) {
+    uint64_t next, expiry, now;
+
+    if (!apic_timer_active) {
+        return;
+    }
+
+    next = scheduler_next_event_ns();
+
+    expiry = timer_next_expiry();
+    if (expiry != TIMER_NO_EXPIRY) {
+        now = sched_clock();
+        expiry = expiry > now ? expiry - now : 1;
+        if (next == 0 || expiry < next) {
+            next = expiry;
+        }
+    }
+    if (next == 0) {
+        if (!this_cpu_read(tick_stopped)) {
+            timer_cancel();
+            this_cpu_write(tick_stopped, 1);
+        }
+        return;
+    }
+
+    this_cpu_write(tick_stopped, 0);
+    timer_program_oneshot(next);
+}
+
+/**
+ * timer_tick_is_stopped - Check whether the tick is stopped on this CPU
+ *
+ * Returns: 1 if an idle CPU stopped its tick, 0 otherwise
+ */
+int timer_tick_is_stopped(void) {
+    return this_cpu_read(tick_stopped);
+}
@@ -16,4 +16,32 @@ void timer_start(void);
 void timer_stop(void);
 int timer_is_active(void);
 
+/* ============================================================================
+ * One-shot clockevent (NO_HZ)
+ * ============================================================================ */
+
+/* LAPIC timer calibration window against the TSC (10 ms) */
+#define TIMER_CALIBRATE_MS      10
+
+/* Assumed LAPIC timer rate when calibration fails (100 MHz bus) */
+#define TIMER_DEFAULT_KHZ       100000
+
+/* Select TSC-deadline or one-shot count mode; returns the LVT mode bits */
+uint32_t timer_oneshot_init(void);
+
+/* Check whether the TSC-deadline mode is in use */
+int timer_has_tsc_deadline(void);
+
+/* Fire the timer once, @delta_ns from now */
+void timer_program_oneshot(uint64_t delta_ns);
+
+/* Disarm a pending one-shot */
+void timer_cancel(void);
+
+/* Program this CPU's next tick from the scheduler, or stop the tick */
+void timer_tick_rearm(void);
+
+/* Check whether the tick is stopped on this CPU */
+int timer_tick_is_stopped(void);
+
 #endif /* EMERGENCE_ARCH_X86_64_TIMER_H */
@@ -0,0 +1,137 @@
+/* Emergence Kernel - x86-64 Time Stamp Counter clock source
+ *
+ * The TSC is calibrated once at boot by counting cycles across a fixed
+ * PIT channel 2 countdown. Channel 2 is used because it can be polled
+ * through port B without an interrupt handler and does not disturb
+ * channel 0. Conversion to nanoseconds uses a 32.32 fixed-point
+ * multiplier so sched_clock() never divides on the hot path.
+ */
+
+#include <stdint.h>
+#include "arch/x86_64/tsc.h"
+#include "arch/x86_64/pit.h"
+#include "arch/x86_64/io.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/include/vdso.h"
+#include "kernel/klog.h"
+
+/* Upper bound on port B polls before giving up on the PIT */
+#define TSC_CALIBRATE_MAX_POLLS 10000000
+
+/* Calibrated frequency and derived ns <-> cycles multipliers */
+static uint64_t tsc_khz;
+static uint64_t tsc_ns_mult;
+static uint64_t tsc_cyc_mult;
+
+/* TSC value at calibration time (sched_clock() epoch) */
+static uint64_t tsc_epoch;
+
+/**
+ * tsc_set_khz - Set the TSC frequency and recompute the ns multiplier
+ * @khz: TSC frequency in kHz
+ */
+static void tsc_set_khz(uint64_t khz) {
+    tsc_khz = khz;
+    tsc_ns_mult = (NSEC_PER_MSEC << TSC_NS_SHIFT) / khz;
+    tsc_cyc_mult = (khz << TSC_NS_SHIFT) / NSEC_PER_MSEC;
+}
+
+/**
+ * tsc_calibrate_pit - Measure TSC cycles across a PIT channel 2 countdown
+ *
+ * Returns: TSC frequency in kHz, or 0 if the PIT never expired
+ */
+static uint64_t tsc_calibrate_pit(void) {
+    uint32_t latch = (PIT_FREQUENCY * TSC_CALIBRATE_MS) / 1000;
+    uint64_t start, end;
+    uint8_t port_b;
+    int polls = 0;
+
+    /* Gate channel 2 on, keep the speaker disconnected */
+    port_b = inb(PIT_PORT_B);
+    outb(PIT_PORT_B, (port_b & ~PIT_PORT_B_SPKR) | PIT_PORT_B_GATE2);
+
+    /* Channel 2, lo/hi access, one-shot, binary */
+    outb(PIT_COMMAND, PIT_CHANNEL_2 | PIT_ACCESS_LOHI | PIT_MODE_ONESHOT);
+    outb(PIT_CH2_DATA, latch & 0xFF);
+    outb(PIT_CH2_DATA, (latch >> 8) & 0xFF);
+
+    start = arch_rdtsc();
+    while ((inb(PIT_PORT_B) & PIT_PORT_B_OUT2) == 0) {
+        if (++polls > TSC_CALIBRATE_MAX_POLLS) {
+            outb(PIT_PORT_B, port_b);
+            return 0;
+        }
+    }
+    end = arch_rdtsc();
+
+    /* Restore port B */
+    outb(PIT_PORT_B, port_b);
+
+    return (end - start) / TSC_CALIBRATE_MS;
+}
+
+/**
+ * tsc_init - Calibrate the TSC and start the sched_clock() epoch
+ *
+ * Must be called on the BSP with interrupts disabled, before anything
+ * reads sched_clock().
+ */
+void tsc_init(void) {
+    uint64_t khz = tsc_calibrate_pit();
+
+    if (khz == 0) {
+        klog_warn("TSC", "PIT calibration failed, assuming %lu kHz",
+                  (unsigned long)TSC_DEFAULT_KHZ);
+        khz = TSC_DEFAULT_KHZ;
+    }
+
+    tsc_set_khz(khz);
+    tsc_epoch = arch_rdtsc();
+    vdso_update_clock(tsc_epoch, tsc_ns_mult);
+
+    klog_info("TSC", "Calibrated TSC: %lu kHz", (unsigned long)khz);
+}
+
+/**
+ * tsc_get_khz - Get the calibrated TSC frequency
+ *
+ * Returns: TSC frequency in kHz (0 before tsc_init())
+ */
+uint64_t tsc_get_khz(void) {
+    return tsc_khz;
+}
+
+/**
+ * tsc_cycles_to_ns - Convert a TSC cycle count to nanoseconds
+ * @cycles: Cycle delta
+ *
+ * Returns: Nanoseconds (0 before tsc_init())
+ */
+uint64_t tsc_cycles_to_ns(uint64_t cycles) {
+    return (uint64_t)(((unsigned __int128)cycles * tsc_ns_mult) >> TSC_NS_SHIFT);
+}
+
+/**
+ * tsc_ns_to_cycles - Convert nanoseconds to a TSC cycle count
+ * @ns: Nanosecond delta
+ *
+ * Used to program TSC-deadline timers.
+ *
+ * Returns: Cycles (0 before tsc_init())
+ */
+uint64_t tsc_ns_to_cycles(uint64_t ns) {
+    return (uint64_t)(((unsigned __int128)ns * tsc_cyc_mult) >> TSC_NS_SHIFT);
+}
+
+/**
+ * sched_clock - Get monotonic time for scheduler accounting
+ *
+ * TSC-based, so cheap enough to call on every context switch and tick.
+ * Assumes an invariant TSC that is synchronized across CPUs.
+ *
+ * Returns: Nanoseconds since tsc_init()
+ */
+uint64_t sched_clock(void) {
+    return tsc_cycles_to_ns(arch_rdtsc() - tsc_epoch);
+}
@@ -0,0 +1,38 @@
+/* Emergence Kernel - x86-64 Time Stamp Counter clock source */
+
+#ifndef EMERGENCE_ARCH_X86_64_TSC_H
+#define EMERGENCE_ARCH_X86_64_TSC_H
+
+#include <stdint.h>
+
+/* Calibration window against PIT channel 2 (10 ms) */
+#define TSC_CALIBRATE_MS      10
+
+/* Assumed frequency when calibration fails (1 GHz) */
+#define TSC_DEFAULT_KHZ       1000000
+
+/* Fixed-point shift for cycles -> nanoseconds conversion */
+#define TSC_NS_SHIFT          32
+
+#define NSEC_PER_USEC         1000ULL
+#define NSEC_PER_MSEC         1000000ULL
+#define NSEC_PER_SEC          1000000000ULL
+
+/* Function prototypes */
+
+/* Calibrate the TSC against the PIT (BSP, interrupts off) */
+void tsc_init(void);
+
+/* Get calibrated TSC frequency in kHz */
+uint64_t tsc_get_khz(void);
+
+/* Convert a TSC cycle delta to nanoseconds */
+uint64_t tsc_cycles_to_ns(uint64_t cycles);
+
+/* Convert nanoseconds to a TSC cycle delta */
+uint64_t tsc_ns_to_cycles(uint64_t ns);
+
+/* Monotonic nanoseconds since tsc_init() */
+uint64_t sched_clock(void);
+
+#endif /* EMERGENCE_ARCH_X86_64_TSC_H */
@@ -9,6 +9,7 @@
 #include <string.h>
 #include "arch/x86_64/include/uaccess.h"
 #include "kernel/klog.h"
+#include "kernel/pmm.h"
 
 /* User memory region bounds
  * x86_64 canonical address check:
@@ -50,7 +51,7 @@ static inline int is_user_pointer(const void *ptr)
  * @addr: Start of user address range
  * @n: Length of range in bytes
  *
- * Returns: 0 if readable, -EFAULT if not readable
+ * Returns: 0 if readable, EFAULT if not readable
  */
 int probe_user_read(const void __user *addr, size_t n)
 {
@@ -59,19 +60,19 @@ int probe_user_read(const void __user *addr, size_t n)
 
     /* Check for overflow */
     if (end < start) {
-        return -EFAULT;
+        return EFAULT;
     }
 
     /* Validate pointer is in user space */
     if (!is_user_pointer(addr)) {
         klog_debug("UACCESS", "Invalid user pointer: %p", addr);
-        return -EFAULT;
+        return EFAULT;
     }
 
     /* Validate end is also in user space */
     if (end >= USER_SPACE_END) {
         klog_debug("UACCESS", "User range exceeds limit: %p + %zx", addr, n);
-        return -EFAULT;
+        return EFAULT;
     }
 
     /* TODO: Walk page tables to verify pages are mapped
@@ -84,7 +85,7 @@ int probe_user_read(const void __user *addr, size_t n)
  * @addr: Start of user address range
  * @n: Length of range in bytes
  *
- * Returns: 0 if writable, -EFAULT if not writable
+ * Returns: 0 if writable, EFAULT if not writable
  */
 int probe_user_write(void __user *addr, size_t n)
 {
@@ -106,18 +107,18 @@ long copy_from_user(void *dst, const void __user *src, size_t n)
     /* Validate pointers */
     if (dst == NULL) {
         klog_warn("UACCESS", "copy_from_user: NULL kernel destination");
-        return -EINVAL;
+        return EINVAL;
     }
 
     if (src == NULL) {
         klog_warn("UACCESS", "copy_from_user: NULL user source");
-        return -EFAULT;
+        return EFAULT;
     }
 
     /* Validate user pointer range */
     if (probe_user_read(src, n) != 0) {
         klog_warn("UACCESS", "copy_from_user: invalid user range %p + %zx", src, n);
-        return -EFAULT;
+        return EFAULT;
     }
 
     /* TODO: Use exception table for efficient fault handling
@@ -144,18 +145,18 @@ long copy_to_user(void __user *dst, const void *src, size_t n)
     /* Validate pointers */
     if (src == NULL) {
         klog_warn("UACCESS", "copy_to_user: NULL kernel source");
-        return -EINVAL;
+        return EINVAL;
     }
 
     if (dst == NULL) {
         klog_warn("UACCESS", "copy_to_user: NULL user destination");
-        return -EFAULT;
+        return EFAULT;
     }
 
     /* Validate user pointer range */
     if (probe_user_write(dst, n) != 0) {
         klog_warn("UACCESS", "copy_to_user: invalid user range %p + %zx", dst, n);
-        return -EFAULT;
+        return EFAULT;
     }
 
     klog_debug("UACCESS", "copy_to_user: %p -> %p, %zu bytes", src, dst, n);
@@ -179,23 +180,33 @@ long strncpy_from_user(char *dst, const char __user *src, size_t count)
     size_t len;
 
     if (dst == NULL || src == NULL) {
-        return -EINVAL;
+        return EINVAL;
     }
 
     if (count == 0) {
-        return -EINVAL;
+        return EINVAL;
     }
 
-    /* Validate user pointer range */
-    if (probe_user_read(src, count) != 0) {
-        klog_warn("UACCESS", "strncpy_from_user: invalid user range %p + %zx", src, count);
-        return -EFAULT;
-    }
-
-    /* Find string length */
+    /* Find string length, probing each page before reading from it:
+     * a short string may end just before an unmapped page */
     len = 0;
     while (len < count - 1) {
+        uint64_t addr = (uint64_t)src + len;
         char c;
+
+        if (len == 0 || (addr & (PAGE_SIZE - 1)) == 0) {
+            size_t chunk = PAGE_SIZE - (addr & (PAGE_SIZE - 1));
+
+            if (chunk > count - 1 - len) {
+                chunk = count - 1 - len;
+            }
+            if (probe_user_read((const void *)addr, chunk) != 0) {
+                klog_warn("UACCESS", "strncpy_from_user: invalid user range %p + %zx",
+                          (const void *)addr, chunk);
+                return EFAULT;
+            }
+        }
+
         c = ((const char *)src)[len];
         if (c == '\0') {
             break;
@@ -224,7 +235,7 @@ long clear_user(void __user *dst, size_t n)
     /* Validate user pointer range */
     if (probe_user_write(dst, n) != 0) {
         klog_warn("UACCESS", "clear_user: invalid user range %p + %zx", dst, n);
-        return -EFAULT;
+        return EFAULT;
     }
 
     klog_debug("UACCESS", "clear_user: clearing %p, %zu bytes", dst, n);
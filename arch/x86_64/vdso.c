@@ -0,0 +1,178 @@
+/* Emergence Kernel - x86_64 vDSO
+ *
+ * The shared data and text pages are one order-1 PMM block laid out as
+ * in user space, vdso_data then text, so the text also runs at its
+ * kernel address. Each address space gets its own struct vdso_proc page,
+ * freed with it.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arch/x86_64/include/vdso.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/msr.h"
+#include "include/barrier.h"
+#include "include/string.h"
+#include "kernel/pmm.h"
+#include "kernel/vm.h"
+#include "kernel/klog.h"
+
+_Static_assert(offsetof(struct vdso_data, seq) == VDSO_DATA_SEQ, "vdso_data layout");
+_Static_assert(offsetof(struct vdso_data, flags) == VDSO_DATA_FLAGS, "vdso_data layout");
+_Static_assert(offsetof(struct vdso_data, tsc_epoch) == VDSO_DATA_TSC_EPOCH, "vdso_data layout");
+_Static_assert(offsetof(struct vdso_data, ns_mult) == VDSO_DATA_NS_MULT, "vdso_data layout");
+_Static_assert(offsetof(struct vdso_proc, pid) == VDSO_PROC_PID, "vdso_proc layout");
+
+/* CPUID.80000001H:EDX RDTSCP and IA32_TSC_AUX support */
+#define CPUID_EXT_EDX_RDTSCP    (1U << 27)
+
+/* Template of the text page (vdso.S) */
+extern const uint8_t vdso_text_start[], vdso_text_end[];
+
+/* Shared pages: [0] vdso_data, [1] text */
+static uint8_t *vdso_pages;
+
+static struct vdso_data *vdso_data(void) {
+    return (struct vdso_data *)vdso_pages;
+}
+
+/**
+ * vdso_init - Allocate and fill the shared vDSO pages
+ *
+ * The clock reads as uncalibrated, and the vDSO falls back to the
+ * syscall, until tsc_init() publishes the calibration.
+ */
+void vdso_init(void) {
+    size_t size = (size_t)(vdso_text_end - vdso_text_start);
+    uint32_t max_ext, eax, ebx, ecx, edx;
+
+    if (size > PAGE_SIZE) {
+        klog_error("VDSO", "Text is %lu bytes, more than a page", (unsigned long)size);
+        return;
+    }
+
+    vdso_pages = pmm_alloc(1);
+    if (vdso_pages == NULL) {
+        klog_error("VDSO", "No memory for the vDSO");
+        return;
+    }
+    memset(vdso_pages, 0, 2 * PAGE_SIZE);
+    memcpy(vdso_pages + PAGE_SIZE, vdso_text_start, size);
+
+    arch_cpuid(0x80000000, &max_ext, NULL, NULL, NULL);
+    if (max_ext >= 0x80000001) {
+        arch_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        if (edx & CPUID_EXT_EDX_RDTSCP) {
+            vdso_data()->flags |= VDSO_F_RDTSCP;
+        }
+    }
+    vdso_init_cpu(0);
+
+    klog_info("VDSO", "vDSO at %p (%lu byte text, getcpu via %s)",
+              (void *)VDSO_TEXT_BASE, (unsigned long)size,
+              (vdso_data()->flags & VDSO_F_RDTSCP) ? "RDTSCP" : "syscall");
+}
+
+/**
+ * vdso_init_cpu - Prepare a CPU for the vDSO's getcpu
+ * @cpu: This CPU's index
+ *
+ * Stores @cpu in IA32_TSC_AUX, which RDTSCP returns in ECX.
+ */
+void vdso_init_cpu(int cpu) {
+    if (vdso_pages != NULL && (vdso_data()->flags & VDSO_F_RDTSCP)) {
+        arch_msr_write(MSR_IA32_TSC_AUX, (uint64_t)cpu);
+    }
+}
+
+/**
+ * vdso_update_clock - Publish the TSC to CLOCK_MONOTONIC conversion
+ * @tsc_epoch: TSC value at time zero
+ * @ns_mult: Nanoseconds per cycle, 32.32 fixed point
+ *
+ * Single writer; readers retry across the update.
+ */
+void vdso_update_clock(uint64_t tsc_epoch, uint64_t ns_mult) {
+    struct vdso_data *d;
+
+    if (vdso_pages == NULL) {
+        return;
+    }
+    d = vdso_data();
+
+    __atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELAXED);
+    smp_wmb();
+    __atomic_store_n(&d->tsc_epoch, tsc_epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->ns_mult, ns_mult, __ATOMIC_RELAXED);
+    smp_wmb();
+    __atomic_store_n(&d->seq, d->seq + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * vdso_map - Map the vDSO into a new address space
+ * @as: Address space
+ * @pid: PID getpid reports in it
+ *
+ * Returns: 0 on success, negative error code on failure (the caller
+ *          destroys @as, which frees whatever was mapped)
+ */
+int vdso_map(address_space_t *as, int pid) {
+    struct vdso_proc *proc;
+    int ret;
+
+    if (vdso_pages == NULL) {
+        return -12;  /* ENOMEM */
+    }
+
+    ret = vm_map_region(as, VDSO_VVAR_BASE, (uint64_t)vdso_pages, PAGE_SIZE,
+                        PT_PRESENT | PT_USER | PT_NX, VM_REGION_VDSO, "vvar");
+    if (ret != 0) {
+        return ret;
+    }
+    ret = vm_map_region(as, VDSO_TEXT_BASE, (uint64_t)vdso_pages + PAGE_SIZE, PAGE_SIZE,
+                        PT_PRESENT | PT_USER, VM_REGION_VDSO, "vdso");
+    if (ret != 0) {
+        return ret;
+    }
+
+    proc = pmm_alloc(0);
+    if (proc == NULL) {
+        return -12;  /* ENOMEM */
+    }
+    memset(proc, 0, PAGE_SIZE);
+    proc->pid = pid;
+
+    ret = vm_map_region(as, VDSO_PROC_BASE, (uint64_t)proc, PAGE_SIZE,
+                        PT_PRESENT | PT_USER | PT_NX, VM_REGION_VDSO, "vproc");
+    if (ret != 0) {
+        pmm_free(proc, 0);
+        return ret;
+    }
+
+    /* Freed with the address space */
+    vm_find_region(as, VDSO_PROC_BASE)->page_order = 0;
+    return 0;
+}
+
+/**
+ * vdso_set_pid - Change the PID getpid reports in an address space
+ * @as: Address space mapped with vdso_map()
+ * @pid: New PID
+ */
+void vdso_set_pid(address_space_t *as, int pid) {
+    vm_region_t *region = vm_find_region(as, VDSO_PROC_BASE);
+
+    if (region != NULL) {
+        __atomic_store_n(&((struct vdso_proc *)region->phys_base)->pid, pid,
+                         __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * vdso_text - Get the kernel address of the shared text page
+ *
+ * Returns: Text page, or NULL if vdso_init() failed
+ */
+void *vdso_text(void) {
+    return vdso_pages != NULL ? vdso_pages + PAGE_SIZE : NULL;
+}
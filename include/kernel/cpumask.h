@@ -0,0 +1,83 @@
+/* Emergence Kernel - CPU masks
+ *
+ * A set of CPU indices, one bit per CPU. The kernel supports far fewer
+ * than 64 CPUs, so a mask is a single word and is passed by value.
+ */
+
+#ifndef _KERNEL_CPUMASK_H
+#define _KERNEL_CPUMASK_H
+
+#include <stdint.h>
+
+typedef uint64_t cpumask_t;
+
+/* Highest number of CPUs a mask can describe */
+#define CPUMASK_MAX_CPUS    64
+
+#define CPU_MASK_NONE       ((cpumask_t)0)
+#define CPU_MASK_ALL        (~(cpumask_t)0)
+
+/* Mask containing only @cpu */
+#define cpumask_of(cpu)     ((cpumask_t)1 << (cpu))
+
+/* Mask of CPUs 0..@nr-1 */
+#define cpumask_first_n(nr) \
+    ((nr) >= CPUMASK_MAX_CPUS ? CPU_MASK_ALL : cpumask_of(nr) - 1)
+
+/**
+ * cpumask_test_cpu - Check whether a CPU is in a mask
+ * @cpu: CPU index
+ * @mask: Mask
+ *
+ * Returns: Non-zero if @cpu is set
+ */
+static inline int cpumask_test_cpu(int cpu, cpumask_t mask) {
+    return cpu >= 0 && cpu < CPUMASK_MAX_CPUS && (mask & cpumask_of(cpu)) != 0;
+}
+
+/**
+ * cpumask_set_cpu - Add a CPU to a mask
+ * @cpu: CPU index (below CPUMASK_MAX_CPUS)
+ * @mask: Mask to update
+ */
+static inline void cpumask_set_cpu(int cpu, cpumask_t *mask) {
+    *mask |= cpumask_of(cpu);
+}
+
+/**
+ * cpumask_clear_cpu - Remove a CPU from a mask
+ * @cpu: CPU index (below CPUMASK_MAX_CPUS)
+ * @mask: Mask to update
+ */
+static inline void cpumask_clear_cpu(int cpu, cpumask_t *mask) {
+    *mask &= ~cpumask_of(cpu);
+}
+
+/**
+ * cpumask_first - Get the lowest CPU in a mask
+ * @mask: Mask
+ *
+ * Returns: CPU index, or -1 if @mask is empty
+ */
+static inline int cpumask_first(cpumask_t mask) {
+    return mask != 0 ? __builtin_ctzll(mask) : -1;
+}
+
+/**
+ * cpumask_weight - Count the CPUs in a mask
+ * @mask: Mask
+ *
+ * Returns: Number of CPUs set
+ */
+static inline int cpumask_weight(cpumask_t mask) {
+    int n = 0;
+
+    /* Clear the lowest bit per step: no popcount instruction is assumed */
+    while (mask != 0) {
+        mask &= mask - 1;
+        n++;
+    }
+    return n;
+}
+
+#endif /* _KERNEL_CPUMASK_H */
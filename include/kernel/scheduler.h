@@ -8,6 +8,7 @@
 #define _KERNEL_SCHEDULER_H
 
 #include "include/kernel/thread.h"
+#include "include/kernel/cpumask.h"
 
 /* ============================================================================
  * Scheduler Lifecycle API
@@ -16,7 +17,7 @@
 /**
  * scheduler_init - Initialize the scheduler
  *
- * Creates the global runqueue and per-CPU idle threads.
+ * Creates the per-CPU runqueues and per-CPU idle threads.
  * Must be called after thread_init() and smp_init().
  */
 void scheduler_init(void);
@@ -37,30 +38,67 @@ void scheduler_start(void) __attribute__((noreturn));
 /**
  * schedule - Perform a context switch
  *
- * Picks the next thread from the runqueue and switches to it.
- * If no threads are available, runs the idle thread.
- * Must be called with interrupts disabled.
+ * Re-queues the current thread if it is still runnable, then switches
+ * to the thread with the smallest virtual runtime. If no threads are
+ * available, runs the idle thread.
  */
 void schedule(void);
 
 /**
- * scheduler_add_thread - Add a thread to the runqueue
+ * schedule_tail - Finish a context switch on the new thread's stack
+ *
+ * Releases the previous thread so other CPUs may run or steal it.
+ * Called after context_switch() returns and by freshly created threads
+ * before their entry function runs.
+ */
+void schedule_tail(void);
+
+/**
+ * scheduler_add_thread - Add a thread to a runqueue
  * @t: Thread to add (will be set to READY state)
  *
- * Adds the thread to the back of the FIFO queue.
+ * Queues the thread on a CPU allowed by its affinity: the one it last ran
+ * on if that is idle or still cache hot, else an idle current CPU, else
+ * the least loaded one. The chosen CPU is sent a reschedule IPI if the
+ * thread should preempt what it runs.
  * Safe to call from interrupt context.
  */
 void scheduler_add_thread(thread_t *t);
 
 /**
- * scheduler_remove_thread - Remove a thread from the runqueue
+ * scheduler_remove_thread - Remove a thread from its runqueue
  * @t: Thread to remove
  *
- * Removes the thread from the runqueue.
+ * Removes the thread from whichever runqueue currently holds it.
+ * Does nothing if the thread is not queued.
  * Safe to call from interrupt context.
  */
 void scheduler_remove_thread(thread_t *t);
 
+/**
+ * wake_up_thread - Make a blocked thread runnable
+ * @t: Thread to wake
+ *
+ * Cancels the sleep of a thread that set THREAD_BLOCKED but has not yet
+ * switched out, otherwise queues it on the CPU chosen as for
+ * scheduler_add_thread() and preempts that CPU if it should.
+ * Safe to call from interrupt context.
+ *
+ * Returns: 1 if the thread was woken, 0 if it was not blocked
+ */
+int wake_up_thread(thread_t *t);
+
+/**
+ * scheduler_switch_address_space - Load the current thread's address space
+ *
+ * A context switch loads the page table of the process the next thread
+ * belongs to, or the kernel's for a kernel thread. A thread whose ->as
+ * changes while it runs calls this to get the same: execve after
+ * installing the new program, a kernel thread leaving a process's
+ * address space before dropping its reference.
+ */
+void scheduler_switch_address_space(void);
+
 /* ============================================================================
  * Scheduler Tick API
  * ============================================================================ */
@@ -68,11 +106,37 @@ void scheduler_remove_thread(thread_t *t);
 /**
  * scheduler_tick - Called from timer interrupt
  *
- * Called every timer tick to check if a context switch is needed.
- * Triggers schedule() at configured intervals.
+ * Charges the running thread for the elapsed time and requests a
+ * reschedule once it has used up its fair slice. Also periodically
+ * rebalances this CPU's runqueue against the busiest one.
  */
 void scheduler_tick(void);
 
+/**
+ * scheduler_irq_exit - Reschedule on the way out of an interrupt or syscall
+ *
+ * Called by the interrupt and syscall return paths after the handler (and
+ * the APIC EOI) is done. Preempts the running thread if this CPU's
+ * need_resched flag was set by the tick, a wakeup or a reschedule IPI.
+ */
+void scheduler_irq_exit(void);
+
+/* Tick period while a CPU has work to account (100 Hz) */
+#define SCHED_TICK_NS   10000000ULL
+
+/**
+ * scheduler_next_event_ns - Time until this CPU's scheduler needs a tick
+ *
+ * Used by the NO_HZ timer to program the next one-shot interrupt instead
+ * of ticking periodically. A busy CPU needs a tick when the running
+ * thread's slice expires; an idle CPU needs none while no CPU has
+ * queued work it could pull.
+ *
+ * Returns: Nanoseconds until the next tick (at most SCHED_TICK_NS),
+ *          or 0 if the tick can be stopped
+ */
+uint64_t scheduler_next_event_ns(void);
+
 /* ============================================================================
  * Scheduler Query API
  * ============================================================================ */
@@ -80,10 +144,159 @@ void scheduler_tick(void);
 /**
  * scheduler_get_nr_running - Get number of runnable threads
  *
- * Returns: Number of threads in the runqueue
+ * Returns: Number of queued threads summed over all CPUs
  */
 int scheduler_get_nr_running(void);
 
+/**
+ * scheduler_get_nr_running_cpu - Get number of runnable threads on a CPU
+ * @cpu: CPU index
+ *
+ * Returns: Number of threads queued on the CPU's runqueue, or 0 if invalid
+ */
+int scheduler_get_nr_running_cpu(int cpu);
+
+/**
+ * scheduler_get_nr_migrations - Get total number of thread migrations
+ *
+ * Returns: Number of threads moved between runqueues by the load balancer
+ */
+uint64_t scheduler_get_nr_migrations(void);
+
+/* ============================================================================
+ * Statistics API (CONFIG_SCHEDSTATS)
+ * ============================================================================ */
+
+/* Snapshot of one CPU's scheduler statistics; times in nanoseconds */
+struct sched_cpu_stats {
+    uint64_t tsc;                   /* TSC when the snapshot was taken */
+    uint64_t clock_ns;              /* sched_clock() when it was taken */
+    uint64_t nr_switches;           /* Context switches */
+    uint64_t idle_time_ns;          /* Time spent running the idle thread */
+    uint64_t rq_len_sum;            /* nr_running integrated over time (thread-ns) */
+    int nr_running;                 /* Threads queued right now */
+    int nr_running_max;             /* Longest queue seen */
+};
+
+/* Snapshot of one thread's scheduler statistics; times in nanoseconds */
+struct sched_thread_stats {
+    uint64_t tsc;                   /* TSC when the snapshot was taken */
+    uint64_t runtime_ns;            /* CPU time consumed */
+    uint64_t wait_sum_ns;           /* Total enqueue->run delay */
+    uint64_t wait_max_ns;           /* Longest enqueue->run delay */
+    uint64_t wait_count;            /* Number of delays measured */
+    uint64_t wait_current_ns;       /* Delay so far if queued right now */
+    uint64_t nr_voluntary_switches; /* Switched out by blocking or yielding */
+    uint64_t nr_involuntary_switches; /* Switched out by preemption */
+    int tid;                        /* Thread ID */
+    int cpu;                        /* Last CPU */
+};
+
+/**
+ * sched_get_cpu_stats - Take a snapshot of a CPU's statistics
+ * @cpu: CPU index
+ * @st: Filled in on success
+ *
+ * The average runqueue length since boot is rq_len_sum / clock_ns.
+ *
+ * Returns: 0 on success, -1 if @cpu is invalid or statistics are disabled
+ */
+int sched_get_cpu_stats(int cpu, struct sched_cpu_stats *st);
+
+/**
+ * sched_get_thread_stats - Take a snapshot of a thread's statistics
+ * @t: Thread
+ * @st: Filled in on success
+ *
+ * Returns: 0 on success, -1 if @t is NULL or statistics are disabled
+ */
+int sched_get_thread_stats(thread_t *t, struct sched_thread_stats *st);
+
+/**
+ * sched_dump_stats - Log statistics of every CPU and live thread
+ *
+ * Prints one "SCHEDSTAT cpu=..." line per CPU and one "SCHEDSTAT tid=..."
+ * line per thread as key=value pairs, for tests/sched/sched_test.py.
+ */
+void sched_dump_stats(void);
+
+/* ============================================================================
+ * Priority API
+ * ============================================================================ */
+
+/* Nice value range - lower is higher priority, each step is ~10% CPU share */
+#define NICE_MIN    (-20)
+#define NICE_MAX    19
+
+/* Scheduling policies */
+#define SCHED_NORMAL    0   /* Fair class, weighted by nice */
+#define SCHED_FIFO      1   /* Real-time, runs until it blocks or yields */
+#define SCHED_RR        2   /* Real-time, round-robin within a priority */
+
+/* Real-time priority range - higher runs first, any RT beats SCHED_NORMAL */
+#define SCHED_RT_PRIO_MIN   0
+#define SCHED_RT_PRIO_MAX   99
+#define SCHED_RT_PRIO_NR    (SCHED_RT_PRIO_MAX - SCHED_RT_PRIO_MIN + 1)
+
+/**
+ * sched_setscheduler - Change the scheduling policy of a thread
+ * @t: Thread
+ * @policy: SCHED_NORMAL, SCHED_FIFO or SCHED_RR
+ * @prio: RT priority (SCHED_RT_PRIO_MIN..MAX), must be 0 for SCHED_NORMAL
+ *
+ * Moves the thread between classes, re-queuing it if needed.
+ *
+ * Returns: 0 on success, -1 on invalid policy or priority
+ */
+int sched_setscheduler(thread_t *t, int policy, int prio);
+
+/**
+ * sched_getscheduler - Get the scheduling policy of a thread
+ * @t: Thread
+ *
+ * Returns: SCHED_NORMAL, SCHED_FIFO or SCHED_RR
+ */
+int sched_getscheduler(thread_t *t);
+
+/**
+ * sched_set_nice - Set the nice value of a thread
+ * @t: Thread
+ * @nice: New nice value (NICE_MIN..NICE_MAX)
+ *
+ * Takes effect immediately, including for queued threads.
+ *
+ * Returns: 0 on success, -1 if @nice is out of range
+ */
+int sched_set_nice(thread_t *t, int nice);
+
+/**
+ * sched_get_nice - Get the nice value of a thread
+ * @t: Thread
+ *
+ * Returns: Nice value
+ */
+int sched_get_nice(thread_t *t);
+
+/**
+ * sched_setaffinity - Restrict the CPUs a thread may run on
+ * @t: Thread
+ * @mask: Allowed CPUs; must include at least one online CPU
+ *
+ * New threads may run anywhere; forked threads inherit their parent's
+ * mask. A thread on a CPU outside @mask is moved off it.
+ *
+ * Returns: 0 on success, -1 if @mask has no online CPU
+ */
+int sched_setaffinity(thread_t *t, cpumask_t mask);
+
+/**
+ * sched_getaffinity - Get the CPUs a thread may run on
+ * @t: Thread
+ *
+ * Returns: Affinity mask limited to online CPUs
+ */
+cpumask_t sched_getaffinity(thread_t *t);
+
 /**
  * scheduler_get_idle_thread - Get the idle thread for a CPU
  * @cpu: CPU index
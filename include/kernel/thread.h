@@ -27,6 +27,13 @@ typedef enum {
 /* Thread flags */
 #define THREAD_FLAG_KERNEL  0x0001  /* Kernel thread (vs user thread) */
 #define THREAD_FLAG_USER    0x0002  /* User thread (ring 3) */
+#define THREAD_FLAG_SCHED_FIFO  0x0004  /* Start in the real-time FIFO class */
+#define THREAD_FLAG_SCHED_RR    0x0008  /* Start in the real-time round-robin class */
+
+/* Real-time priority (0..99, higher runs first) for THREAD_FLAG_SCHED_* */
+#define THREAD_FLAG_RT_PRIO_SHIFT   16
+#define THREAD_FLAG_RT_PRIO(prio)   (((prio) & 0x7F) << THREAD_FLAG_RT_PRIO_SHIFT)
+#define THREAD_FLAG_GET_RT_PRIO(f)  (((f) >> THREAD_FLAG_RT_PRIO_SHIFT) & 0x7F)
 
 /* Default stack size (16KB = 4 pages) */
 #define THREAD_DEFAULT_STACK_SIZE 16384
@@ -77,6 +84,14 @@ void thread_exit(void) __attribute__((noreturn));
  */
 void thread_yield(void);
 
+/**
+ * thread_sleep_ns - Sleep for a number of nanoseconds
+ * @ns: Time to sleep
+ *
+ * Blocks the current thread on a high-resolution timer.
+ */
+void thread_sleep_ns(uint64_t ns);
+
 /**
  * thread_destroy - Free thread resources
  * @t: Thread to destroy
@@ -115,6 +130,22 @@ void thread_set_current(thread_t *t);
  */
 int thread_get_tid(thread_t *t);
 
+/**
+ * thread_find_by_tid - Look up a live thread by ID
+ * @tid: Thread ID
+ *
+ * The caller must drop the reference with thread_put().
+ *
+ * Returns: Referenced thread, or NULL if no live thread has that ID
+ */
+thread_t *thread_find_by_tid(int tid);
+
+/**
+ * thread_put - Drop a reference from thread_find_by_tid()
+ * @t: Thread (may be NULL)
+ */
+void thread_put(thread_t *t);
+
 /**
  * thread_get_state - Get thread state
  * @t: Thread to query
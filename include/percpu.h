@@ -0,0 +1,67 @@
+/* Emergence Kernel - Per-CPU variables
+ *
+ * DEFINE_PER_CPU() places a variable in the .data..percpu section. The
+ * linker gathers that section into a template (__per_cpu_start to
+ * __per_cpu_end), and setup_per_cpu_areas() gives every CPU its own copy
+ * of it before anything else runs. __per_cpu_offset[cpu] is the distance
+ * from the template to CPU @cpu's copy.
+ *
+ * The template itself belongs to no CPU: a per-CPU variable must only be
+ * used through the accessors below, never by name.
+ *
+ *   this_cpu_read(var), this_cpu_write(var, val), this_cpu_add(var, val),
+ *   this_cpu_inc(var), this_cpu_dec(var)
+ *       Current CPU's copy of a scalar, each a single instruction that
+ *       cannot be split by an interrupt or a migration. @var must be the
+ *       plain name of a file-scope per-CPU variable.
+ *   this_cpu_ptr(&var)
+ *       Pointer to the current CPU's copy. Stays valid only while the
+ *       thread cannot migrate (preemption or interrupts disabled).
+ *   per_cpu_ptr(&var, cpu), per_cpu(var, cpu)
+ *       Another CPU's copy.
+ */
+
+#ifndef _KERNEL_PERCPU_H
+#define _KERNEL_PERCPU_H
+
+#include <stdint.h>
+
+#define PER_CPU_SECTION ".data..percpu"
+
+/* Define a per-CPU variable; may be preceded by static */
+#define DEFINE_PER_CPU(type, name) \
+    __attribute__((section(PER_CPU_SECTION), used)) __typeof__(type) name
+
+/* Declare a per-CPU variable defined in another file */
+#define DECLARE_PER_CPU(type, name) \
+    extern __attribute__((section(PER_CPU_SECTION))) __typeof__(type) name
+
+/* Template bounds (linker script) and each CPU's offset from it */
+extern char __per_cpu_start[], __per_cpu_end[];
+extern uint64_t __per_cpu_offset[];
+
+/* Include architecture-specific this_cpu_*() accessors */
+#ifdef __x86_64__
+#include "arch/x86_64/percpu_arch.h"
+#else
+#error "Unsupported architecture"
+#endif
+
+/* This CPU's entry of __per_cpu_offset[] */
+DECLARE_PER_CPU(uint64_t, this_cpu_off);
+
+#define per_cpu_ptr(ptr, cpu) \
+    ((__typeof__(ptr))((uintptr_t)(ptr) + __per_cpu_offset[(cpu)]))
+
+#define per_cpu(var, cpu)   (*per_cpu_ptr(&(var), (cpu)))
+
+#define this_cpu_ptr(ptr) \
+    ((__typeof__(ptr))((uintptr_t)(ptr) + this_cpu_read(this_cpu_off)))
+
+#define this_cpu_inc(var)   this_cpu_add(var, 1)
+#define this_cpu_dec(var)   this_cpu_add(var, -1)
+
+/* Copy the template for every CPU (arch/x86_64/smp.c) */
+void setup_per_cpu_areas(void);
+
+#endif /* _KERNEL_PERCPU_H */
@@ -0,0 +1,77 @@
+/* Emergence Kernel - Kernel preemption control
+ *
+ * Every CPU keeps a preempt_count. While it is non-zero the thread running
+ * on that CPU must not be switched out: spin locks and nesting-aware
+ * interrupt-disable sections (irq_disable(), irq_save()) raise it for as
+ * long as they are held, and code may raise it directly around per-CPU
+ * state with preempt_disable().
+ *
+ * A thread is preempted only when the count is zero and interrupts are
+ * enabled: on the way out of an interrupt (scheduler_irq_exit()), or when
+ * preempt_enable() drops the count to zero with a reschedule pending.
+ */
+
+#ifndef _KERNEL_PREEMPT_H
+#define _KERNEL_PREEMPT_H
+
+#include "include/barrier.h"
+
+#ifdef __x86_64__
+#include "arch/x86_64/preempt_arch.h"
+#else
+#error "Unsupported architecture"
+#endif
+
+/* Reschedule if one is pending and we may (kernel/scheduler.c) */
+void preempt_schedule(void);
+
+/**
+ * preempt_count - Get the current CPU's preemption count
+ *
+ * Returns: 0 if the current thread may be preempted
+ */
+static inline int preempt_count(void) {
+    return arch_preempt_count();
+}
+
+/**
+ * preempt_disable - Stop the current thread from being switched out
+ *
+ * Nests; each call must be matched by preempt_enable().
+ */
+static inline void preempt_disable(void) {
+    arch_preempt_count_add(1);
+    barrier();
+}
+
+/**
+ * preempt_enable_no_resched - Undo preempt_disable() without rescheduling
+ *
+ * For paths that reschedule by other means right afterwards.
+ */
+static inline void preempt_enable_no_resched(void) {
+    barrier();
+    arch_preempt_count_add(-1);
+}
+
+/**
+ * preempt_enable - Undo preempt_disable()
+ *
+ * Preemption point: switches away right here if the count drops to zero
+ * while a reschedule is pending.
+ */
+static inline void preempt_enable(void) {
+    barrier();
+    if (arch_preempt_count_dec_and_test()) {
+        preempt_schedule();
+    }
+}
+
+/**
+ * preemptible - Check whether the current thread may be switched out
+ */
+static inline int preemptible(void) {
+    return preempt_count() == 0 && arch_irqs_enabled();
+}
+
+#endif /* _KERNEL_PREEMPT_H */
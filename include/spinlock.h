@@ -10,6 +10,8 @@ typedef struct arch_spinlock spinlock_t;
 typedef struct arch_rwlock rwlock_t;
 typedef unsigned long irq_flags_t;
 
+#include "include/preempt.h"
+
 /* Include architecture-specific implementation */
 #ifdef __x86_64__
 #include "arch/x86_64/spinlock_arch.h"
@@ -33,9 +35,11 @@ static inline void spin_lock_init(spinlock_t *lock) {
  * spin_lock - Acquire a spin lock
  * @lock: Lock to acquire
  *
- * Spins until the lock becomes available.
+ * Spins until the lock becomes available. The holder cannot be
+ * preempted until it releases the lock.
  */
 static inline void spin_lock(spinlock_t *lock) {
+    preempt_disable();
     arch_spin_lock(lock);
 }
 
@@ -45,6 +49,7 @@ static inline void spin_lock(spinlock_t *lock) {
  */
 static inline void spin_unlock(spinlock_t *lock) {
     arch_spin_unlock(lock);
+    preempt_enable();
 }
 
 /**
@@ -54,7 +59,12 @@ static inline void spin_unlock(spinlock_t *lock) {
  * Returns: 1 if lock was acquired, 0 if lock is already held
  */
 static inline int spin_trylock(spinlock_t *lock) {
-    return arch_spin_trylock(lock);
+    preempt_disable();
+    if (arch_spin_trylock(lock)) {
+        return 1;
+    }
+    preempt_enable();
+    return 0;
 }
 
 /* ============================================================================
@@ -67,7 +77,8 @@ static inline int spin_trylock(spinlock_t *lock) {
  *
  * Saves the current interrupt state and disables interrupts before
  * acquiring the lock. Use this when the lock could be accessed from
- * interrupt context to prevent deadlocks.
+ * interrupt context to prevent deadlocks. Preemption stays disabled
+ * until the matching spin_unlock_irqrestore().
  *
  * Returns: Saved interrupt flags (scalar value)
  *
@@ -99,6 +110,7 @@ static inline void spin_unlock_irqrestore(spinlock_t *lock, irq_flags_t flags) {
  * Does not save interrupt state - use when you know interrupts were enabled.
  */
 static inline void spin_lock_irq(spinlock_t *lock) {
+    preempt_disable();
     arch_spin_lock_irq(lock);
 }
 
@@ -110,6 +122,7 @@ static inline void spin_lock_irq(spinlock_t *lock) {
  */
 static inline void spin_unlock_irq(spinlock_t *lock) {
     arch_spin_unlock_irq(lock);
+    preempt_enable();
 }
 
 /* ============================================================================
@@ -132,6 +145,7 @@ static inline void rwlock_init(rwlock_t *lock) {
  * Writers are excluded until all readers release the lock.
  */
 static inline void spin_read_lock(rwlock_t *lock) {
+    preempt_disable();
     arch_spin_read_lock(lock);
 }
 
@@ -141,6 +155,7 @@ static inline void spin_read_lock(rwlock_t *lock) {
  */
 static inline void spin_read_unlock(rwlock_t *lock) {
     arch_spin_read_unlock(lock);
+    preempt_enable();
 }
 
 /**
@@ -150,6 +165,7 @@ static inline void spin_read_unlock(rwlock_t *lock) {
  * Exclusive access - no readers or other writers allowed.
  */
 static inline void spin_write_lock(rwlock_t *lock) {
+    preempt_disable();
     arch_spin_write_lock(lock);
 }
 
@@ -159,6 +175,7 @@ static inline void spin_write_lock(rwlock_t *lock) {
  */
 static inline void spin_write_unlock(rwlock_t *lock) {
     arch_spin_write_unlock(lock);
+    preempt_enable();
 }
 
 /* ============================================================================
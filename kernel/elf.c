@@ -0,0 +1,134 @@
+/* Emergence Kernel - ELF64 program loader */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/elf.h"
+#include "kernel/vm.h"
+#include "kernel/pmm.h"
+#include "kernel/klog.h"
+#include "include/string.h"
+
+#define ENOEXEC     8
+
+/* Segments must end below the lowest stack a process may get */
+#define ELF_USER_END    (USER_STACK_BASE - USER_STACK_SIZE)
+
+/* Check the file header; returns 0 if @ehdr is a loadable x86_64 executable */
+static int elf_check_header(const elf64_ehdr_t *ehdr, size_t size) {
+    if (size < sizeof(*ehdr) ||
+        strncmp((const char *)ehdr->e_ident, ELF_MAGIC, sizeof(ELF_MAGIC) - 1) != 0) {
+        return -1;
+    }
+    if (ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+        ehdr->e_type != ET_EXEC || ehdr->e_machine != EM_X86_64) {
+        return -1;
+    }
+    if (ehdr->e_phentsize != sizeof(elf64_phdr_t) || ehdr->e_phoff > size ||
+        (size - ehdr->e_phoff) / sizeof(elf64_phdr_t) < ehdr->e_phnum) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * elf_map_segment - Map one PT_LOAD segment
+ * @as: Address space
+ * @image: Executable
+ * @size: Size of @image
+ * @ph: Program header
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+static int elf_map_segment(address_space_t *as, const uint8_t *image, size_t size,
+                           const elf64_phdr_t *ph) {
+    uint64_t lead = ph->p_vaddr & (PAGE_SIZE - 1);
+    uint64_t start = ph->p_vaddr - lead;
+    uint64_t end, phys, flags;
+    vm_region_type_t type;
+    const char *name;
+
+    if (ph->p_filesz > ph->p_memsz || ph->p_offset > size ||
+        ph->p_filesz > size - ph->p_offset ||
+        ph->p_vaddr >= ELF_USER_END || ph->p_memsz > ELF_USER_END - ph->p_vaddr) {
+        klog_warn("ELF", "Segment at %p lies outside the file or user space",
+                  (void *)ph->p_vaddr);
+        return -ENOEXEC;
+    }
+    end = (ph->p_vaddr + ph->p_memsz + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    /* Backing frames for the page at @start */
+    phys = (uint64_t)image + ph->p_offset - lead;
+    if ((phys & (PAGE_SIZE - 1)) != 0 || ph->p_offset < lead) {
+        klog_warn("ELF", "Segment at %p cannot share frames: offset %lX is not page-congruent",
+                  (void *)ph->p_vaddr, ph->p_offset);
+        return -ENOEXEC;
+    }
+
+    if (vm_find_region(as, start) != NULL || vm_find_region(as, end - 1) != NULL) {
+        klog_warn("ELF", "Segment at %p overlaps another", (void *)ph->p_vaddr);
+        return -ENOEXEC;
+    }
+
+    flags = PT_PRESENT | PT_USER;
+    if (ph->p_flags & PF_W) {
+        flags |= PT_WRITE;
+    }
+    if (!(ph->p_flags & PF_X)) {
+        flags |= PT_NX;
+    }
+
+    if (ph->p_flags & PF_X) {
+        type = VM_REGION_CODE;
+        name = "text";
+    } else if (ph->p_flags & PF_W) {
+        type = VM_REGION_DATA;
+        name = "data";
+    } else {
+        type = VM_REGION_RODATA;
+        name = "rodata";
+    }
+
+    return vm_map_backed_region(as, start, end - start, phys, lead + ph->p_filesz,
+                                flags, type, name);
+}
+
+/**
+ * elf_load - Map a static ELF64 executable into an address space
+ * @as: Address space
+ * @image: Executable
+ * @size: Size of @image in bytes
+ * @entry: Returns the entry point
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+int elf_load(address_space_t *as, const void *image, size_t size, uint64_t *entry) {
+    const elf64_ehdr_t *ehdr = image;
+    const elf64_phdr_t *ph;
+    int i, ret, nr_loaded = 0;
+
+    if (elf_check_header(ehdr, size) != 0) {
+        klog_warn("ELF", "Not a static x86_64 ELF executable");
+        return -ENOEXEC;
+    }
+
+    ph = (const elf64_phdr_t *)((const uint8_t *)image + ehdr->e_phoff);
+    for (i = 0; i < ehdr->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0) {
+            continue;
+        }
+        ret = elf_map_segment(as, image, size, &ph[i]);
+        if (ret != 0) {
+            return ret;
+        }
+        nr_loaded++;
+    }
+
+    if (nr_loaded == 0) {
+        klog_warn("ELF", "No loadable segments");
+        return -ENOEXEC;
+    }
+
+    *entry = ehdr->e_entry;
+    klog_debug("ELF", "Loaded %d segments, entry %p", nr_loaded, (void *)ehdr->e_entry);
+    return 0;
+}
@@ -0,0 +1,80 @@
+/* Emergence Kernel - ELF64 program loader
+ *
+ * Loads static x86_64 executables (ET_EXEC) into an address space
+ * without copying them: each PT_LOAD segment becomes a region backed by
+ * the frames holding the image, faulted in page by page (vm_fault()).
+ * Read-only segments stay shared with the image; writable ones are
+ * copied a page at a time on first write, and their .bss is zero-filled
+ * on demand.
+ *
+ * Sharing frames needs every segment's file offset to be congruent to
+ * its address modulo PAGE_SIZE (as ld lays them out) and the image to
+ * start on a page boundary (as the initramfs lays it out).
+ */
+
+#ifndef _KERNEL_ELF_H
+#define _KERNEL_ELF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/vm.h"
+
+/* e_ident */
+#define ELF_MAGIC       "\177ELF"
+#define EI_CLASS        4
+#define EI_DATA         5
+#define ELFCLASS64      2
+#define ELFDATA2LSB     1
+
+/* e_type and e_machine */
+#define ET_EXEC         2
+#define EM_X86_64       62
+
+/* p_type and p_flags */
+#define PT_LOAD         1
+#define PF_X            (1 << 0)
+#define PF_W            (1 << 1)
+#define PF_R            (1 << 2)
+
+typedef struct elf64_ehdr {
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;               /* Entry point */
+    uint64_t e_phoff;               /* Program header table offset */
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;           /* Size of one program header */
+    uint16_t e_phnum;               /* Number of program headers */
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} elf64_ehdr_t;
+
+typedef struct elf64_phdr {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;              /* Segment offset in the file */
+    uint64_t p_vaddr;               /* Segment address */
+    uint64_t p_paddr;
+    uint64_t p_filesz;              /* Bytes in the file */
+    uint64_t p_memsz;               /* Bytes in memory (rest is .bss) */
+    uint64_t p_align;
+} elf64_phdr_t;
+
+/**
+ * elf_load - Map a static ELF64 executable into an address space
+ * @as: Address space, with no regions where the segments go
+ * @image: Executable, page-aligned and identity-mapped; must outlive @as
+ * @size: Size of @image in bytes
+ * @entry: Returns the entry point
+ *
+ * Returns: 0 on success, -8 (ENOEXEC) if @image is not a loadable
+ *          executable, or another negative error code. On failure @as
+ *          may hold some of the segments.
+ */
+int elf_load(address_space_t *as, const void *image, size_t size, uint64_t *entry);
+
+#endif /* _KERNEL_ELF_H */
@@ -0,0 +1,205 @@
+/* Emergence Kernel - Per-process file descriptor tables */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/fdtable.h"
+#include "kernel/slab.h"
+#include "kernel/klog.h"
+#include "include/string.h"
+
+#define FDTABLE_CHUNK_BYTES (FDTABLE_CHUNK_FDS * sizeof(process_fd_t))
+
+/* Entry for @fd, or NULL if its chunk does not exist */
+static process_fd_t *fdtable_slot(struct fdtable *t, int fd) {
+    process_fd_t *chunk;
+
+    if (fd < 0 || fd >= PROCESS_MAX_FDS) {
+        return NULL;
+    }
+    if (fd < FDTABLE_INLINE_FDS) {
+        return &t->fd_inline[fd];
+    }
+
+    fd -= FDTABLE_INLINE_FDS;
+    chunk = t->chunks[fd / FDTABLE_CHUNK_FDS];
+    return chunk != NULL ? &chunk[fd % FDTABLE_CHUNK_FDS] : NULL;
+}
+
+/* Entry for @fd, allocating its chunk if needed */
+static process_fd_t *fdtable_slot_alloc(struct fdtable *t, int fd) {
+    process_fd_t *slot = fdtable_slot(t, fd);
+    int index;
+
+    if (slot != NULL || fd < FDTABLE_INLINE_FDS || fd >= PROCESS_MAX_FDS) {
+        return slot;
+    }
+
+    index = (fd - FDTABLE_INLINE_FDS) / FDTABLE_CHUNK_FDS;
+    t->chunks[index] = slab_alloc_size(FDTABLE_CHUNK_BYTES);
+    if (t->chunks[index] == NULL) {
+        return NULL;
+    }
+    memset(t->chunks[index], 0, FDTABLE_CHUNK_BYTES);
+    return fdtable_slot(t, fd);
+}
+
+/**
+ * fdtable_alloc - Allocate an empty descriptor table
+ *
+ * Returns: Table with one reference, or NULL if out of memory
+ */
+struct fdtable *fdtable_alloc(void) {
+    struct fdtable *t = slab_alloc_size(sizeof(*t));
+
+    if (t == NULL) {
+        return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+    t->refcount = 1;
+    return t;
+}
+
+/**
+ * fdtable_share - Take another reference to a table
+ * @t: Table of the forking process
+ *
+ * Returns: @t, now shared until either side changes it
+ */
+struct fdtable *fdtable_share(struct fdtable *t) {
+    __atomic_add_fetch(&t->refcount, 1, __ATOMIC_RELAXED);
+    return t;
+}
+
+/**
+ * fdtable_put - Drop a reference to a table
+ * @t: Table (may be NULL)
+ *
+ * The last reference frees the table and its chunks.
+ */
+void fdtable_put(struct fdtable *t) {
+    int i;
+
+    if (t == NULL || __atomic_sub_fetch(&t->refcount, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    for (i = 0; i < FDTABLE_NR_CHUNKS; i++) {
+        if (t->chunks[i] != NULL) {
+            slab_free_size(t->chunks[i], FDTABLE_CHUNK_BYTES);
+        }
+    }
+    slab_free_size(t, sizeof(*t));
+}
+
+/**
+ * fdtable_unshare - Give the caller a private table
+ * @tp: Caller's table pointer, replaced by a copy if the table is shared
+ *
+ * Shared tables are never written, so the copy needs no lock. Only
+ * chunks holding open descriptors are copied.
+ *
+ * Returns: 0 on success, -1 if out of memory (*@tp unchanged)
+ */
+int fdtable_unshare(struct fdtable **tp) {
+    struct fdtable *old = *tp, *new;
+    process_fd_t *src, *dst;
+    int fd;
+
+    if (__atomic_load_n(&old->refcount, __ATOMIC_ACQUIRE) == 1) {
+        return 0;
+    }
+
+    new = fdtable_alloc();
+    if (new == NULL) {
+        return -1;
+    }
+
+    for (fd = 0; fd < PROCESS_MAX_FDS; fd++) {
+        src = fdtable_slot(old, fd);
+        if (src == NULL || src->file == NULL) {
+            continue;
+        }
+        dst = fdtable_slot_alloc(new, fd);
+        if (dst == NULL) {
+            fdtable_put(new);
+            return -1;
+        }
+        *dst = *src;
+    }
+    new->nr_open = old->nr_open;
+    new->next_fd = old->next_fd;
+
+    *tp = new;
+    fdtable_put(old);
+    return 0;
+}
+
+/**
+ * fdtable_install - Open a descriptor
+ * @t: Private table (see fdtable_unshare())
+ * @file: Object the descriptor refers to (must not be NULL)
+ * @flags: Descriptor flags
+ *
+ * Returns: Lowest free descriptor, or -1 if the table is full or out of memory
+ */
+int fdtable_install(struct fdtable *t, void *file, int flags) {
+    process_fd_t *slot;
+    int fd;
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    for (fd = t->next_fd; fd < PROCESS_MAX_FDS; fd++) {
+        slot = fdtable_slot_alloc(t, fd);
+        if (slot == NULL) {
+            klog_warn("FD", "No memory for descriptor %d", fd);
+            return -1;
+        }
+        if (slot->file == NULL) {
+            slot->file = file;
+            slot->flags = flags;
+            slot->refcount = 1;
+            t->nr_open++;
+            t->next_fd = fd + 1;
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/**
+ * fdtable_close - Close a descriptor
+ * @t: Private table (see fdtable_unshare())
+ * @fd: Descriptor
+ *
+ * Returns: 0 on success, -1 if @fd is not open
+ */
+int fdtable_close(struct fdtable *t, int fd) {
+    process_fd_t *slot = fdtable_slot(t, fd);
+
+    if (slot == NULL || slot->file == NULL) {
+        return -1;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    t->nr_open--;
+    if (fd < t->next_fd) {
+        t->next_fd = fd;
+    }
+    return 0;
+}
+
+/**
+ * fdtable_lookup - Get an open descriptor's entry
+ * @t: Table
+ * @fd: Descriptor
+ *
+ * Returns: Entry, valid until the table is next changed, or NULL if
+ *          @fd is not open
+ */
+process_fd_t *fdtable_lookup(struct fdtable *t, int fd) {
+    process_fd_t *slot = fdtable_slot(t, fd);
+
+    return slot != NULL && slot->file != NULL ? slot : NULL;
+}
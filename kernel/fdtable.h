@@ -0,0 +1,77 @@
+/* Emergence Kernel - Per-process file descriptor tables
+ *
+ * A table holds a few descriptors inline and grows in chunks:
+ *
+ *   fd < FDTABLE_INLINE_FDS   ->  fd_inline[fd]
+ *   otherwise                 ->  chunks[(fd - INLINE) / CHUNK][(fd - INLINE) % CHUNK]
+ *
+ * so a process with a handful of open files costs one small allocation,
+ * and chunks appear only as higher descriptors are opened.
+ *
+ * fork() shares the parent's table and counts the reference. A shared
+ * table is never modified: whoever changes it first makes a private
+ * copy (fdtable_unshare()), so sharing needs no lock on the table. The
+ * owning process serializes its own changes (process_t.fd_lock).
+ */
+
+#ifndef _KERNEL_FDTABLE_H
+#define _KERNEL_FDTABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Maximum number of open file descriptors per process */
+#define PROCESS_MAX_FDS  256
+
+/* Table geometry */
+#define FDTABLE_INLINE_FDS  8
+#define FDTABLE_CHUNK_FDS   64
+#define FDTABLE_NR_CHUNKS \
+    ((PROCESS_MAX_FDS - FDTABLE_INLINE_FDS + FDTABLE_CHUNK_FDS - 1) / FDTABLE_CHUNK_FDS)
+
+/**
+ * struct process_fd - File descriptor entry
+ * @flags: File descriptor flags (close-on-exec, etc.)
+ * @refcount: Reference count for dup()
+ * @file: Pointer to file structure (when VFS is implemented)
+ *
+ * Tracks open file descriptors for a process. An entry is in use while
+ * @file is non-NULL. For now, this is a stub until full VFS is
+ * implemented.
+ */
+typedef struct process_fd {
+    int flags;
+    int refcount;
+    void *file;  /* Will be struct file * when VFS exists */
+} process_fd_t;
+
+struct fdtable {
+    int refcount;                   /* Processes sharing it (atomic) */
+    int nr_open;                    /* Entries in use */
+    int next_fd;                    /* No free entry below this */
+    process_fd_t fd_inline[FDTABLE_INLINE_FDS];
+    process_fd_t *chunks[FDTABLE_NR_CHUNKS];    /* FDTABLE_CHUNK_FDS entries each */
+};
+
+/* Allocate an empty table with one reference */
+struct fdtable *fdtable_alloc(void);
+
+/* Take another reference for a forked child */
+struct fdtable *fdtable_share(struct fdtable *t);
+
+/* Drop a reference; the last one frees the table */
+void fdtable_put(struct fdtable *t);
+
+/* Make *@tp private to the caller before changing it; -1 if out of memory */
+int fdtable_unshare(struct fdtable **tp);
+
+/* Install @file at the lowest free descriptor of a private table; -1 if full */
+int fdtable_install(struct fdtable *t, void *file, int flags);
+
+/* Free descriptor @fd of a private table; -1 if it is not open */
+int fdtable_close(struct fdtable *t, int fd);
+
+/* Get the entry for an open @fd, or NULL */
+process_fd_t *fdtable_lookup(struct fdtable *t, int fd);
+
+#endif /* _KERNEL_FDTABLE_H */
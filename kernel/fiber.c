@@ -0,0 +1,271 @@
+/* Emergence Kernel - Kernel fibers
+ *
+ * A switched-out fiber's stack holds, from its saved RSP up:
+ *
+ *   r15, r14, r13, r12, rbx, rbp, return address
+ *
+ * which fiber_switch() (context.S) pops before returning into it. A new
+ * fiber's stack is built to look the same, returning into fiber_entry
+ * with the struct fiber in rbx.
+ *
+ * Fibers switch directly to the next runnable fiber. Only returning, or
+ * parking with nothing else runnable, goes back to the host thread.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/fiber.h"
+#include "kernel/pmm.h"
+#include "kernel/klog.h"
+#include "arch/x86_64/power.h"
+#include "include/spinlock.h"
+
+/* Assembly helpers - implemented in context.S */
+void fiber_switch(uint64_t *save_sp, uint64_t load_sp);
+void fiber_entry(void);
+
+/* Stack pool: free stacks are linked through their first word */
+static spinlock_t fiber_pool_lock = SPIN_LOCK_UNLOCKED;
+static void *free_fiber_stacks;
+static uint64_t nr_fiber_stacks;
+static uint64_t nr_free_fiber_stacks;
+
+/* Carve a fresh PMM block into stacks; called with fiber_pool_lock held */
+static void fiber_pool_grow(void) {
+    uint64_t base, end, stack;
+
+    base = (uint64_t)pmm_alloc(FIBER_CHUNK_ORDER);
+    if (base == 0) {
+        return;
+    }
+    end = base + ((uint64_t)PAGE_SIZE << FIBER_CHUNK_ORDER);
+
+    /* fiber_current() needs stacks aligned to their size */
+    stack = (base + FIBER_STACK_SIZE - 1) & ~(uint64_t)(FIBER_STACK_SIZE - 1);
+    for (; stack + FIBER_STACK_SIZE <= end; stack += FIBER_STACK_SIZE) {
+        *(void **)stack = free_fiber_stacks;
+        free_fiber_stacks = (void *)stack;
+        nr_fiber_stacks++;
+        nr_free_fiber_stacks++;
+    }
+}
+
+static void *fiber_stack_alloc(void) {
+    irq_flags_t flags;
+    void *stack;
+
+    flags = spin_lock_irqsave(&fiber_pool_lock);
+    if (free_fiber_stacks == NULL) {
+        fiber_pool_grow();
+    }
+    stack = free_fiber_stacks;
+    if (stack != NULL) {
+        free_fiber_stacks = *(void **)stack;
+        nr_free_fiber_stacks--;
+    }
+    spin_unlock_irqrestore(&fiber_pool_lock, flags);
+
+    return stack;
+}
+
+static void fiber_stack_free(void *stack) {
+    irq_flags_t flags;
+
+    flags = spin_lock_irqsave(&fiber_pool_lock);
+    *(void **)stack = free_fiber_stacks;
+    free_fiber_stacks = stack;
+    nr_free_fiber_stacks++;
+    spin_unlock_irqrestore(&fiber_pool_lock, flags);
+}
+
+/* Stop if @f's stack ran into its struct fiber */
+static void fiber_check(struct fiber *f) {
+    if (f->canary != FIBER_CANARY) {
+        klog_error("FIBER", "Fiber %d at %p overflowed its stack", f->id, (void *)f);
+        system_shutdown();
+    }
+}
+
+/* Switch from @prev to the next runnable fiber, or to the host if none */
+static void fiber_schedule(struct fiber_sched *s, struct fiber *prev) {
+    struct list_head *node = list_pop_front(&s->runq);
+    struct fiber *next;
+
+    fiber_check(prev);
+    s->nr_switches++;
+
+    if (node == NULL) {
+        s->current = NULL;
+        fiber_switch(&prev->sp, s->host_sp);
+        return;
+    }
+
+    next = list_entry(node, struct fiber, run_list);
+    s->current = next;
+    fiber_switch(&prev->sp, next->sp);
+}
+
+/* First code run on a fiber's stack (tail-called from fiber_entry) */
+void fiber_start(struct fiber *f) __attribute__((noreturn));
+void fiber_start(struct fiber *f) {
+    struct fiber_sched *s = f->sched;
+
+    f->func(f->arg);
+
+    /* The host frees the stack once we are off it */
+    fiber_check(f);
+    f->state = FIBER_DEAD;
+    s->nr_fibers--;
+    s->dead = f;
+    s->current = NULL;
+    s->nr_switches++;
+    fiber_switch(&f->sp, s->host_sp);
+    __builtin_unreachable();
+}
+
+/**
+ * fiber_sched_init - Prepare a fiber scheduler
+ * @s: Scheduler
+ */
+void fiber_sched_init(struct fiber_sched *s) {
+    list_init(&s->runq);
+    s->current = NULL;
+    s->dead = NULL;
+    s->host_sp = 0;
+    s->nr_fibers = 0;
+    s->next_id = 0;
+    s->nr_switches = 0;
+}
+
+/**
+ * fiber_create - Create a fiber
+ * @s: Scheduler that will run it
+ * @func: Entry function; the fiber ends when it returns
+ * @arg: Argument passed to @func
+ *
+ * The fiber is queued behind the runnable ones and first runs from
+ * fiber_sched_run() or when another fiber of @s yields.
+ *
+ * Returns: New fiber, or NULL if out of memory
+ */
+struct fiber *fiber_create(struct fiber_sched *s, fiber_func_t func, void *arg) {
+    struct fiber *f;
+    uint64_t *sp;
+
+    f = fiber_stack_alloc();
+    if (f == NULL) {
+        klog_error("FIBER", "Out of memory for fiber stacks");
+        return NULL;
+    }
+
+    f->sched = s;
+    f->func = func;
+    f->arg = arg;
+    f->state = FIBER_RUNNABLE;
+    f->id = s->next_id++;
+    f->canary = FIBER_CANARY;
+
+    /* Initial frame for fiber_switch(): registers, then fiber_entry */
+    sp = (uint64_t *)((uint64_t)f + FIBER_STACK_SIZE);
+    *--sp = 0;                          /* fiber_start()'s return address */
+    *--sp = (uint64_t)fiber_entry;      /* fiber_switch() returns here */
+    *--sp = 0;                          /* rbp */
+    *--sp = (uint64_t)f;                /* rbx */
+    *--sp = 0;                          /* r12 */
+    *--sp = 0;                          /* r13 */
+    *--sp = 0;                          /* r14 */
+    *--sp = 0;                          /* r15 */
+    f->sp = (uint64_t)sp;
+
+    list_push_back(&s->runq, &f->run_list);
+    s->nr_fibers++;
+    return f;
+}
+
+/**
+ * fiber_sched_run - Run fibers until none is runnable
+ * @s: Scheduler
+ *
+ * Called by the host thread. Returns once every fiber has returned or
+ * is parked; after waking parked fibers, call it again to run them.
+ *
+ * Returns: Number of fibers that have not returned
+ */
+int fiber_sched_run(struct fiber_sched *s) {
+    struct list_head *node;
+    struct fiber *f;
+
+    while ((node = list_pop_front(&s->runq)) != NULL) {
+        f = list_entry(node, struct fiber, run_list);
+        s->current = f;
+        s->nr_switches++;
+        fiber_switch(&s->host_sp, f->sp);
+
+        /* Back on the host stack: a fiber returned or parked */
+        if (s->dead != NULL) {
+            fiber_stack_free(s->dead);
+            s->dead = NULL;
+        }
+    }
+
+    return s->nr_fibers;
+}
+
+/**
+ * fiber_yield - Let the other runnable fibers run
+ *
+ * Requeues the current fiber behind them. Returns at once if it is the
+ * only runnable one. Must be called on a fiber stack.
+ */
+void fiber_yield(void) {
+    struct fiber *f = fiber_current();
+    struct fiber_sched *s = f->sched;
+
+    if (list_empty(&s->runq)) {
+        fiber_check(f);
+        return;
+    }
+
+    list_push_back(&s->runq, &f->run_list);
+    fiber_schedule(s, f);
+}
+
+/**
+ * fiber_park - Sleep until woken
+ *
+ * Must be called on a fiber stack. Returns after fiber_wake() once the
+ * scheduler gets to the fiber again.
+ */
+void fiber_park(void) {
+    struct fiber *f = fiber_current();
+
+    f->state = FIBER_PARKED;
+    fiber_schedule(f->sched, f);
+}
+
+/**
+ * fiber_wake - Make a parked fiber runnable
+ * @f: Fiber of the caller's scheduler
+ *
+ * Does nothing if @f is not parked.
+ */
+void fiber_wake(struct fiber *f) {
+    if (f->state != FIBER_PARKED) {
+        return;
+    }
+    f->state = FIBER_RUNNABLE;
+    list_push_back(&f->sched->runq, &f->run_list);
+}
+
+/**
+ * fiber_get_stats - Get fiber stack pool counters
+ * @stats: Filled in with the current counters
+ */
+void fiber_get_stats(struct fiber_stats *stats) {
+    irq_flags_t flags;
+
+    flags = spin_lock_irqsave(&fiber_pool_lock);
+    stats->nr_stacks = nr_fiber_stacks;
+    stats->nr_free = nr_free_fiber_stacks;
+    spin_unlock_irqrestore(&fiber_pool_lock, flags);
+}
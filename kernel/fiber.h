@@ -0,0 +1,110 @@
+/* Emergence Kernel - Kernel fibers
+ *
+ * A fiber is a cooperative task with its own small stack, run by a
+ * kernel thread on behalf of a fiber scheduler. A thread can host any
+ * number of fibers; they switch only when one calls fiber_yield(),
+ * fiber_park() or returns, so a switch saves just the callee-saved
+ * registers and costs a few dozen cycles.
+ *
+ * Fiber stacks are FIBER_STACK_SIZE bytes, aligned to their size, with
+ * the struct fiber at the bottom. The running fiber is found from RSP,
+ * and a canary at the top of the struct catches most overflows on the
+ * next switch. Stacks come from a global pool that carves them out of
+ * large PMM blocks and keeps them for reuse, so creating a fiber costs
+ * no page allocation once the pool is warm.
+ *
+ * A fiber scheduler and its fibers belong to one host thread, and every
+ * call on them must come from that thread or its fibers. Fiber stacks
+ * have no guard page and also take any interrupt that arrives while the
+ * fiber runs.
+ */
+
+#ifndef _KERNEL_FIBER_H
+#define _KERNEL_FIBER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/list.h"
+
+/* Stack per fiber, including the struct fiber at its bottom (power of two) */
+#define FIBER_STACK_SIZE        (8 * 1024)
+
+/* PMM block order the stack pool carves stacks from (128 KB) */
+#define FIBER_CHUNK_ORDER       5
+
+/* Value of struct fiber.canary while the stack is intact */
+#define FIBER_CANARY            0x46494245525F4F4BULL
+
+/* Fiber states */
+#define FIBER_RUNNABLE          0   /* On its scheduler's run queue or running */
+#define FIBER_PARKED            1   /* Waiting for fiber_wake() */
+#define FIBER_DEAD              2   /* Returned; stack freed by the scheduler */
+
+struct fiber_sched;
+
+typedef void (*fiber_func_t)(void *arg);
+
+/* Fiber, at the lowest address of its stack */
+struct fiber {
+    uint64_t sp;                    /* Saved RSP while switched out */
+    struct fiber_sched *sched;      /* Scheduler that runs it */
+    struct list_head run_list;      /* Run queue linkage */
+    fiber_func_t func;              /* Entry function */
+    void *arg;                      /* Entry argument */
+    int state;                      /* FIBER_* */
+    int id;                         /* Creation index within its scheduler */
+    uint64_t canary;                /* FIBER_CANARY unless the stack overflowed */
+};
+
+/* Fiber scheduler, normally on the host thread's stack */
+struct fiber_sched {
+    struct list_head runq;          /* Runnable fibers, FIFO */
+    struct fiber *current;          /* Running fiber, or NULL in the host */
+    struct fiber *dead;             /* Returned fiber whose stack the host frees */
+    uint64_t host_sp;               /* Host RSP while a fiber runs */
+    int nr_fibers;                  /* Fibers that have not returned */
+    int next_id;                    /* id of the next fiber created */
+    uint64_t nr_switches;           /* Switches between fibers or to the host */
+};
+
+/* Prepare an empty fiber scheduler */
+void fiber_sched_init(struct fiber_sched *s);
+
+/* Create a runnable fiber calling @func(@arg); NULL if out of memory */
+struct fiber *fiber_create(struct fiber_sched *s, fiber_func_t func, void *arg);
+
+/* Run fibers until none is runnable; returns how many have not returned */
+int fiber_sched_run(struct fiber_sched *s);
+
+/* Let the other runnable fibers run; from a fiber only */
+void fiber_yield(void);
+
+/* Sleep until fiber_wake(); from a fiber only */
+void fiber_park(void);
+
+/* Make a parked fiber runnable again */
+void fiber_wake(struct fiber *f);
+
+/**
+ * fiber_current - Get the running fiber
+ *
+ * Only meaningful on a fiber stack.
+ *
+ * Returns: Fiber whose stack RSP is on
+ */
+static inline struct fiber *fiber_current(void) {
+    uint64_t sp;
+
+    asm volatile ("mov %%rsp, %0" : "=r"(sp));
+    return (struct fiber *)(sp & ~(uint64_t)(FIBER_STACK_SIZE - 1));
+}
+
+/* Stack pool counters for tests and debugging */
+struct fiber_stats {
+    uint64_t nr_stacks;             /* Stacks ever carved */
+    uint64_t nr_free;               /* Stacks ready for reuse */
+};
+
+void fiber_get_stats(struct fiber_stats *stats);
+
+#endif /* _KERNEL_FIBER_H */
@@ -0,0 +1,238 @@
+/* Emergence Kernel - High-resolution timers
+ *
+ * Each CPU keeps its hrtimers in an rbtree ordered by expiry, with the
+ * earliest one cached, so the timer interrupt finds what is due in O(1)
+ * and the LAPIC one-shot can be programmed for the exact deadline.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/timer.h"
+#include "kernel/rbtree.h"
+#include "include/spinlock.h"
+#include "include/barrier.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/idt.h"
+#include "arch/x86_64/timer.h"
+
+/* Per-CPU hrtimer queue */
+struct hrtimer_base {
+    spinlock_t lock;
+    int cpu;                            /* Owning CPU */
+    struct rb_root_cached active;       /* Queued timers by expiry */
+    struct hrtimer *running;            /* Callback in progress */
+};
+
+static DEFINE_PER_CPU(struct hrtimer_base, hrtimer_bases);
+
+/* Lock the queue a timer is on; returns NULL (nothing locked) if it is idle */
+static struct hrtimer_base *lock_hrtimer_base(struct hrtimer *timer, irq_flags_t *flags) {
+    while (1) {
+        int cpu = READ_ONCE(timer->cpu);
+        struct hrtimer_base *base;
+
+        if (cpu < 0) {
+            return NULL;
+        }
+        base = per_cpu_ptr(&hrtimer_bases, cpu);
+        *flags = spin_lock_irqsave(&base->lock);
+        if (timer->cpu == cpu) {
+            return base;
+        }
+        spin_unlock_irqrestore(&base->lock, *flags);
+    }
+}
+
+/* Dequeue a queued timer (lock held) */
+static void __remove_hrtimer(struct hrtimer_base *base, struct hrtimer *timer) {
+    rb_erase_cached(&timer->node, &base->active);
+    rb_clear_node(&timer->node);
+    timer->cpu = -1;
+}
+
+/**
+ * enqueue_hrtimer - Insert a timer into a queue
+ * @base: Queue (lock held)
+ * @timer: Idle timer with its expiry set
+ *
+ * Timers with equal expiry fire in the order they were queued.
+ *
+ * Returns: 1 if @timer is now the earliest in the queue
+ */
+static int enqueue_hrtimer(struct hrtimer_base *base, struct hrtimer *timer) {
+    struct rb_node **link = &base->active.root.node;
+    struct rb_node *parent = NULL;
+    int leftmost = 1;
+
+    while (*link != NULL) {
+        struct hrtimer *entry;
+
+        parent = *link;
+        entry = rb_entry(parent, struct hrtimer, node);
+        if (timer->expires < entry->expires) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+
+    rb_link_node(&timer->node, parent, link);
+    rb_insert_color_cached(&timer->node, &base->active, leftmost);
+    timer->cpu = base->cpu;
+    return leftmost;
+}
+
+/**
+ * hrtimer_init - Prepare an hrtimer
+ * @timer: Timer
+ * @function: Callback, run from the timer interrupt
+ */
+void hrtimer_init(struct hrtimer *timer, void (*function)(struct hrtimer *)) {
+    rb_clear_node(&timer->node);
+    timer->expires = 0;
+    timer->function = function;
+    timer->cpu = -1;
+}
+
+/**
+ * hrtimer_start - Queue an hrtimer on this CPU
+ * @timer: Timer set up with hrtimer_init()
+ * @expires_ns: sched_clock() time to fire at
+ *
+ * Re-queues the timer if it was already pending. An expiry in the past
+ * fires on the next timer interrupt.
+ */
+void hrtimer_start(struct hrtimer *timer, uint64_t expires_ns) {
+    struct hrtimer_base *base;
+    irq_flags_t flags;
+    int first;
+
+    base = lock_hrtimer_base(timer, &flags);
+    if (base != NULL) {
+        __remove_hrtimer(base, timer);
+        spin_unlock_irqrestore(&base->lock, flags);
+    }
+
+    base = this_cpu_ptr(&hrtimer_bases);
+    flags = spin_lock_irqsave(&base->lock);
+    timer->expires = expires_ns;
+    first = enqueue_hrtimer(base, timer);
+    spin_unlock_irqrestore(&base->lock, flags);
+
+#if CONFIG_NO_HZ
+    if (first) {
+        flags = irq_save(1);
+        timer_tick_rearm();
+        irq_restore(flags);
+    }
+#else
+    (void)first;
+#endif
+}
+
+/**
+ * hrtimer_cancel - Dequeue an hrtimer and wait for its callback
+ * @timer: Timer
+ *
+ * On return the callback is not running on any CPU, so the timer may be
+ * freed. Must not be called from the timer's own callback.
+ *
+ * Returns: 1 if the timer was pending, 0 otherwise
+ */
+int hrtimer_cancel(struct hrtimer *timer) {
+    struct hrtimer_base *base;
+    irq_flags_t flags;
+    int ret = 0;
+
+    base = lock_hrtimer_base(timer, &flags);
+    if (base != NULL) {
+        __remove_hrtimer(base, timer);
+        spin_unlock_irqrestore(&base->lock, flags);
+        ret = 1;
+    }
+
+    for (int cpu = 0; cpu < smp_get_cpu_count(); cpu++) {
+        while (READ_ONCE(per_cpu(hrtimer_bases, cpu).running) == timer) {
+            cpu_relax();
+        }
+    }
+    return ret;
+}
+
+/**
+ * hrtimer_active - Check whether an hrtimer is queued
+ * @timer: Timer
+ */
+int hrtimer_active(struct hrtimer *timer) {
+    return READ_ONCE(timer->cpu) >= 0;
+}
+
+/**
+ * hrtimer_run_queues - Run this CPU's expired hrtimers
+ * @now: Current sched_clock() time
+ *
+ * Callbacks run with the queue unlocked, so they may re-arm their timer.
+ */
+void hrtimer_run_queues(uint64_t now) {
+    struct hrtimer_base *base = this_cpu_ptr(&hrtimer_bases);
+    struct rb_node *node;
+    irq_flags_t flags;
+
+    flags = spin_lock_irqsave(&base->lock);
+
+    while ((node = rb_first_cached(&base->active)) != NULL) {
+        struct hrtimer *timer = rb_entry(node, struct hrtimer, node);
+        void (*fn)(struct hrtimer *) = timer->function;
+
+        if (timer->expires > now) {
+            break;
+        }
+
+        __remove_hrtimer(base, timer);
+        base->running = timer;
+        spin_unlock_irqrestore(&base->lock, flags);
+
+        fn(timer);
+
+        flags = spin_lock_irqsave(&base->lock);
+        base->running = NULL;
+    }
+
+    spin_unlock_irqrestore(&base->lock, flags);
+}
+
+/**
+ * hrtimer_next_expiry - Get the earliest hrtimer expiry on this CPU
+ *
+ * Returns: sched_clock() time in ns, or TIMER_NO_EXPIRY if none is queued
+ */
+uint64_t hrtimer_next_expiry(void) {
+    struct hrtimer_base *base = this_cpu_ptr(&hrtimer_bases);
+    struct rb_node *node;
+    uint64_t next = TIMER_NO_EXPIRY;
+    irq_flags_t flags;
+
+    flags = spin_lock_irqsave(&base->lock);
+    node = rb_first_cached(&base->active);
+    if (node != NULL) {
+        next = rb_entry(node, struct hrtimer, node)->expires;
+    }
+    spin_unlock_irqrestore(&base->lock, flags);
+
+    return next;
+}
+
+/**
+ * hrtimers_init - Initialize the per-CPU hrtimer queues
+ */
+void hrtimers_init(void) {
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        struct hrtimer_base *base = per_cpu_ptr(&hrtimer_bases, cpu);
+
+        spin_lock_init(&base->lock);
+        base->cpu = cpu;
+        rb_root_cached_init(&base->active);
+        base->running = NULL;
+    }
+}
@@ -0,0 +1,166 @@
+/* Emergence Kernel - ID allocator and ID-to-pointer map */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/idr.h"
+#include "kernel/pmm.h"
+#include "include/string.h"
+
+_Static_assert(IDR_LEAF_SIZE * sizeof(void *) == PAGE_SIZE, "idr leaf must be one page");
+_Static_assert(IDR_MAX % 64 == 0, "idr bitmap must be whole words");
+
+#define IDR_NR_WORDS    (IDR_MAX / 64)
+
+/**
+ * idr_init - Prepare an empty ID allocator
+ * @idr: ID allocator
+ * @min: Lowest ID to hand out (IDs below it stay reserved)
+ */
+void idr_init(struct idr *idr, int min) {
+    int id;
+
+    memset(idr, 0, sizeof(*idr));
+    idr->min = min;
+    idr->cursor = min;
+
+    for (id = 0; id < min; id++) {
+        idr->bitmap[id / 64] |= 1ULL << (id % 64);
+    }
+}
+
+/**
+ * idr_destroy - Release an ID allocator's memory
+ * @idr: ID allocator with no concurrent users
+ *
+ * Frees the leaf pages; idr_init() must be called before reusing @idr.
+ */
+void idr_destroy(struct idr *idr) {
+    int i;
+
+    for (i = 0; i < IDR_NR_LEAVES; i++) {
+        if (idr->leaves[i] != NULL) {
+            pmm_free(idr->leaves[i], 0);
+            idr->leaves[i] = NULL;
+        }
+    }
+}
+
+/* Get the leaf holding @id, installing a zeroed one if there is none */
+static void **idr_get_leaf(struct idr *idr, int id) {
+    void ***slot = &idr->leaves[id >> IDR_LEAF_SHIFT];
+    void **leaf = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    void **expected = NULL;
+
+    if (leaf != NULL) {
+        return leaf;
+    }
+
+    leaf = pmm_alloc(0);
+    if (leaf == NULL) {
+        return NULL;
+    }
+    memset(leaf, 0, PAGE_SIZE);
+
+    /* Lost the race: use the winner's leaf */
+    if (!__atomic_compare_exchange_n(slot, &expected, leaf, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        pmm_free(leaf, 0);
+        leaf = expected;
+    }
+    return leaf;
+}
+
+/**
+ * idr_alloc - Allocate an ID
+ * @idr: ID allocator
+ * @ptr: Pointer to map the ID to; NULL to publish it later with idr_replace()
+ *
+ * Takes the first free ID at or after the cursor, wrapping around to
+ * the lowest ID.
+ *
+ * Returns: New ID, or -1 if every ID is in use or out of memory
+ */
+int idr_alloc(struct idr *idr, void *ptr) {
+    int start = __atomic_load_n(&idr->cursor, __ATOMIC_RELAXED);
+    uint64_t word, mask;
+    void **leaf;
+    int i, n, id;
+
+    if (start < idr->min || start >= IDR_MAX) {
+        start = idr->min;
+    }
+
+    /* Words from the cursor on, the cursor's own word again last in full */
+    i = start / 64;
+    for (n = 0; n <= IDR_NR_WORDS; n++, i = (i + 1) % IDR_NR_WORDS) {
+        mask = n == 0 ? ~0ULL << (start % 64) : ~0ULL;
+        word = __atomic_load_n(&idr->bitmap[i], __ATOMIC_RELAXED);
+
+        while ((~word & mask) != 0) {
+            uint64_t bit = 1ULL << __builtin_ctzll(~word & mask);
+
+            if (__atomic_compare_exchange_n(&idr->bitmap[i], &word, word | bit, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                id = i * 64 + __builtin_ctzll(bit);
+                goto found;
+            }
+        }
+    }
+    return -1;
+
+found:
+    leaf = idr_get_leaf(idr, id);
+    if (leaf == NULL) {
+        __atomic_fetch_and(&idr->bitmap[id / 64], ~(1ULL << (id % 64)), __ATOMIC_RELEASE);
+        return -1;
+    }
+
+    __atomic_store_n(&leaf[id & (IDR_LEAF_SIZE - 1)], ptr, __ATOMIC_RELEASE);
+    __atomic_store_n(&idr->cursor, id + 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&idr->nr_used, 1, __ATOMIC_RELAXED);
+    return id;
+}
+
+/**
+ * idr_replace - Change the pointer an allocated ID maps to
+ * @idr: ID allocator
+ * @id: ID from idr_alloc()
+ * @ptr: New pointer
+ *
+ * Returns: Previous pointer, or NULL if @id is not allocated
+ */
+void *idr_replace(struct idr *idr, int id, void *ptr) {
+    void **leaf;
+
+    if (id < idr->min || id >= IDR_MAX) {
+        return NULL;
+    }
+    leaf = __atomic_load_n(&idr->leaves[id >> IDR_LEAF_SHIFT], __ATOMIC_ACQUIRE);
+    if (leaf == NULL) {
+        return NULL;
+    }
+    return __atomic_exchange_n(&leaf[id & (IDR_LEAF_SIZE - 1)], ptr, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * idr_remove - Free an ID
+ * @idr: ID allocator
+ * @id: ID from idr_alloc()
+ *
+ * Unmaps @id before freeing it, so a lookup never finds the next user
+ * of the ID with the old pointer.
+ */
+void idr_remove(struct idr *idr, int id) {
+    uint64_t old;
+
+    if (id < idr->min || id >= IDR_MAX) {
+        return;
+    }
+
+    idr_replace(idr, id, NULL);
+    old = __atomic_fetch_and(&idr->bitmap[id / 64], ~(1ULL << (id % 64)),
+                             __ATOMIC_RELEASE);
+    if (old & (1ULL << (id % 64))) {
+        __atomic_sub_fetch(&idr->nr_used, 1, __ATOMIC_RELAXED);
+    }
+}
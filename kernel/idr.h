@@ -0,0 +1,82 @@
+/* Emergence Kernel - ID allocator and ID-to-pointer map
+ *
+ * Hands out integer IDs (PIDs, TIDs) from a bitmap and maps each to a
+ * pointer through a two-level radix table:
+ *
+ *   id  ->  slots[id / IDR_LEAF_SIZE]  ->  leaf[id % IDR_LEAF_SIZE]
+ *
+ * Allocation searches the bitmap from a cursor just past the last ID
+ * handed out and claims a bit with a compare-and-swap, so freed IDs are
+ * reused only after the cursor has wrapped around. Lookup is two loads.
+ * Neither takes a lock; only installing a new leaf (once per 512 IDs,
+ * never freed) races through a compare-and-swap too.
+ *
+ * A lookup does not keep the object alive: callers need some other
+ * guarantee that it is not freed under them, as with a list lookup
+ * whose lock has been dropped.
+ */
+
+#ifndef _KERNEL_IDR_H
+#define _KERNEL_IDR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* IDs run from the idr's min up to IDR_MAX - 1 */
+#define IDR_MAX             32768
+
+/* Radix table geometry: a leaf is one page of pointers */
+#define IDR_LEAF_SHIFT      9
+#define IDR_LEAF_SIZE       (1 << IDR_LEAF_SHIFT)
+#define IDR_NR_LEAVES       (IDR_MAX / IDR_LEAF_SIZE)
+
+struct idr {
+    uint64_t bitmap[IDR_MAX / 64];  /* Set bit = ID in use */
+    void **leaves[IDR_NR_LEAVES];   /* Leaf pages, allocated on first use */
+    int cursor;                     /* Where the next search starts */
+    int min;                        /* Lowest ID handed out */
+    int nr_used;                    /* IDs currently allocated */
+};
+
+/* Prepare an empty idr handing out IDs from @min */
+void idr_init(struct idr *idr, int min);
+
+/* Free the leaf pages of an idr nothing uses any more */
+void idr_destroy(struct idr *idr);
+
+/* Allocate an ID mapped to @ptr (may be NULL until idr_replace()); -1 if full */
+int idr_alloc(struct idr *idr, void *ptr);
+
+/* Map an allocated @id to @ptr; returns the old pointer */
+void *idr_replace(struct idr *idr, int id, void *ptr);
+
+/* Free @id for reuse */
+void idr_remove(struct idr *idr, int id);
+
+/**
+ * idr_find - Look up the pointer mapped to an ID
+ * @idr: ID allocator
+ * @id: ID to look up
+ *
+ * Returns: Pointer given to idr_alloc()/idr_replace(), or NULL if @id
+ *          is out of range, free or not mapped yet
+ */
+static inline void *idr_find(struct idr *idr, int id) {
+    void **leaf;
+
+    if (id < 0 || id >= IDR_MAX) {
+        return NULL;
+    }
+    leaf = __atomic_load_n(&idr->leaves[id >> IDR_LEAF_SHIFT], __ATOMIC_ACQUIRE);
+    if (leaf == NULL) {
+        return NULL;
+    }
+    return __atomic_load_n(&leaf[id & (IDR_LEAF_SIZE - 1)], __ATOMIC_ACQUIRE);
+}
+
+/* Number of allocated IDs */
+static inline int idr_count(struct idr *idr) {
+    return __atomic_load_n(&idr->nr_used, __ATOMIC_RELAXED);
+}
+
+#endif /* _KERNEL_IDR_H */
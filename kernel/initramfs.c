@@ -0,0 +1,184 @@
+/* Emergence Kernel - Initial RAM filesystem */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/initramfs.h"
+#include "kernel/klog.h"
+#include "arch/x86_64/multiboot2.h"
+#include "include/string.h"
+
+/* newc header: magic, then 13 fields of 8 hex digits */
+#define NEWC_MAGIC          "070701"
+#define NEWC_HEADER_SIZE    110
+#define NEWC_MODE           1
+#define NEWC_FILESIZE       6
+#define NEWC_NAMESIZE       11
+#define NEWC_TRAILER        "TRAILER!!!"
+
+#define NEWC_ALIGN(x)       (((x) + 3) & ~(size_t)3)
+
+/* Boot initramfs, inside its module */
+static const uint8_t *initramfs_base;
+static size_t initramfs_size;
+
+/* Value of header field @index, or -1 if it is not hex */
+static long newc_field(const uint8_t *header, int index) {
+    const uint8_t *p = header + 6 + index * 8;
+    long value = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        value <<= 4;
+        if (p[i] >= '0' && p[i] <= '9') {
+            value |= p[i] - '0';
+        } else if (p[i] >= 'a' && p[i] <= 'f') {
+            value |= p[i] - 'a' + 10;
+        } else if (p[i] >= 'A' && p[i] <= 'F') {
+            value |= p[i] - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
+
+/* Drop the "/" or "./" archive names and paths may start with */
+static const char *newc_skip_root(const char *path) {
+    if (path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    while (*path == '/') {
+        path++;
+    }
+    return path;
+}
+
+/**
+ * newc_next - Parse the entry at @*offset
+ * @archive: Archive
+ * @size: Archive size
+ * @offset: Entry offset, advanced to the next entry
+ * @name: Returns the entry name
+ * @file: Returns the entry contents and mode
+ *
+ * Returns: 1 for an entry, 0 at the trailer, -1 if the archive is malformed
+ */
+static int newc_next(const uint8_t *archive, size_t size, size_t *offset,
+                     const char **name, struct initramfs_file *file) {
+    const uint8_t *header = archive + *offset;
+    long mode, filesize, namesize;
+    size_t data;
+
+    if (*offset + NEWC_HEADER_SIZE > size ||
+        strncmp((const char *)header, NEWC_MAGIC, sizeof(NEWC_MAGIC) - 1) != 0) {
+        return -1;
+    }
+
+    mode = newc_field(header, NEWC_MODE);
+    filesize = newc_field(header, NEWC_FILESIZE);
+    namesize = newc_field(header, NEWC_NAMESIZE);
+    if (mode < 0 || filesize < 0 || namesize < 1) {
+        return -1;
+    }
+
+    data = NEWC_ALIGN(*offset + NEWC_HEADER_SIZE + (size_t)namesize);
+    if (data > size || (size_t)filesize > size - data ||
+        header[NEWC_HEADER_SIZE + namesize - 1] != '\0') {
+        return -1;
+    }
+
+    *name = (const char *)header + NEWC_HEADER_SIZE;
+    if (strcmp(*name, NEWC_TRAILER) == 0) {
+        return 0;
+    }
+
+    file->data = archive + data;
+    file->size = (size_t)filesize;
+    file->mode = (uint32_t)mode;
+    *offset = NEWC_ALIGN(data + (size_t)filesize);
+    return 1;
+}
+
+/**
+ * initramfs_find - Look up a file in a newc archive
+ * @archive: Archive
+ * @size: Archive size in bytes
+ * @path: Path of the file, with or without a leading "/"
+ * @file: Returns the file
+ *
+ * Returns: 0 on success, -1 if there is no such file
+ */
+int initramfs_find(const void *archive, size_t size, const char *path,
+                   struct initramfs_file *file) {
+    struct initramfs_file entry;
+    size_t offset = 0;
+    const char *name;
+
+    path = newc_skip_root(path);
+    while (newc_next(archive, size, &offset, &name, &entry) > 0) {
+        if (strcmp(newc_skip_root(name), path) == 0) {
+            *file = entry;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * initramfs_lookup - Look up a file in the boot initramfs
+ * @path: Path of the file
+ * @file: Returns the file
+ *
+ * Returns: 0 on success, -1 if there is no such file or no initramfs
+ */
+int initramfs_lookup(const char *path, struct initramfs_file *file) {
+    if (initramfs_base == NULL) {
+        return -1;
+    }
+    return initramfs_find(initramfs_base, initramfs_size, path, file);
+}
+
+/**
+ * initramfs_init - Find the boot initramfs
+ *
+ * Uses the module whose command line is "initramfs", or else the
+ * first module.
+ *
+ * Returns: Number of regular files, or -1 if there is no usable initramfs
+ */
+int initramfs_init(void) {
+    struct initramfs_file entry;
+    uint64_t start, end;
+    const char *cmdline, *name;
+    size_t offset = 0;
+    int i, ret, nr_files = 0;
+
+    /* Stops past the last module if none is named: fall back to the first */
+    for (i = 0; multiboot_get_module(i, &start, &end, &cmdline) == 0; i++) {
+        if (strcmp(cmdline, "initramfs") == 0) {
+            break;
+        }
+    }
+    if (multiboot_get_module(i, &start, &end, NULL) != 0 &&
+        multiboot_get_module(0, &start, &end, NULL) != 0) {
+        klog_info("INITRAMFS", "No initramfs module");
+        return -1;
+    }
+
+    while ((ret = newc_next((const uint8_t *)start, end - start, &offset,
+                            &name, &entry)) > 0) {
+        if ((entry.mode & INITRAMFS_S_IFMT) == INITRAMFS_S_IFREG) {
+            nr_files++;
+        }
+    }
+    if (ret < 0) {
+        klog_error("INITRAMFS", "Module at %p is not a newc cpio archive", (void *)start);
+        return -1;
+    }
+
+    initramfs_base = (const uint8_t *)start;
+    initramfs_size = end - start;
+    klog_info("INITRAMFS", "%d files in %lu byte initramfs at %p",
+              nr_files, (unsigned long)initramfs_size, (void *)start);
+    return nr_files;
+}
@@ -0,0 +1,43 @@
+/* Emergence Kernel - Initial RAM filesystem
+ *
+ * The initramfs is a "newc" cpio archive the boot loader passes as a
+ * multiboot2 module. It is never unpacked: files are looked up in the
+ * module in place, and programs are mapped straight from its frames
+ * (see kernel/elf.c). scripts/mkinitramfs.py NUL-pads each name so that
+ * file data starts on a page boundary, which lets those frames be
+ * shared; the reader itself only needs the 4-byte newc alignment.
+ */
+
+#ifndef _KERNEL_INITRAMFS_H
+#define _KERNEL_INITRAMFS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* File type bits of initramfs_file.mode */
+#define INITRAMFS_S_IFMT    0170000
+#define INITRAMFS_S_IFREG   0100000
+
+/**
+ * struct initramfs_file - A file found in an archive
+ * @data: Contents, in place inside the archive
+ * @size: Size in bytes
+ * @mode: File type and permission bits
+ */
+struct initramfs_file {
+    const void *data;
+    size_t size;
+    uint32_t mode;
+};
+
+/* Find the initramfs module; returns the number of files, or -1 if none */
+int initramfs_init(void);
+
+/* Look up @path in the boot initramfs; 0 on success, -1 if not found */
+int initramfs_lookup(const char *path, struct initramfs_file *file);
+
+/* Look up @path in a newc archive at @archive; 0 on success, -1 if not found */
+int initramfs_find(const void *archive, size_t size, const char *path,
+                   struct initramfs_file *file);
+
+#endif /* _KERNEL_INITRAMFS_H */
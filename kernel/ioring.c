@@ -0,0 +1,378 @@
+/* Emergence Kernel - Submission/completion rings
+ *
+ * The ring block is one PMM block owned by the address space it is
+ * mapped into, and the kernel works on it through its kernel address.
+ * Everything the process can write is untrusted: the kernel keeps its
+ * own sq_head, cq_tail and ring sizes in struct ioring and only ever
+ * publishes them, and runs each SQE from a private copy.
+ *
+ * Only one context consumes a ring: sys_ioring_enter() without a poller,
+ * the poller thread with one.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/ioring.h"
+#include "kernel/process.h"
+#include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "kernel/wait.h"
+#include "kernel/vm.h"
+#include "kernel/pmm.h"
+#include "kernel/slab.h"
+#include "kernel/klog.h"
+#include "arch/x86_64/include/syscall.h"
+#include "arch/x86_64/tsc.h"
+#include "include/barrier.h"
+#include "include/string.h"
+
+_Static_assert(sizeof(struct ioring_sqe) == 64, "an SQE is one cache line");
+_Static_assert(offsetof(struct ioring_rings, cq_head) == 64 &&
+               sizeof(struct ioring_rings) == 128,
+               "each ring's indices get their own cache line");
+
+/* ioring_ops[] flags */
+#define IORING_OP_OK        0x01    /* Accepted in an SQE */
+#define IORING_OP_INLINE    0x02    /* Sleeps or needs the process: not from the poller */
+
+/* Syscalls an SQE may carry; add a line to add an operation */
+static const uint8_t ioring_ops[NR_syscalls] = {
+    [SYS_write]         = IORING_OP_OK,
+    [SYS_yield]         = IORING_OP_OK,
+    [SYS_wait]          = IORING_OP_OK | IORING_OP_INLINE,
+    [SYS_nanosleep]     = IORING_OP_OK | IORING_OP_INLINE,
+    [SYS_clock_gettime] = IORING_OP_OK,
+    [SYS_getcpu]        = IORING_OP_OK,
+};
+
+struct ioring {
+    struct ioring_rings *rings;     /* Kernel address of the shared block */
+    struct ioring_sqe *sqes;
+    struct ioring_cqe *cqes;
+    uint32_t sq_entries;            /* Power of two */
+    uint32_t cq_entries;            /* 2 * sq_entries */
+    uint32_t sq_head;               /* Kernel's copy of rings->sq_head */
+    uint32_t cq_tail;               /* Kernel's copy of rings->cq_tail */
+    uint32_t flags;                 /* IORING_SETUP_* */
+    uint8_t order;                  /* PMM order of the block */
+    int submitting;                 /* An enter is consuming the SQ (atomic) */
+    int stop;                       /* Poller must exit (atomic) */
+    int refs;                       /* The process, and the poller (atomic) */
+    address_space_t *as;            /* Mapped here, referenced */
+    thread_t *sq_thread;            /* Poller, or NULL */
+    wait_queue_head_t sq_wait;      /* Idle poller sleeps here */
+    wait_queue_head_t cq_wait;      /* IORING_ENTER_GETEVENTS sleeps here */
+};
+
+/* Unmap the block and free the context once neither user is left */
+static void ioring_put(struct ioring *ctx)
+{
+    if (__atomic_sub_fetch(&ctx->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    vm_unmap_region(ctx->as, IORING_MAP_BASE, (uint64_t)PAGE_SIZE << ctx->order);
+    vm_put_address_space(ctx->as);
+    slab_free_size(ctx, sizeof(*ctx));
+}
+
+/* Completions the process has not consumed yet */
+static uint32_t ioring_cq_ready(struct ioring *ctx)
+{
+    return ctx->cq_tail - __atomic_load_n(&ctx->rings->cq_head, __ATOMIC_ACQUIRE);
+}
+
+/* SQEs the process has queued but the kernel has not run */
+static uint32_t ioring_sq_pending(struct ioring *ctx)
+{
+    uint32_t pending = __atomic_load_n(&ctx->rings->sq_tail, __ATOMIC_ACQUIRE) - ctx->sq_head;
+
+    /* A tail more than a ring ahead is garbage: run what the ring holds */
+    return pending > ctx->sq_entries ? ctx->sq_entries : pending;
+}
+
+/* Run one SQE; @from_poller is set in the poller thread */
+static int64_t ioring_issue(const struct ioring_sqe *sqe, int from_poller)
+{
+    uint8_t op;
+
+    if (sqe->flags != 0) {
+        return -22;  /* EINVAL */
+    }
+    if (sqe->opcode == IORING_OP_NOP) {
+        return 0;
+    }
+
+    op = sqe->opcode < NR_syscalls ? ioring_ops[sqe->opcode] : 0;
+    if (!(op & IORING_OP_OK)) {
+        return -22;  /* EINVAL */
+    }
+    if ((op & IORING_OP_INLINE) && from_poller) {
+        return -11;  /* EAGAIN */
+    }
+
+    return syscall_dispatch(sqe->opcode, sqe->args[0], sqe->args[1], sqe->args[2],
+                            sqe->args[3], sqe->args[4], sqe->args[5]);
+}
+
+/**
+ * ioring_submit - Run queued SQEs and post their completions
+ * @ctx: Ring
+ * @max: Most SQEs to run
+ * @from_poller: Called from the poller thread
+ *
+ * Stops early when the CQ is full. The SQE slot is handed back before
+ * the operation runs, so an operation that sleeps holds no slot.
+ *
+ * Returns: Number of SQEs run
+ */
+static uint32_t ioring_submit(struct ioring *ctx, uint32_t max, int from_poller)
+{
+    struct ioring_sqe sqe;
+    struct ioring_cqe *cqe;
+    uint32_t pending = ioring_sq_pending(ctx);
+    uint32_t done = 0;
+    int64_t res;
+
+    while (done < max && done < pending && ioring_cq_ready(ctx) < ctx->cq_entries) {
+        memcpy(&sqe, &ctx->sqes[ctx->sq_head & (ctx->sq_entries - 1)], sizeof(sqe));
+        ctx->sq_head++;
+        __atomic_store_n(&ctx->rings->sq_head, ctx->sq_head, __ATOMIC_RELEASE);
+
+        res = ioring_issue(&sqe, from_poller);
+
+        cqe = &ctx->cqes[ctx->cq_tail & (ctx->cq_entries - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->res = res;
+        ctx->cq_tail++;
+        __atomic_store_n(&ctx->rings->cq_tail, ctx->cq_tail, __ATOMIC_RELEASE);
+        done++;
+    }
+
+    if (done != 0 && wq_has_sleeper(&ctx->cq_wait)) {
+        wake_up_all(&ctx->cq_wait);
+    }
+    return done;
+}
+
+/* Anything the poller can run right now */
+static int ioring_sq_runnable(struct ioring *ctx)
+{
+    return ioring_sq_pending(ctx) != 0 && ioring_cq_ready(ctx) < ctx->cq_entries;
+}
+
+/*
+ * Poller thread: run SQEs as they appear, yielding between looks. After
+ * IORING_SQPOLL_IDLE_NS with nothing runnable (an empty SQ, or a full
+ * CQ) it sets IORING_SQ_NEED_WAKEUP and sleeps; the process checks the
+ * flag after queueing SQEs or consuming CQEs.
+ */
+static void ioring_sq_thread(void *arg)
+{
+    struct ioring *ctx = arg;
+    uint64_t idle_since = sched_clock();
+
+    while (!__atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE)) {
+        if (ioring_submit(ctx, ctx->sq_entries, 1) != 0) {
+            idle_since = sched_clock();
+            continue;
+        }
+        if (sched_clock() - idle_since < IORING_SQPOLL_IDLE_NS) {
+            thread_yield();
+            continue;
+        }
+
+        /* Flag first, then look again: a process that queued before
+         * seeing the flag is caught by the look */
+        __atomic_or_fetch(&ctx->rings->sq_flags, IORING_SQ_NEED_WAKEUP, __ATOMIC_RELAXED);
+        smp_mb();
+        wait_event(ctx->sq_wait, ioring_sq_runnable(ctx) ||
+                                 __atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE));
+        __atomic_and_fetch(&ctx->rings->sq_flags, ~IORING_SQ_NEED_WAKEUP, __ATOMIC_RELAXED);
+        idle_since = sched_clock();
+    }
+
+    /* Off the process's page table before it can go with the last ref */
+    thread_get_current()->as = NULL;
+    scheduler_switch_address_space();
+    ioring_put(ctx);
+    thread_exit();
+}
+
+/**
+ * ioring_setup - Create a process's rings
+ * @p: Process
+ * @entries: SQ entries, 1 to IORING_MAX_ENTRIES, rounded up to a power of two
+ * @flags: IORING_SETUP_*
+ *
+ * A process has at most one set of rings, mapped at IORING_MAP_BASE.
+ * Forked children do not inherit them.
+ *
+ * Returns: User address of the ring block, or negative error code
+ */
+int64_t ioring_setup(process_t *p, uint32_t entries, uint32_t flags)
+{
+    struct ioring *ctx;
+    struct ioring_rings *rings;
+    uint32_t sq_entries = 1;
+    uint64_t sqes_off, cqes_off, size;
+    uint8_t order = 0;
+    thread_t *t;
+    int ret;
+
+    if (p == NULL || p->vm == NULL) {
+        return -1;  /* EPERM */
+    }
+    if (entries == 0 || entries > IORING_MAX_ENTRIES || (flags & ~IORING_SETUP_SQPOLL)) {
+        return -22;  /* EINVAL */
+    }
+    /* A vfork child shares its parent's address space and its mapping */
+    if (p->ring != NULL || vm_find_region(p->vm, IORING_MAP_BASE) != NULL) {
+        return -16;  /* EBUSY */
+    }
+
+    while (sq_entries < entries) {
+        sq_entries <<= 1;
+    }
+    sqes_off = sizeof(struct ioring_rings);
+    cqes_off = sqes_off + sq_entries * sizeof(struct ioring_sqe);
+    size = cqes_off + 2 * sq_entries * sizeof(struct ioring_cqe);
+    while (((uint64_t)PAGE_SIZE << order) < size) {
+        order++;
+    }
+
+    ctx = slab_alloc_size(sizeof(*ctx));
+    if (ctx == NULL) {
+        return -12;  /* ENOMEM */
+    }
+    rings = pmm_alloc(order);
+    if (rings == NULL) {
+        slab_free_size(ctx, sizeof(*ctx));
+        return -12;  /* ENOMEM */
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    memset(rings, 0, (size_t)PAGE_SIZE << order);
+
+    rings->sq_mask = sq_entries - 1;
+    rings->sqes_off = (uint32_t)sqes_off;
+    rings->cq_mask = 2 * sq_entries - 1;
+    rings->cqes_off = (uint32_t)cqes_off;
+
+    ret = vm_map_region(p->vm, IORING_MAP_BASE, (uint64_t)rings, (uint64_t)PAGE_SIZE << order,
+                        PT_PRESENT | PT_USER | PT_WRITE | PT_NX, VM_REGION_IORING, "ioring");
+    if (ret != 0) {
+        pmm_free(rings, order);
+        slab_free_size(ctx, sizeof(*ctx));
+        return ret;
+    }
+    /* Freed with the mapping */
+    vm_find_region(p->vm, IORING_MAP_BASE)->page_order = order;
+    vm_get_address_space(p->vm);
+
+    ctx->rings = rings;
+    ctx->sqes = (struct ioring_sqe *)((uint8_t *)rings + sqes_off);
+    ctx->cqes = (struct ioring_cqe *)((uint8_t *)rings + cqes_off);
+    ctx->sq_entries = sq_entries;
+    ctx->cq_entries = 2 * sq_entries;
+    ctx->flags = flags;
+    ctx->order = order;
+    ctx->refs = 1;
+    ctx->as = p->vm;
+    init_waitqueue_head(&ctx->sq_wait);
+    init_waitqueue_head(&ctx->cq_wait);
+
+    if (flags & IORING_SETUP_SQPOLL) {
+        t = thread_create("ioring-sq", ioring_sq_thread, ctx,
+                          THREAD_DEFAULT_STACK_SIZE, THREAD_FLAG_KERNEL);
+        if (t == NULL) {
+            ioring_put(ctx);
+            return -12;  /* ENOMEM */
+        }
+        /* Runs in the process's address space, so the user pointers in
+         * the SQEs mean what they do to the process */
+        t->as = ctx->as;
+        ctx->sq_thread = t;
+        ctx->refs = 2;
+        scheduler_add_thread(t);
+    }
+
+    p->ring = ctx;
+    klog_debug("IORING", "PID=%d: %u SQEs, %u CQEs, order %u%s", p->pid,
+               sq_entries, 2 * sq_entries, order,
+               (flags & IORING_SETUP_SQPOLL) ? ", polled" : "");
+    return (int64_t)IORING_MAP_BASE;
+}
+
+/**
+ * ioring_enter - Submit SQEs and wait for completions
+ * @p: Process
+ * @to_submit: Most SQEs to run
+ * @min_complete: With IORING_ENTER_GETEVENTS, CQEs to wait for
+ * @flags: IORING_ENTER_*
+ *
+ * Without a poller the SQEs run here, in order, before this returns, so
+ * their completions are already posted and IORING_ENTER_GETEVENTS never
+ * sleeps. With one, this only wakes it (IORING_ENTER_SQ_WAKEUP) and
+ * waits for its completions.
+ *
+ * Returns: Number of SQEs run (@to_submit with a poller), or negative
+ *          error code: -EBUSY if the CQ is full or another thread is
+ *          submitting
+ */
+int64_t ioring_enter(process_t *p, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+    struct ioring *ctx = p != NULL ? p->ring : NULL;
+    int64_t ret = 0;
+
+    if (ctx == NULL || (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))) {
+        return -22;  /* EINVAL */
+    }
+
+    if (ctx->sq_thread != NULL) {
+        if (flags & IORING_ENTER_SQ_WAKEUP) {
+            wake_up(&ctx->sq_wait);
+        }
+        ret = to_submit;
+        if (flags & IORING_ENTER_GETEVENTS) {
+            if (min_complete > ctx->cq_entries) {
+                min_complete = ctx->cq_entries;
+            }
+            wait_event(ctx->cq_wait, ioring_cq_ready(ctx) >= min_complete);
+        }
+        return ret;
+    }
+
+    if (to_submit != 0) {
+        if (__atomic_exchange_n(&ctx->submitting, 1, __ATOMIC_ACQUIRE)) {
+            return -16;  /* EBUSY */
+        }
+        ret = ioring_submit(ctx, to_submit, 0);
+        if (ret == 0 && ioring_sq_pending(ctx) != 0) {
+            ret = -16;  /* EBUSY: CQ full */
+        }
+        __atomic_store_n(&ctx->submitting, 0, __ATOMIC_RELEASE);
+    }
+    return ret;
+}
+
+/**
+ * ioring_destroy - Tear down a process's rings
+ * @p: Process
+ *
+ * Stops the poller, if any; the block is unmapped and freed once it has
+ * exited. Safe to call on a process without rings.
+ */
+void ioring_destroy(process_t *p)
+{
+    struct ioring *ctx = p->ring;
+
+    if (ctx == NULL) {
+        return;
+    }
+    p->ring = NULL;
+
+    if (ctx->sq_thread != NULL) {
+        __atomic_store_n(&ctx->stop, 1, __ATOMIC_RELEASE);
+        wake_up(&ctx->sq_wait);
+    }
+    ioring_put(ctx);
+}
@@ -0,0 +1,109 @@
+/* Emergence Kernel - Submission/completion rings
+ *
+ * A process queues syscalls in shared memory and collects their results
+ * there, so a batch of N operations costs one SYSCALL instead of N, or
+ * none at all with a polling kernel thread:
+ *
+ *   sys_ioring_setup()  maps one block at IORING_MAP_BASE:
+ *
+ *     0          struct ioring_rings   indices and flags, a cache line per ring
+ *     sqes_off   struct ioring_sqe[sq_entries]   written by the process
+ *     cqes_off   struct ioring_cqe[cq_entries]   written by the kernel
+ *
+ *   sys_ioring_enter()  runs up to @to_submit queued entries in order and
+ *                       posts one completion for each
+ *
+ * Each ring has a producer and a consumer index, free-running 32-bit
+ * counters masked on use. The producer fills an entry, then publishes it
+ * with a release store of its index; the consumer reads the index with
+ * acquire before reading the entry. The process produces SQEs (sq_tail)
+ * and consumes CQEs (cq_head); the kernel does the opposite.
+ *
+ * An SQE is a syscall: @opcode is its number and @args its arguments,
+ * run through the same table as the SYSCALL instruction. Only syscalls
+ * listed in ioring.c are accepted; anything else completes with -EINVAL.
+ * Adding an operation is adding a line there.
+ *
+ * With IORING_SETUP_SQPOLL a kernel thread consumes the SQ as entries
+ * appear. When it has found nothing to do for IORING_SQPOLL_IDLE_NS it
+ * sets IORING_SQ_NEED_WAKEUP and sleeps, and the process must call
+ * sys_ioring_enter() with IORING_ENTER_SQ_WAKEUP after queueing more.
+ * The process must order its sq_tail store before its sq_flags load
+ * (MFENCE or a locked instruction), or it can miss the flag.
+ */
+
+#ifndef _KERNEL_IORING_H
+#define _KERNEL_IORING_H
+
+#include <stdint.h>
+
+/* User address of the ring block, below the vDSO */
+#define IORING_MAP_BASE         0x7ffe00000000ULL
+
+/* Largest SQ; the CQ has twice as many entries */
+#define IORING_MAX_ENTRIES      256
+
+/* sys_ioring_setup() flags */
+#define IORING_SETUP_SQPOLL     (1U << 0)   /* Consume the SQ from a kernel thread */
+
+/* sys_ioring_enter() flags */
+#define IORING_ENTER_GETEVENTS  (1U << 0)   /* Wait for @min_complete CQEs */
+#define IORING_ENTER_SQ_WAKEUP  (1U << 1)   /* Wake a sleeping SQ poller */
+
+/* ioring_rings.sq_flags */
+#define IORING_SQ_NEED_WAKEUP   (1U << 0)   /* Poller asleep: enter to wake it */
+
+/* SQE opcode that does nothing and completes with 0 */
+#define IORING_OP_NOP           0
+
+/* How long an idle SQ poller spins before sleeping */
+#define IORING_SQPOLL_IDLE_NS   1000000ULL
+
+/* Submission queue entry: one syscall */
+struct ioring_sqe {
+    uint32_t opcode;                /* IORING_OP_NOP or a syscall number */
+    uint32_t flags;                 /* Reserved, must be 0 */
+    uint64_t user_data;             /* Copied to the CQE */
+    uint64_t args[6];               /* Syscall arguments */
+};
+
+/* Completion queue entry */
+struct ioring_cqe {
+    uint64_t user_data;             /* From the SQE */
+    int64_t res;                    /* Syscall return value */
+};
+
+/*
+ * Shared header. The kernel keeps its own copy of the masks and offsets
+ * and never reads them back from here.
+ */
+struct ioring_rings {
+    /* SQ: process produces */
+    uint32_t sq_head;               /* Next SQE the kernel runs (kernel writes) */
+    uint32_t sq_tail;               /* Next free SQE (process writes) */
+    uint32_t sq_mask;               /* sq_entries - 1 */
+    uint32_t sq_flags;              /* IORING_SQ_* (kernel writes) */
+    uint32_t sqes_off;              /* Byte offset of the SQE array */
+    uint32_t sq_pad[11];
+
+    /* CQ: kernel produces */
+    uint32_t cq_head;               /* Next CQE the process reads (process writes) */
+    uint32_t cq_tail;               /* Next free CQE (kernel writes) */
+    uint32_t cq_mask;               /* cq_entries - 1 */
+    uint32_t cqes_off;              /* Byte offset of the CQE array */
+    uint32_t cq_pad[12];
+};
+
+struct process;
+
+/* Create the calling process's rings; returns their user address */
+int64_t ioring_setup(struct process *p, uint32_t entries, uint32_t flags);
+
+/* Submit queued SQEs and optionally wait for completions */
+int64_t ioring_enter(struct process *p, uint32_t to_submit, uint32_t min_complete,
+                     uint32_t flags);
+
+/* Tear down a process's rings (exit, execve, reap); idempotent */
+void ioring_destroy(struct process *p);
+
+#endif /* _KERNEL_IORING_H */
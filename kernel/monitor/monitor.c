@@ -8,6 +8,8 @@
 #include "kernel/klog.h"
 #include "kernel/pcd.h"
 #include "kernel/pmm.h"
+#include "include/preempt.h"
+#include "arch/x86_64/smp.h"
 
 /* Page table index extraction macros */
 #define PML4_INDEX(vaddr) (((vaddr) >> 39) & 0x1FF)
@@ -18,7 +20,6 @@
 /* External functions */
 extern void *pmm_alloc(uint8_t order);
 extern void pmm_free(void *addr, uint8_t order);
-extern int smp_get_cpu_index(void);
 
 /* Internal PCD function (monitor-only access) */
 extern void _pcd_set_type_internal(uint64_t phys_addr, uint8_t type);
@@ -177,8 +178,6 @@ static void monitor_protect_state(void) {
  * - Shows per-invariant details only if CONFIG_DEBUG_NK_INVARIANTS_VERBOSE=1
  */
 void monitor_verify_invariants(void) {
-    extern int smp_get_cpu_index(void);
-
     int cpu_id = smp_get_cpu_index();
 
 #if CONFIG_DEBUG_NK_INVARIANTS_VERBOSE
@@ -861,6 +860,8 @@ extern monitor_ret_t nk_entry_trampoline(monitor_call_t call, uint64_t arg1,
  */
 monitor_ret_t monitor_call(monitor_call_t call, uint64_t arg1,
                             uint64_t arg2, uint64_t arg3) {
+    monitor_ret_t ret;
+
     /* If monitor not initialized yet, call directly */
     if (monitor_pml4_phys == 0) {
         return monitor_call_handler(call, arg1, arg2, arg3);
@@ -871,8 +872,14 @@ monitor_ret_t monitor_call(monitor_call_t call, uint64_t arg1,
         return monitor_call_handler(call, arg1, arg2, arg3);
     }
 
-    /* Unprivileged (CR0.WP=1): use trampoline to toggle CR0.WP */
-    return nk_entry_trampoline(call, arg1, arg2, arg3);
+    /* Unprivileged (CR0.WP=1): use trampoline to toggle CR0.WP.
+     * The trampoline keeps our RSP and CR0 in per-CPU data and runs on a
+     * shared stack, so we must stay on this CPU until it returns. */
+    preempt_disable();
+    ret = nk_entry_trampoline(call, arg1, arg2, arg3);
+    preempt_enable();
+
+    return ret;
 }
 
 /* PMM monitor call wrappers */
@@ -1,6 +1,7 @@
 /* Emergence Kernel - Physical Memory Manager (Buddy System Implementation) */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "kernel/pmm.h"
 #include "arch/x86_64/multiboot2.h"
 #include "include/spinlock.h"
@@ -223,6 +224,17 @@ void pmm_init(uint32_t mbi_addr) {
         pmm_reserve_region(mbi_info_addr, mbi_size_aligned);
     }
 
+    /* Reserve boot modules (the initramfs is mapped straight from its frames) */
+    uint64_t mod_start, mod_end;
+    for (int i = 0; multiboot_get_module(i, &mod_start, &mod_end, NULL) == 0; i++) {
+        uint64_t mod_base = mod_start & ~(uint64_t)(PAGE_SIZE - 1);
+        uint64_t mod_size = ((mod_end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1)) - mod_base;
+
+        klog_debug("PMM", "Reserving module %d at %p, size %lX bytes",
+                  i, (void *)mod_base, mod_size);
+        pmm_reserve_region(mod_base, mod_size);
+    }
+
     /* Reserve kernel region */
     uint64_t kernel_start = (uint64_t)_kernel_start;
     uint64_t kernel_end = (uint64_t)_kernel_end;
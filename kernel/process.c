@@ -13,12 +13,23 @@
 #include "kernel/slab.h"
 #include "kernel/pmm.h"
 #include "kernel/klog.h"
+#include "kernel/idr.h"
+#include "kernel/elf.h"
+#include "kernel/initramfs.h"
+#include "kernel/ioring.h"
+#include "arch/x86_64/include/uaccess.h"
+#include "arch/x86_64/include/vdso.h"
+#include "arch/x86_64/include/ptrace.h"
+#include "arch/x86_64/include/syscall.h"
 #include "include/string.h"
 #include "include/spinlock.h"
 
 /* External: kernel_halt from main.c */
 extern void kernel_halt(void);
 
+/* External: enter ring 3 (syscall_entry.S) */
+extern void jump_to_user_mode(uint64_t user_rip, uint64_t user_rsp, uint64_t user_rflags);
+
 /* Slab cache for process_t structures */
 static slab_cache_t process_cache_struct;
 static slab_cache_t *process_cache = &process_cache_struct;
@@ -27,10 +38,13 @@ static slab_cache_t *process_cache = &process_cache_struct;
 static struct list_head process_list;
 static spinlock_t process_list_lock = SPIN_LOCK_UNLOCKED;
 
-/* PID allocator */
-static int next_pid = 1;
+/* PID allocator and PID -> process map; pid_lock orders a lookup's
+ * reference against the PID's removal */
+static struct idr pid_idr;
 static spinlock_t pid_lock = SPIN_LOCK_UNLOCKED;
 
+_Static_assert(PID_MAX <= IDR_MAX, "PID_MAX exceeds the idr range");
+
 /* Idle "init" process (PID 1) */
 static process_t *init_process = NULL;
 
@@ -46,12 +60,16 @@ void process_init(void)
     /* Initialize global process list */
     list_init(&process_list);
     spin_lock_init(&process_list_lock);
+    idr_init(&pid_idr, 1);
     spin_lock_init(&pid_lock);
 
     /* Create slab cache for process_t structures */
     /* Note: slab_cache_create requires power-of-two size, so use 256 bytes */
     size_t process_size = sizeof(process_t);
     size_t cache_size = 256;  /* Next power of two that fits process_t */
+
+    /* Descriptors live in a separate table (kernel/fdtable.h) */
+    _Static_assert(sizeof(process_t) <= 512, "process_t outgrew its slab cache");
     if (process_size > cache_size) {
         cache_size = 512;  /* Use larger size if needed */
     }
@@ -61,14 +79,12 @@ void process_init(void)
         return;
     }
 
-    /* Create init process (PID 1) */
+    /* Create init process (the first PID handed out is 1) */
     init_process = process_create("init", 0);
     if (init_process == NULL) {
         klog_error("PROC", "Failed to create init process");
         return;
     }
-    init_process->pid = 1;
-    next_pid = 2;  /* Next PID will be 2 */
 
     klog_info("PROC", "Process subsystem initialized (init PID=%d)", init_process->pid);
 }
@@ -76,19 +92,20 @@ void process_init(void)
 /**
  * process_alloc_pid - Allocate a new PID
  *
+ * The PID is reserved but not mapped: process_get_by_pid() finds the
+ * process only once process_create() has finished setting it up. Freed
+ * PIDs are reused after the allocator has wrapped around.
+ *
  * Returns: New PID, or negative error code on failure
  */
 int process_alloc_pid(void)
 {
-    int pid;
+    int pid = idr_alloc(&pid_idr, NULL);
 
-    spin_lock(&pid_lock);
-    pid = next_pid++;
     if (pid >= PID_MAX) {
+        idr_remove(&pid_idr, pid);
         pid = -1;  /* Out of PIDs */
     }
-    spin_unlock(&pid_lock);
-
     return pid;
 }
 
@@ -98,8 +115,9 @@ int process_alloc_pid(void)
  */
 void process_free_pid(int pid)
 {
-    /* TODO: Add PID to free list for reuse */
-    (void)pid;
+    spin_lock(&pid_lock);
+    idr_remove(&pid_idr, pid);
+    spin_unlock(&pid_lock);
 }
 
 /**
@@ -127,10 +145,19 @@ process_t *process_create(const char *name, int flags)
     /* Clear structure */
     memset(p, 0, sizeof(process_t));
 
+    /* Descriptor table (forked children replace it with the parent's) */
+    p->files = fdtable_alloc();
+    if (p->files == NULL) {
+        klog_error("PROC", "Failed to allocate descriptor table");
+        slab_free(process_cache, p);
+        return NULL;
+    }
+
     /* Allocate PID */
     p->pid = process_alloc_pid();
     if (p->pid < 0) {
         klog_error("PROC", "Failed to allocate PID");
+        fdtable_put(p->files);
         slab_free(process_cache, p);
         return NULL;
     }
@@ -148,12 +175,13 @@ process_t *process_create(const char *name, int flags)
     p->state = PROCESS_CREATED;
     p->exit_status = 0;
     p->flags = 0;
+    p->refcount = 1;
     p->parent = NULL;
-    p->waiter = NULL;
+    init_waitqueue_head(&p->child_exit);
     spin_lock_init(&p->exit_lock);
     p->main_thread = NULL;
     p->vm = NULL;
-    p->fd_count = 0;
+    spin_lock_init(&p->fd_lock);
     p->thread_count = 0;
 
     /* Initialize lists */
@@ -166,6 +194,9 @@ process_t *process_create(const char *name, int flags)
     list_push_back(&process_list, &p->all_list);
     spin_unlock(&process_list_lock);
 
+    /* Visible to process_get_by_pid() from here on */
+    idr_replace(&pid_idr, p->pid, p);
+
     klog_info("PROC", "Created process '%s' (PID=%d)", p->name, p->pid);
 
     return p;
@@ -191,24 +222,33 @@ process_t *process_get_current(void)
  * process_get_by_pid - Find a process by PID
  * @pid: Process ID to find
  *
- * Returns: Pointer to process, or NULL if not found
+ * Constant time. The process cannot be freed until the caller drops
+ * the reference taken here with process_put().
+ *
+ * Returns: Referenced process, or NULL if not found
  */
 process_t *process_get_by_pid(int pid)
 {
-    struct list_head *pos;
-    process_t *result = NULL;
+    process_t *p;
 
-    spin_lock(&process_list_lock);
-    list_for_each(pos, &process_list) {
-        process_t *p = list_entry(pos, process_t, all_list);
-        if (p->pid == pid) {
-            result = p;
-            break;
-        }
+    spin_lock(&pid_lock);
+    p = idr_find(&pid_idr, pid);
+    if (p != NULL) {
+        __atomic_add_fetch(&p->refcount, 1, __ATOMIC_RELAXED);
     }
-    spin_unlock(&process_list_lock);
+    spin_unlock(&pid_lock);
+    return p;
+}
 
-    return result;
+/**
+ * process_put - Drop a reference from process_get_by_pid()
+ * @p: Process (may be NULL)
+ */
+void process_put(process_t *p)
+{
+    if (p != NULL && __atomic_sub_fetch(&p->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        slab_free(process_cache, p);
+    }
 }
 
 /**
@@ -227,7 +267,7 @@ void process_add_thread(process_t *p, thread_t *t)
     t->as = p->vm;
 
     /* Add to process's thread list */
-    list_push_back(&p->threads, &t->run_list);  /* Use run_list for linkage */
+    list_push_back(&p->threads, &t->thread_node);
     p->thread_count++;
 
     /* If first thread, set as main_thread */
@@ -251,7 +291,7 @@ void process_remove_thread(process_t *p, thread_t *t)
     }
 
     /* Remove from process's thread list */
-    list_remove(&t->run_list);
+    list_remove(&t->thread_node);
     p->thread_count--;
 
     /* Clear cross-references */
@@ -272,11 +312,7 @@ void process_remove_thread(process_t *p, thread_t *t)
                   p->pid, p->exit_status);
 
         /* Wake up parent if waiting */
-        if (p->parent != NULL && p->parent->waiter != NULL) {
-            thread_t *waiter = p->parent->waiter;
-            p->parent->waiter = NULL;
-            waiter->state = THREAD_READY;
-            scheduler_add_thread(waiter);
+        if (p->parent != NULL && wake_up_all(&p->parent->child_exit) > 0) {
             klog_debug("PROC", "Woke up parent PID=%d waiting for child", p->parent->pid);
         }
     }
@@ -322,6 +358,19 @@ process_t *process_fork(void)
         return NULL;
     }
 
+    if (vdso_map(child_vm, child->pid) != 0) {
+        klog_error("PROC", "fork: failed to map the vDSO");
+        vm_destroy_address_space(child_vm);
+        process_reap(child);
+        return NULL;
+    }
+
+    /* Share the parent's descriptors until either side changes them */
+    fdtable_put(child->files);
+    spin_lock(&parent->fd_lock);
+    child->files = fdtable_share(parent->files);
+    spin_unlock(&parent->fd_lock);
+
     /* Set up parent/child relationship */
     child->parent = parent;
     child->ppid = parent->pid;
@@ -339,8 +388,9 @@ process_t *process_fork(void)
                                   THREAD_FLAG_USER);
     if (child_thread == NULL) {
         klog_error("PROC", "fork: failed to create child thread");
-        vm_destroy_address_space(child_vm);
-        slab_free(process_cache, child);
+        /* Drops child_vm and the descriptors, and frees the PID */
+        list_remove(&child->siblings);
+        process_reap(child);
         return NULL;
     }
 
@@ -348,7 +398,11 @@ process_t *process_fork(void)
     child_thread->process = child;
     child_thread->as = child_vm;
     child_thread->flags = THREAD_FLAG_USER;
+    child_thread->cpus_allowed = parent_thread->cpus_allowed;
     /* TODO: Copy register state from parent */
+    if (fpu_thread_copy(child_thread, parent_thread) < 0) {
+        klog_warn("PROC", "fork: no memory for FPU state, child starts with a clean FPU");
+    }
 
     /* Add thread to process */
     process_add_thread(child, child_thread);
@@ -364,6 +418,425 @@ process_t *process_fork(void)
     return child;
 }
 
+/*
+ * First code run by a vfork child: return 0 from the parent's vfork in
+ * ring 3. @parent_regs stays valid until the child lets the parent go,
+ * which it cannot have done yet.
+ */
+static void process_vfork_start(void *parent_regs)
+{
+    struct pt_regs regs = *(const struct pt_regs *)parent_regs;
+
+    regs.rax = 0;
+    ret_to_user(&regs);
+}
+
+/**
+ * process_vfork - Create a child that borrows the current address space
+ * @regs: User registers saved on entry to the vfork syscall
+ *
+ * Returns: Pointer to child process (in parent), or NULL on failure
+ */
+process_t *process_vfork(const struct pt_regs *regs)
+{
+    process_t *parent, *child;
+    thread_t *parent_thread, *child_thread;
+
+    parent = process_get_current();
+    parent_thread = thread_get_current();
+    if (parent == NULL || parent_thread == NULL) {
+        klog_error("PROC", "vfork: no current process");
+        return NULL;
+    }
+
+    klog_info("PROC", "vforking process PID=%d", parent->pid);
+
+    child = process_create(parent->name, 0);
+    if (child == NULL) {
+        klog_error("PROC", "vfork: failed to create child process");
+        return NULL;
+    }
+
+    /* Share the parent's descriptors until either side changes them */
+    fdtable_put(child->files);
+    spin_lock(&parent->fd_lock);
+    child->files = fdtable_share(parent->files);
+    spin_unlock(&parent->fd_lock);
+
+    child_thread = thread_create(child->name, process_vfork_start, (void *)regs,
+                                 parent_thread->kernel_stack_size, THREAD_FLAG_USER);
+    if (child_thread == NULL) {
+        klog_error("PROC", "vfork: failed to create child thread");
+        process_reap(child);
+        return NULL;
+    }
+
+    /* Borrow the address space instead of cloning it */
+    vm_get_address_space(parent->vm);
+    child->vm = parent->vm;
+    child->parent = parent;
+    child->ppid = parent->pid;
+    list_push_back(&parent->children, &child->siblings);
+
+    child_thread->cpus_allowed = parent_thread->cpus_allowed;
+    child_thread->user_stack = parent_thread->user_stack;
+    child_thread->user_stack_size = parent_thread->user_stack_size;
+    child_thread->user_rsp = regs->rsp;
+    if (fpu_thread_copy(child_thread, parent_thread) < 0) {
+        klog_warn("PROC", "vfork: no memory for FPU state, child starts with a clean FPU");
+    }
+    process_add_thread(child, child_thread);
+
+    /* getpid through the vDSO answers for whoever runs in the address space */
+    vdso_set_pid(parent->vm, child->pid);
+
+    child->state = PROCESS_RUNNING;
+    child_thread->state = THREAD_READY;
+    scheduler_add_thread(child_thread);
+
+    /* The child runs on our memory: stay off it until the child lets go */
+    wait_event(parent->child_exit,
+               (child->flags & PROC_FLAG_VFORK_DONE) || child->state == PROCESS_ZOMBIE);
+    vdso_set_pid(parent->vm, parent->pid);
+
+    klog_info("PROC", "vfork: parent PID=%d resumed after child PID=%d",
+              parent->pid, child->pid);
+
+    return child;
+}
+
+/* Copy from a kernel pointer, or a user one with SPAWN_USER; 0 on success */
+static long spawn_copy(void *dst, const void *src, size_t n, int flags)
+{
+    if (flags & SPAWN_USER) {
+        return copy_from_user(dst, src, n);
+    }
+    memcpy(dst, src, n);
+    return 0;
+}
+
+/**
+ * spawn_map - Back a new user region with a block the region owns
+ * @as: Address space being built
+ * @start: Virtual start address
+ * @size: Size in bytes, rounded up to a power-of-two number of pages
+ * @flags: Page table flags
+ * @type: Region type
+ * @name: Region name
+ *
+ * Returns: Kernel (identity-mapped) address of the block, or NULL
+ */
+static uint8_t *spawn_map(address_space_t *as, uint64_t start, uint64_t size,
+                          uint64_t flags, vm_region_type_t type, const char *name)
+{
+    uint8_t order = 0;
+    uint8_t *block;
+
+    while (((uint64_t)PAGE_SIZE << order) < size) {
+        order++;
+    }
+
+    block = pmm_alloc(order);
+    if (block == NULL) {
+        return NULL;
+    }
+    if (vm_map_region(as, start, (uint64_t)block, (uint64_t)PAGE_SIZE << order,
+                      flags, type, name) != 0) {
+        pmm_free(block, order);
+        return NULL;
+    }
+
+    /* Freed with the address space */
+    vm_find_region(as, start)->page_order = order;
+    return block;
+}
+
+/**
+ * spawn_setup_stack - Lay out argc and argv on a new user stack
+ * @stack: Kernel address of the SPAWN_STACK_SIZE stack block
+ * @argv: NULL-terminated argument vector (may be NULL)
+ * @flags: SPAWN_USER if @argv is a user pointer
+ *
+ * The strings fill the top SPAWN_ARG_BYTES; below them, 16-byte
+ * aligned, go argc, the argv pointers and a NULL.
+ *
+ * Returns: Initial user RSP, or 0 if @argv is too big or unreadable
+ */
+static uint64_t spawn_setup_stack(uint8_t *stack, const char *const argv[], int flags)
+{
+    uint8_t *top = stack + SPAWN_STACK_SIZE;
+    char *strings = (char *)top - SPAWN_ARG_BYTES;
+    char *next = strings;
+    uint64_t uargv[SPAWN_ARG_MAX];
+    const char *arg;
+    uint64_t *sp;
+    size_t room;
+    long len;
+    int argc, i;
+
+/* User address of a byte of the stack block */
+#define SPAWN_STACK_UADDR(p) (USER_STACK_BASE - (uint64_t)(top - (uint8_t *)(p)))
+
+    for (argc = 0; argv != NULL; argc++) {
+        if (spawn_copy(&arg, &argv[argc], sizeof(arg), flags) != 0) {
+            return 0;
+        }
+        if (arg == NULL) {
+            break;
+        }
+        if (argc == SPAWN_ARG_MAX) {
+            klog_warn("PROC", "spawn: more than %d arguments", SPAWN_ARG_MAX);
+            return 0;
+        }
+
+        /* A string filling all the room may have been cut short */
+        room = SPAWN_ARG_BYTES - (size_t)(next - strings);
+        if (flags & SPAWN_USER) {
+            len = strncpy_from_user(next, arg, room);
+        } else {
+            len = (long)strlen(arg);
+            if ((size_t)len < room) {
+                memcpy(next, arg, (size_t)len + 1);
+            }
+        }
+        if (len < 0 || (size_t)len >= room - 1) {
+            klog_warn("PROC", "spawn: arguments exceed %d bytes", SPAWN_ARG_BYTES);
+            return 0;
+        }
+
+        uargv[argc] = SPAWN_STACK_UADDR(next);
+        next += len + 1;
+    }
+
+    /* argc, argv[0..argc-1], NULL and padding to keep RSP 16-byte aligned */
+    sp = (uint64_t *)strings - (argc + 2 + (argc & 1));
+    sp[0] = (uint64_t)argc;
+    for (i = 0; i < argc; i++) {
+        sp[1 + i] = uargv[i];
+    }
+    sp[1 + argc] = 0;
+
+    return SPAWN_STACK_UADDR(sp);
+
+#undef SPAWN_STACK_UADDR
+}
+
+/* First code run by a spawned process: enter its image in ring 3 */
+static void process_spawn_start(void *entry)
+{
+    thread_t *t = thread_get_current();
+
+    /* RFLAGS: IF=1, bit 1=1 (reserved but must be 1) */
+    jump_to_user_mode((uint64_t)entry, t->user_rsp, 0x202);
+}
+
+/**
+ * process_spawn - Start a process running a fresh image
+ * @name: Process name
+ * @image: Flat binary, loaded at SPAWN_LOAD_BASE and entered at its start
+ * @size: Size of @image in bytes
+ * @argv: NULL-terminated argument vector (may be NULL)
+ * @flags: SPAWN_USER if @image and @argv are user pointers
+ *
+ * Costs one address space, two regions and the copy of @image,
+ * however big the caller's address space is.
+ *
+ * Returns: Pointer to child process, or NULL on failure
+ */
+process_t *process_spawn(const char *name, const void *image, size_t size,
+                         const char *const argv[], int flags)
+{
+    process_t *parent = process_get_current();
+    process_t *child;
+    thread_t *child_thread;
+    address_space_t *child_vm;
+    uint8_t *text, *stack;
+    uint64_t user_rsp;
+
+    if (image == NULL || size == 0 || size > SPAWN_IMAGE_MAX) {
+        klog_error("PROC", "spawn: bad image size %lu", (unsigned long)size);
+        return NULL;
+    }
+
+    klog_info("PROC", "Spawning '%s' (%lu byte image)", name, (unsigned long)size);
+
+    child_vm = vm_create_address_space(AS_SHARE_KERNEL);
+    if (child_vm == NULL) {
+        klog_error("PROC", "spawn: failed to create address space");
+        return NULL;
+    }
+
+    /* Image, written through the kernel mapping of its pages */
+    text = spawn_map(child_vm, SPAWN_LOAD_BASE, size, PT_PRESENT | PT_USER,
+                     VM_REGION_CODE, "text");
+    stack = spawn_map(child_vm, USER_STACK_BASE - SPAWN_STACK_SIZE, SPAWN_STACK_SIZE,
+                      PT_PRESENT | PT_USER | PT_WRITE | PT_NX, VM_REGION_STACK, "stack");
+    if (text == NULL || stack == NULL) {
+        klog_error("PROC", "spawn: out of memory for image or stack");
+        goto fail_vm;
+    }
+    if (spawn_copy(text, image, size, flags) != 0) {
+        klog_warn("PROC", "spawn: image at %p is not readable", image);
+        goto fail_vm;
+    }
+    memset(text + size, 0, vm_find_region(child_vm, SPAWN_LOAD_BASE)->end -
+                           SPAWN_LOAD_BASE - size);
+    memset(stack, 0, SPAWN_STACK_SIZE);
+
+    user_rsp = spawn_setup_stack(stack, argv, flags);
+    if (user_rsp == 0) {
+        goto fail_vm;
+    }
+
+    child = process_create(name, 0);
+    if (child == NULL) {
+        klog_error("PROC", "spawn: failed to create process");
+        goto fail_vm;
+    }
+    child->vm = child_vm;
+
+    if (vdso_map(child_vm, child->pid) != 0) {
+        klog_error("PROC", "spawn: failed to map the vDSO");
+        process_reap(child);
+        return NULL;
+    }
+
+    child_thread = thread_create(child->name, process_spawn_start,
+                                 (void *)SPAWN_LOAD_BASE, 0, THREAD_FLAG_USER);
+    if (child_thread == NULL) {
+        klog_error("PROC", "spawn: failed to create thread");
+        process_reap(child);
+        return NULL;
+    }
+    child_thread->user_stack = (void *)(USER_STACK_BASE - SPAWN_STACK_SIZE);
+    child_thread->user_stack_size = SPAWN_STACK_SIZE;
+    child_thread->user_rsp = user_rsp;
+
+    /* Share the parent's descriptors until either side changes them */
+    if (parent != NULL) {
+        fdtable_put(child->files);
+        spin_lock(&parent->fd_lock);
+        child->files = fdtable_share(parent->files);
+        spin_unlock(&parent->fd_lock);
+
+        child->parent = parent;
+        child->ppid = parent->pid;
+        list_push_back(&parent->children, &child->siblings);
+    }
+
+    process_add_thread(child, child_thread);
+
+    child->state = PROCESS_RUNNING;
+    child_thread->state = THREAD_READY;
+    scheduler_add_thread(child_thread);
+
+    klog_info("PROC", "Spawned '%s' as PID=%d", child->name, child->pid);
+
+    return child;
+
+fail_vm:
+    vm_destroy_address_space(child_vm);
+    return NULL;
+}
+
+/* @p no longer uses a vfork parent's memory: let the parent run */
+static void process_vfork_release(process_t *p)
+{
+    if (p->parent == NULL || (p->flags & PROC_FLAG_VFORK_DONE)) {
+        return;
+    }
+    p->flags |= PROC_FLAG_VFORK_DONE;
+    wake_up_all(&p->parent->child_exit);
+}
+
+/**
+ * process_execve - Replace the current program with one from the initramfs
+ * @path: Path of the executable in the initramfs
+ * @argv: NULL-terminated argument vector (may be NULL)
+ * @flags: SPAWN_USER if @argv is a user pointer
+ *
+ * Only the pages the program touches are ever mapped; read-only ones
+ * are the initramfs's own frames.
+ *
+ * Returns: Only on failure, with a negative error code
+ */
+int process_execve(const char *path, const char *const argv[], int flags)
+{
+    process_t *p = process_get_current();
+    thread_t *t = thread_get_current();
+    struct initramfs_file file;
+    address_space_t *vm, *old_vm;
+    uint64_t entry, user_rsp;
+    uint8_t *stack;
+    int ret;
+
+    if (p == NULL || t == NULL) {
+        klog_error("PROC", "execve: no current process");
+        return -1;  /* EPERM */
+    }
+
+    if (initramfs_lookup(path, &file) != 0 ||
+        (file.mode & INITRAMFS_S_IFMT) != INITRAMFS_S_IFREG) {
+        klog_warn("PROC", "execve: %s not found in the initramfs", path);
+        return -2;  /* ENOENT */
+    }
+
+    klog_info("PROC", "PID=%d executing %s (%lu bytes)", p->pid, path,
+              (unsigned long)file.size);
+
+    vm = vm_create_address_space(AS_SHARE_KERNEL);
+    if (vm == NULL) {
+        return -12;  /* ENOMEM */
+    }
+
+    ret = elf_load(vm, file.data, file.size, &entry);
+    if (ret != 0) {
+        goto fail_vm;
+    }
+    ret = vdso_map(vm, p->pid);
+    if (ret != 0) {
+        goto fail_vm;
+    }
+
+    /* argv is read from the old address space, still the live one */
+    stack = spawn_map(vm, USER_STACK_BASE - SPAWN_STACK_SIZE, SPAWN_STACK_SIZE,
+                      PT_PRESENT | PT_USER | PT_WRITE | PT_NX, VM_REGION_STACK, "stack");
+    if (stack == NULL) {
+        ret = -12;  /* ENOMEM */
+        goto fail_vm;
+    }
+    memset(stack, 0, SPAWN_STACK_SIZE);
+    user_rsp = spawn_setup_stack(stack, argv, flags);
+    if (user_rsp == 0) {
+        ret = -7;  /* E2BIG */
+        goto fail_vm;
+    }
+
+    /* No way back from here: the rings go with the old program */
+    ioring_destroy(p);
+    old_vm = p->vm;
+    p->vm = vm;
+    t->as = vm;
+    t->user_stack = (void *)(USER_STACK_BASE - SPAWN_STACK_SIZE);
+    t->user_stack_size = SPAWN_STACK_SIZE;
+    t->user_rsp = user_rsp;
+    snprintf(p->name, PROCESS_NAME_MAX, "%s", path);
+
+    scheduler_switch_address_space();
+    process_vfork_release(p);
+    vm_put_address_space(old_vm);
+
+    /* RFLAGS: IF=1, bit 1=1 (reserved but must be 1) */
+    jump_to_user_mode(entry, user_rsp, 0x202);
+
+    klog_error("PROC", "execve: returned from user mode");
+    process_exit(-1);
+
+fail_vm:
+    vm_destroy_address_space(vm);
+    return ret;
+}
+
 /**
  * process_exit - Exit the current process
  * @exit_code: Exit status code
@@ -386,25 +859,73 @@ void process_exit(int exit_code)
     p->state = PROCESS_ZOMBIE;
     spin_unlock(&p->exit_lock);
 
-    /* TODO: Close all file descriptors */
-    /* TODO: Notify parent */
+    /* Notify parent */
+    if (p->parent != NULL) {
+        wake_up_all(&p->parent->child_exit);
+    }
+
+    /* Close all file descriptors */
+    spin_lock(&p->fd_lock);
+    fdtable_put(p->files);
+    p->files = NULL;
+    spin_unlock(&p->fd_lock);
+
+    /* Stop any SQ poller now rather than when the parent reaps us */
+    ioring_destroy(p);
+
     /* TODO: Reap child processes (give to init) */
 
     /* Exit current thread - this will trigger process cleanup */
     thread_exit();
 }
 
+/**
+ * process_wait_done - Check whether wait() can return
+ * @parent: Waiting process
+ * @pid: PID to match (-1 = any child)
+ * @zombie: Returns the first matching zombie, or NULL
+ *
+ * Returns: Non-zero if a matching child has exited or none is left
+ */
+static int process_wait_done(process_t *parent, int pid, process_t **zombie)
+{
+    struct list_head *pos;
+    int found = 0;
+
+    *zombie = NULL;
+
+    list_for_each(pos, &parent->children) {
+        process_t *child = list_entry(pos, process_t, siblings);
+
+        if (pid != -1 && child->pid != pid) {
+            continue;
+        }
+
+        if (child->state == PROCESS_ZOMBIE) {
+            *zombie = child;
+            return 1;
+        }
+        found = 1;
+    }
+
+    return !found;
+}
+
 /**
  * process_wait - Wait for a child process to exit
  * @pid: PID to wait for (-1 = any child)
  * @status: Pointer to store exit status
  *
+ * Sleeps on the caller's child_exit wait queue until a matching child
+ * becomes a zombie.
+ *
  * Returns: PID of exited child, or negative error code on failure
  */
 int process_wait(int pid, int *status)
 {
     process_t *current;
-    struct list_head *pos;
+    process_t *child;
+    int child_pid;
 
     current = process_get_current();
     if (current == NULL) {
@@ -413,37 +934,26 @@ int process_wait(int pid, int *status)
 
     klog_debug("PROC", "Process PID=%d waiting for child PID=%d", current->pid, pid);
 
-    /* Find exited child */
-    list_for_each(pos, &current->children) {
-        process_t *child = list_entry(pos, process_t, siblings);
-
-        if (pid != -1 && child->pid != pid) {
-            continue;
-        }
-
-        if (child->state == PROCESS_ZOMBIE) {
-            /* Child has exited - reap it */
-            if (status != NULL) {
-                *status = child->exit_status;
-            }
-
-            int child_pid = child->pid;
+    /* Block until a matching child has exited */
+    wait_event(current->child_exit, process_wait_done(current, pid, &child));
+    if (child == NULL) {
+        return -1;  /* ECHILD */
+    }
 
-            /* Remove from children list */
-            list_remove(&child->siblings);
+    /* Child has exited - reap it */
+    if (status != NULL) {
+        *status = child->exit_status;
+    }
 
-            /* Reap child process */
-            process_reap(child);
+    child_pid = child->pid;
 
-            return child_pid;
-        }
-    }
+    /* Remove from children list */
+    list_remove(&child->siblings);
 
-    /* No exited child found - block current thread */
-    /* TODO: Implement proper blocking wait */
-    klog_debug("PROC", "No exited child found, would block");
+    /* Reap child process */
+    process_reap(child);
 
-    return -1;  /* ECHILD */
+    return child_pid;
 }
 
 /**
@@ -458,9 +968,12 @@ void process_reap(process_t *p)
 
     klog_debug("PROC", "Reaping zombie process PID=%d", p->pid);
 
-    /* Destroy address space */
+    /* Rings of a process that never exited */
+    ioring_destroy(p);
+
+    /* Drop the address space (a vfork child only borrowed it) */
     if (p->vm != NULL) {
-        vm_destroy_address_space(p->vm);
+        vm_put_address_space(p->vm);
         p->vm = NULL;
     }
 
@@ -469,11 +982,81 @@ void process_reap(process_t *p)
     list_remove(&p->all_list);
     spin_unlock(&process_list_lock);
 
-    /* Free PID */
+    /* Drop the descriptor table if the process never exited */
+    fdtable_put(p->files);
+    p->files = NULL;
+
+    /* Free PID: lookups find nothing from here on */
     process_free_pid(p->pid);
 
-    /* Free process structure */
-    slab_free(process_cache, p);
+    /* Free process structure once no lookup holds it */
+    process_put(p);
 
     klog_debug("PROC", "Process reaped successfully");
 }
+
+/**
+ * process_fd_install - Open a file descriptor
+ * @p: Process
+ * @file: Object the descriptor refers to (must not be NULL)
+ * @flags: Descriptor flags
+ *
+ * Returns: Lowest free descriptor, or -1 if the table is full or out of memory
+ */
+int process_fd_install(process_t *p, void *file, int flags)
+{
+    int fd = -1;
+
+    spin_lock(&p->fd_lock);
+    if (p->files != NULL && fdtable_unshare(&p->files) == 0) {
+        fd = fdtable_install(p->files, file, flags);
+    }
+    spin_unlock(&p->fd_lock);
+
+    return fd;
+}
+
+/**
+ * process_fd_close - Close a file descriptor
+ * @p: Process
+ * @fd: Descriptor
+ *
+ * Returns: 0 on success, -1 if @fd is not open
+ */
+int process_fd_close(process_t *p, int fd)
+{
+    int ret = -1;
+
+    spin_lock(&p->fd_lock);
+    if (p->files != NULL && fdtable_lookup(p->files, fd) != NULL &&
+        fdtable_unshare(&p->files) == 0) {
+        ret = fdtable_close(p->files, fd);
+    }
+    spin_unlock(&p->fd_lock);
+
+    return ret;
+}
+
+/**
+ * process_fd_get - Get the object behind a file descriptor
+ * @p: Process
+ * @fd: Descriptor
+ *
+ * Returns: The file given to process_fd_install(), or NULL if @fd is not open
+ */
+void *process_fd_get(process_t *p, int fd)
+{
+    process_fd_t *entry;
+    void *file = NULL;
+
+    spin_lock(&p->fd_lock);
+    if (p->files != NULL) {
+        entry = fdtable_lookup(p->files, fd);
+        if (entry != NULL) {
+            file = entry->file;
+        }
+    }
+    spin_unlock(&p->fd_lock);
+
+    return file;
+}
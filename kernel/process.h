@@ -12,10 +12,14 @@
 #include "kernel/list.h"
 #include "kernel/thread.h"
 #include "kernel/vm.h"
+#include "kernel/wait.h"
+#include "kernel/fdtable.h"
 #include "include/spinlock.h"
 
-/* Forward declaration */
+/* Forward declarations */
 typedef struct process process_t;
+struct ioring;
+struct pt_regs;
 
 /* Process states */
 typedef enum {
@@ -29,27 +33,9 @@ typedef enum {
 /* Maximum process name length */
 #define PROCESS_NAME_MAX  32
 
-/* Maximum number of open file descriptors per process */
-#define PROCESS_MAX_FDS  256
-
 /* Maximum PID value */
 #define PID_MAX          32768
 
-/**
- * struct process_fd - File descriptor entry
- * @flags: File descriptor flags (close-on-exec, etc.)
- * @refcount: Reference count for dup()
- * @file: Pointer to file structure (when VFS is implemented)
- *
- * Tracks open file descriptors for a process.
- * For now, this is a stub until full VFS is implemented.
- */
-typedef struct process_fd {
-    int flags;
-    int refcount;
-    void *file;  /* Will be struct file * when VFS exists */
-} process_fd_t;
-
 /**
  * struct process - Process Control Block
  * @pid: Process ID
@@ -69,10 +55,11 @@ typedef struct process_fd {
  * @main_thread: Primary thread (for single-threaded processes)
  *
  * @vm: Virtual address space
- * @fd_table: File descriptor table
- * @fd_count: Number of open file descriptors
+ * @files: File descriptor table, shared with forked children until written
+ * @fd_lock: Serializes this process's descriptor table changes
+ * @ring: Submission/completion rings (kernel/ioring.h), or NULL
  *
- * @waiter: Thread waiting for this process to exit (for wait/wait4)
+ * @child_exit: Woken whenever a child becomes a zombie (for wait/wait4)
  * @exit_lock: Lock protecting exit-related fields
  *
  * Per-process control block containing all state needed for
@@ -85,6 +72,7 @@ struct process {
     process_state_t state;          /* Current state */
     int exit_status;                /* Exit status code */
     int flags;                      /* Process flags */
+    int refcount;                   /* Until reaped, plus process_get_by_pid() holders (atomic) */
     char name[PROCESS_NAME_MAX];    /* Process name */
 
     /* Process hierarchy */
@@ -102,11 +90,14 @@ struct process {
     address_space_t *vm;            /* Virtual address space */
 
     /* File I/O (stub until VFS is implemented) */
-    process_fd_t fd_table[PROCESS_MAX_FDS];
-    int fd_count;
+    struct fdtable *files;          /* Descriptor table (kernel/fdtable.h) */
+    spinlock_t fd_lock;             /* Protects files */
+
+    /* Batched syscalls */
+    struct ioring *ring;            /* Rings from sys_ioring_setup() */
 
     /* Wait/exit synchronization */
-    thread_t *waiter;               /* Thread waiting for exit */
+    wait_queue_head_t child_exit;   /* Threads waiting for a child to exit */
     spinlock_t exit_lock;           /* Lock for exit fields */
 };
 
@@ -115,6 +106,16 @@ struct process {
 #define PROC_FLAG_PTRACED    (1 << 1)  /* Process is being traced (ptrace) */
 #define PROC_FLAG_VFORK_DONE (1 << 2)  /* vfork parent has released */
 
+/* process_spawn() image layout */
+#define SPAWN_LOAD_BASE   0x400000ULL       /* Image loaded and entered here */
+#define SPAWN_IMAGE_MAX   (1024 * 1024)     /* Largest image */
+#define SPAWN_STACK_SIZE  (64 * 1024)       /* Initial user stack, below USER_STACK_BASE */
+#define SPAWN_ARG_MAX     32                /* Arguments, including argv[0] */
+#define SPAWN_ARG_BYTES   4096              /* Argument strings, including NULs */
+
+/* process_spawn() flags */
+#define SPAWN_USER        (1 << 0)          /* @image and @argv are user pointers */
+
 /* Process API */
 
 /**
@@ -148,6 +149,53 @@ process_t *process_create(const char *name, int flags);
  */
 process_t *process_fork(void);
 
+/**
+ * process_vfork - Create a child that borrows the current address space
+ * @regs: User registers saved on entry to the vfork syscall
+ *
+ * Returns: Pointer to child process (in parent), or NULL on failure
+ *
+ * Like process_fork(), but the child shares the parent's address space
+ * instead of a copy, and the parent sleeps until the child exits (or
+ * sets PROC_FLAG_VFORK_DONE when it stops using the borrowed memory).
+ * The child enters ring 3 with @regs, returning 0 from the syscall.
+ */
+process_t *process_vfork(const struct pt_regs *regs);
+
+/**
+ * process_spawn - Start a process running a fresh image
+ * @name: Process name
+ * @image: Flat binary, loaded at SPAWN_LOAD_BASE and entered at its start
+ * @size: Size of @image in bytes (at most SPAWN_IMAGE_MAX)
+ * @argv: NULL-terminated argument vector (may be NULL)
+ * @flags: SPAWN_USER if @image and @argv are user pointers
+ *
+ * Returns: Pointer to child process, or NULL on failure
+ *
+ * Builds the child's address space from @image alone: the caller's page
+ * tables are neither cloned nor touched. The child is a child of the
+ * current process, if any, and shares its descriptors until either side
+ * changes them. It enters user mode with RSP pointing at argc, followed
+ * by the argv pointers and a NULL.
+ */
+process_t *process_spawn(const char *name, const void *image, size_t size,
+                         const char *const argv[], int flags);
+
+/**
+ * process_execve - Replace the current program with one from the initramfs
+ * @path: Path of a static ELF64 executable in the initramfs
+ * @argv: NULL-terminated argument vector (may be NULL)
+ * @flags: SPAWN_USER if @argv is a user pointer (@path is a kernel string)
+ *
+ * Returns: Only on failure, with a negative error code and the current
+ *          program untouched
+ *
+ * Builds a new address space whose segments are mapped straight from
+ * the initramfs (see kernel/elf.h), drops the old one, releases a vfork
+ * parent and enters the program in user mode.
+ */
+int process_execve(const char *path, const char *const argv[], int flags);
+
 /**
  * process_exit - Exit the current process
  * @exit_code: Exit status code
@@ -191,10 +239,20 @@ process_t *process_get_current(void);
  * process_get_by_pid - Find a process by PID
  * @pid: Process ID to find
  *
- * Returns: Pointer to process, or NULL if not found
+ * The caller must drop the reference with process_put().
+ *
+ * Returns: Referenced process, or NULL if not found
  */
 process_t *process_get_by_pid(int pid);
 
+/**
+ * process_put - Drop a reference from process_get_by_pid()
+ * @p: Process (may be NULL)
+ *
+ * The structure of a reaped process is freed with the last reference.
+ */
+void process_put(process_t *p);
+
 /**
  * process_add_thread - Add a thread to a process
  * @p: Process
@@ -226,4 +284,32 @@ int process_alloc_pid(void);
  */
 void process_free_pid(int pid);
 
+/**
+ * process_fd_install - Open a file descriptor
+ * @p: Process
+ * @file: Object the descriptor refers to (must not be NULL)
+ * @flags: Descriptor flags
+ *
+ * Returns: Lowest free descriptor, or -1 if the table is full or out of memory
+ */
+int process_fd_install(process_t *p, void *file, int flags);
+
+/**
+ * process_fd_close - Close a file descriptor
+ * @p: Process
+ * @fd: Descriptor
+ *
+ * Returns: 0 on success, -1 if @fd is not open
+ */
+int process_fd_close(process_t *p, int fd);
+
+/**
+ * process_fd_get - Get the object behind a file descriptor
+ * @p: Process
+ * @fd: Descriptor
+ *
+ * Returns: The file given to process_fd_install(), or NULL if @fd is not open
+ */
+void *process_fd_get(process_t *p, int fd);
+
 #endif /* _KERNEL_PROCESS_H */
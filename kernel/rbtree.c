@@ -0,0 +1,370 @@
+/* Emergence Kernel - Red-black tree implementation
+ *
+ * Classic CLRS red-black tree with explicit parent pointers. Properties:
+ *   1) Every node is red or black.
+ *   2) The root is black.
+ *   3) A red node has no red children.
+ *   4) Every path from a node to its NULL leaves has the same number of
+ *      black nodes.
+ * which bounds the height to 2*log2(n+1).
+ */
+
+#include <stddef.h>
+#include "kernel/rbtree.h"
+
+/* NULL leaves count as black */
+static inline int rb_is_black(struct rb_node *node) {
+    return node == NULL || node->color == RB_BLACK;
+}
+
+static inline int rb_is_red(struct rb_node *node) {
+    return node != NULL && node->color == RB_RED;
+}
+
+/**
+ * rb_replace_child - Point whatever referenced @old at @new instead
+ * @parent: Parent of @old (NULL if @old is the root)
+ * @old: Child being replaced
+ * @new: Replacement (may be NULL)
+ * @root: Tree root
+ */
+static void rb_replace_child(struct rb_node *parent, struct rb_node *old,
+                             struct rb_node *new, struct rb_root *root) {
+    if (parent == NULL) {
+        root->node = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+/**
+ * rb_rotate_left - Rotate @node down to the left
+ * @node: Node whose right child moves up
+ * @root: Tree root
+ */
+static void rb_rotate_left(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *right = node->right;
+    struct rb_node *parent = node->parent;
+
+    node->right = right->left;
+    if (right->left != NULL) {
+        right->left->parent = node;
+    }
+
+    right->left = node;
+    right->parent = parent;
+    rb_replace_child(parent, node, right, root);
+    node->parent = right;
+}
+
+/**
+ * rb_rotate_right - Rotate @node down to the right
+ * @node: Node whose left child moves up
+ * @root: Tree root
+ */
+static void rb_rotate_right(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *left = node->left;
+    struct rb_node *parent = node->parent;
+
+    node->left = left->right;
+    if (left->right != NULL) {
+        left->right->parent = node;
+    }
+
+    left->right = node;
+    left->parent = parent;
+    rb_replace_child(parent, node, left, root);
+    node->parent = left;
+}
+
+/**
+ * rb_insert_color - Restore red-black properties after insertion
+ * @node: Newly linked (red) node
+ * @root: Tree root
+ */
+void rb_insert_color(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *parent, *gparent, *uncle;
+
+    while ((parent = node->parent) != NULL && parent->color == RB_RED) {
+        /* Parent is red, so it is not the root and gparent exists */
+        gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+
+            /* Case 1: red uncle - recolor and continue upwards */
+            if (rb_is_red(uncle)) {
+                parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            /* Case 2: node is an inner child - rotate into case 3 */
+            if (node == parent->right) {
+                rb_rotate_left(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+
+            /* Case 3: node is an outer child */
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_right(gparent, root);
+        } else {
+            uncle = gparent->left;
+
+            if (rb_is_red(uncle)) {
+                parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->left) {
+                rb_rotate_right(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_left(gparent, root);
+        }
+    }
+
+    root->node->color = RB_BLACK;
+}
+
+/**
+ * rb_erase_color - Restore red-black properties after removing a black node
+ * @node: Node that took the removed node's place (may be NULL)
+ * @parent: Parent of @node
+ * @root: Tree root
+ *
+ * @node carries an extra black that is pushed up or resolved by rotation.
+ */
+static void rb_erase_color(struct rb_node *node, struct rb_node *parent,
+                           struct rb_root *root) {
+    struct rb_node *sibling;
+
+    while (node != root->node && rb_is_black(node)) {
+        if (node == parent->left) {
+            sibling = parent->right;
+
+            /* Case 1: red sibling - rotate to get a black sibling */
+            if (rb_is_red(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(parent, root);
+                sibling = parent->right;
+            }
+
+            /* Case 2: sibling has two black children - recolor, move up */
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+
+            /* Case 3: sibling's far child is black - rotate into case 4 */
+            if (rb_is_black(sibling->right)) {
+                sibling->left->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_right(sibling, root);
+                sibling = parent->right;
+            }
+
+            /* Case 4: sibling's far child is red - rotate and finish */
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->right->color = RB_BLACK;
+            rb_rotate_left(parent, root);
+            node = root->node;
+            break;
+        } else {
+            sibling = parent->left;
+
+            if (rb_is_red(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(parent, root);
+                sibling = parent->left;
+            }
+
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+
+            if (rb_is_black(sibling->left)) {
+                sibling->right->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_left(sibling, root);
+                sibling = parent->left;
+            }
+
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->left->color = RB_BLACK;
+            rb_rotate_right(parent, root);
+            node = root->node;
+            break;
+        }
+    }
+
+    if (node != NULL) {
+        node->color = RB_BLACK;
+    }
+}
+
+/**
+ * rb_erase - Remove a node from the tree
+ * @node: Node to remove (must be linked into @root)
+ * @root: Tree root
+ *
+ * The node is left in the "cleared" state (rb_empty_node() is true).
+ */
+void rb_erase(struct rb_node *node, struct rb_root *root) {
+    struct rb_node *child, *parent;
+    int color;
+
+    if (node->left == NULL || node->right == NULL) {
+        /* At most one child: splice the node out directly */
+        child = node->left != NULL ? node->left : node->right;
+        parent = node->parent;
+        color = node->color;
+
+        if (child != NULL) {
+            child->parent = parent;
+        }
+        rb_replace_child(parent, node, child, root);
+    } else {
+        /* Two children: move the in-order successor into node's place */
+        struct rb_node *successor = node->right;
+
+        while (successor->left != NULL) {
+            successor = successor->left;
+        }
+
+        child = successor->right;
+        parent = successor->parent;
+        color = successor->color;
+
+        if (parent == node) {
+            /* Successor is node's right child and keeps its right subtree */
+            parent = successor;
+        } else {
+            if (child != NULL) {
+                child->parent = parent;
+            }
+            parent->left = child;
+
+            successor->right = node->right;
+            node->right->parent = successor;
+        }
+
+        successor->left = node->left;
+        node->left->parent = successor;
+        successor->parent = node->parent;
+        successor->color = node->color;
+        rb_replace_child(node->parent, node, successor, root);
+    }
+
+    if (color == RB_BLACK) {
+        rb_erase_color(child, parent, root);
+    }
+
+    rb_clear_node(node);
+}
+
+/**
+ * rb_first - Get the smallest node
+ * @root: Tree root
+ *
+ * Returns: Leftmost node, or NULL if the tree is empty
+ */
+struct rb_node *rb_first(const struct rb_root *root) {
+    struct rb_node *node = root->node;
+
+    if (node == NULL) {
+        return NULL;
+    }
+    while (node->left != NULL) {
+        node = node->left;
+    }
+    return node;
+}
+
+/**
+ * rb_last - Get the largest node
+ * @root: Tree root
+ *
+ * Returns: Rightmost node, or NULL if the tree is empty
+ */
+struct rb_node *rb_last(const struct rb_root *root) {
+    struct rb_node *node = root->node;
+
+    if (node == NULL) {
+        return NULL;
+    }
+    while (node->right != NULL) {
+        node = node->right;
+    }
+    return node;
+}
+
+/**
+ * rb_next - Get the in-order successor
+ * @node: Current node
+ *
+ * Returns: Next node, or NULL if @node is the largest
+ */
+struct rb_node *rb_next(const struct rb_node *node) {
+    struct rb_node *parent;
+
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL) {
+            node = node->left;
+        }
+        return (struct rb_node *)node;
+    }
+
+    /* Walk up until we come from a left child */
+    while ((parent = node->parent) != NULL && node == parent->right) {
+        node = parent;
+    }
+    return parent;
+}
+
+/**
+ * rb_prev - Get the in-order predecessor
+ * @node: Current node
+ *
+ * Returns: Previous node, or NULL if @node is the smallest
+ */
+struct rb_node *rb_prev(const struct rb_node *node) {
+    struct rb_node *parent;
+
+    if (node->left != NULL) {
+        node = node->left;
+        while (node->right != NULL) {
+            node = node->right;
+        }
+        return (struct rb_node *)node;
+    }
+
+    /* Walk up until we come from a right child */
+    while ((parent = node->parent) != NULL && node == parent->left) {
+        node = parent;
+    }
+    return parent;
+}
@@ -0,0 +1,138 @@
+/* Emergence Kernel - Red-black tree implementation (Linux-style)
+ *
+ * Intrusive red-black tree: embed struct rb_node in the object and use
+ * rb_entry() to get back to it. Callers do their own ordered descent and
+ * link the new node with rb_link_node() followed by rb_insert_color().
+ *
+ * struct rb_root_cached additionally caches the leftmost node so the
+ * minimum can be read in O(1), which is what ordered runqueues need.
+ */
+
+#ifndef _KERNEL_RBTREE_H
+#define _KERNEL_RBTREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RB_RED   0
+#define RB_BLACK 1
+
+/* Tree node */
+struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    int color;
+};
+
+/* Tree root */
+struct rb_root {
+    struct rb_node *node;
+};
+
+/* Tree root with cached leftmost node */
+struct rb_root_cached {
+    struct rb_root root;
+    struct rb_node *leftmost;
+};
+
+#define RB_ROOT         ((struct rb_root){ NULL })
+#define RB_ROOT_CACHED  ((struct rb_root_cached){ { NULL }, NULL })
+
+/* Get container structure from rb_node member pointer */
+#define rb_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - (uint64_t)&((type *)0)->member))
+
+/* Get container structure, or NULL if @ptr is NULL */
+#define rb_entry_safe(ptr, type, member) \
+    ((ptr) ? rb_entry(ptr, type, member) : NULL)
+
+/* Initialize a root */
+static inline void rb_root_init(struct rb_root *root) {
+    root->node = NULL;
+}
+
+/* Initialize a cached root */
+static inline void rb_root_cached_init(struct rb_root_cached *root) {
+    root->root.node = NULL;
+    root->leftmost = NULL;
+}
+
+/* Check if tree is empty */
+static inline int rb_empty(struct rb_root *root) {
+    return root->node == NULL;
+}
+
+/* Mark a node as not linked into any tree */
+static inline void rb_clear_node(struct rb_node *node) {
+    node->parent = node;
+}
+
+/* Check if a node is not linked into any tree */
+static inline int rb_empty_node(struct rb_node *node) {
+    return node->parent == node;
+}
+
+/**
+ * rb_link_node - Attach a node at a leaf position found by descent
+ * @node: Node to link
+ * @parent: Parent of the leaf position (NULL for an empty tree)
+ * @link: Child pointer of @parent (or root->node) to fill in
+ *
+ * Must be followed by rb_insert_color() to rebalance.
+ */
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+                                struct rb_node **link) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+}
+
+/* Rebalance after rb_link_node() */
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+
+/* Remove a node and rebalance */
+void rb_erase(struct rb_node *node, struct rb_root *root);
+
+/* In-order navigation (NULL at either end) */
+struct rb_node *rb_first(const struct rb_root *root);
+struct rb_node *rb_last(const struct rb_root *root);
+struct rb_node *rb_next(const struct rb_node *node);
+struct rb_node *rb_prev(const struct rb_node *node);
+
+/* Get the cached leftmost node */
+static inline struct rb_node *rb_first_cached(const struct rb_root_cached *root) {
+    return root->leftmost;
+}
+
+/**
+ * rb_insert_color_cached - Rebalance and maintain the leftmost cache
+ * @node: Node just linked with rb_link_node()
+ * @root: Cached root
+ * @leftmost: Non-zero if the descent never went right
+ */
+static inline void rb_insert_color_cached(struct rb_node *node,
+                                          struct rb_root_cached *root,
+                                          int leftmost) {
+    if (leftmost) {
+        root->leftmost = node;
+    }
+    rb_insert_color(node, &root->root);
+}
+
+/**
+ * rb_erase_cached - Remove a node and maintain the leftmost cache
+ * @node: Node to remove
+ * @root: Cached root
+ */
+static inline void rb_erase_cached(struct rb_node *node,
+                                   struct rb_root_cached *root) {
+    if (root->leftmost == node) {
+        root->leftmost = rb_next(node);
+    }
+    rb_erase(node, &root->root);
+}
+
+#endif /* _KERNEL_RBTREE_H */
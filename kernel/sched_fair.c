@@ -0,0 +1,457 @@
+/* Emergence Kernel - Fair Scheduling Class
+ *
+ * Proportional-share scheduling by weighted virtual runtime. Each thread
+ * accumulates vruntime at a rate inversely proportional to its weight
+ * (derived from its nice value), and the thread with the smallest vruntime
+ * runs next. Over a scheduling period every runnable thread therefore gets
+ * CPU time in proportion to its weight.
+ *
+ * Runtime is measured with sched_clock() rather than timer ticks, so a
+ * thread that blocks halfway through a tick is charged only for what it
+ * actually used.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
+#include "kernel/rbtree.h"
+#include "arch/x86_64/tsc.h"
+
+/* Nice to weight table
+ *
+ * Each nice step changes the weight by ~1.25x, so a thread gets ~10% more
+ * or less CPU than a thread one nice level away. Nice 0 maps to NICE_0_LOAD.
+ */
+static const uint64_t sched_prio_to_weight[40] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548, 7620, 6100, 4904, 3906,
+    /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+    /*   0 */ 1024, 820, 655, 526, 423,
+    /*   5 */ 335, 272, 215, 172, 137,
+    /*  10 */ 110, 87, 70, 56, 45,
+    /*  15 */ 36, 29, 23, 18, 15,
+};
+
+/* Number of threads that fit into SCHED_LATENCY_NS at minimum granularity */
+#define SCHED_NR_LATENCY (SCHED_LATENCY_NS / SCHED_MIN_GRANULARITY_NS)
+
+/* ============================================================================
+ * Helpers
+ * ============================================================================ */
+
+/* Wrap-safe vruntime comparison */
+static inline int entity_before(struct sched_entity *a, struct sched_entity *b) {
+    return (int64_t)(a->vruntime - b->vruntime) < 0;
+}
+
+static inline uint64_t max_vruntime(uint64_t a, uint64_t b) {
+    return (int64_t)(b - a) > 0 ? b : a;
+}
+
+static inline uint64_t min_vruntime(uint64_t a, uint64_t b) {
+    return (int64_t)(b - a) < 0 ? b : a;
+}
+
+/* Get the thread running on @rq if it belongs to the fair class */
+static inline thread_t *cfs_curr(runqueue_t *rq) {
+    thread_t *curr = rq->curr;
+
+    if (curr == NULL || curr == rq->idle || curr->sched_class != &fair_sched_class) {
+        return NULL;
+    }
+    return curr;
+}
+
+/**
+ * sched_calc_delta_fair - Scale a runtime delta by NICE_0_LOAD / weight
+ * @delta: Runtime in nanoseconds
+ * @weight: Load weight of the thread
+ *
+ * Returns: Virtual runtime delta
+ */
+uint64_t sched_calc_delta_fair(uint64_t delta, uint64_t weight) {
+    if (weight == NICE_0_LOAD) {
+        return delta;
+    }
+    return delta * NICE_0_LOAD / weight;
+}
+
+/**
+ * sched_period - Length of one scheduling period
+ * @nr_running: Number of runnable threads
+ *
+ * Returns: Period in nanoseconds
+ */
+static uint64_t sched_period(int nr_running) {
+    if ((uint64_t)nr_running > SCHED_NR_LATENCY) {
+        return (uint64_t)nr_running * SCHED_MIN_GRANULARITY_NS;
+    }
+    return SCHED_LATENCY_NS;
+}
+
+/**
+ * sched_slice - Wall-clock slice a running thread is entitled to
+ * @cfs: Fair runqueue (@t is running, so not queued on it)
+ * @t: Running thread
+ *
+ * Returns: Slice in nanoseconds, proportional to @t's share of the load
+ */
+static uint64_t sched_slice(struct cfs_rq *cfs, thread_t *t) {
+    uint64_t load = cfs->load_weight + t->se.weight;
+
+    return sched_period(cfs->nr_running + 1) * t->se.weight / load;
+}
+
+/**
+ * update_min_vruntime - Advance the runqueue's vruntime floor
+ * @cfs: Fair runqueue
+ * @curr: Running fair thread, or NULL
+ */
+static void update_min_vruntime(struct cfs_rq *cfs, thread_t *curr) {
+    struct rb_node *leftmost = rb_first_cached(&cfs->timeline);
+    uint64_t vruntime = cfs->min_vruntime;
+
+    if (curr != NULL) {
+        vruntime = curr->se.vruntime;
+    }
+
+    if (leftmost != NULL) {
+        struct sched_entity *se = rb_entry(leftmost, struct sched_entity, run_node);
+
+        if (curr == NULL) {
+            vruntime = se->vruntime;
+        } else {
+            vruntime = min_vruntime(vruntime, se->vruntime);
+        }
+    }
+
+    /* Never go backwards */
+    cfs->min_vruntime = max_vruntime(cfs->min_vruntime, vruntime);
+}
+
+/**
+ * update_curr - Charge the running thread for time since last accounting
+ * @rq: Runqueue (lock held)
+ */
+static void update_curr(runqueue_t *rq) {
+    thread_t *curr = cfs_curr(rq);
+    uint64_t now, delta;
+
+    if (curr == NULL) {
+        return;
+    }
+
+    now = sched_clock();
+    delta = now - curr->se.exec_start;
+    if ((int64_t)delta <= 0) {
+        return;
+    }
+
+    curr->se.exec_start = now;
+    curr->se.sum_exec_runtime += delta;
+    curr->se.vruntime += sched_calc_delta_fair(delta, curr->se.weight);
+
+    update_min_vruntime(&rq->cfs, curr);
+}
+
+/**
+ * place_entity - Choose the vruntime of a thread entering the runqueue
+ * @cfs: Fair runqueue
+ * @t: New or woken thread
+ *
+ * New threads start at min_vruntime, so they neither jump the queue nor
+ * wait behind everything already queued. Woken threads keep their own
+ * vruntime, but get at most half a latency period of credit for the time
+ * they slept. This lets interactive threads preempt CPU hogs promptly
+ * without starving them after a long sleep.
+ */
+static void place_entity(struct cfs_rq *cfs, thread_t *t) {
+    uint64_t vruntime = cfs->min_vruntime;
+
+    if (t->se.sum_exec_runtime != 0) {
+        vruntime -= SCHED_LATENCY_NS / 2;
+    }
+
+    t->se.vruntime = max_vruntime(t->se.vruntime, vruntime);
+}
+
+/* ============================================================================
+ * Timeline (rbtree) management
+ * ============================================================================ */
+
+/**
+ * __enqueue_entity - Insert a thread into the timeline
+ * @cfs: Fair runqueue
+ * @se: Entity to insert
+ *
+ * Equal keys go to the right, so threads with the same vruntime run in
+ * FIFO order.
+ */
+static void __enqueue_entity(struct cfs_rq *cfs, struct sched_entity *se) {
+    struct rb_node **link = &cfs->timeline.root.node;
+    struct rb_node *parent = NULL;
+    int leftmost = 1;
+
+    while (*link != NULL) {
+        struct sched_entity *entry;
+
+        parent = *link;
+        entry = rb_entry(parent, struct sched_entity, run_node);
+        if (entity_before(se, entry)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+
+    rb_link_node(&se->run_node, parent, link);
+    rb_insert_color_cached(&se->run_node, &cfs->timeline, leftmost);
+}
+
+/**
+ * __dequeue_entity - Remove a thread from the timeline
+ * @cfs: Fair runqueue
+ * @se: Entity to remove
+ */
+static void __dequeue_entity(struct cfs_rq *cfs, struct sched_entity *se) {
+    rb_erase_cached(&se->run_node, &cfs->timeline);
+}
+
+/* ============================================================================
+ * Class operations
+ * ============================================================================ */
+
+static void enqueue_thread_fair(runqueue_t *rq, thread_t *t, int flags) {
+    struct cfs_rq *cfs = &rq->cfs;
+
+    /* Keep min_vruntime current before using it as a baseline */
+    update_curr(rq);
+
+    /* Migrated threads carry vruntime relative to their old runqueue */
+    if (flags & ENQUEUE_MIGRATED) {
+        t->se.vruntime += cfs->min_vruntime;
+    }
+
+    if (flags & ENQUEUE_WAKEUP) {
+        place_entity(cfs, t);
+    }
+
+    __enqueue_entity(cfs, &t->se);
+    cfs->nr_running++;
+    cfs->load_weight += t->se.weight;
+}
+
+static void dequeue_thread_fair(runqueue_t *rq, thread_t *t, int flags) {
+    struct cfs_rq *cfs = &rq->cfs;
+
+    update_curr(rq);
+
+    __dequeue_entity(cfs, &t->se);
+    cfs->nr_running--;
+    cfs->load_weight -= t->se.weight;
+
+    update_min_vruntime(cfs, cfs_curr(rq));
+
+    /* Make vruntime relative so it can be rebased on the new runqueue */
+    if (flags & DEQUEUE_MIGRATE) {
+        t->se.vruntime -= cfs->min_vruntime;
+    }
+}
+
+static thread_t *pick_next_thread_fair(runqueue_t *rq) {
+    struct rb_node *leftmost = rb_first_cached(&rq->cfs.timeline);
+
+    if (leftmost == NULL) {
+        return NULL;
+    }
+    return rb_entry(leftmost, thread_t, se.run_node);
+}
+
+static void set_next_thread_fair(runqueue_t *rq, thread_t *t) {
+    (void)rq;
+
+    /* Start a new slice */
+    t->se.exec_start = sched_clock();
+    t->se.prev_sum_exec_runtime = t->se.sum_exec_runtime;
+}
+
+static void put_prev_thread_fair(runqueue_t *rq, thread_t *t) {
+    (void)t;
+
+    /* rq->curr is still @t here - charge it for its last stretch */
+    update_curr(rq);
+}
+
+/**
+ * task_tick_fair - Check whether the running thread has used its slice
+ *
+ * Preempts once the thread has run for its weighted share of the period,
+ * or, after at least the minimum granularity, once its vruntime is more
+ * than a slice ahead of the leftmost queued thread.
+ */
+static int task_tick_fair(runqueue_t *rq, thread_t *curr) {
+    struct cfs_rq *cfs = &rq->cfs;
+    struct rb_node *leftmost;
+    uint64_t ideal_runtime, delta_exec;
+    int64_t delta;
+
+    update_curr(rq);
+
+    if (cfs->nr_running == 0) {
+        return 0;
+    }
+
+    ideal_runtime = sched_slice(cfs, curr);
+    delta_exec = curr->se.sum_exec_runtime - curr->se.prev_sum_exec_runtime;
+    if (delta_exec > ideal_runtime) {
+        return 1;
+    }
+
+    if (delta_exec < SCHED_MIN_GRANULARITY_NS) {
+        return 0;
+    }
+
+    leftmost = rb_first_cached(&cfs->timeline);
+    delta = (int64_t)(curr->se.vruntime -
+                      rb_entry(leftmost, struct sched_entity, run_node)->vruntime);
+
+    return delta > (int64_t)ideal_runtime;
+}
+
+/**
+ * slice_remaining_fair - Time left in the running thread's slice
+ *
+ * Mirrors the first check in task_tick_fair(); the vruntime test there is
+ * only a refinement and is caught by the following tick.
+ */
+static uint64_t slice_remaining_fair(runqueue_t *rq, thread_t *curr) {
+    struct cfs_rq *cfs = &rq->cfs;
+    uint64_t ideal_runtime, delta_exec;
+
+    if (cfs->nr_running == 0) {
+        return SCHED_SLICE_INFINITE;
+    }
+
+    update_curr(rq);
+
+    ideal_runtime = sched_slice(cfs, curr);
+    delta_exec = curr->se.sum_exec_runtime - curr->se.prev_sum_exec_runtime;
+
+    return delta_exec < ideal_runtime ? ideal_runtime - delta_exec : 0;
+}
+
+/**
+ * check_preempt_curr_fair - Wakeup preemption within the fair class
+ *
+ * A waking thread preempts only if it is behind the running thread by more
+ * than the wakeup granularity, which stops ping-ponging between threads
+ * with nearly equal vruntime.
+ */
+static int check_preempt_curr_fair(runqueue_t *rq, thread_t *t) {
+    thread_t *curr = rq->curr;
+    int64_t delta;
+
+    update_curr(rq);
+
+    delta = (int64_t)(curr->se.vruntime - t->se.vruntime);
+    return delta > (int64_t)sched_calc_delta_fair(SCHED_WAKEUP_GRANULARITY_NS, t->se.weight);
+}
+
+/**
+ * migrate_thread_rq_fair - A sleeping thread is woken on another CPU
+ * @rq: Runqueue it last ran on (lock held)
+ * @t: Thread
+ *
+ * Makes its vruntime relative, like DEQUEUE_MIGRATE does for a queued
+ * thread, so ENQUEUE_MIGRATED can rebase it on the new runqueue.
+ */
+static void migrate_thread_rq_fair(runqueue_t *rq, thread_t *t) {
+    t->se.vruntime -= rq->cfs.min_vruntime;
+}
+
+/**
+ * switched_to_fair - A running thread moved into the fair class
+ *
+ * Its vruntime may be arbitrarily stale; place it like a waking thread.
+ */
+static void switched_to_fair(runqueue_t *rq, thread_t *t) {
+    place_entity(&rq->cfs, t);
+}
+
+/**
+ * select_migratable_fair - Pick a thread for the load balancer
+ *
+ * Scans from the rightmost (largest vruntime) end: those threads would
+ * wait longest here, and are the least likely to be cache hot. Threads
+ * that can_migrate_thread() rules out are skipped.
+ */
+static thread_t *select_migratable_fair(runqueue_t *rq, int dst_cpu) {
+    struct rb_node *node;
+
+    for (node = rb_last(&rq->cfs.timeline.root); node != NULL; node = rb_prev(node)) {
+        thread_t *t = rb_entry(node, thread_t, se.run_node);
+
+        if (can_migrate_thread(t, dst_cpu)) {
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+const struct sched_class fair_sched_class = {
+    .next               = NULL,
+    .name               = "fair",
+    .enqueue_thread     = enqueue_thread_fair,
+    .dequeue_thread     = dequeue_thread_fair,
+    .pick_next_thread   = pick_next_thread_fair,
+    .set_next_thread    = set_next_thread_fair,
+    .put_prev_thread    = put_prev_thread_fair,
+    .task_tick          = task_tick_fair,
+    .slice_remaining    = slice_remaining_fair,
+    .check_preempt_curr = check_preempt_curr_fair,
+    .select_migratable  = select_migratable_fair,
+    .migrate_thread_rq  = migrate_thread_rq_fair,
+    .switched_to        = switched_to_fair,
+};
+
+/* ============================================================================
+ * Initialization
+ * ============================================================================ */
+
+/**
+ * init_cfs_rq - Initialize a fair runqueue
+ * @cfs: Fair runqueue
+ */
+void init_cfs_rq(struct cfs_rq *cfs) {
+    rb_root_cached_init(&cfs->timeline);
+    cfs->min_vruntime = 0;
+    cfs->load_weight = 0;
+    cfs->nr_running = 0;
+}
+
+/**
+ * sched_fair_set_weight - Set the nice value and weight of a thread
+ * @t: Thread (must not be queued)
+ * @nice: Nice value (NICE_MIN..NICE_MAX)
+ */
+void sched_fair_set_weight(thread_t *t, int nice) {
+    t->se.nice = nice;
+    t->se.weight = sched_prio_to_weight[nice - NICE_MIN];
+}
+
+/**
+ * sched_fair_init_thread - Initialize the fair class state of a thread
+ * @t: New thread
+ */
+void sched_fair_init_thread(thread_t *t) {
+    rb_clear_node(&t->se.run_node);
+    t->se.vruntime = 0;
+    t->se.exec_start = 0;
+    t->se.sum_exec_runtime = 0;
+    t->se.prev_sum_exec_runtime = 0;
+    sched_fair_set_weight(t, 0);
+}
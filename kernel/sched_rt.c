@@ -0,0 +1,279 @@
+/* Emergence Kernel - Real-Time Scheduling Class
+ *
+ * Fixed-priority scheduling for latency-critical threads. Any queued
+ * real-time thread runs before every fair thread. Within the class the
+ * highest priority wins; equal priorities are served FIFO.
+ *
+ *   SCHED_FIFO - runs until it blocks, yields or is preempted by a higher
+ *                priority; a preempted thread keeps its place at the head.
+ *   SCHED_RR   - like FIFO, but after SCHED_RR_TIMESLICE_NS it moves to the
+ *                tail of its priority list if others are waiting.
+ *
+ * Picking is O(1): the runqueue keeps a bitmap of non-empty priority lists
+ * and the highest priority is found with bsf over two 64-bit words.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
+#include "kernel/list.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/tsc.h"
+
+/* ============================================================================
+ * Priority bitmap
+ * ============================================================================ */
+
+/* Map a priority to its queue/bitmap index (highest priority = index 0) */
+static inline int rt_index(int prio) {
+    return SCHED_RT_PRIO_MAX - prio;
+}
+
+static inline void rt_bitmap_set(struct rt_rq *rt, int idx) {
+    rt->bitmap[idx / 64] |= 1ULL << (idx % 64);
+}
+
+static inline void rt_bitmap_clear(struct rt_rq *rt, int idx) {
+    rt->bitmap[idx / 64] &= ~(1ULL << (idx % 64));
+}
+
+/**
+ * rt_find_first - Find the highest-priority non-empty queue
+ * @rt: RT runqueue
+ *
+ * Returns: Queue index, or -1 if no RT thread is queued
+ */
+static inline int rt_find_first(struct rt_rq *rt) {
+    for (int i = 0; i < RT_BITMAP_WORDS; i++) {
+        if (rt->bitmap[i] != 0) {
+            return i * 64 + (int)arch_bsf(rt->bitmap[i]);
+        }
+    }
+    return -1;
+}
+
+/* Get the thread running on @rq if it belongs to the RT class */
+static inline thread_t *rt_curr(runqueue_t *rq) {
+    thread_t *curr = rq->curr;
+
+    if (curr == NULL || curr == rq->idle || curr->sched_class != &rt_sched_class) {
+        return NULL;
+    }
+    return curr;
+}
+
+/**
+ * update_curr_rt - Charge the running RT thread for time since last accounting
+ * @rq: Runqueue (lock held)
+ */
+static void update_curr_rt(runqueue_t *rq) {
+    thread_t *curr = rt_curr(rq);
+    uint64_t now, delta;
+
+    if (curr == NULL) {
+        return;
+    }
+
+    now = sched_clock();
+    delta = now - curr->se.exec_start;
+    if ((int64_t)delta <= 0) {
+        return;
+    }
+
+    curr->se.exec_start = now;
+    curr->se.sum_exec_runtime += delta;
+
+    if (curr->rt.policy == SCHED_RR) {
+        curr->rt.time_slice -= (int64_t)delta;
+    }
+}
+
+/* ============================================================================
+ * Class operations
+ * ============================================================================ */
+
+static void enqueue_thread_rt(runqueue_t *rq, thread_t *t, int flags) {
+    struct rt_rq *rt = &rq->rt;
+    int idx = rt_index(t->rt.prio);
+    int head;
+
+    /* A preempted thread that still has budget resumes first */
+    head = (flags & ENQUEUE_PREEMPTED) &&
+           (t->rt.policy == SCHED_FIFO || t->rt.time_slice > 0);
+
+    if (t->rt.policy == SCHED_RR && t->rt.time_slice <= 0) {
+        t->rt.time_slice = SCHED_RR_TIMESLICE_NS;
+    }
+
+    if (head) {
+        list_push_front(&rt->queue[idx], &t->rt.run_list);
+    } else {
+        list_push_back(&rt->queue[idx], &t->rt.run_list);
+    }
+    rt_bitmap_set(rt, idx);
+    rt->nr_running++;
+}
+
+static void dequeue_thread_rt(runqueue_t *rq, thread_t *t, int flags) {
+    struct rt_rq *rt = &rq->rt;
+    int idx = rt_index(t->rt.prio);
+
+    (void)flags;
+
+    list_remove(&t->rt.run_list);
+    if (list_empty(&rt->queue[idx])) {
+        rt_bitmap_clear(rt, idx);
+    }
+    rt->nr_running--;
+}
+
+static thread_t *pick_next_thread_rt(runqueue_t *rq) {
+    int idx = rt_find_first(&rq->rt);
+
+    if (idx < 0) {
+        return NULL;
+    }
+    return list_entry(rq->rt.queue[idx].next, thread_t, rt.run_list);
+}
+
+static void set_next_thread_rt(runqueue_t *rq, thread_t *t) {
+    (void)rq;
+    t->se.exec_start = sched_clock();
+}
+
+static void put_prev_thread_rt(runqueue_t *rq, thread_t *t) {
+    (void)t;
+    update_curr_rt(rq);
+}
+
+/**
+ * task_tick_rt - Round-robin time slice expiry
+ *
+ * FIFO threads are never preempted by the tick. An RR thread whose slice
+ * ran out is preempted only if another thread of the same priority is
+ * waiting; otherwise it just gets a fresh slice.
+ */
+static int task_tick_rt(runqueue_t *rq, thread_t *curr) {
+    int idx;
+
+    update_curr_rt(rq);
+
+    /* Higher priority woke up without preempting us yet */
+    idx = rt_find_first(&rq->rt);
+    if (idx >= 0 && idx < rt_index(curr->rt.prio)) {
+        return 1;
+    }
+
+    if (curr->rt.policy != SCHED_RR || curr->rt.time_slice > 0) {
+        return 0;
+    }
+
+    if (list_empty(&rq->rt.queue[rt_index(curr->rt.prio)])) {
+        curr->rt.time_slice = SCHED_RR_TIMESLICE_NS;
+        return 0;
+    }
+
+    /* Leave time_slice exhausted so enqueue puts us at the tail */
+    return 1;
+}
+
+/**
+ * slice_remaining_rt - Time until the running RT thread yields to a peer
+ *
+ * Only an RR thread with a waiting peer of its own priority has an expiry;
+ * a higher priority waiting already means preempt now.
+ */
+static uint64_t slice_remaining_rt(runqueue_t *rq, thread_t *curr) {
+    int idx = rt_find_first(&rq->rt);
+
+    if (idx >= 0 && idx < rt_index(curr->rt.prio)) {
+        return 0;
+    }
+
+    if (curr->rt.policy != SCHED_RR ||
+        list_empty(&rq->rt.queue[rt_index(curr->rt.prio)])) {
+        return SCHED_SLICE_INFINITE;
+    }
+
+    update_curr_rt(rq);
+
+    return curr->rt.time_slice > 0 ? (uint64_t)curr->rt.time_slice : 0;
+}
+
+static int check_preempt_curr_rt(runqueue_t *rq, thread_t *t) {
+    return t->rt.prio > rq->curr->rt.prio;
+}
+
+/**
+ * select_migratable_rt - Pick a thread for the load balancer
+ *
+ * Offers the highest-priority waiting thread that may run on @dst_cpu:
+ * an idle CPU that pulls it cuts its wakeup latency the most.
+ */
+static thread_t *select_migratable_rt(runqueue_t *rq, int dst_cpu) {
+    struct rt_rq *rt = &rq->rt;
+
+    if (rt->nr_running == 0) {
+        return NULL;
+    }
+
+    for (int idx = rt_find_first(rt); idx < SCHED_RT_PRIO_NR; idx++) {
+        struct list_head *pos;
+
+        list_for_each(pos, &rt->queue[idx]) {
+            thread_t *t = list_entry(pos, thread_t, rt.run_list);
+
+            if (can_migrate_thread(t, dst_cpu)) {
+                return t;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+const struct sched_class rt_sched_class = {
+    .next               = &fair_sched_class,
+    .name               = "rt",
+    .enqueue_thread     = enqueue_thread_rt,
+    .dequeue_thread     = dequeue_thread_rt,
+    .pick_next_thread   = pick_next_thread_rt,
+    .set_next_thread    = set_next_thread_rt,
+    .put_prev_thread    = put_prev_thread_rt,
+    .task_tick          = task_tick_rt,
+    .slice_remaining    = slice_remaining_rt,
+    .check_preempt_curr = check_preempt_curr_rt,
+    .select_migratable  = select_migratable_rt,
+    .migrate_thread_rq  = NULL,
+    .switched_to        = NULL,
+};
+
+/* ============================================================================
+ * Initialization
+ * ============================================================================ */
+
+/**
+ * init_rt_rq - Initialize an RT runqueue
+ * @rt: RT runqueue
+ */
+void init_rt_rq(struct rt_rq *rt) {
+    for (int i = 0; i < SCHED_RT_PRIO_NR; i++) {
+        list_init(&rt->queue[i]);
+    }
+    for (int i = 0; i < RT_BITMAP_WORDS; i++) {
+        rt->bitmap[i] = 0;
+    }
+    rt->nr_running = 0;
+}
+
+/**
+ * sched_rt_init_thread - Initialize the RT class state of a thread
+ * @t: New thread
+ */
+void sched_rt_init_thread(thread_t *t) {
+    list_init(&t->rt.run_list);
+    t->rt.policy = SCHED_NORMAL;
+    t->rt.prio = 0;
+    t->rt.time_slice = 0;
+}
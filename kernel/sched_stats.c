@@ -0,0 +1,152 @@
+/* Emergence Kernel - Scheduler statistics snapshots and dump
+ *
+ * The counters themselves are kept by the hooks in kernel/sched_stats.h.
+ * This file turns them into consistent snapshots and logs them in a
+ * key=value format that tests/sched/sched_test.py parses.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "kernel/klog.h"
+#include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "kernel/sched_stats.h"
+#include "include/spinlock.h"
+#include "include/barrier.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/tsc.h"
+
+#if CONFIG_SCHEDSTATS
+
+/**
+ * sched_get_cpu_stats - Take a snapshot of a CPU's statistics
+ * @cpu: CPU index
+ * @st: Filled in on success
+ *
+ * Idle time and the runqueue length integral are brought up to date
+ * under the runqueue lock, so a CPU sitting idle still reports it.
+ *
+ * Returns: 0 on success, -1 if @cpu is invalid
+ */
+int sched_get_cpu_stats(int cpu, struct sched_cpu_stats *st) {
+    runqueue_t *rq;
+    irq_flags_t flags;
+    uint64_t now;
+
+    if (st == NULL || cpu < 0 || cpu >= smp_get_cpu_count()) {
+        return -1;
+    }
+    rq = scheduler_get_runqueue(cpu);
+
+    flags = spin_lock_irqsave(&rq->lock);
+    now = sched_clock();
+    schedstat_rq_len(rq, now);
+
+    st->tsc = arch_rdtsc();
+    st->clock_ns = now;
+    st->nr_switches = rq->stats.nr_switches;
+    st->idle_time_ns = rq->stats.idle_time;
+    if (rq->stats.idle_stamp != 0) {
+        st->idle_time_ns += now - rq->stats.idle_stamp;
+    }
+    st->rq_len_sum = rq->stats.len_sum;
+    st->nr_running = rq->nr_running;
+    st->nr_running_max = rq->stats.nr_running_max;
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    return 0;
+}
+
+/**
+ * sched_get_thread_stats - Take a snapshot of a thread's statistics
+ * @t: Thread
+ * @st: Filled in on success
+ *
+ * Read without locking: each field is a single word and the snapshot is
+ * only used for reporting, so a count that is one event stale is fine.
+ *
+ * Returns: 0 on success, -1 if @t is NULL
+ */
+int sched_get_thread_stats(thread_t *t, struct sched_thread_stats *st) {
+    uint64_t wait_start;
+
+    if (t == NULL || st == NULL) {
+        return -1;
+    }
+
+    st->tsc = arch_rdtsc();
+    st->runtime_ns = READ_ONCE(t->se.sum_exec_runtime);
+    st->wait_sum_ns = READ_ONCE(t->stats.wait_sum);
+    st->wait_max_ns = READ_ONCE(t->stats.wait_max);
+    st->wait_count = READ_ONCE(t->stats.wait_count);
+    wait_start = READ_ONCE(t->stats.wait_start);
+    st->wait_current_ns = wait_start != 0 ? sched_clock() - wait_start : 0;
+    st->nr_voluntary_switches = READ_ONCE(t->stats.nr_voluntary_switches);
+    st->nr_involuntary_switches = READ_ONCE(t->stats.nr_involuntary_switches);
+    st->tid = t->tid;
+    st->cpu = t->cpu;
+
+    return 0;
+}
+
+/* thread_for_each() callback for sched_dump_stats() */
+static void dump_thread_stats(thread_t *t, void *arg) {
+    struct sched_thread_stats st;
+
+    (void)arg;
+    if (sched_get_thread_stats(t, &st) < 0) {
+        return;
+    }
+
+    klog_info("SCHED", "SCHEDSTAT tid=%d cpu=%d runtime_ns=%lu wait_ns=%lu "
+              "wait_max_ns=%lu waits=%lu wait_now_ns=%lu vcsw=%lu ivcsw=%lu name=%s",
+              st.tid, st.cpu, (unsigned long)st.runtime_ns,
+              (unsigned long)st.wait_sum_ns, (unsigned long)st.wait_max_ns,
+              (unsigned long)st.wait_count, (unsigned long)st.wait_current_ns,
+              (unsigned long)st.nr_voluntary_switches,
+              (unsigned long)st.nr_involuntary_switches,
+              t->name != NULL ? t->name : "?");
+}
+
+/**
+ * sched_dump_stats - Log statistics of every CPU and live thread
+ */
+void sched_dump_stats(void) {
+    struct sched_cpu_stats st;
+    int nr_cpus = smp_get_cpu_count();
+
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        if (sched_get_cpu_stats(cpu, &st) < 0) {
+            continue;
+        }
+        klog_info("SCHED", "SCHEDSTAT cpu=%d tsc=%lu clock_ns=%lu switches=%lu "
+                  "idle_ns=%lu nr_running=%d nr_running_max=%d rq_len_sum=%lu",
+                  cpu, (unsigned long)st.tsc, (unsigned long)st.clock_ns,
+                  (unsigned long)st.nr_switches, (unsigned long)st.idle_time_ns,
+                  st.nr_running, st.nr_running_max, (unsigned long)st.rq_len_sum);
+    }
+
+    thread_for_each(dump_thread_stats, NULL);
+}
+
+#else /* !CONFIG_SCHEDSTATS */
+
+int sched_get_cpu_stats(int cpu, struct sched_cpu_stats *st) {
+    (void)cpu;
+    (void)st;
+    return -1;
+}
+
+int sched_get_thread_stats(thread_t *t, struct sched_thread_stats *st) {
+    (void)t;
+    (void)st;
+    return -1;
+}
+
+void sched_dump_stats(void) {
+    klog_info("SCHED", "Scheduler statistics disabled (CONFIG_SCHEDSTATS=0)");
+}
+
+#endif /* CONFIG_SCHEDSTATS */
@@ -0,0 +1,109 @@
+/* Emergence Kernel - Scheduler statistics hooks
+ *
+ * Called by the scheduler core with the runqueue lock held. All times are
+ * sched_clock() nanoseconds, which the TSC drives. With CONFIG_SCHEDSTATS=0
+ * every hook is empty and the accounting compiles away.
+ */
+
+#ifndef _KERNEL_SCHED_STATS_H
+#define _KERNEL_SCHED_STATS_H
+
+#include <stdint.h>
+#include "kernel/scheduler.h"
+#include "arch/x86_64/tsc.h"
+
+#if CONFIG_SCHEDSTATS
+
+/* Bring the runqueue length integral up to @now before nr_running changes */
+static inline void schedstat_rq_len(runqueue_t *rq, uint64_t now) {
+    struct rq_statistics *st = &rq->stats;
+
+    st->len_sum += (uint64_t)rq->nr_running * (now - st->len_stamp);
+    st->len_stamp = now;
+}
+
+/* @t is being queued on @rq: starts its wait unless it is already waiting */
+static inline void schedstat_enqueue(runqueue_t *rq, thread_t *t) {
+    uint64_t now = sched_clock();
+
+    schedstat_rq_len(rq, now);
+    if (t->stats.wait_start == 0) {
+        t->stats.wait_start = now;
+    }
+    if (rq->nr_running + 1 > rq->stats.nr_running_max) {
+        rq->stats.nr_running_max = rq->nr_running + 1;
+    }
+}
+
+/* A thread leaves @rq's queue, to run or to move; its wait goes on */
+static inline void schedstat_dequeue(runqueue_t *rq) {
+    schedstat_rq_len(rq, sched_clock());
+}
+
+/* @t was taken off the runqueues for good: forget its wait */
+static inline void schedstat_wait_cancel(thread_t *t) {
+    t->stats.wait_start = 0;
+}
+
+/* @next was picked to run at @now: close its enqueue->run delay */
+static inline void schedstat_wait_end(thread_t *next, uint64_t now) {
+    struct sched_statistics *st = &next->stats;
+    uint64_t delta;
+
+    if (st->wait_start == 0) {
+        return;
+    }
+    delta = now - st->wait_start;
+    st->wait_start = 0;
+    st->wait_sum += delta;
+    st->wait_count++;
+    if (delta > st->wait_max) {
+        st->wait_max = delta;
+    }
+}
+
+/* The idle thread starts running on @rq at @now */
+static inline void schedstat_idle_start(runqueue_t *rq, uint64_t now) {
+    rq->stats.idle_stamp = now;
+}
+
+/* @rq switches from @prev to @next at @now */
+static inline void schedstat_switch(runqueue_t *rq, thread_t *prev, thread_t *next,
+                                    int involuntary, uint64_t now) {
+    struct rq_statistics *st = &rq->stats;
+
+    st->nr_switches++;
+
+    if (prev == rq->idle) {
+        if (st->idle_stamp != 0) {
+            st->idle_time += now - st->idle_stamp;
+        }
+        st->idle_stamp = 0;
+    } else if (prev != NULL) {
+        if (involuntary) {
+            prev->stats.nr_involuntary_switches++;
+        } else {
+            prev->stats.nr_voluntary_switches++;
+        }
+    }
+
+    if (next == rq->idle) {
+        st->idle_stamp = now;
+    }
+}
+
+#else /* !CONFIG_SCHEDSTATS */
+
+static inline void schedstat_enqueue(runqueue_t *rq, thread_t *t) { (void)rq; (void)t; }
+static inline void schedstat_dequeue(runqueue_t *rq) { (void)rq; }
+static inline void schedstat_wait_cancel(thread_t *t) { (void)t; }
+static inline void schedstat_wait_end(thread_t *next, uint64_t now) { (void)next; (void)now; }
+static inline void schedstat_idle_start(runqueue_t *rq, uint64_t now) { (void)rq; (void)now; }
+static inline void schedstat_switch(runqueue_t *rq, thread_t *prev, thread_t *next,
+                                    int involuntary, uint64_t now) {
+    (void)rq; (void)prev; (void)next; (void)involuntary; (void)now;
+}
+
+#endif /* CONFIG_SCHEDSTATS */
+
+#endif /* _KERNEL_SCHED_STATS_H */
@@ -1,4 +1,4 @@
-/* Emergence Kernel - FIFO Scheduler */
+/* Emergence Kernel - Scheduler core with per-CPU runqueues */
 
 #include <stdint.h>
 #include <stddef.h>
@@ -6,29 +6,338 @@
 #include "kernel/klog.h"
 #include "kernel/thread.h"
 #include "kernel/scheduler.h"
+#include "kernel/sched_stats.h"
 #include "kernel/pmm.h"
+#include "kernel/vm.h"
 #include "kernel/list.h"
 #include "include/spinlock.h"
 #include "include/string.h"
+#include "include/barrier.h"
+#include "include/preempt.h"
 #include "arch/x86_64/smp.h"
+#include "arch/x86_64/ipi.h"
+#include "arch/x86_64/idle.h"
+#include "arch/x86_64/tsc.h"
+#include "arch/x86_64/timer.h"
+#include "arch/x86_64/cr.h"
 #include "arch/x86_64/include/cpu_context.h"
+#include "arch/x86_64/include/gdt.h"
+#include "arch/x86_64/include/syscall.h"
 
-/* Global runqueue */
-static runqueue_t runqueue;
-
-/* Scheduler tick counter for preemptive scheduling */
-static uint64_t scheduler_tick_counter;
+/* Per-CPU runqueues */
+static DEFINE_PER_CPU(runqueue_t, runqueues);
 
 /* Forward declarations for external functions */
 extern void context_switch(cpu_context_t *prev, cpu_context_t *next);
 
-/* Forward declaration for internal helper */
-static thread_t *pick_next_thread(void);
+/* Forward declarations for internal helpers */
+static thread_t *pick_next_thread(runqueue_t *rq);
+static int load_balance(runqueue_t *this_rq, int idle);
+static void __schedule(int preempt);
+
+/**
+ * this_rq - Get the runqueue of the current CPU
+ */
+static inline runqueue_t *this_rq(void) {
+    return this_cpu_ptr(&runqueues);
+}
+
+/**
+ * cpu_rq - Get the runqueue of @cpu
+ */
+static inline runqueue_t *cpu_rq(int cpu) {
+    return per_cpu_ptr(&runqueues, cpu);
+}
+
+/**
+ * enqueue_thread_locked - Queue a thread on a runqueue
+ * @rq: Runqueue (lock held)
+ * @t: Thread to queue
+ * @flags: ENQUEUE_* flags
+ */
+static void enqueue_thread_locked(runqueue_t *rq, thread_t *t, int flags) {
+    schedstat_enqueue(rq, t);
+    t->sched_class->enqueue_thread(rq, t, flags);
+    t->on_rq = rq->cpu;
+    rq->nr_running++;
+}
+
+/**
+ * dequeue_thread_locked - Remove a thread from a runqueue
+ * @rq: Runqueue (lock held)
+ * @t: Thread to remove (must be queued on @rq)
+ * @flags: DEQUEUE_* flags
+ */
+static void dequeue_thread_locked(runqueue_t *rq, thread_t *t, int flags) {
+    schedstat_dequeue(rq);
+    t->sched_class->dequeue_thread(rq, t, flags);
+    t->on_rq = -1;
+    rq->nr_running--;
+}
+
+/**
+ * thread_rq_lock - Lock the runqueue a thread belongs to
+ * @t: Thread
+ * @flags: Returns saved interrupt flags
+ *
+ * A queued thread belongs to the runqueue holding it; otherwise to the CPU
+ * it last ran on. Retries if the thread is migrated while we wait.
+ *
+ * Returns: Locked runqueue
+ */
+static runqueue_t *thread_rq_lock(thread_t *t, irq_flags_t *flags) {
+    runqueue_t *rq;
+    int cpu;
+
+    while (1) {
+        cpu = t->on_rq;
+        if (cpu < 0) {
+            cpu = t->cpu;
+        }
+        rq = (cpu >= 0 && cpu < SMP_MAX_CPUS) ? cpu_rq(cpu) : this_rq();
+
+        *flags = spin_lock_irqsave(&rq->lock);
+        if (t->on_rq < 0 || t->on_rq == rq->cpu) {
+            return rq;
+        }
+        spin_unlock_irqrestore(&rq->lock, *flags);
+    }
+}
+
+/**
+ * sched_class_above - Check whether one class outranks another
+ * @a: First class
+ * @b: Second class
+ *
+ * Returns: Non-zero if @a comes before @b in priority order
+ */
+static int sched_class_above(const struct sched_class *a, const struct sched_class *b) {
+    const struct sched_class *class;
+
+    for_each_class(class) {
+        if (class == b) {
+            return 0;
+        }
+        if (class == a) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * resched_curr - Make a CPU reschedule as soon as possible
+ * @rq: Runqueue (lock held)
+ *
+ * Sets need_resched, which the CPU acts on when it next returns from an
+ * interrupt or system call. A remote CPU is kicked with a reschedule IPI
+ * so it neither waits for its next tick nor sleeps on with the tick
+ * stopped, unless it is idling in MWAIT on need_resched: the store alone
+ * wakes it. CPUs that have not entered the scheduler cannot take the IPI
+ * yet and only get the flag.
+ */
+static void resched_curr(runqueue_t *rq) {
+    if (rq->need_resched) {
+        return;     /* Already pending, IPI (if any) already sent */
+    }
+    rq->need_resched = 1;
+
+    if (rq->cpu != smp_get_cpu_index() && rq->curr != NULL) {
+        /* Pairs with idle_thread_func(): it sees the flag or we see it polling */
+        smp_mb();
+        if (!READ_ONCE(rq->idle_polling)) {
+            smp_send_reschedule(rq->cpu);
+        }
+    }
+}
+
+/**
+ * check_preempt_curr - Decide whether a newly queued thread should run now
+ * @rq: Runqueue (lock held)
+ * @t: Thread just queued on @rq
+ *
+ * Reschedules @rq's CPU if @t belongs to a higher class than the running
+ * thread, or if its own class says so.
+ */
+static void check_preempt_curr(runqueue_t *rq, thread_t *t) {
+    thread_t *curr = rq->curr;
+
+    if (curr == NULL || curr == rq->idle) {
+        resched_curr(rq);
+    } else if (t->sched_class == curr->sched_class) {
+        if (t->sched_class->check_preempt_curr(rq, t)) {
+            resched_curr(rq);
+        }
+    } else if (sched_class_above(t->sched_class, curr->sched_class)) {
+        resched_curr(rq);
+    }
+}
+
+/**
+ * cpu_is_idle - Check whether a CPU is idle with nothing queued
+ * @rq: Runqueue (read without the lock)
+ */
+static inline int cpu_is_idle(runqueue_t *rq) {
+    thread_t *curr = READ_ONCE(rq->curr);
+
+    return curr != NULL && curr == rq->idle &&
+           READ_ONCE(rq->nr_running) == 0 && !READ_ONCE(rq->need_resched);
+}
+
+/**
+ * thread_cache_hot - Check whether a thread's cache state is likely warm
+ * @t: Thread that is not running
+ *
+ * Returns: Non-zero if it left its last CPU less than
+ *          SCHED_MIGRATION_COST_NS ago
+ */
+static inline int thread_cache_hot(thread_t *t) {
+    return t->last_ran != 0 && sched_clock() - t->last_ran < SCHED_MIGRATION_COST_NS;
+}
+
+/**
+ * find_idlest_cpu - Find the least loaded CPU a thread may run on
+ * @t: Thread to place
+ * @allowed: Online CPUs allowed by @t's affinity
+ * @prev: Preferred CPU on ties, also the fallback
+ *
+ * Load is the number of queued threads, plus one for a running thread
+ * other than idle. A real-time thread first of all avoids CPUs already
+ * running real-time work, which it could not preempt. CPUs that have not
+ * entered the scheduler are never chosen.
+ *
+ * Returns: CPU index
+ */
+static int find_idlest_cpu(thread_t *t, cpumask_t allowed, int prev) {
+    int is_rt = t->sched_class == &rt_sched_class;
+    int nr_cpus = smp_get_cpu_count();
+    int best = -1, best_load = 0, best_rt = 0;
+
+    for (int i = 0; i < nr_cpus; i++) {
+        int cpu = (prev + i) % nr_cpus;
+        runqueue_t *rq = cpu_rq(cpu);
+        thread_t *curr = READ_ONCE(rq->curr);
+        int load, curr_rt;
+
+        if (!cpumask_test_cpu(cpu, allowed) || curr == NULL) {
+            continue;
+        }
+
+        load = READ_ONCE(rq->nr_running) + (curr != rq->idle);
+        curr_rt = is_rt && curr->sched_class == &rt_sched_class;
+
+        if (best < 0 || curr_rt < best_rt ||
+            (curr_rt == best_rt && load < best_load)) {
+            best = cpu;
+            best_load = load;
+            best_rt = curr_rt;
+        }
+    }
+
+    return best >= 0 ? best : prev;
+}
+
+/**
+ * select_task_rq - Choose the CPU a new or woken thread should run on
+ * @t: Thread about to be queued (not on any runqueue)
+ *
+ * Only CPUs in the thread's affinity mask are considered. The CPU it last
+ * ran on is kept if it is idle or the thread is still cache hot there.
+ * Otherwise an idle waking CPU takes it, and failing that the least
+ * loaded allowed CPU. Threads that never ran start from the current CPU.
+ *
+ * Runqueues are read unlocked. A stale answer only costs a migration by
+ * the load balancer later.
+ *
+ * Returns: CPU index
+ */
+static int select_task_rq(thread_t *t) {
+    int nr_cpus = smp_get_cpu_count();
+    int this_cpu = smp_get_cpu_index();
+    cpumask_t allowed = t->cpus_allowed & cpumask_first_n(nr_cpus);
+    int prev = t->cpu;
+
+    if (allowed == CPU_MASK_NONE) {
+        /* Only possible if CPUs went away; never strand the thread */
+        allowed = cpumask_first_n(nr_cpus);
+    }
+
+    if (cpumask_test_cpu(prev, allowed)) {
+        if (cpu_is_idle(cpu_rq(prev)) || thread_cache_hot(t)) {
+            return prev;
+        }
+    } else {
+        prev = cpumask_test_cpu(this_cpu, allowed) ? this_cpu : cpumask_first(allowed);
+    }
+
+    if (this_cpu != prev && cpumask_test_cpu(this_cpu, allowed) &&
+        cpu_is_idle(cpu_rq(this_cpu))) {
+        return this_cpu;
+    }
+
+    return find_idlest_cpu(t, allowed, prev);
+}
+
+/**
+ * enqueue_thread_on - Queue a thread that is on no runqueue
+ * @t: READY thread, not queued and not running
+ * @cpu: Target CPU index
+ * @flags: ENQUEUE_* flags
+ *
+ * Preempts the target CPU if @t should run first.
+ */
+static void enqueue_thread_on(thread_t *t, int cpu, int flags) {
+    runqueue_t *rq = cpu_rq(cpu);
+    irq_flags_t irq_flags;
+
+    irq_flags = spin_lock_irqsave(&rq->lock);
+    enqueue_thread_locked(rq, t, flags);
+    check_preempt_curr(rq, t);
+    spin_unlock_irqrestore(&rq->lock, irq_flags);
+}
+
+/**
+ * double_rq_lock - Lock two runqueues without deadlocking
+ * @a: First runqueue
+ * @b: Second runqueue (must differ from @a)
+ *
+ * Lock hierarchy: runqueues are always taken in ascending CPU order.
+ *
+ * Returns: Saved interrupt flags
+ */
+static irq_flags_t double_rq_lock(runqueue_t *a, runqueue_t *b) {
+    irq_flags_t flags;
+
+    if (a->cpu < b->cpu) {
+        flags = spin_lock_irqsave(&a->lock);
+        spin_lock(&b->lock);
+    } else {
+        flags = spin_lock_irqsave(&b->lock);
+        spin_lock(&a->lock);
+    }
+    return flags;
+}
+
+/**
+ * double_rq_unlock - Release two runqueues locked by double_rq_lock()
+ * @a: First runqueue
+ * @b: Second runqueue
+ * @flags: Flags returned by double_rq_lock()
+ */
+static void double_rq_unlock(runqueue_t *a, runqueue_t *b, irq_flags_t flags) {
+    if (a->cpu < b->cpu) {
+        spin_unlock(&b->lock);
+        spin_unlock_irqrestore(&a->lock, flags);
+    } else {
+        spin_unlock(&a->lock);
+        spin_unlock_irqrestore(&b->lock, flags);
+    }
+}
 
 /**
  * scheduler_init - Initialize the scheduler
  *
- * Creates the global runqueue and per-CPU idle threads.
+ * Creates the per-CPU runqueues and per-CPU idle threads.
  * Must be called after thread_init() and smp_init().
  */
 void scheduler_init(void) {
@@ -36,22 +345,38 @@ void scheduler_init(void) {
 
     klog_info("SCHED", "Initializing scheduler");
 
-    /* Initialize runqueue */
-    spin_lock_init(&runqueue.lock);
-    list_init(&runqueue.thread_list);
-    runqueue.nr_running = 0;
-
-    /* Clear idle thread pointers */
+    /* Initialize per-CPU runqueues */
     for (i = 0; i < SMP_MAX_CPUS; i++) {
-        runqueue.idle_threads[i] = NULL;
+        runqueue_t *rq = cpu_rq(i);
+
+        spin_lock_init(&rq->lock);
+        init_rt_rq(&rq->rt);
+        init_cfs_rq(&rq->cfs);
+        rq->nr_running = 0;
+        rq->need_resched = 0;
+        rq->idle_polling = 0;
+        rq->cpu = i;
+        rq->curr = NULL;
+        rq->idle = NULL;
+        rq->prev = NULL;
+        rq->push_prev = 0;
+        rq->kernel_cr3 = 0;
+        rq->tick_counter = 0;
+        rq->nr_migrations_in = 0;
+        rq->nr_migrations_out = 0;
+        rq->nr_idle_steals = 0;
+        rq->nr_balance_runs = 0;
+        memset(&rq->stats, 0, sizeof(rq->stats));
     }
 
     /* Create idle threads for each CPU */
     for (i = 0; i < SMP_MAX_CPUS; i++) {
-        char name[16];
+        /* thread_create() keeps the pointer, so the name must outlive us */
+        static char idle_names[SMP_MAX_CPUS][16];
+        char *name = idle_names[i];
         thread_t *idle;
 
-        snprintf(name, sizeof(name), "idle_cpu%d", i);
+        snprintf(name, sizeof(idle_names[i]), "idle_cpu%d", i);
 
         idle = thread_create(name, idle_thread_func, (void *)(uintptr_t)i,
                         THREAD_DEFAULT_STACK_SIZE, THREAD_FLAG_KERNEL);
@@ -60,7 +385,8 @@ void scheduler_init(void) {
             continue;
         }
 
-        runqueue.idle_threads[i] = idle;
+        idle->cpu = i;
+        cpu_rq(i)->idle = idle;
         klog_info("SCHED", "Created idle thread for CPU %d (tid=%d)", i, idle->tid);
     }
 
@@ -70,19 +396,79 @@ void scheduler_init(void) {
  * idle_thread_func - Idle thread entry point
  * @arg: CPU index (cast to void*)
  *
- * Loops forever with HLT instruction. Each CPU has its own idle thread.
+ * Each CPU has its own idle thread. Work is checked with interrupts off
+ * and the CPU sleeps in idle_enter(), which enables interrupts atomically
+ * with the sleep, so a wakeup arriving in between is not slept through.
+ * With MWAIT the CPU advertises idle_polling and watches need_resched,
+ * so a remote resched_curr() wakes it with the store alone. With NO_HZ
+ * the tick is stopped before sleeping unless another CPU has work this
+ * one could pull.
  */
 void idle_thread_func(void *arg) {
     int cpu = (int)(uintptr_t)arg;
+    runqueue_t *rq = cpu_rq(cpu);
+    int polling = idle_uses_mwait();
 
     klog_debug("SCHED", "Idle thread started on CPU %d", cpu);
 
-    /* Idle loop - HLT halts until next interrupt */
     while (1) {
-        arch_cpu_halt();
+        arch_disable_interrupts();
+
+        /* Pairs with resched_curr(): we see need_resched or it sees us polling */
+        rq->idle_polling = polling;
+        smp_mb();
+
+        if (rq->nr_running > 0 || READ_ONCE(rq->need_resched)) {
+            rq->idle_polling = 0;
+            arch_enable_interrupts();
+            schedule();
+            continue;
+        }
+
+#if CONFIG_NO_HZ
+        timer_tick_rearm();
+#endif
+        idle_enter(&rq->need_resched);
+        rq->idle_polling = 0;
+    }
+}
+
+/*
+ * Load the page table @next runs on: its process's, or for a kernel
+ * thread the kernel's own, so no kernel thread is left on the tables of
+ * a process that may since have been freed. The kernel's is whatever a
+ * process's replaced, which follows the nested kernel's switch to its
+ * shared page table.
+ */
+static void switch_address_space(runqueue_t *rq, thread_t *next)
+{
+    uint64_t cr3 = arch_cr3_read();
+
+    if (next->as == NULL) {
+        if (rq->kernel_cr3 != 0) {
+            arch_cr3_write(rq->kernel_cr3);
+            rq->kernel_cr3 = 0;
+        }
+        return;
+    }
+
+    if (rq->kernel_cr3 == 0) {
+        rq->kernel_cr3 = cr3;
+    }
+    if ((cr3 & ~0xFFFULL) != next->as->pml4_phys) {
+        arch_cr3_write(next->as->pml4_phys);
     }
 }
 
+/**
+ * scheduler_switch_address_space - Load the current thread's address space
+ */
+void scheduler_switch_address_space(void) {
+    preempt_disable();
+    switch_address_space(this_rq(), thread_get_current());
+    preempt_enable();
+}
+
 /**
  * scheduler_start - Start scheduling on the current CPU
  *
@@ -91,17 +477,22 @@ void idle_thread_func(void *arg) {
  */
 void scheduler_start(void) {
     thread_t *current = thread_get_current();
+    runqueue_t *rq = this_rq();
     thread_t *idle;
 
     /* If no current thread, switch to idle */
     if (current == NULL) {
-        int cpu = smp_get_cpu_index();
-        idle = runqueue.idle_threads[cpu];
+        idle = rq->idle;
         if (idle != NULL) {
             thread_set_current(idle);
             idle->state = THREAD_RUNNING;
-            /* Jump to idle thread context */
-            context_switch(NULL, &idle->context);
+            idle->on_cpu = 1;
+            rq->curr = idle;
+            schedstat_idle_start(rq, sched_clock());
+            /* Jump to idle thread context - the boot stack is never resumed.
+             * The idle thread's schedule_tail() drops this count. */
+            preempt_disable();
+            context_switch(&rq->boot_context, &idle->context);
         }
         /* Should never reach here */
     }
@@ -118,81 +509,310 @@ void scheduler_start(void) {
 /**
  * schedule - Perform a context switch
  *
- * Picks the next thread from the runqueue and switches to it.
- * If no threads are available, runs the idle thread.
- * Must be called with interrupts disabled.
+ * Re-queues the current thread if it is still runnable, then picks the
+ * best thread from this CPU's runqueue (stealing from the busiest CPU if
+ * it is empty) and switches to it. Falls back to the idle thread.
  */
 void schedule(void) {
+    __schedule(0);
+}
+
+/**
+ * thread_runnable - Check whether a thread giving up the CPU stays runnable
+ * @rq: Runqueue of the current CPU
+ * @t: Thread leaving the CPU (may be NULL)
+ * @preempt: Non-zero if @t is being preempted
+ *
+ * A thread preempted between marking itself BLOCKED and calling schedule()
+ * has not gone to sleep yet: it stays runnable, and the sleep turns into a
+ * spurious wakeup that its wait loop absorbs.
+ */
+static inline int thread_runnable(runqueue_t *rq, thread_t *t, int preempt) {
+    return t != NULL && t != rq->idle && t->state != THREAD_TERMINATED &&
+           (preempt || t->state != THREAD_BLOCKED);
+}
+
+/**
+ * __schedule - Core of schedule()
+ * @preempt: Non-zero if the current thread is being preempted rather
+ *           than giving up the CPU voluntarily
+ */
+static void __schedule(int preempt) {
     thread_t *prev, *next;
+    runqueue_t *rq = this_rq();
+    irq_flags_t rq_flags;
+    uint64_t flags, now;
+    void *stack_top;
+    int prev_runnable;
+
+    /* Held across the switch and dropped by schedule_tail() on the next
+     * thread's stack, so nothing preempts a half-finished switch */
+    preempt_disable();
+    flags = arch_disable_interrupts();
+
+    if (preempt_count() != 1) {
+        klog_error("SCHED", "Scheduling while atomic (preempt_count=%d)",
+                   preempt_count() - 1);
+    }
 
     /* Get current thread */
     prev = thread_get_current();
+    prev_runnable = thread_runnable(rq, prev, preempt);
+
+    /* Nothing queued locally and prev is done - try to steal work first */
+    if (rq->nr_running == 0 && !prev_runnable && smp_get_cpu_count() > 1) {
+        load_balance(rq, 1);
+    }
 
-    /* Pick next thread from runqueue */
-    next = pick_next_thread();
+    rq_flags = spin_lock_irqsave(&rq->lock);
+    now = sched_clock();
 
-    /* If no thread available, use idle thread */
-    if (next == NULL) {
-        int cpu = smp_get_cpu_index();
-        next = runqueue.idle_threads[cpu];
+    /* Re-check under the lock: a waker may have cancelled our sleep */
+    prev_runnable = thread_runnable(rq, prev, preempt);
+
+    /* Charge prev for its run and put it back so it competes fairly.
+     * It stays marked on_cpu until schedule_tail() runs on the new stack,
+     * so a concurrent steal can never pick it up while we are still on it. */
+    if (prev != NULL && prev != rq->idle && rq->curr == prev) {
+        prev->sched_class->put_prev_thread(rq, prev);
+        prev->last_ran = now;
+    }
+    rq->curr = NULL;
+    rq->need_resched = 0;
+    if (prev_runnable && !cpumask_test_cpu(rq->cpu, prev->cpus_allowed)) {
+        /* Its affinity changed while it ran: schedule_tail() moves it */
+        prev->state = THREAD_READY;
+        if (prev->sched_class->migrate_thread_rq != NULL) {
+            prev->sched_class->migrate_thread_rq(rq, prev);
+        }
+        rq->push_prev = 1;
+    } else if (prev_runnable) {
+        prev->state = THREAD_READY;
+        enqueue_thread_locked(rq, prev, preempt ? ENQUEUE_PREEMPTED : 0);
     }
 
+    /* Pick next thread from runqueue, or go idle */
+    next = pick_next_thread(rq);
+    if (next != NULL) {
+        dequeue_thread_locked(rq, next, 0);
+        next->sched_class->set_next_thread(rq, next);
+        schedstat_wait_end(next, now);
+    } else {
+        next = rq->idle;
+    }
+    rq->curr = next;
+    if (next != NULL && next != prev) {
+        schedstat_switch(rq, prev, next, preempt && prev_runnable, now);
+    }
+
+    spin_unlock_irqrestore(&rq->lock, rq_flags);
+
     /* No thread to run - should never happen */
     if (next == NULL) {
         klog_error("SCHED", "No thread to run!");
+        arch_restore_interrupts(flags);
+        preempt_enable_no_resched();
         return;
     }
 
+    next->state = THREAD_RUNNING;
+
     /* Same thread - no switch needed */
     if (prev == next) {
+        arch_restore_interrupts(flags);
+        preempt_enable_no_resched();
         return;
     }
 
-    /* Update thread states */
-    if (prev != NULL) {
-        /* Put previous thread back on runqueue if it's still runnable */
-        if (prev->state != THREAD_TERMINATED && prev->state != THREAD_BLOCKED) {
-            prev->state = THREAD_READY;
-            scheduler_add_thread(prev);
-        }
-    }
-
-    next->state = THREAD_RUNNING;
-    next->cpu = smp_get_cpu_index();
+    next->cpu = rq->cpu;
+    next->on_cpu = 1;
+    rq->prev = prev;
 
     /* Set current thread */
     thread_set_current(next);
 
+    /* Save prev's FPU registers and load or arm next's */
+    fpu_switch(prev, next);
+
+    /* A thread preempted in ring 3 resumes under its own page table */
+    switch_address_space(rq, next);
+
+    /* Syscalls, interrupts and exceptions from next's user mode enter
+     * on its own kernel stack */
+    if (next->kernel_stack != NULL) {
+        stack_top = (uint8_t *)next->kernel_stack + next->kernel_stack_size;
+        syscall_set_entry_stack(stack_top);
+        tss_set_rsp0(stack_top);
+    } else {
+        syscall_set_entry_stack(NULL);
+    }
+
     /* Perform context switch */
-    context_switch(&prev->context, &next->context);
+    context_switch(prev != NULL ? &prev->context : &rq->boot_context,
+                   &next->context);
+
+    /* Back on prev's stack, possibly on another CPU after a migration */
+    schedule_tail();
+    arch_restore_interrupts(flags);
+}
+
+/**
+ * schedule_tail - Finish a context switch on the new thread's stack
+ *
+ * Releases the previous thread so other CPUs may run or steal it, and
+ * queues it on an allowed CPU if its affinity excludes this one, or
+ * hands it to the reaper if it has exited. Drops
+ * the preemption count __schedule() took before switching.
+ */
+void schedule_tail(void) {
+    runqueue_t *rq = this_rq();
+    thread_t *prev = rq->prev;
+    int push = rq->push_prev;
+
+    rq->prev = NULL;
+    rq->push_prev = 0;
+    if (prev != NULL) {
+        smp_mb();
+        prev->on_cpu = 0;
+    }
+
+    if (push) {
+        int cpu = select_task_rq(prev);
+
+        prev->cpu = cpu;
+        prev->nr_migrations++;
+        enqueue_thread_on(prev, cpu, ENQUEUE_MIGRATED);
+    } else if (prev != NULL && prev->state == THREAD_TERMINATED) {
+        thread_release(prev);
+    }
+
+#if CONFIG_NO_HZ
+    /* The next tick depends on the slice of the thread now running */
+    timer_tick_rearm();
+#endif
+
+    preempt_enable_no_resched();
 }
 
 /**
  * scheduler_tick - Called from timer interrupt
  *
- * Called every timer tick to check if a context switch is needed.
- * Triggers schedule() every SCHEDULER_TICK_INTERVAL ticks.
+ * Charges the running thread for the elapsed time and sets need_resched
+ * once its class says its slice is used up. The idle thread is preempted
+ * as soon as anything is queued. Also pulls work from the busiest CPU
+ * every SCHEDULER_BALANCE_INTERVAL ticks. The switch itself happens in
+ * scheduler_irq_exit(), after the interrupt has been acknowledged.
  */
 void scheduler_tick(void) {
+    runqueue_t *rq = this_rq();
+    thread_t *curr;
+    irq_flags_t flags;
+    int resched = 0;
+
     /* Increment tick counter */
-    scheduler_tick_counter++;
+    rq->tick_counter++;
 
-    /* Check if it's time for a context switch */
-    if ((scheduler_tick_counter % SCHEDULER_TICK_INTERVAL) == 0) {
-        /* Time to schedule */
-        schedule();
+    flags = spin_lock_irqsave(&rq->lock);
+    curr = rq->curr;
+    resched = rq->need_resched;
+    if (curr != NULL) {
+        curr->ticks++;
+        if (curr == rq->idle) {
+            resched |= rq->nr_running > 0;
+        } else {
+            resched |= curr->sched_class->task_tick(rq, curr);
+        }
+    }
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    /* Periodic rebalance */
+    if ((rq->tick_counter % SCHEDULER_BALANCE_INTERVAL) == 0) {
+        resched |= load_balance(rq, 0) > 0 && curr == rq->idle;
+    }
+
+    if (resched) {
+        rq->need_resched = 1;
+    }
+}
+
+/**
+ * scheduler_irq_exit - Reschedule on the way out of an interrupt or syscall
+ *
+ * Runs with interrupts disabled, after the APIC EOI, so the preempted
+ * thread does not keep the interrupt in service while it is switched out.
+ * Does nothing on a CPU that has not entered the scheduler, or if the
+ * interrupted code had preemption disabled; preempt_enable() picks the
+ * reschedule up when it is re-enabled.
+ */
+void scheduler_irq_exit(void) {
+    runqueue_t *rq = this_rq();
+
+    if (READ_ONCE(rq->need_resched) && rq->curr != NULL && preempt_count() == 0) {
+        __schedule(1);
+    }
+}
+
+/**
+ * preempt_schedule - Preemption point of preempt_enable()
+ *
+ * Called when the preemption count drops to zero. Switches away if a
+ * reschedule is pending. With interrupts disabled it leaves the pending
+ * reschedule to the next interrupt exit or preemption point.
+ */
+void preempt_schedule(void) {
+    runqueue_t *rq = this_rq();
+
+    if (READ_ONCE(rq->need_resched) && rq->curr != NULL && arch_irqs_enabled()) {
+        __schedule(1);
+    }
+}
+
+/**
+ * scheduler_next_event_ns - Time until this CPU's scheduler needs a tick
+ *
+ * Returns: Nanoseconds until the next tick (at most SCHED_TICK_NS),
+ *          or 0 if the tick can be stopped
+ */
+uint64_t scheduler_next_event_ns(void) {
+    runqueue_t *rq = this_rq();
+    uint64_t next = SCHED_TICK_NS;
+    uint64_t slice;
+    irq_flags_t flags;
+    thread_t *curr;
+
+    flags = spin_lock_irqsave(&rq->lock);
+    curr = rq->curr;
+
+    if (rq->need_resched) {
+        next = SCHED_TICK_MIN_NS;
+    } else if (curr != NULL && curr == rq->idle) {
+        /* Keep ticking only while the balancer has something to pull */
+        if (rq->nr_running == 0 && scheduler_get_nr_running() == 0) {
+            next = 0;
+        }
+    } else if (curr != NULL) {
+        slice = curr->sched_class->slice_remaining(rq, curr);
+        if (slice < next) {
+            next = slice > SCHED_TICK_MIN_NS ? slice : SCHED_TICK_MIN_NS;
+        }
     }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return next;
 }
 
 /**
- * scheduler_add_thread - Add a thread to the runqueue
+ * scheduler_add_thread - Add a new thread to a runqueue
  * @t: Thread to add (must be in READY state)
  *
- * Adds the thread to the back of the FIFO queue.
+ * Queues the thread on the CPU picked by select_task_rq() and preempts
+ * that CPU if the thread should run first. The class decides where the
+ * thread is placed in the queue.
  * Safe to call from interrupt context.
  */
 void scheduler_add_thread(thread_t *t) {
     irq_flags_t flags;
+    runqueue_t *rq;
 
     if (t == NULL) {
         return;
@@ -203,53 +823,384 @@ void scheduler_add_thread(thread_t *t) {
         t->state = THREAD_READY;
     }
 
+    rq = cpu_rq(select_task_rq(t));
+
     /* Acquire runqueue lock with interrupts disabled */
-    flags = spin_lock_irqsave(&runqueue.lock);
+    flags = spin_lock_irqsave(&rq->lock);
 
-    /* Add to back of FIFO queue */
-    list_push_back(&t->run_list, &runqueue.thread_list);
-    runqueue.nr_running++;
+    /* Already queued (e.g. woken twice) - nothing to do */
+    if (t->on_rq < 0) {
+        enqueue_thread_locked(rq, t, ENQUEUE_WAKEUP);
+        check_preempt_curr(rq, t);
+    }
 
-    spin_unlock_irqrestore(&runqueue.lock, flags);
+    spin_unlock_irqrestore(&rq->lock, flags);
 }
 
- /**
- * scheduler_remove_thread - Remove a thread from the runqueue
+/**
+ * wake_up_thread - Make a blocked thread runnable
+ * @t: Thread to wake
+ *
+ * A thread blocks by setting THREAD_BLOCKED and calling schedule(). If the
+ * wakeup arrives before it got that far, the sleep is simply cancelled and
+ * schedule() keeps it runnable. Otherwise it is queued on the CPU picked by
+ * select_task_rq(), which is kicked if the thread should preempt it.
+ * A thread still being switched out stays on its old CPU. Safe to call
+ * from interrupt context.
+ *
+ * Returns: 1 if the thread was woken, 0 if it was not blocked
+ */
+int wake_up_thread(thread_t *t) {
+    irq_flags_t flags;
+    runqueue_t *rq;
+    int cpu;
+
+    if (t == NULL) {
+        return 0;
+    }
+
+    rq = thread_rq_lock(t, &flags);
+
+    if (t->state != THREAD_BLOCKED) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return 0;
+    }
+
+    if (rq->curr == t) {
+        /* Still on its way into schedule() */
+        t->state = THREAD_RUNNING;
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return 1;
+    }
+
+    /* READY claims the wakeup: concurrent wakers back off from here on */
+    t->state = THREAD_READY;
+
+    cpu = t->on_cpu ? rq->cpu : select_task_rq(t);
+    if (cpu != rq->cpu) {
+        if (t->sched_class->migrate_thread_rq != NULL) {
+            t->sched_class->migrate_thread_rq(rq, t);
+        }
+        t->cpu = cpu;
+        t->nr_migrations++;
+        spin_unlock_irqrestore(&rq->lock, flags);
+
+        enqueue_thread_on(t, cpu, ENQUEUE_WAKEUP | ENQUEUE_MIGRATED);
+        return 1;
+    }
+
+    enqueue_thread_locked(rq, t, ENQUEUE_WAKEUP);
+    check_preempt_curr(rq, t);
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return 1;
+}
+
+/**
+ * scheduler_remove_thread - Remove a thread from its runqueue
  * @t: Thread to remove
  */
 void scheduler_remove_thread(thread_t *t) {
     irq_flags_t flags;
+    runqueue_t *rq;
 
     if (t == NULL) {
         return;
     }
 
-    /* Acquire runqueue lock */
-    flags = spin_lock_irqsave(&runqueue.lock);
+    rq = thread_rq_lock(t, &flags);
+    if (t->on_rq >= 0) {
+        dequeue_thread_locked(rq, t, 0);
+    }
+    schedstat_wait_cancel(t);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/**
+ * sched_init_thread - Prepare scheduler state of a freshly created thread
+ * @t: New thread (not yet visible to the scheduler)
+ *
+ * New threads start in the fair class at nice 0.
+ */
+void sched_init_thread(thread_t *t) {
+    t->on_rq = -1;
+    t->on_cpu = 0;
+    t->nr_migrations = 0;
+    t->cpus_allowed = CPU_MASK_ALL;
+    t->last_ran = 0;
+    memset(&t->stats, 0, sizeof(t->stats));
+    t->sched_class = &fair_sched_class;
+    sched_fair_init_thread(t);
+    sched_rt_init_thread(t);
+
+    if (t->flags & THREAD_FLAG_SCHED_FIFO) {
+        sched_setscheduler(t, SCHED_FIFO, THREAD_FLAG_GET_RT_PRIO(t->flags));
+    } else if (t->flags & THREAD_FLAG_SCHED_RR) {
+        sched_setscheduler(t, SCHED_RR, THREAD_FLAG_GET_RT_PRIO(t->flags));
+    }
+}
+
+/**
+ * sched_setscheduler - Change the scheduling policy of a thread
+ * @t: Thread
+ * @policy: SCHED_NORMAL, SCHED_FIFO or SCHED_RR
+ * @prio: RT priority (SCHED_RT_PRIO_MIN..MAX), must be 0 for SCHED_NORMAL
+ *
+ * A queued thread is moved to its new class queue; a running thread is
+ * switched in place and its CPU reschedules to re-evaluate it.
+ *
+ * Returns: 0 on success, -1 on invalid policy or priority
+ */
+int sched_setscheduler(thread_t *t, int policy, int prio) {
+    const struct sched_class *new_class;
+    irq_flags_t flags;
+    runqueue_t *rq;
+    int queued, running;
+
+    if (t == NULL) {
+        return -1;
+    }
+
+    switch (policy) {
+    case SCHED_NORMAL:
+        if (prio != 0) {
+            return -1;
+        }
+        new_class = &fair_sched_class;
+        break;
+    case SCHED_FIFO:
+    case SCHED_RR:
+        if (prio < SCHED_RT_PRIO_MIN || prio > SCHED_RT_PRIO_MAX) {
+            return -1;
+        }
+        new_class = &rt_sched_class;
+        break;
+    default:
+        return -1;
+    }
+
+    rq = thread_rq_lock(t, &flags);
+
+    queued = t->on_rq >= 0;
+    running = rq->curr == t;
+
+    if (queued) {
+        dequeue_thread_locked(rq, t, 0);
+    }
+    if (running) {
+        t->sched_class->put_prev_thread(rq, t);
+    }
+
+    t->rt.policy = policy;
+    t->rt.prio = prio;
+    t->rt.time_slice = SCHED_RR_TIMESLICE_NS;
+
+    if (new_class != t->sched_class) {
+        t->sched_class = new_class;
+        if (running && new_class->switched_to != NULL) {
+            new_class->switched_to(rq, t);
+        }
+    }
+
+    if (running) {
+        t->sched_class->set_next_thread(rq, t);
+        resched_curr(rq);
+    }
+    if (queued) {
+        enqueue_thread_locked(rq, t, ENQUEUE_WAKEUP);
+        check_preempt_curr(rq, t);
+    }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return 0;
+}
+
+/**
+ * sched_getscheduler - Get the scheduling policy of a thread
+ * @t: Thread
+ *
+ * Returns: SCHED_NORMAL, SCHED_FIFO or SCHED_RR
+ */
+int sched_getscheduler(thread_t *t) {
+    return t->rt.policy;
+}
+
+/**
+ * sched_set_nice - Set the nice value of a thread
+ * @t: Thread
+ * @nice: New nice value (NICE_MIN..NICE_MAX)
+ *
+ * A queued thread is re-queued so the runqueue load stays consistent.
+ *
+ * Returns: 0 on success, -1 if @nice is out of range
+ */
+int sched_set_nice(thread_t *t, int nice) {
+    irq_flags_t flags;
+    runqueue_t *rq;
+    int queued;
+
+    if (t == NULL || nice < NICE_MIN || nice > NICE_MAX) {
+        return -1;
+    }
+
+    rq = thread_rq_lock(t, &flags);
+
+    queued = t->on_rq >= 0;
+    if (queued) {
+        dequeue_thread_locked(rq, t, 0);
+    }
+
+    sched_fair_set_weight(t, nice);
+
+    if (queued) {
+        enqueue_thread_locked(rq, t, 0);
+    }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return 0;
+}
+
+/**
+ * sched_get_nice - Get the nice value of a thread
+ * @t: Thread
+ *
+ * Returns: Nice value
+ */
+int sched_get_nice(thread_t *t) {
+    return t->se.nice;
+}
+
+/**
+ * sched_setaffinity - Restrict the CPUs a thread may run on
+ * @t: Thread
+ * @mask: Allowed CPUs; must include at least one online CPU
+ *
+ * A thread queued on a CPU it may no longer use is moved right away. A
+ * running one is moved when it next leaves its CPU, which is rescheduled
+ * for that; if it is the caller, this happens before returning.
+ *
+ * Returns: 0 on success, -1 if @mask has no online CPU
+ */
+int sched_setaffinity(thread_t *t, cpumask_t mask) {
+    irq_flags_t flags;
+    runqueue_t *rq;
+    int cpu, self = 0;
+
+    if (t == NULL || (mask & cpumask_first_n(smp_get_cpu_count())) == CPU_MASK_NONE) {
+        return -1;
+    }
+
+    rq = thread_rq_lock(t, &flags);
+    t->cpus_allowed = mask;
+
+    if (cpumask_test_cpu(rq->cpu, mask)) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return 0;
+    }
+
+    if (t->on_rq >= 0 && !t->on_cpu) {
+        dequeue_thread_locked(rq, t, DEQUEUE_MIGRATE);
+        spin_unlock_irqrestore(&rq->lock, flags);
+
+        cpu = select_task_rq(t);
+        t->cpu = cpu;
+        t->nr_migrations++;
+        enqueue_thread_on(t, cpu, ENQUEUE_MIGRATED);
+        return 0;
+    }
+
+    if (rq->curr == t) {
+        resched_curr(rq);
+        self = rq == this_rq();
+    }
+    spin_unlock_irqrestore(&rq->lock, flags);
 
-    /* Remove from runqueue */
-    list_remove(&t->run_list);
-    runqueue.nr_running--;
+    if (self) {
+        schedule();
+    }
+    return 0;
+}
 
-    spin_unlock_irqrestore(&runqueue.lock, flags);
+/**
+ * sched_getaffinity - Get the CPUs a thread may run on
+ * @t: Thread
+ *
+ * Returns: Affinity mask limited to online CPUs
+ */
+cpumask_t sched_getaffinity(thread_t *t) {
+    return t->cpus_allowed & cpumask_first_n(smp_get_cpu_count());
 }
 
 /**
  * scheduler_get_nr_running - Get number of runnable threads
  *
- * Returns: Number of threads in the runqueue
+ * Returns: Number of queued threads summed over all CPUs
  */
 int scheduler_get_nr_running(void) {
-    return runqueue.nr_running;
+    int total = 0;
+
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        total += cpu_rq(i)->nr_running;
+    }
+    return total;
 }
+
 /**
- * scheduler_get_runqueue - Get the global runqueue
+ * scheduler_get_nr_running_cpu - Get number of runnable threads on a CPU
+ * @cpu: CPU index
  *
- * Returns: Pointer to the global runqueue
+ * Returns: Number of threads queued on the CPU's runqueue, or 0 if invalid
  */
-runqueue_t *scheduler_get_runqueue(void) {
-    return &runqueue;
+int scheduler_get_nr_running_cpu(int cpu) {
+    if (cpu < 0 || cpu >= SMP_MAX_CPUS) {
+        return 0;
+    }
+    return cpu_rq(cpu)->nr_running;
+}
+
+/**
+ * scheduler_get_nr_migrations - Get total number of thread migrations
+ *
+ * Returns: Number of threads moved between runqueues by the load balancer
+ */
+uint64_t scheduler_get_nr_migrations(void) {
+    uint64_t total = 0;
+
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        total += cpu_rq(i)->nr_migrations_in;
+    }
+    return total;
+}
+
+/**
+ * scheduler_get_runqueue - Get a CPU's runqueue
+ * @cpu: CPU index
+ *
+ * Returns: Pointer to the CPU's runqueue, or NULL if invalid
+ */
+runqueue_t *scheduler_get_runqueue(int cpu) {
+    if (cpu < 0 || cpu >= SMP_MAX_CPUS) {
+        return NULL;
+    }
+    return cpu_rq(cpu);
+}
+/**
+ * scheduler_peek_next - Get the thread schedule() would pick next
+ * @rq: Runqueue
+ *
+ * Returns: Best queued thread (left queued), or NULL if @rq is empty
+ */
+thread_t *scheduler_peek_next(runqueue_t *rq) {
+    irq_flags_t flags;
+    thread_t *next;
+
+    flags = spin_lock_irqsave(&rq->lock);
+    next = pick_next_thread(rq);
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    return next;
 }
+
 /**
  * scheduler_get_idle_thread - Get the idle thread for a CPU
  * @cpu: CPU index
@@ -260,32 +1211,146 @@ thread_t *scheduler_get_idle_thread(int cpu) {
     if (cpu < 0 || cpu >= SMP_MAX_CPUS) {
         return NULL;
     }
-    return runqueue.idle_threads[cpu];
+    return cpu_rq(cpu)->idle;
+}
+
+/* ============================================================================
+ * Load Balancing
+ * ============================================================================ */
+
+/**
+ * find_busiest_queue - Find the runqueue with the most queued threads
+ * @this_rq: Runqueue of the balancing CPU (excluded)
+ *
+ * Reads queue lengths without locking; the result is only a hint and is
+ * re-validated under the locks before anything is moved.
+ *
+ * Returns: Busiest runqueue, or NULL if every other queue is empty
+ */
+static runqueue_t *find_busiest_queue(runqueue_t *this_rq) {
+    runqueue_t *busiest = NULL;
+    int max_running = 0;
+    int nr_cpus = smp_get_cpu_count();
+
+    for (int i = 0; i < nr_cpus; i++) {
+        runqueue_t *rq = cpu_rq(i);
+        int nr = READ_ONCE(rq->nr_running);
+
+        if (rq == this_rq) {
+            continue;
+        }
+        if (nr > max_running) {
+            max_running = nr;
+            busiest = rq;
+        }
+    }
+
+    return busiest;
 }
+
 /**
- * pick_next_thread - Pick next thread from runqueue (FIFO order)
+ * detach_one_thread - Take a migratable thread off a runqueue
+ * @src: Source runqueue (lock held)
+ * @dst_cpu: CPU the thread will move to
  *
- * Returns: Next thread to run, or NULL if runqueue is empty
+ * Each class picks its own candidate, starting with the highest class.
+ * Threads still finishing a switch out on their old CPU, or not allowed
+ * on @dst_cpu, are never chosen.
+ *
+ * Returns: Detached thread, or NULL if none can be moved
  */
-static thread_t *pick_next_thread(void) {
-    thread_t *next = NULL;
+static thread_t *detach_one_thread(runqueue_t *src, int dst_cpu) {
+    const struct sched_class *class;
+
+    for_each_class(class) {
+        thread_t *t = class->select_migratable(src, dst_cpu);
+
+        if (t != NULL) {
+            dequeue_thread_locked(src, t, DEQUEUE_MIGRATE);
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * load_balance - Pull threads from the busiest CPU onto this one
+ * @this_rq: Runqueue of the balancing CPU
+ * @idle: Non-zero when called because this CPU has nothing to run
+ *
+ * An idle CPU steals a single thread from any non-empty queue. The periodic
+ * balancer only acts on an imbalance of at least
+ * SCHEDULER_IMBALANCE_THRESHOLD and moves half the difference.
+ *
+ * Returns: Number of threads migrated
+ */
+static int load_balance(runqueue_t *this_rq, int idle) {
+    runqueue_t *busiest;
     irq_flags_t flags;
+    int nr_moved = 0;
+    int nr_to_move;
 
-    /* Acquire runqueue lock */
-    flags = spin_lock_irqsave(&runqueue.lock);
+    if (!idle) {
+        this_rq->nr_balance_runs++;
+    }
 
-    /* Check if runqueue is empty */
-    if (list_empty(&runqueue.thread_list)) {
-        spin_unlock_irqrestore(&runqueue.lock, flags);
-        return NULL;
+    busiest = find_busiest_queue(this_rq);
+    if (busiest == NULL) {
+        return 0;
     }
 
-    /* Get next thread from front of queue (FIFO) */
-    struct list_head *node = list_pop_front(&runqueue.thread_list);
-    next = list_entry(node, thread_t, run_list);
-    runqueue.nr_running--;
+    flags = double_rq_lock(this_rq, busiest);
 
-    spin_unlock_irqrestore(&runqueue.lock, flags);
+    /* Re-validate now that both queues are stable */
+    if (idle) {
+        nr_to_move = busiest->nr_running > 0 ? 1 : 0;
+    } else {
+        int imbalance = busiest->nr_running - this_rq->nr_running;
+        nr_to_move = imbalance >= SCHEDULER_IMBALANCE_THRESHOLD ? imbalance / 2 : 0;
+    }
 
-    return next;
+    while (nr_moved < nr_to_move) {
+        thread_t *t = detach_one_thread(busiest, this_rq->cpu);
+
+        if (t == NULL) {
+            break;
+        }
+        enqueue_thread_locked(this_rq, t, ENQUEUE_MIGRATED);
+        t->nr_migrations++;
+        nr_moved++;
+    }
+
+    busiest->nr_migrations_out += nr_moved;
+    this_rq->nr_migrations_in += nr_moved;
+    if (idle && nr_moved > 0) {
+        this_rq->nr_idle_steals++;
+    }
+
+    double_rq_unlock(this_rq, busiest, flags);
+
+    return nr_moved;
+}
+
+/**
+ * pick_next_thread - Pick the next thread to run
+ * @rq: Runqueue of the current CPU (lock held)
+ *
+ * Asks each class in priority order; the first one with a runnable thread
+ * wins. The thread is left queued.
+ *
+ * Returns: Next thread to run, or NULL if the runqueue is empty
+ */
+static thread_t *pick_next_thread(runqueue_t *rq) {
+    const struct sched_class *class;
+
+    for_each_class(class) {
+        thread_t *next = class->pick_next_thread(rq);
+
+        if (next != NULL) {
+            return next;
+        }
+    }
+
+    return NULL;
 }
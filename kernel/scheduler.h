@@ -1,4 +1,4 @@
-/* Emergence Kernel - FIFO Scheduler Internal Implementation
+/* Emergence Kernel - Scheduler Internal Implementation
  *
  * This header contains internal scheduler implementation details.
  * Public API is in include/kernel/scheduler.h
@@ -17,26 +17,215 @@
 /* Internal dependencies */
 #include "kernel/thread.h"
 #include "kernel/list.h"
+#include "kernel/rbtree.h"
 #include "include/spinlock.h"
 #include "arch/x86_64/smp.h"  /* For SMP_MAX_CPUS */
 
-/* Scheduler tick interval - trigger context switch every N timer ticks */
-#define SCHEDULER_TICK_INTERVAL 5
+/* Fair class tunables (nanoseconds)
+ *
+ * Every runnable thread gets a turn within SCHED_LATENCY_NS, unless so many
+ * are queued that each slice would drop below SCHED_MIN_GRANULARITY_NS, in
+ * which case the period stretches to nr_running * SCHED_MIN_GRANULARITY_NS.
+ */
+#define SCHED_LATENCY_NS            6000000ULL
+#define SCHED_MIN_GRANULARITY_NS    750000ULL
+
+/* Minimum vruntime lead a waking thread needs to preempt the running one */
+#define SCHED_WAKEUP_GRANULARITY_NS 1000000ULL
+
+/* Weight of a nice-0 thread */
+#define NICE_0_LOAD                 1024
+
+/* SCHED_RR time slice (nanoseconds) */
+#define SCHED_RR_TIMESLICE_NS       100000000LL
+
+/* Shortest one-shot tick the NO_HZ timer is programmed for */
+#define SCHED_TICK_MIN_NS           100000ULL
+
+/* slice_remaining() value when nothing is waiting to take over the CPU */
+#define SCHED_SLICE_INFINITE        UINT64_MAX
+
+/* Periodic load balance - pull work from the busiest CPU every N ticks */
+#define SCHEDULER_BALANCE_INTERVAL 20
+
+/* Queue length difference required before the periodic balancer migrates */
+#define SCHEDULER_IMBALANCE_THRESHOLD 2
+
+/* A thread that left its CPU less than this long ago (ns) is cache hot there */
+#define SCHED_MIGRATION_COST_NS     500000ULL
+
+/* Enqueue flags */
+#define ENQUEUE_WAKEUP      0x01    /* Thread was blocked or is new */
+#define ENQUEUE_MIGRATED    0x02    /* Thread arrives from another runqueue */
+#define ENQUEUE_PREEMPTED   0x04    /* Running thread was involuntarily preempted */
+
+/* Dequeue flags */
+#define DEQUEUE_MIGRATE     0x01    /* Thread leaves for another runqueue */
+
+struct runqueue;
+
+/* Scheduling class operations
+ *
+ * Classes are consulted in priority order through ->next. A thread that is
+ * running is never linked into its class queue: pick_next_thread() only
+ * peeks, the core dequeues the chosen thread and calls set_next_thread().
+ * All operations are called with the runqueue lock held.
+ */
+struct sched_class {
+    const struct sched_class *next;     /* Next lower-priority class */
+    const char *name;
+
+    /* Link @t into the class queue */
+    void (*enqueue_thread)(struct runqueue *rq, thread_t *t, int flags);
+
+    /* Unlink @t from the class queue */
+    void (*dequeue_thread)(struct runqueue *rq, thread_t *t, int flags);
+
+    /* Return the best queued thread without dequeuing it, or NULL */
+    thread_t *(*pick_next_thread)(struct runqueue *rq);
+
+    /* @t (just dequeued) starts running */
+    void (*set_next_thread)(struct runqueue *rq, thread_t *t);
+
+    /* @t stops running (before it is re-queued or blocks) */
+    void (*put_prev_thread)(struct runqueue *rq, thread_t *t);
+
+    /* Timer tick while @t runs; returns non-zero if @t should be preempted */
+    int (*task_tick)(struct runqueue *rq, thread_t *t);
+
+    /* Nanoseconds until running @t should be preempted by the tick,
+     * or SCHED_SLICE_INFINITE if no queued thread competes with it */
+    uint64_t (*slice_remaining)(struct runqueue *rq, thread_t *t);
+
+    /* Return non-zero if newly queued @t (same class as rq->curr) should preempt it */
+    int (*check_preempt_curr)(struct runqueue *rq, thread_t *t);
+
+    /* Return a queued thread the load balancer may move to @dst_cpu, or NULL */
+    thread_t *(*select_migratable)(struct runqueue *rq, int dst_cpu);
+
+    /* Optional: unqueued @t is about to be woken on another runqueue */
+    void (*migrate_thread_rq)(struct runqueue *rq, thread_t *t);
+
+    /* Optional: running @t just moved into this class */
+    void (*switched_to)(struct runqueue *rq, thread_t *t);
+};
 
-/* Global runqueue structure */
+/* Fair class runqueue
+ *
+ * Threads are ordered by vruntime; the leftmost (smallest vruntime) is
+ * cached so picking the next thread is O(1). min_vruntime only moves
+ * forward and is the baseline for placing new and woken threads.
+ */
+struct cfs_rq {
+    struct rb_root_cached timeline;             /* Queued threads by vruntime */
+    uint64_t min_vruntime;                      /* Monotonic vruntime floor */
+    uint64_t load_weight;                       /* Sum of queued weights */
+    int nr_running;                             /* Number of queued threads */
+};
+
+/* Real-time class runqueue
+ *
+ * One FIFO list per priority plus a bitmap of non-empty lists. Bit i
+ * stands for priority SCHED_RT_PRIO_MAX - i, so the lowest set bit (one
+ * bsf per word) is the highest runnable priority.
+ */
+#define RT_BITMAP_WORDS ((SCHED_RT_PRIO_NR + 63) / 64)
+
+struct rt_rq {
+    struct list_head queue[SCHED_RT_PRIO_NR];   /* Per-priority FIFO lists */
+    uint64_t bitmap[RT_BITMAP_WORDS];           /* Non-empty list bitmap */
+    int nr_running;                             /* Number of queued threads */
+};
+
+/* Per-CPU scheduler statistics (CONFIG_SCHEDSTATS), sched_clock() ns */
+struct rq_statistics {
+    uint64_t nr_switches;                       /* Context switches */
+    uint64_t idle_time;                         /* Time spent in the idle thread */
+    uint64_t idle_stamp;                        /* When idle started, 0 while busy */
+    uint64_t len_sum;                           /* Integral of nr_running over time */
+    uint64_t len_stamp;                         /* When len_sum was last brought up to date */
+    int nr_running_max;                         /* Longest queue seen */
+};
+
+/* Per-CPU runqueue structure
+ *
+ * Each CPU owns one runqueue and only takes its own lock on the fast path
+ * (enqueue of a local thread, pick of the next thread). Remote runqueues are
+ * locked only by the load balancer, always in ascending CPU order.
+ */
 struct runqueue {
-    spinlock_t lock;                            /* Protects runqueue operations */
-    struct list_head thread_list;               /* FIFO queue of runnable threads */
-    int nr_running;                             /* Number of runnable threads */
-    thread_t *idle_threads[SMP_MAX_CPUS];      /* Per-CPU idle threads */
+    spinlock_t lock;                            /* Protects this runqueue */
+    int nr_running;                             /* Number of queued threads */
+    int cpu;                                    /* Owning CPU index */
+    int need_resched;                           /* Running thread should be preempted */
+    int idle_polling;                           /* Idle in MWAIT on need_resched, no IPI needed */
+    struct rt_rq rt;                            /* Real-time class queue */
+    struct cfs_rq cfs;                          /* Fair class queue */
+    thread_t *curr;                             /* Running thread */
+    thread_t *idle;                             /* This CPU's idle thread */
+    thread_t *prev;                             /* Thread switched out, finished in schedule_tail() */
+    int push_prev;                              /* prev must move off this CPU (affinity) */
+    cpu_context_t boot_context;                 /* Scratch context for the first switch */
+    uint64_t kernel_cr3;                        /* Kernel CR3 while a process's is loaded, else 0 */
+    uint64_t tick_counter;                      /* Scheduler ticks seen on this CPU */
+
+    /* Load balancing statistics */
+    uint64_t nr_migrations_in;                  /* Threads pulled onto this CPU */
+    uint64_t nr_migrations_out;                 /* Threads pulled away from this CPU */
+    uint64_t nr_idle_steals;                    /* Successful steals while idle */
+    uint64_t nr_balance_runs;                   /* Periodic rebalance attempts */
+
+    struct rq_statistics stats;                 /* Latency and load statistics */
 };
 
 typedef struct runqueue runqueue_t;
 
+/* Scheduling classes, highest priority first */
+extern const struct sched_class rt_sched_class;
+extern const struct sched_class fair_sched_class;
+#define sched_class_highest (&rt_sched_class)
+
+#define for_each_class(class) \
+    for (class = sched_class_highest; class != NULL; class = class->next)
+
+/**
+ * can_migrate_thread - Check whether a queued thread may move to a CPU
+ * @t: Queued thread
+ * @dst_cpu: Destination CPU index
+ *
+ * Threads still being switched out on their old CPU, and threads whose
+ * affinity excludes @dst_cpu, must stay where they are.
+ */
+static inline int can_migrate_thread(thread_t *t, int dst_cpu) {
+    return !t->on_cpu && cpumask_test_cpu(dst_cpu, t->cpus_allowed);
+}
+
+/* Initialize a runqueue's real-time class queue */
+void init_rt_rq(struct rt_rq *rt);
+
+/* Initialize the real-time class state of a new thread */
+void sched_rt_init_thread(thread_t *t);
+
+/* Initialize a runqueue's fair class queue */
+void init_cfs_rq(struct cfs_rq *cfs);
+
+/* Initialize the fair class state of a new thread */
+void sched_fair_init_thread(thread_t *t);
+
+/* Update the weight of a thread (not queued) from its nice value */
+void sched_fair_set_weight(thread_t *t, int nice);
+
+/* Scale a runtime delta by NICE_0_LOAD / weight */
+uint64_t sched_calc_delta_fair(uint64_t delta, uint64_t weight);
+
 /* Idle thread function - forward declaration */
 void idle_thread_func(void *arg);
 
-/* Internal accessor for tests - forward declaration */
-runqueue_t *scheduler_get_runqueue(void);
+/* Prepare scheduler state of a freshly created thread */
+void sched_init_thread(thread_t *t);
+
+/* Internal accessors for tests - forward declarations */
+runqueue_t *scheduler_get_runqueue(int cpu);
+thread_t *scheduler_peek_next(runqueue_t *rq);
 
 #endif /* _KERNEL_SCHEDULER_INTERNAL_H */
@@ -0,0 +1,183 @@
+/* Emergence Kernel - Kernel thread stack pool
+ *
+ * Layout of the stack area (see kernel/stack.h):
+ *
+ *   STACK_AREA_BASE + n * STACK_SLOT_SIZE
+ *   +------------------+------------------------------+
+ *   | guard (unmapped) | stack (STACK_POOL_STACK_SIZE) |
+ *   +------------------+------------------------------+
+ *                      ^ stack_alloc() result           ^ initial RSP
+ *
+ * Slots are handed out in order and never unmapped. A freed stack's
+ * first word links it into the global free list.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/stack.h"
+#include "kernel/kmap.h"
+#include "kernel/klog.h"
+#include "include/spinlock.h"
+#include "include/barrier.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/idt.h"
+
+/* Per-CPU cache of free stacks, used with interrupts disabled */
+struct stack_cache {
+    void *stacks[STACK_CACHE_SIZE];
+    int nr;
+};
+
+static DEFINE_PER_CPU(struct stack_cache, stack_cache);
+
+/* Global pool: next unused slot and the free list */
+static spinlock_t stack_pool_lock;
+static int next_slot;
+static void *free_stacks;
+static uint64_t nr_free;
+static uint64_t nr_reused;
+
+/**
+ * stack_pool_init - Initialize the stack pool
+ */
+void stack_pool_init(void) {
+    spin_lock_init(&stack_pool_lock);
+    next_slot = 0;
+    free_stacks = NULL;
+    nr_free = 0;
+    nr_reused = 0;
+
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        per_cpu(stack_cache, cpu).nr = 0;
+    }
+
+    klog_info("STACK", "Stack pool at %p: %d slots of %d KB (%d KB guard)",
+              (void *)STACK_AREA_BASE, STACK_AREA_SLOTS,
+              STACK_SLOT_SIZE / 1024, STACK_GUARD_SIZE / 1024);
+}
+
+/* Map a fresh slot; returns the stack base or NULL */
+static void *stack_map_slot(void) {
+    uint64_t base;
+    kmap_t *mapping;
+    irq_flags_t flags;
+    int slot;
+
+    flags = spin_lock_irqsave(&stack_pool_lock);
+    slot = next_slot < STACK_AREA_SLOTS ? next_slot++ : -1;
+    spin_unlock_irqrestore(&stack_pool_lock, flags);
+
+    if (slot < 0) {
+        klog_error("STACK", "Stack area exhausted (%d slots)", STACK_AREA_SLOTS);
+        return NULL;
+    }
+
+    base = STACK_AREA_BASE + (uint64_t)slot * STACK_SLOT_SIZE + STACK_GUARD_SIZE;
+    mapping = kmap_create(base, base + STACK_POOL_STACK_SIZE, 0,
+                          X86_PTE_PRESENT | X86_PTE_WRITABLE,
+                          KMAP_STACK, KMAP_NONPAGEABLE, KMAP_MONITOR_NONE,
+                          "thread_stack");
+    if (mapping == NULL) {
+        return NULL;
+    }
+    if (kmap_map_pages(mapping) != 0) {
+        /* The slot stays reserved; its range is simply never used */
+        kmap_put(mapping);
+        klog_error("STACK", "Failed to map stack slot %d", slot);
+        return NULL;
+    }
+
+    return (void *)base;
+}
+
+/**
+ * stack_alloc - Allocate a guarded kernel stack
+ *
+ * Takes a stack from this CPU's cache, then from the global free list,
+ * and maps a new slot only when both are empty.
+ *
+ * Returns: Lowest address of a STACK_POOL_STACK_SIZE stack, or NULL
+ */
+void *stack_alloc(void) {
+    struct stack_cache *cache;
+    irq_flags_t flags;
+    void *stack = NULL;
+
+    flags = irq_save(1);
+    cache = this_cpu_ptr(&stack_cache);
+    if (cache->nr > 0) {
+        stack = cache->stacks[--cache->nr];
+    }
+    irq_restore(flags);
+
+    if (stack == NULL) {
+        flags = spin_lock_irqsave(&stack_pool_lock);
+        stack = free_stacks;
+        if (stack != NULL) {
+            free_stacks = *(void **)stack;
+            nr_free--;
+        }
+        spin_unlock_irqrestore(&stack_pool_lock, flags);
+    }
+
+    if (stack == NULL) {
+        return stack_map_slot();
+    }
+
+    flags = spin_lock_irqsave(&stack_pool_lock);
+    nr_reused++;
+    spin_unlock_irqrestore(&stack_pool_lock, flags);
+    return stack;
+}
+
+/**
+ * stack_free - Return a stack for reuse
+ * @stack: Result of stack_alloc(), no longer in use by any thread
+ *
+ * Keeps it mapped in this CPU's cache, or on the global free list if
+ * the cache is full.
+ */
+void stack_free(void *stack) {
+    struct stack_cache *cache;
+    irq_flags_t flags;
+
+    if (stack == NULL) {
+        return;
+    }
+
+    flags = irq_save(1);
+    cache = this_cpu_ptr(&stack_cache);
+    if (cache->nr < STACK_CACHE_SIZE) {
+        cache->stacks[cache->nr++] = stack;
+        stack = NULL;
+    }
+    irq_restore(flags);
+
+    if (stack != NULL) {
+        flags = spin_lock_irqsave(&stack_pool_lock);
+        *(void **)stack = free_stacks;
+        free_stacks = stack;
+        nr_free++;
+        spin_unlock_irqrestore(&stack_pool_lock, flags);
+    }
+}
+
+/**
+ * stack_pool_get_stats - Get stack pool counters
+ * @stats: Filled in with the current counters
+ */
+void stack_pool_get_stats(struct stack_pool_stats *stats) {
+    irq_flags_t flags;
+    uint64_t cached = 0;
+
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        cached += READ_ONCE(per_cpu(stack_cache, cpu).nr);
+    }
+
+    flags = spin_lock_irqsave(&stack_pool_lock);
+    stats->nr_slots = next_slot;
+    stats->nr_free = nr_free;
+    stats->nr_reused = nr_reused;
+    spin_unlock_irqrestore(&stack_pool_lock, flags);
+    stats->nr_cached = cached;
+}
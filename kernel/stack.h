@@ -0,0 +1,65 @@
+/* Emergence Kernel - Kernel thread stack pool
+ *
+ * Thread stacks live in a dedicated virtual range, one fixed-size slot
+ * per stack. The stack occupies the top of its slot and the pages below
+ * it are never mapped, so running off the end faults on the guard area
+ * instead of overwriting whatever was allocated next to the stack.
+ *
+ * Stacks stay mapped once created. Freed stacks go to a small per-CPU
+ * cache and then to a global free list, so creating a thread normally
+ * reuses a stack without touching the PMM or the page tables. Never
+ * unmapping also means the range never needs a cross-CPU TLB flush and
+ * its top-level page table entry, shared by every address space, stays.
+ */
+
+#ifndef _KERNEL_STACK_H
+#define _KERNEL_STACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Virtual range for thread stacks (PML4 slot 510, below the kernel image) */
+#define STACK_AREA_BASE         0xFFFFFF0000000000ULL
+#define STACK_AREA_SLOTS        1024
+
+/* Each slot: guard pages, then the stack at the top */
+#define STACK_SLOT_SIZE         (32 * 1024)
+#define STACK_POOL_STACK_SIZE   (16 * 1024)
+#define STACK_GUARD_SIZE        (STACK_SLOT_SIZE - STACK_POOL_STACK_SIZE)
+
+#define STACK_AREA_END          (STACK_AREA_BASE + (uint64_t)STACK_AREA_SLOTS * STACK_SLOT_SIZE)
+
+/* Free stacks each CPU keeps before returning them to the global list */
+#define STACK_CACHE_SIZE        8
+
+/* Set up the stack area and per-CPU caches (after kmap_init) */
+void stack_pool_init(void);
+
+/* Get a guarded stack of STACK_POOL_STACK_SIZE bytes; returns its lowest address */
+void *stack_alloc(void);
+
+/* Return a stack from stack_alloc() for reuse */
+void stack_free(void *stack);
+
+/* Check whether @addr lies in the stack area */
+static inline int stack_in_pool(uint64_t addr) {
+    return addr >= STACK_AREA_BASE && addr < STACK_AREA_END;
+}
+
+/* Check whether @addr lies in the guard area below a pooled stack */
+static inline int stack_is_guard(uint64_t addr) {
+    return stack_in_pool(addr) &&
+           ((addr - STACK_AREA_BASE) % STACK_SLOT_SIZE) < STACK_GUARD_SIZE;
+}
+
+/* Pool counters for tests and debugging */
+struct stack_pool_stats {
+    uint64_t nr_slots;              /* Slots ever mapped */
+    uint64_t nr_free;               /* Stacks on the global free list */
+    uint64_t nr_cached;             /* Stacks in per-CPU caches */
+    uint64_t nr_reused;             /* Allocations served without mapping */
+};
+
+void stack_pool_get_stats(struct stack_pool_stats *stats);
+
+#endif /* _KERNEL_STACK_H */
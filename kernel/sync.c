@@ -0,0 +1,345 @@
+/* Emergence Kernel - Sleeping synchronization primitives
+ *
+ * Every sleeping path follows the wait queue protocol: queue an exclusive
+ * entry (which marks us BLOCKED), retry the fast path, and only then call
+ * schedule(). The releasing side updates the state first and wakes one
+ * sleeper afterwards, so a release can never slip between the retry and
+ * the sleep.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/sync.h"
+#include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "include/barrier.h"
+
+/* ============================================================================
+ * Mutex
+ * ============================================================================ */
+
+/**
+ * mutex_init - Initialize an unlocked mutex
+ * @m: Mutex
+ */
+void mutex_init(mutex_t *m) {
+    m->owner = NULL;
+    init_waitqueue_head(&m->wait);
+}
+
+/* Try to take the mutex for @curr with a single compare-and-swap */
+static inline int __mutex_trylock(mutex_t *m, thread_t *curr) {
+    thread_t *expected = NULL;
+
+    return __atomic_compare_exchange_n(&m->owner, &expected, curr, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/**
+ * mutex_optimistic_spin - Spin while the owner is running
+ * @m: Mutex
+ * @curr: Current thread
+ *
+ * A holder that is on a CPU will usually release soon, and spinning for
+ * that is cheaper than two context switches. Gives up as soon as the owner
+ * is switched out, since it then cannot release before we would sleep.
+ *
+ * Returns: 1 if the mutex was acquired
+ */
+static int mutex_optimistic_spin(mutex_t *m, thread_t *curr) {
+    for (int i = 0; i < MUTEX_SPIN_MAX; i++) {
+        thread_t *owner = __atomic_load_n(&m->owner, __ATOMIC_RELAXED);
+
+        if (owner == NULL) {
+            if (__mutex_trylock(m, curr)) {
+                return 1;
+            }
+            continue;
+        }
+
+        if (!__atomic_load_n(&owner->on_cpu, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+        cpu_relax();
+    }
+
+    return 0;
+}
+
+/**
+ * mutex_lock - Acquire a mutex, sleeping if necessary
+ * @m: Mutex
+ *
+ * Not recursive. Must be called from thread context.
+ */
+void mutex_lock(mutex_t *m) {
+    thread_t *curr = thread_get_current();
+    wait_queue_entry_t wait;
+
+    if (__mutex_trylock(m, curr)) {
+        return;
+    }
+
+    if (mutex_optimistic_spin(m, curr)) {
+        return;
+    }
+
+    init_waitqueue_entry(&wait, curr, WQ_FLAG_EXCLUSIVE);
+    while (1) {
+        prepare_to_wait(&m->wait, &wait);
+        if (__mutex_trylock(m, curr)) {
+            break;
+        }
+        schedule();
+    }
+    finish_wait(&m->wait, &wait);
+}
+
+/**
+ * mutex_trylock - Acquire a mutex without sleeping
+ * @m: Mutex
+ *
+ * Returns: 1 if acquired, 0 if it is held
+ */
+int mutex_trylock(mutex_t *m) {
+    return __mutex_trylock(m, thread_get_current());
+}
+
+/**
+ * mutex_unlock - Release a mutex
+ * @m: Mutex held by the current thread
+ *
+ * The mutex is released before the first sleeper is woken, so a running
+ * contender may take it first; the woken thread then simply sleeps again.
+ */
+void mutex_unlock(mutex_t *m) {
+    __atomic_store_n(&m->owner, NULL, __ATOMIC_RELEASE);
+
+    if (wq_has_sleeper(&m->wait)) {
+        wake_up(&m->wait);
+    }
+}
+
+/**
+ * mutex_is_locked - Check whether a mutex is held
+ * @m: Mutex
+ *
+ * Returns: Non-zero if held
+ */
+int mutex_is_locked(mutex_t *m) {
+    return __atomic_load_n(&m->owner, __ATOMIC_RELAXED) != NULL;
+}
+
+/* ============================================================================
+ * Semaphore
+ * ============================================================================ */
+
+/**
+ * sema_init - Initialize a semaphore
+ * @sem: Semaphore
+ * @count: Initial number of available units
+ */
+void sema_init(semaphore_t *sem, int count) {
+    sem->count = count;
+    init_waitqueue_head(&sem->wait);
+}
+
+/**
+ * down_trylock - Take a unit without sleeping
+ * @sem: Semaphore
+ *
+ * Returns: 1 if a unit was taken, 0 if none was available
+ */
+int down_trylock(semaphore_t *sem) {
+    int count = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+
+    while (count > 0) {
+        if (__atomic_compare_exchange_n(&sem->count, &count, count - 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * down - Take a unit, sleeping until one is available
+ * @sem: Semaphore
+ */
+void down(semaphore_t *sem) {
+    wait_queue_entry_t wait;
+
+    if (down_trylock(sem)) {
+        return;
+    }
+
+    init_wait_entry(&wait, WQ_FLAG_EXCLUSIVE);
+    while (1) {
+        prepare_to_wait(&sem->wait, &wait);
+        if (down_trylock(sem)) {
+            break;
+        }
+        schedule();
+    }
+    finish_wait(&sem->wait, &wait);
+}
+
+/**
+ * up - Release a unit and wake one sleeper
+ * @sem: Semaphore
+ */
+void up(semaphore_t *sem) {
+    __atomic_add_fetch(&sem->count, 1, __ATOMIC_RELEASE);
+
+    if (wq_has_sleeper(&sem->wait)) {
+        wake_up(&sem->wait);
+    }
+}
+
+/* ============================================================================
+ * Completion
+ * ============================================================================ */
+
+/**
+ * init_completion - Initialize a completion that has not happened yet
+ * @x: Completion
+ */
+void init_completion(struct completion *x) {
+    x->done = 0;
+    init_waitqueue_head(&x->wait);
+}
+
+/**
+ * reinit_completion - Reset a completion for reuse
+ * @x: Completion with no waiters
+ */
+void reinit_completion(struct completion *x) {
+    x->done = 0;
+}
+
+/**
+ * try_wait_for_completion - Consume a completion without sleeping
+ * @x: Completion
+ *
+ * Returns: 1 if it had been completed, 0 otherwise
+ */
+int try_wait_for_completion(struct completion *x) {
+    irq_flags_t flags;
+    int ret = 0;
+
+    flags = spin_lock_irqsave(&x->wait.lock);
+    if (x->done > 0) {
+        if (x->done != COMPLETION_DONE_ALL) {
+            x->done--;
+        }
+        ret = 1;
+    }
+    spin_unlock_irqrestore(&x->wait.lock, flags);
+
+    return ret;
+}
+
+/**
+ * wait_for_completion - Sleep until a completion happens
+ * @x: Completion
+ *
+ * Each complete() releases exactly one waiter; complete_all() releases
+ * all current and future waiters until reinit_completion().
+ */
+void wait_for_completion(struct completion *x) {
+    wait_queue_entry_t wait;
+
+    if (try_wait_for_completion(x)) {
+        return;
+    }
+
+    init_wait_entry(&wait, WQ_FLAG_EXCLUSIVE);
+    while (1) {
+        prepare_to_wait(&x->wait, &wait);
+        if (try_wait_for_completion(x)) {
+            break;
+        }
+        schedule();
+    }
+    finish_wait(&x->wait, &wait);
+}
+
+/**
+ * wait_for_completion_timeout - Sleep until a completion happens or a timeout passes
+ * @x: Completion
+ * @timeout_ns: Longest time to sleep
+ *
+ * Returns: 0 on timeout, otherwise the time left in ns (at least 1)
+ */
+uint64_t wait_for_completion_timeout(struct completion *x, uint64_t timeout_ns) {
+    wait_queue_entry_t wait;
+    uint64_t left = timeout_ns;
+
+    if (try_wait_for_completion(x)) {
+        return left > 0 ? left : 1;
+    }
+
+    init_wait_entry(&wait, WQ_FLAG_EXCLUSIVE);
+    while (1) {
+        prepare_to_wait(&x->wait, &wait);
+        if (try_wait_for_completion(x)) {
+            if (left == 0) {
+                left = 1;
+            }
+            break;
+        }
+        if (left == 0) {
+            break;
+        }
+        left = schedule_timeout(left);
+    }
+    finish_wait(&x->wait, &wait);
+
+    /* A complete() that picked us just as we timed out goes to the next waiter */
+    if (left == 0 && completion_done(x)) {
+        wake_up(&x->wait);
+    }
+
+    return left;
+}
+
+/**
+ * completion_done - Check for pending completions without consuming one
+ * @x: Completion
+ *
+ * Returns: Non-zero if a wait_for_completion() would not sleep
+ */
+int completion_done(struct completion *x) {
+    return __atomic_load_n(&x->done, __ATOMIC_RELAXED) > 0;
+}
+
+/**
+ * complete - Signal one waiter
+ * @x: Completion
+ */
+void complete(struct completion *x) {
+    irq_flags_t flags;
+
+    flags = spin_lock_irqsave(&x->wait.lock);
+    if (x->done != COMPLETION_DONE_ALL) {
+        x->done++;
+    }
+    spin_unlock_irqrestore(&x->wait.lock, flags);
+
+    wake_up(&x->wait);
+}
+
+/**
+ * complete_all - Signal all waiters, now and until reinit_completion()
+ * @x: Completion
+ */
+void complete_all(struct completion *x) {
+    irq_flags_t flags;
+
+    flags = spin_lock_irqsave(&x->wait.lock);
+    x->done = COMPLETION_DONE_ALL;
+    spin_unlock_irqrestore(&x->wait.lock, flags);
+
+    wake_up_all(&x->wait);
+}
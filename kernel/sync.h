@@ -0,0 +1,78 @@
+/* Emergence Kernel - Sleeping synchronization primitives
+ *
+ * Built on wait queues, for code that may hold a lock or wait for an
+ * event long enough that spinning would waste the CPU:
+ *
+ *   mutex      - owner-tracked sleeping lock. A contender spins briefly
+ *                while the owner is running on another CPU, then blocks.
+ *   semaphore  - counting semaphore.
+ *   completion - one-shot or counted "this has happened" event.
+ *
+ * All sleeping operations must be called from thread context. up(),
+ * complete() and complete_all() may also be called from interrupts.
+ */
+
+#ifndef _KERNEL_SYNC_H
+#define _KERNEL_SYNC_H
+
+#include <stdint.h>
+#include "include/kernel/thread.h"
+#include "kernel/wait.h"
+
+/* ============================================================================
+ * Mutex
+ * ============================================================================ */
+
+/* Maximum owner polls before a contended mutex_lock() goes to sleep */
+#define MUTEX_SPIN_MAX      1000
+
+typedef struct mutex {
+    thread_t *owner;                /* Holder, NULL when unlocked */
+    wait_queue_head_t wait;         /* Blocked contenders */
+} mutex_t;
+
+#define MUTEX_INIT(name) \
+    { .owner = NULL, .wait = WAIT_QUEUE_HEAD_INIT((name).wait) }
+
+void mutex_init(mutex_t *m);
+void mutex_lock(mutex_t *m);
+int mutex_trylock(mutex_t *m);
+void mutex_unlock(mutex_t *m);
+int mutex_is_locked(mutex_t *m);
+
+/* ============================================================================
+ * Semaphore
+ * ============================================================================ */
+
+typedef struct semaphore {
+    int count;                      /* Available units */
+    wait_queue_head_t wait;         /* Blocked down() callers */
+} semaphore_t;
+
+void sema_init(semaphore_t *sem, int count);
+void down(semaphore_t *sem);
+int down_trylock(semaphore_t *sem);
+void up(semaphore_t *sem);
+
+/* ============================================================================
+ * Completion
+ * ============================================================================ */
+
+/* done value after complete_all(): every waiter passes from then on */
+#define COMPLETION_DONE_ALL 0x7FFFFFFF
+
+struct completion {
+    int done;                       /* Pending completions (wait.lock) */
+    wait_queue_head_t wait;         /* Waiters */
+};
+
+void init_completion(struct completion *x);
+void reinit_completion(struct completion *x);
+void wait_for_completion(struct completion *x);
+uint64_t wait_for_completion_timeout(struct completion *x, uint64_t timeout_ns);
+int try_wait_for_completion(struct completion *x);
+int completion_done(struct completion *x);
+void complete(struct completion *x);
+void complete_all(struct completion *x);
+
+#endif /* _KERNEL_SYNC_H */
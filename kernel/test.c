@@ -25,7 +25,7 @@ static const char *selected_test_names[MAX_SELECTED_TESTS];
 static int selected_test_count = 0;
 
 /* Track which tests have already run (for unified mode) */
-#define MAX_TESTS 16
+#define MAX_TESTS 32
 static const char *tests_run_names[MAX_TESTS];  /* Stores names of run tests */
 static int tests_run_count = 0;
 
@@ -51,8 +51,12 @@ extern int run_nk_smp_monitor_stress_tests(void);
 extern int run_minilibc_tests(void);
 extern int run_nk_trampoline_tests(void);
 extern int run_sched_tests(void);
+extern int run_process_tests(void);
+extern int run_vdso_tests(void);
+extern int run_ioring_tests(void);
 extern int run_syscall_tests(void);
 extern int run_kmap_tests(void);
+extern int run_idle_tests(void);
 
 /* Test registry array */
 const test_case_t test_registry[] = {
@@ -164,6 +168,33 @@ const test_case_t test_registry[] = {
         .auto_run = 1  /* Auto-run after scheduler init */
     },
 #endif
+#if CONFIG_TESTS_PROCESS
+    {
+        .name = "process",
+        .description = "PID/TID allocation, fdtable, spawn and ELF loading tests",
+        .run_func = run_process_tests,
+        .enabled = 1,
+        .auto_run = 1  /* Auto-run after scheduler init */
+    },
+#endif
+#if CONFIG_TESTS_VDSO
+    {
+        .name = "vdso",
+        .description = "vDSO code and user mapping tests",
+        .run_func = run_vdso_tests,
+        .enabled = 1,
+        .auto_run = 1  /* Auto-run after scheduler init */
+    },
+#endif
+#if CONFIG_TESTS_IORING
+    {
+        .name = "ioring",
+        .description = "Submission/completion ring batched syscall tests",
+        .run_func = run_ioring_tests,
+        .enabled = 1,
+        .auto_run = 1  /* Auto-run after scheduler init */
+    },
+#endif
 #if CONFIG_TESTS_MINILIBC
     {
         .name = "minilibc",
@@ -208,6 +239,15 @@ const test_case_t test_registry[] = {
         .enabled = 1,
         .auto_run = 1  /* Auto-run in test-all */
     },
+#endif
+#if CONFIG_TESTS_IDLE
+    {
+        .name = "idle",
+        .description = "Idle wakeup latency benchmark (HLT vs MWAIT)",
+        .run_func = run_idle_tests,
+        .enabled = 1,
+        .auto_run = 1  /* Auto-run after AP startup */
+    },
 #endif
     { .name = NULL }  /* Sentinel */
 };
@@ -7,17 +7,26 @@
 #include "kernel/list.h"
 #include "kernel/slab.h"
 #include "kernel/pmm.h"
+#include "kernel/stack.h"
 #include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "kernel/timer.h"
+#include "kernel/workqueue.h"
+#include "kernel/idr.h"
 #include "arch/x86_64/smp.h"
+#include "arch/x86_64/tsc.h"
 #include "arch/x86_64/include/cpu_context.h"
 #include "include/spinlock.h"
+#include "include/barrier.h"
 #include "include/string.h"
 
 /* Slab cache for thread structures */
 static slab_cache_t *thread_cache = NULL;
 
-/* Thread ID counter */
-static int next_tid = 1;
+/* TID allocator and TID -> thread map; tid_lock orders a lookup's
+ * reference against the TID's removal */
+static struct idr tid_idr;
+static spinlock_t tid_lock;
 
 /* List of all threads */
 static struct list_head all_threads_list;
@@ -27,10 +36,33 @@ static spinlock_t all_threads_lock;
 static uint64_t nr_total_threads;
 static uint64_t nr_active_threads;
 
+/* Exited kernel threads waiting to be freed, linked by all_list */
+static struct list_head dead_threads;
+static spinlock_t dead_threads_lock;
+static struct work_struct reap_work;
+
 /* External assembly functions */
 extern void context_switch(cpu_context_t *prev, cpu_context_t *next);
 extern void thread_entry_wrapper(void);
 
+/* reap_work: free every thread on dead_threads */
+static void thread_reap_dead(struct work_struct *work) {
+    struct list_head *node;
+    irq_flags_t flags;
+
+    (void)work;
+    while (1) {
+        flags = spin_lock_irqsave(&dead_threads_lock);
+        node = list_pop_front(&dead_threads);
+        spin_unlock_irqrestore(&dead_threads_lock, flags);
+
+        if (node == NULL) {
+            break;
+        }
+        thread_destroy(list_entry(node, thread_t, all_list));
+    }
+}
+
 /**
  * thread_init - Initialize the thread subsystem
  */
@@ -38,11 +70,15 @@ void thread_init(void) {
     klog_info("THREAD", "Initializing thread subsystem");
 
     /* Initialize slab cache for thread_t structures
-     * sizeof(thread_t) is 288 bytes, which is not a power of two.
+     * sizeof(thread_t) is 504 bytes, which is not a power of two.
      * Round up to 512 bytes (next power of two) for the slab cache.
      */
     static slab_cache_t thread_cache_data;
-    size_t cache_size = 512;  /* Next power of two after 288 */
+    size_t cache_size = 512;  /* Next power of two after 504 */
+
+    _Static_assert(sizeof(thread_t) <= 512, "thread_t outgrew its slab cache");
+    _Static_assert(offsetof(thread_t, context.rflags) == 192,
+                   "thread_entry_wrapper reads context.rflags at offset 192");
 
     if (slab_cache_create(&thread_cache_data, cache_size) < 0) {
         klog_error("THREAD", "Failed to create thread slab cache (size=%zu)", cache_size);
@@ -52,12 +88,22 @@ void thread_init(void) {
     thread_cache = &thread_cache_data;
     klog_info("THREAD", "Created thread cache (object_size=%zu)", cache_size);
 
+    /* Guarded, recycled kernel stacks */
+    stack_pool_init();
+
+    idr_init(&tid_idr, 1);
+    spin_lock_init(&tid_lock);
+
     /* Initialize all-threads list */
     list_init(&all_threads_list);
     spin_lock_init(&all_threads_lock);
     nr_total_threads = 0;
     nr_active_threads = 0;
 
+    list_init(&dead_threads);
+    spin_lock_init(&dead_threads_lock);
+    init_work(&reap_work, thread_reap_dead);
+
     klog_info("THREAD", "Thread subsystem initialized");
 }
 
@@ -94,6 +140,11 @@ thread_t *thread_create(const char *name,
         order++;
     }
 
+    /* Stacks that fit a pool slot get a guard area and are recycled */
+    if (actual_stack_size <= STACK_POOL_STACK_SIZE) {
+        actual_stack_size = STACK_POOL_STACK_SIZE;
+    }
+
     /* Allocate thread structure from slab cache */
     thread = slab_alloc(thread_cache);
     if (thread == NULL) {
@@ -104,30 +155,45 @@ thread_t *thread_create(const char *name,
     /* Zero-initialize thread structure */
     memset(thread, 0, sizeof(thread_t));
 
-    /* Allocate stack using PMM (contiguous pages) */
-    stack = pmm_alloc(order);
+    /* Reserve a TID; the thread is mapped to it once fully set up */
+    thread->tid = idr_alloc(&tid_idr, NULL);
+    if (thread->tid < 0) {
+        klog_error("THREAD", "Out of thread IDs");
+        slab_free(thread_cache, thread);
+        return NULL;
+    }
+
+    /* Allocate stack from the pool, or larger ones from PMM (contiguous
+     * pages, no guard) */
+    if (actual_stack_size == STACK_POOL_STACK_SIZE) {
+        stack = stack_alloc();
+    } else {
+        stack = pmm_alloc(order);
+    }
     if (stack == NULL) {
         klog_error("THREAD", "Failed to allocate stack (order %d)", order);
+        idr_remove(&tid_idr, thread->tid);
         slab_free(thread_cache, thread);
         return NULL;
     }
 
     /* Initialize thread fields */
-    thread->tid = next_tid++;
-
     thread->name = name;
     thread->entry_func = func;
     thread->entry_arg = arg;
     thread->flags = flags;
+    thread->refcount = 1;
     thread->state = THREAD_CREATED;
     thread->cpu = -1;
     thread->ticks = 0;
+    sched_init_thread(thread);
+    fpu_thread_init(thread);
 
     thread->kernel_stack = stack;
     thread->kernel_stack_size = actual_stack_size;
 
     /* Initialize list heads */
-    list_init(&thread->run_list);
+    list_init(&thread->thread_node);
     list_init(&thread->all_list);
 
     /* Set up initial context for new thread using architecture abstraction
@@ -155,10 +221,12 @@ thread_t *thread_create(const char *name,
 
     /* Add to all-threads list */
     spin_lock(&all_threads_lock);
-    list_push_back(&thread->all_list, &all_threads_list);
+    list_push_back(&all_threads_list, &thread->all_list);
     nr_total_threads++;
     spin_unlock(&all_threads_lock);
 
+    idr_replace(&tid_idr, thread->tid, thread);
+
     klog_info("THREAD", "Created thread '%s' (tid=%d, stack=%zu bytes)",
              name, thread->tid, actual_stack_size);
 
@@ -181,15 +249,16 @@ void thread_exit(void) {
 
     klog_debug("THREAD", "Thread '%s' (tid=%d) exiting", current->name, current->tid);
 
-    /* Mark thread as terminated */
-    current->state = THREAD_TERMINATED;
-
     /* Remove from all-threads list */
     spin_lock(&all_threads_lock);
     list_remove(&current->all_list);
     nr_active_threads--;
     spin_unlock(&all_threads_lock);
 
+    /* Mark thread as terminated last: a preemption from here on already
+     * switches it out for good, which is all schedule() below would do */
+    current->state = THREAD_TERMINATED;
+
     /* Trigger context switch - this never returns */
     extern void schedule(void);
     schedule();
@@ -214,16 +283,60 @@ void thread_yield(void) {
         return;
     }
 
-    /* Mark as ready and add back to runqueue */
-    current->state = THREAD_READY;
-    extern void scheduler_add_thread(thread_t *t);
-    scheduler_add_thread(current);
-
-    /* Trigger context switch */
+    /* schedule() re-queues the current thread at the back of its runqueue */
     extern void schedule(void);
     schedule();
 }
 
+/* On-stack hrtimer that ends a thread_sleep_ns() */
+struct sleep_timer {
+    struct hrtimer timer;
+    thread_t *thread;
+    volatile int done;
+};
+
+static void sleep_timer_fn(struct hrtimer *timer) {
+    struct sleep_timer *st = timer_container_of(timer, struct sleep_timer, timer);
+
+    st->done = 1;
+    wake_up_thread(st->thread);
+}
+
+/**
+ * thread_sleep_ns - Sleep for a number of nanoseconds
+ * @ns: Time to sleep
+ *
+ * Blocks on an hrtimer, so the CPU is free for other threads (or idle)
+ * until the deadline. Precision is that of the LAPIC one-shot with
+ * CONFIG_NO_HZ, and one tick otherwise.
+ */
+void thread_sleep_ns(uint64_t ns) {
+    thread_t *current = thread_get_current();
+    struct sleep_timer st;
+
+    if (current == NULL || ns == 0) {
+        return;
+    }
+
+    st.thread = current;
+    st.done = 0;
+    hrtimer_init(&st.timer, sleep_timer_fn);
+    hrtimer_start(&st.timer, sched_clock() + ns);
+
+    while (1) {
+        current->state = THREAD_BLOCKED;
+        /* Pairs with the wakeup: publish BLOCKED before testing @done */
+        smp_mb();
+        if (st.done) {
+            current->state = THREAD_RUNNING;
+            break;
+        }
+        schedule();
+    }
+
+    hrtimer_cancel(&st.timer);
+}
+
 /**
  * thread_get_current - Get the currently running thread
  *
@@ -253,8 +366,17 @@ void thread_destroy(thread_t *t) {
         return;
     }
 
+    /* Threads destroyed without exiting are still on the all-threads list */
+    spin_lock(&all_threads_lock);
+    if (!list_empty(&t->all_list)) {
+        list_remove(&t->all_list);
+    }
+    spin_unlock(&all_threads_lock);
+
     /* Free stack */
-    if (t->kernel_stack != NULL) {
+    if (t->kernel_stack != NULL && stack_in_pool((uint64_t)t->kernel_stack)) {
+        stack_free(t->kernel_stack);
+    } else if (t->kernel_stack != NULL) {
         /* Calculate order from stack size */
         int order = 0;
         size_t pages = t->kernel_stack_size / PAGE_SIZE;
@@ -264,8 +386,37 @@ void thread_destroy(thread_t *t) {
         pmm_free(t->kernel_stack, order);
     }
 
-    /* Free thread structure */
-    slab_free(thread_cache, t);
+    /* Free FPU state */
+    fpu_thread_free(t);
+
+    /* The TID may be handed out again from here on; the structure goes
+     * once no lookup holds it */
+    spin_lock(&tid_lock);
+    idr_remove(&tid_idr, t->tid);
+    spin_unlock(&tid_lock);
+    thread_put(t);
+}
+
+/**
+ * thread_release - Hand an exited thread to the reaper
+ * @t: Thread that called thread_exit(), now off every CPU
+ *
+ * Called by the scheduler once the switch away from @t is complete.
+ * Its stack cannot be freed from there, so a worker does it. Threads
+ * of a process are left to the process teardown.
+ */
+void thread_release(thread_t *t) {
+    irq_flags_t flags;
+
+    if (t->process != NULL) {
+        return;
+    }
+
+    flags = spin_lock_irqsave(&dead_threads_lock);
+    list_push_back(&dead_threads, &t->all_list);
+    spin_unlock_irqrestore(&dead_threads_lock, flags);
+
+    schedule_work(&reap_work);
 }
 
 /**
@@ -278,6 +429,59 @@ int thread_get_tid(thread_t *t) {
     return t ? t->tid : -1;
 }
 
+/**
+ * thread_for_each - Call a function on every live thread
+ * @fn: Callback; must not create or destroy threads
+ * @arg: Passed through to @fn
+ */
+void thread_for_each(void (*fn)(thread_t *t, void *arg), void *arg) {
+    struct list_head *pos;
+
+    spin_lock(&all_threads_lock);
+    list_for_each(pos, &all_threads_list) {
+        fn(list_entry(pos, thread_t, all_list), arg);
+    }
+    spin_unlock(&all_threads_lock);
+}
+
+/**
+ * thread_find_by_tid - Look up a live thread by ID
+ * @tid: Thread ID
+ *
+ * Constant time. The thread cannot be freed until the caller drops the
+ * reference taken here with thread_put().
+ *
+ * Returns: Referenced thread, or NULL if no live thread has that ID
+ */
+thread_t *thread_find_by_tid(int tid) {
+    thread_t *t;
+
+    spin_lock(&tid_lock);
+    t = idr_find(&tid_idr, tid);
+
+    /* Exited threads keep their TID until they are destroyed */
+    if (t != NULL && t->state == THREAD_TERMINATED) {
+        t = NULL;
+    }
+    if (t != NULL) {
+        __atomic_add_fetch(&t->refcount, 1, __ATOMIC_RELAXED);
+    }
+    spin_unlock(&tid_lock);
+    return t;
+}
+
+/**
+ * thread_put - Drop a reference from thread_find_by_tid()
+ * @t: Thread (may be NULL)
+ *
+ * Frees the structure of a destroyed thread with the last reference.
+ */
+void thread_put(thread_t *t) {
+    if (t != NULL && __atomic_sub_fetch(&t->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        slab_free(thread_cache, t);
+    }
+}
+
 /**
  * thread_get_state - Get thread state
  * @t: Thread to query
@@ -10,25 +10,91 @@
 
 /* Include public API first */
 #include "include/kernel/thread.h"
+#include "include/kernel/cpumask.h"
 
 /* Include architecture-specific context */
 #include "arch/x86_64/include/cpu_context.h"
+#include "arch/x86_64/fpu.h"
 
 /* Internal dependencies */
 #include "kernel/list.h"
+#include "kernel/rbtree.h"
 
 /* Page size for stack allocation */
 #define PAGE_SIZE 4096
 
+struct sched_class;
+
+/* Fair scheduling entity - per-thread state of the fair class
+ *
+ * Layout:
+ *   0-31:      run_node (32 bytes)
+ *   32-39:     vruntime (8 bytes)
+ *   40-47:     exec_start (8 bytes)
+ *   48-55:     sum_exec_runtime (8 bytes)
+ *   56-63:     prev_sum_exec_runtime (8 bytes)
+ *   64-71:     weight (8 bytes)
+ *   72-75:     nice (4 bytes)
+ *   76-79:     padding (4 bytes)
+ * Total: 80 bytes
+ */
+struct sched_entity {
+    struct rb_node run_node;        /* Runqueue timeline linkage */
+    uint64_t vruntime;              /* Weighted virtual runtime (ns) */
+    uint64_t exec_start;            /* sched_clock() of last accounting */
+    uint64_t sum_exec_runtime;      /* Total CPU time consumed (ns) */
+    uint64_t prev_sum_exec_runtime; /* sum_exec_runtime when last picked */
+    uint64_t weight;                /* Load weight derived from nice */
+    int nice;                       /* Nice value (-20..19) */
+};
+
+/* Real-time scheduling entity - per-thread state of the RT class
+ *
+ * Layout:
+ *   0-15:      run_list (16 bytes)
+ *   16-19:     policy (4 bytes)
+ *   20-23:     prio (4 bytes)
+ *   24-31:     time_slice (8 bytes)
+ * Total: 32 bytes
+ */
+struct sched_rt_entity {
+    struct list_head run_list;      /* Priority queue linkage */
+    int policy;                     /* SCHED_NORMAL, SCHED_FIFO or SCHED_RR */
+    int prio;                       /* RT priority (0..99, higher runs first) */
+    int64_t time_slice;             /* SCHED_RR budget left (ns) */
+};
+
+/* Scheduler statistics of a thread (CONFIG_SCHEDSTATS)
+ *
+ * Times are sched_clock() nanoseconds. Run time is se.sum_exec_runtime.
+ *
+ * Layout:
+ *   0-7:       wait_start (8 bytes)
+ *   8-15:      wait_sum (8 bytes)
+ *   16-23:     wait_max (8 bytes)
+ *   24-31:     wait_count (8 bytes)
+ *   32-39:     nr_voluntary_switches (8 bytes)
+ *   40-47:     nr_involuntary_switches (8 bytes)
+ * Total: 48 bytes
+ */
+struct sched_statistics {
+    uint64_t wait_start;            /* When it was queued, 0 while not waiting */
+    uint64_t wait_sum;              /* Total enqueue->run delay */
+    uint64_t wait_max;              /* Longest enqueue->run delay */
+    uint64_t wait_count;            /* Number of delays measured */
+    uint64_t nr_voluntary_switches; /* Switched out by blocking or yielding */
+    uint64_t nr_involuntary_switches; /* Switched out by preemption */
+};
+
 /* Thread Control Block - Full internal definition
  *
  * Layout (verified offsets):
- *   0-15:      run_list (16 bytes)
+ *   0-15:      thread_node (16 bytes)
  *   16-31:     all_list (16 bytes)
  *   32-35:     state (4 bytes)
  *   36-39:     tid (4 bytes)
  *   40-43:     flags (4 bytes)
- *   44-47:     padding (4 bytes)
+ *   44-47:     refcount (4 bytes)
  *   48-55:     name pointer (8 bytes)
  *   56-199:    context (144 bytes)
  *   200-207:   kernel_stack (8 bytes)
@@ -43,20 +109,31 @@
  *   264-271:   user_stack pointer (8 bytes)
  *   272-279:   user_stack_size (8 bytes)
  *   280-287:   user_rsp (8 bytes)
- * Total: 288 bytes (fits in 512B slab cache)
+ *   288-291:   on_rq (4 bytes)
+ *   292-295:   on_cpu (4 bytes)
+ *   296-303:   nr_migrations (8 bytes)
+ *   304-311:   cpus_allowed (8 bytes)
+ *   312-319:   last_ran (8 bytes)
+ *   320-327:   sched_class pointer (8 bytes)
+ *   328-407:   se (80 bytes)
+ *   408-439:   rt (32 bytes)
+ *   440-487:   stats (48 bytes)
+ *   488-503:   fpu (16 bytes)
+ * Total: 504 bytes (fits in 512B slab cache)
  */
 struct thread {
-    struct list_head run_list;      /* Runqueue linkage */
+    struct list_head thread_node;   /* Process thread list linkage */
     struct list_head all_list;      /* All-threads list linkage */
 
     thread_state_t state;           /* Current state */
     int tid;                        /* Thread ID (unique) */
     int flags;                      /* Thread flags */
+    int refcount;                   /* The thread, plus thread_find_by_tid() holders (atomic) */
     const char *name;               /* Debug name */
 
     cpu_context_t context;          /* Saved register state (arch-specific) */
 
-    void *kernel_stack;             /* Stack base (from PMM) */
+    void *kernel_stack;             /* Stack base (stack pool or PMM) */
     size_t kernel_stack_size;       /* Stack size in bytes */
 
     void (*entry_func)(void *);     /* Entry function */
@@ -73,10 +150,32 @@ struct thread {
     void *user_stack;               /* User stack base (for user threads) */
     size_t user_stack_size;         /* User stack size in bytes */
     uint64_t user_rsp;              /* Saved user RSP during syscall */
+
+    /* Scheduler state */
+    int on_rq;                      /* CPU whose runqueue holds us (-1 = none) */
+    int on_cpu;                     /* Set while running or being switched out */
+    uint64_t nr_migrations;         /* Times moved between runqueues */
+    cpumask_t cpus_allowed;         /* CPUs this thread may run on */
+    uint64_t last_ran;              /* sched_clock() when it last left a CPU */
+    const struct sched_class *sched_class;  /* Scheduling class */
+    struct sched_entity se;         /* Fair class state */
+    struct sched_rt_entity rt;      /* Real-time class state */
+    struct sched_statistics stats;  /* Latency and switch statistics */
+
+    struct fpu fpu;                 /* Extended (x87/SSE/AVX) register state */
 };
 
-/* Assembly context switch function - implemented in context.S */
+/* Queue an exited thread for freeing (from schedule_tail) */
+void thread_release(thread_t *t);
+
+/* Call @fn on every live thread, with the thread list locked */
+void thread_for_each(void (*fn)(thread_t *t, void *arg), void *arg);
+
+/* Assembly context switch functions - implemented in context.S
+ * context_switch() saves only the callee-saved registers, RSP and RIP;
+ * context_switch_full() also saves caller-saved registers and RFLAGS. */
 void context_switch(cpu_context_t *prev, cpu_context_t *next);
+void context_switch_full(cpu_context_t *prev, cpu_context_t *next);
 
 /* Assembly entry wrapper - implemented in context.S */
 void thread_entry_wrapper(void);
@@ -0,0 +1,426 @@
+/* Emergence Kernel - Timer wheel
+ *
+ * Each CPU has a wheel of TIMER_LVL_DEPTH levels with TIMER_LVL_SIZE
+ * buckets each. Level n buckets are 8^n wheel ticks wide. A timer is put
+ * on the lowest level whose range covers its timeout, in the bucket just
+ * after its expiry, and stays there until it fires: timers never cascade
+ * between levels. The price is that a timer on level n fires up to one
+ * level-n bucket late, which is fine for timeouts.
+ *
+ * Each level keeps a 64-bit map of non-empty buckets, so adding,
+ * cancelling and finding the next expiry never walk the timers.
+ *
+ * base->clk is the next wheel tick to process. When the wheel has been
+ * idle (NO_HZ) it jumps straight to the next pending bucket rather than
+ * stepping through every tick it slept through.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/timer.h"
+#include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "kernel/list.h"
+#include "include/spinlock.h"
+#include "include/barrier.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/idt.h"
+#include "arch/x86_64/tsc.h"
+#include "arch/x86_64/timer.h"
+
+/* Per-level geometry */
+#define LVL_SHIFT(n)    ((n) * TIMER_LVL_CLK_SHIFT)
+#define LVL_GRAN(n)     (1ULL << LVL_SHIFT(n))
+#define LVL_OFFS(n)     ((n) * TIMER_LVL_SIZE)
+#define LVL_MASK        (TIMER_LVL_SIZE - 1)
+
+/* First timeout (in ticks) that no longer fits level n - 1 */
+#define LVL_START(n)    ((uint64_t)(TIMER_LVL_SIZE - 1) << LVL_SHIFT((n) - 1))
+
+/* Per-CPU wheel */
+struct timer_base {
+    spinlock_t lock;
+    int cpu;                                    /* Owning CPU */
+    uint64_t clk;                               /* Next wheel tick to process */
+    uint64_t next_expiry;                       /* Earliest pending bucket (ticks) */
+    struct timer_list *running;                 /* Callback in progress */
+    uint64_t pending_map[TIMER_LVL_DEPTH];      /* Non-empty buckets per level */
+    struct list_head vectors[TIMER_WHEEL_SIZE]; /* Buckets */
+};
+
+static DEFINE_PER_CPU(struct timer_base, timer_bases);
+
+/* Current time in wheel ticks */
+static inline uint64_t wheel_now(void) {
+    return sched_clock() / TIMER_WHEEL_TICK_NS;
+}
+
+/**
+ * calc_wheel_index - Pick the bucket for a timer
+ * @expires: Expiry in wheel ticks (not before @clk)
+ * @clk: Base clock
+ * @bucket_expiry: Returns the tick at which the bucket is processed
+ *
+ * The bucket is the one after the expiry's, so the timer never fires
+ * early; at most 63 buckets ahead of @clk, so it cannot alias a bucket
+ * that is processed before the expiry.
+ *
+ * Returns: Bucket index
+ */
+static int calc_wheel_index(uint64_t expires, uint64_t clk, uint64_t *bucket_expiry) {
+    uint64_t delta = expires - clk;
+    int lvl;
+
+    for (lvl = 0; lvl < TIMER_LVL_DEPTH - 1; lvl++) {
+        if (delta < LVL_START(lvl + 1)) {
+            break;
+        }
+    }
+
+    if (lvl == TIMER_LVL_DEPTH - 1 && delta >= TIMER_WHEEL_TIMEOUT_MAX) {
+        expires = clk + TIMER_WHEEL_TIMEOUT_MAX;
+    }
+
+    expires = (expires >> LVL_SHIFT(lvl)) + 1;
+    *bucket_expiry = expires << LVL_SHIFT(lvl);
+    return LVL_OFFS(lvl) + (int)(expires & LVL_MASK);
+}
+
+/**
+ * next_pending_bucket - Find the earliest non-empty bucket
+ * @base: Wheel (lock held)
+ *
+ * Returns: Tick at which it is processed, or TIMER_NO_EXPIRY
+ */
+static uint64_t next_pending_bucket(struct timer_base *base) {
+    uint64_t next = TIMER_NO_EXPIRY;
+
+    for (int lvl = 0; lvl < TIMER_LVL_DEPTH; lvl++) {
+        uint64_t map = base->pending_map[lvl];
+        uint64_t start, t;
+        unsigned int pos;
+
+        if (map == 0) {
+            continue;
+        }
+
+        /* First slot of this level not yet processed */
+        start = (base->clk + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+        pos = (unsigned int)(start & LVL_MASK);
+
+        /* Rotate so bit 0 is @start, then take the first set bit */
+        if (pos != 0) {
+            map = (map >> pos) | (map << (TIMER_LVL_SIZE - pos));
+        }
+        t = (start + (uint64_t)__builtin_ctzll(map)) << LVL_SHIFT(lvl);
+        if (t < next) {
+            next = t;
+        }
+    }
+
+    return next;
+}
+
+/* Unlink a queued timer from its bucket (lock held) */
+static void detach_timer(struct timer_base *base, struct timer_list *timer) {
+    int idx = timer->idx;
+
+    list_remove(&timer->entry);
+    if (list_empty(&base->vectors[idx])) {
+        base->pending_map[idx / TIMER_LVL_SIZE] &= ~(1ULL << (idx & LVL_MASK));
+    }
+    timer->cpu = -1;
+}
+
+/**
+ * lock_timer_base - Lock the wheel a timer is queued on
+ * @timer: Timer
+ * @flags: Returns saved interrupt flags
+ *
+ * Returns: Locked base, or NULL (nothing locked) if the timer is idle
+ */
+static struct timer_base *lock_timer_base(struct timer_list *timer, irq_flags_t *flags) {
+    while (1) {
+        int cpu = READ_ONCE(timer->cpu);
+        struct timer_base *base;
+
+        if (cpu < 0) {
+            return NULL;
+        }
+        base = per_cpu_ptr(&timer_bases, cpu);
+        *flags = spin_lock_irqsave(&base->lock);
+        if (timer->cpu == cpu) {
+            return base;
+        }
+        spin_unlock_irqrestore(&base->lock, *flags);
+    }
+}
+
+/**
+ * timer_setup - Prepare a timer
+ * @timer: Timer
+ * @function: Callback, run from the timer interrupt
+ */
+void timer_setup(struct timer_list *timer, void (*function)(struct timer_list *)) {
+    list_init(&timer->entry);
+    timer->expires = 0;
+    timer->function = function;
+    timer->cpu = -1;
+    timer->idx = 0;
+}
+
+/**
+ * timer_add - Queue a timer on this CPU's wheel
+ * @timer: Timer set up with timer_setup()
+ * @expires_ns: sched_clock() time to fire at (rounded up to a wheel tick)
+ *
+ * Re-queues the timer if it was already pending. O(1).
+ */
+void timer_add(struct timer_list *timer, uint64_t expires_ns) {
+    struct timer_base *base = this_cpu_ptr(&timer_bases);
+    uint64_t expires, bucket_expiry;
+    irq_flags_t flags;
+    int idx, earlier = 0;
+
+    timer_delete(timer);
+
+    expires = (expires_ns + TIMER_WHEEL_TICK_NS - 1) / TIMER_WHEEL_TICK_NS;
+
+    flags = spin_lock_irqsave(&base->lock);
+    if (expires < base->clk) {
+        expires = base->clk;
+    }
+    idx = calc_wheel_index(expires, base->clk, &bucket_expiry);
+
+    timer->expires = expires;
+    timer->idx = idx;
+    timer->cpu = base->cpu;
+    list_push_back(&base->vectors[idx], &timer->entry);
+    base->pending_map[idx / TIMER_LVL_SIZE] |= 1ULL << (idx & LVL_MASK);
+
+    if (bucket_expiry < base->next_expiry) {
+        base->next_expiry = bucket_expiry;
+        earlier = 1;
+    }
+    spin_unlock_irqrestore(&base->lock, flags);
+
+#if CONFIG_NO_HZ
+    /* The LAPIC may be programmed for later, or not at all */
+    if (earlier) {
+        flags = irq_save(1);
+        timer_tick_rearm();
+        irq_restore(flags);
+    }
+#else
+    (void)earlier;
+#endif
+}
+
+/**
+ * timer_delete - Dequeue a timer
+ * @timer: Timer
+ *
+ * Does not wait for a running callback. O(1).
+ *
+ * Returns: 1 if the timer was pending, 0 otherwise
+ */
+int timer_delete(struct timer_list *timer) {
+    struct timer_base *base;
+    irq_flags_t flags;
+
+    base = lock_timer_base(timer, &flags);
+    if (base == NULL) {
+        return 0;
+    }
+    detach_timer(base, timer);
+    spin_unlock_irqrestore(&base->lock, flags);
+    return 1;
+}
+
+/**
+ * timer_delete_sync - Dequeue a timer and wait for its callback
+ * @timer: Timer
+ *
+ * On return the callback is not running on any CPU, so the timer may be
+ * freed. Must not be called from the timer's own callback.
+ *
+ * Returns: 1 if the timer was pending, 0 otherwise
+ */
+int timer_delete_sync(struct timer_list *timer) {
+    int ret = timer_delete(timer);
+
+    for (int cpu = 0; cpu < smp_get_cpu_count(); cpu++) {
+        while (READ_ONCE(per_cpu(timer_bases, cpu).running) == timer) {
+            cpu_relax();
+        }
+    }
+    return ret;
+}
+
+/**
+ * timer_pending - Check whether a timer is queued
+ * @timer: Timer
+ */
+int timer_pending(struct timer_list *timer) {
+    return READ_ONCE(timer->cpu) >= 0;
+}
+
+/**
+ * expire_timers - Run the callbacks of one bucket
+ * @base: Wheel (lock held; dropped around each callback)
+ * @head: Bucket
+ * @flags: Interrupt flags saved when the lock was taken
+ */
+static void expire_timers(struct timer_base *base, struct list_head *head,
+                          irq_flags_t flags) {
+    while (!list_empty(head)) {
+        struct timer_list *timer = list_entry(head->next, struct timer_list, entry);
+        void (*fn)(struct timer_list *) = timer->function;
+
+        detach_timer(base, timer);
+        base->running = timer;
+        spin_unlock_irqrestore(&base->lock, flags);
+
+        fn(timer);
+
+        flags = spin_lock_irqsave(&base->lock);
+        base->running = NULL;
+    }
+}
+
+/**
+ * run_wheel - Process every wheel tick up to now
+ * @base: This CPU's wheel
+ */
+static void run_wheel(struct timer_base *base) {
+    uint64_t now = wheel_now();
+    irq_flags_t flags;
+
+    flags = spin_lock_irqsave(&base->lock);
+
+    while (base->clk <= now) {
+        uint64_t clk;
+
+        /* Skip the ticks with nothing to run */
+        base->next_expiry = next_pending_bucket(base);
+        if (base->next_expiry > now) {
+            base->clk = now + 1;
+            break;
+        }
+        if (base->next_expiry > base->clk) {
+            base->clk = base->next_expiry;
+        }
+
+        clk = base->clk++;
+        for (int lvl = 0; lvl < TIMER_LVL_DEPTH; lvl++) {
+            int idx = LVL_OFFS(lvl) + (int)((clk >> LVL_SHIFT(lvl)) & LVL_MASK);
+
+            if (base->pending_map[lvl] & (1ULL << (idx & LVL_MASK))) {
+                expire_timers(base, &base->vectors[idx], flags);
+            }
+
+            /* A coarser level only has a bucket boundary at aligned ticks */
+            if (clk & (LVL_GRAN(lvl + 1) - 1)) {
+                break;
+            }
+        }
+    }
+
+    base->next_expiry = next_pending_bucket(base);
+    spin_unlock_irqrestore(&base->lock, flags);
+}
+
+/**
+ * run_local_timers - Run this CPU's expired timers
+ *
+ * Called from the timer interrupt, with interrupts disabled.
+ */
+void run_local_timers(void) {
+    hrtimer_run_queues(sched_clock());
+    run_wheel(this_cpu_ptr(&timer_bases));
+}
+
+/**
+ * timer_next_expiry - Get the earliest timer expiry on this CPU
+ *
+ * Returns: sched_clock() time in ns, or TIMER_NO_EXPIRY if nothing is queued
+ */
+uint64_t timer_next_expiry(void) {
+    struct timer_base *base = this_cpu_ptr(&timer_bases);
+    uint64_t next = hrtimer_next_expiry();
+    uint64_t wheel = READ_ONCE(base->next_expiry);
+
+    if (wheel != TIMER_NO_EXPIRY && wheel * TIMER_WHEEL_TICK_NS < next) {
+        next = wheel * TIMER_WHEEL_TICK_NS;
+    }
+    return next;
+}
+
+/**
+ * timers_init - Initialize the per-CPU timer wheels and hrtimer queues
+ *
+ * Requires tsc_init(): the wheels start at the current time.
+ */
+void timers_init(void) {
+    uint64_t now = wheel_now();
+
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        struct timer_base *base = per_cpu_ptr(&timer_bases, cpu);
+
+        spin_lock_init(&base->lock);
+        base->cpu = cpu;
+        base->clk = now;
+        base->next_expiry = TIMER_NO_EXPIRY;
+        base->running = NULL;
+        for (int lvl = 0; lvl < TIMER_LVL_DEPTH; lvl++) {
+            base->pending_map[lvl] = 0;
+        }
+        for (int i = 0; i < TIMER_WHEEL_SIZE; i++) {
+            list_init(&base->vectors[i]);
+        }
+    }
+
+    hrtimers_init();
+}
+
+/* ============================================================================
+ * Sleeping with a timeout
+ * ============================================================================ */
+
+struct timeout_timer {
+    struct timer_list timer;
+    thread_t *thread;
+};
+
+static void process_timeout(struct timer_list *timer) {
+    struct timeout_timer *t = timer_container_of(timer, struct timeout_timer, timer);
+
+    wake_up_thread(t->thread);
+}
+
+/**
+ * schedule_timeout - Sleep until woken or a timeout passes
+ * @timeout_ns: Longest time to sleep
+ *
+ * The caller marks itself THREAD_BLOCKED first (prepare_to_wait()), just
+ * as for schedule(). The timeout is a wheel timer: it may run late by up
+ * to one wheel bucket but never early.
+ *
+ * Returns: Time left in ns, 0 if the timeout passed
+ */
+uint64_t schedule_timeout(uint64_t timeout_ns) {
+    struct timeout_timer t;
+    uint64_t expires = sched_clock() + timeout_ns;
+    uint64_t now;
+
+    t.thread = thread_get_current();
+    timer_setup(&t.timer, process_timeout);
+    timer_add(&t.timer, expires);
+
+    schedule();
+
+    timer_delete_sync(&t.timer);
+
+    now = sched_clock();
+    return expires > now ? expires - now : 0;
+}
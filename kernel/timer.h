@@ -0,0 +1,118 @@
+/* Emergence Kernel - Kernel timers
+ *
+ * Two kinds of timers, both kept per CPU and both driving the one-shot
+ * LAPIC timer through timer_tick_rearm():
+ *
+ *   timer_list - coarse timeouts on a hierarchical timer wheel. Adding and
+ *                cancelling are O(1). Expiry is rounded up to the wheel
+ *                granularity of the level the timer lands on, which grows
+ *                by 8x per level (1 ms, 8 ms, 64 ms, ...), so a timer may
+ *                fire up to 1/8th of its timeout late but never early.
+ *   hrtimer    - precise deadlines in sched_clock() nanoseconds, kept
+ *                sorted in an rbtree. O(log n) to add, O(1) to find the
+ *                next expiry.
+ *
+ * Callbacks run from the timer interrupt with interrupts disabled and the
+ * timer already dequeued; they may re-add it.
+ */
+
+#ifndef _KERNEL_TIMER_H
+#define _KERNEL_TIMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/list.h"
+#include "kernel/rbtree.h"
+#include "include/spinlock.h"
+
+/* Get the structure embedding a timer */
+#define timer_container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Returned by the next-expiry helpers when nothing is queued */
+#define TIMER_NO_EXPIRY         UINT64_MAX
+
+/* ============================================================================
+ * Timer wheel
+ * ============================================================================ */
+
+/* Level 0 granularity: one wheel tick */
+#define TIMER_WHEEL_TICK_NS     1000000ULL
+
+/* Each level has 64 buckets and is 8x coarser than the one below */
+#define TIMER_LVL_CLK_SHIFT     3
+#define TIMER_LVL_BITS          6
+#define TIMER_LVL_SIZE          (1 << TIMER_LVL_BITS)
+#define TIMER_LVL_DEPTH         8
+#define TIMER_WHEEL_SIZE        (TIMER_LVL_SIZE * TIMER_LVL_DEPTH)
+
+/* Longest timeout the wheel holds (in wheel ticks); longer ones are clamped */
+#define TIMER_WHEEL_TIMEOUT_MAX \
+    (((uint64_t)TIMER_LVL_SIZE - 1) << ((TIMER_LVL_DEPTH - 1) * TIMER_LVL_CLK_SHIFT))
+
+struct timer_list {
+    struct list_head entry;         /* Bucket linkage */
+    uint64_t expires;               /* Expiry in wheel ticks */
+    void (*function)(struct timer_list *timer);
+    int cpu;                        /* Wheel it is queued on, -1 if idle */
+    int idx;                        /* Bucket index while queued */
+};
+
+/* Prepare a timer; it is not queued until timer_add() */
+void timer_setup(struct timer_list *timer, void (*function)(struct timer_list *));
+
+/* Queue (or re-queue) a timer on this CPU to fire at sched_clock() time @expires_ns */
+void timer_add(struct timer_list *timer, uint64_t expires_ns);
+
+/* Dequeue a timer; returns 1 if it was pending */
+int timer_delete(struct timer_list *timer);
+
+/* Dequeue a timer and wait for a running callback to finish */
+int timer_delete_sync(struct timer_list *timer);
+
+/* Check whether a timer is queued */
+int timer_pending(struct timer_list *timer);
+
+/* ============================================================================
+ * High-resolution timers
+ * ============================================================================ */
+
+struct hrtimer {
+    struct rb_node node;            /* Per-CPU expiry tree linkage */
+    uint64_t expires;               /* Expiry in sched_clock() nanoseconds */
+    void (*function)(struct hrtimer *timer);
+    int cpu;                        /* CPU it is queued on, -1 if idle */
+};
+
+/* Prepare an hrtimer; it is not queued until hrtimer_start() */
+void hrtimer_init(struct hrtimer *timer, void (*function)(struct hrtimer *));
+
+/* Queue (or re-queue) an hrtimer on this CPU at sched_clock() time @expires_ns */
+void hrtimer_start(struct hrtimer *timer, uint64_t expires_ns);
+
+/* Dequeue an hrtimer and wait for a running callback; returns 1 if it was pending */
+int hrtimer_cancel(struct hrtimer *timer);
+
+/* Check whether an hrtimer is queued */
+int hrtimer_active(struct hrtimer *timer);
+
+/* ============================================================================
+ * Interrupt side and sleeping
+ * ============================================================================ */
+
+/* Initialize the per-CPU timer bases */
+void timers_init(void);
+void hrtimers_init(void);
+
+/* Run this CPU's expired timers (timer interrupt) */
+void run_local_timers(void);
+void hrtimer_run_queues(uint64_t now);
+
+/* Earliest expiry on this CPU in sched_clock() ns, or TIMER_NO_EXPIRY */
+uint64_t timer_next_expiry(void);
+uint64_t hrtimer_next_expiry(void);
+
+/* Sleep until woken or @timeout_ns passed; returns the time left */
+uint64_t schedule_timeout(uint64_t timeout_ns);
+
+#endif /* _KERNEL_TIMER_H */
@@ -10,9 +10,20 @@
 #include "kernel/pmm.h"
 #include "kernel/klog.h"
 #include "kernel/slab.h"
+#include "kernel/thread.h"
 #include "include/string.h"
 #include "include/spinlock.h"
 
+/* Physical address bits of a page table entry */
+#define PTE_ADDR_MASK   0x000FFFFFFFFFF000ULL
+
+/* Region flags as written to a PTE: EFER.NXE is not enabled, so the NX
+ * bit would be reserved and fault. Regions still record it in @perm. */
+#define PTE_FLAGS(flags) (((flags) & ~PT_NX) | PT_PRESENT)
+
+/* Page fault error code: the access was a write */
+#define PF_ERR_WRITE    (1ULL << 1)
+
 /* External: master kernel page table from boot.S */
 extern uint64_t boot_pml4[];
 
@@ -46,8 +57,9 @@ void vm_init(void)
         return;
     }
 
-    /* Initialize slab cache for vm_region structures */
-    ret = slab_cache_create(vm_region_cache, sizeof(vm_region_t));
+    /* Initialize slab cache for vm_region structures (power-of-two objects) */
+    _Static_assert(sizeof(vm_region_t) <= 128, "vm_region_t outgrew its slab cache");
+    ret = slab_cache_create(vm_region_cache, 128);
     if (ret != 0) {
         klog_error("VM", "Failed to create vm_region slab cache");
         return;
@@ -56,6 +68,100 @@ void vm_init(void)
     klog_info("VM", "VM subsystem initialized (PML4 at %p)", master_kernel_pml4);
 }
 
+/**
+ * vm_walk - Find the page table entry for a user address
+ * @as: Address space
+ * @virt: Virtual address
+ * @alloc: Allocate missing page tables
+ *
+ * Page tables are PMM pages, reached through the identity mapping.
+ *
+ * Returns: Pointer to the PTE, or NULL if a table is missing (or out of memory)
+ */
+static uint64_t *vm_walk(address_space_t *as, uint64_t virt, int alloc)
+{
+    uint64_t *table = as->pml4;
+    uint64_t *entry, *next;
+    int shift;
+
+    for (shift = 39; shift > 12; shift -= 9) {
+        entry = &table[(virt >> shift) & 0x1FF];
+        if (!(*entry & PT_PRESENT)) {
+            if (!alloc) {
+                return NULL;
+            }
+            next = pmm_alloc(0);
+            if (next == NULL) {
+                return NULL;
+            }
+            memset(next, 0, PAGE_SIZE);
+            /* Permissions are enforced by the last level */
+            *entry = (uint64_t)next | PT_PRESENT | PT_WRITE | PT_USER;
+        }
+        table = (uint64_t *)(*entry & PTE_ADDR_MASK);
+    }
+
+    return &table[(virt >> 12) & 0x1FF];
+}
+
+/* Drop a stale translation of @virt if @as is live on this CPU */
+static void vm_flush_page(address_space_t *as, uint64_t virt)
+{
+    uint64_t cr3;
+
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    if ((cr3 & PTE_ADDR_MASK) == as->pml4_phys) {
+        __asm__ volatile ("invlpg (%0)" : : "r"(virt) : "memory");
+    }
+}
+
+/**
+ * vm_release_pages - Unmap every page of a region
+ * @as: Address space
+ * @region: Region to clear
+ *
+ * Frees the pages the region faulted in (zero-filled pages and private
+ * copies); the backing frames belong to whoever supplied them.
+ */
+static void vm_release_pages(address_space_t *as, vm_region_t *region)
+{
+    uint64_t backing_end = region->phys_base +
+        ((region->backed_size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1));
+    uint64_t virt, phys, *pte;
+
+    for (virt = region->start; virt < region->end; virt += PAGE_SIZE) {
+        pte = vm_walk(as, virt, 0);
+        if (pte == NULL || !(*pte & PT_PRESENT)) {
+            continue;
+        }
+
+        phys = *pte & PTE_ADDR_MASK;
+        if (phys < region->phys_base || phys >= backing_end) {
+            pmm_free((void *)phys, 0);
+        }
+        *pte = 0;
+        vm_flush_page(as, virt);
+    }
+}
+
+/* Free the page tables below @table; @level 3 is the PML4 */
+static void vm_free_tables(uint64_t *table, int level, int nr_entries)
+{
+    uint64_t *child;
+    int i;
+
+    for (i = 0; i < nr_entries; i++) {
+        if (!(table[i] & PT_PRESENT)) {
+            continue;
+        }
+        child = (uint64_t *)(table[i] & PTE_ADDR_MASK);
+        if (level > 1) {
+            vm_free_tables(child, level - 1, 512);
+        }
+        pmm_free(child, 0);
+    }
+}
+
 /**
  * vm_create_address_space - Create a new address space
  * @flags: Creation flags
@@ -144,11 +250,16 @@ void vm_destroy_address_space(address_space_t *as)
     list_for_each_safe(pos, n, &as->regions) {
         vm_region_t *region = list_entry(pos, vm_region_t, node);
         list_remove(pos);
+        vm_release_pages(as, region);
+        if (region->page_order >= 0) {
+            pmm_free((void *)region->phys_base, (uint8_t)region->page_order);
+        }
         slab_free(vm_region_cache, region);
     }
     spin_unlock(&as->lock);
 
-    /* Free PML4 page table */
+    /* Free the user half's page tables; the kernel half is shared */
+    vm_free_tables(as->pml4, 3, 256);
     pmm_free(as->pml4, 0);
 
     /* Free address_space structure */
@@ -207,31 +318,28 @@ void vm_switch_address_space(address_space_t *as)
 }
 
 /**
- * vm_map_region - Map a memory region into an address space
+ * vm_add_region - Validate and track a new region
  * @as: Address space
  * @start: Virtual start address
- * @phys: Physical start address
+ * @phys: Physical start address of the backing
  * @size: Size in bytes
  * @flags: Page table flags
  * @type: Region type
  * @name: Region name
+ * @out: Returns the region, with the whole of it backed and not CoW
  *
  * Returns: 0 on success, negative error code on failure
  */
-int vm_map_region(address_space_t *as,
-                  uint64_t start,
-                  uint64_t phys,
-                  uint64_t size,
-                  uint64_t flags,
-                  vm_region_type_t type,
-                  const char *name)
+static int vm_add_region(address_space_t *as,
+                         uint64_t start,
+                         uint64_t phys,
+                         uint64_t size,
+                         uint64_t flags,
+                         vm_region_type_t type,
+                         const char *name,
+                         vm_region_t **out)
 {
     vm_region_t *region;
-    uint64_t virt;
-    uint64_t num_pages;
-
-    klog_debug("VM", "Mapping region %s: virt=%p phys=%p size=%p",
-               name, start, phys, size);
 
     /* Validate alignment */
     if ((start & (PAGE_SIZE - 1)) || (phys & (PAGE_SIZE - 1))) {
@@ -254,6 +362,9 @@ int vm_map_region(address_space_t *as,
     region->start = start;
     region->end = start + size;
     region->phys_base = phys;
+    region->page_order = -1;
+    region->backed_size = size;
+    region->cow = 0;
     region->flags = flags;
     region->type = type;
     region->perm = 0;
@@ -276,16 +387,52 @@ int vm_map_region(address_space_t *as,
     as->region_count++;
     spin_unlock(&as->lock);
 
-    /* Map pages into page tables */
-    num_pages = size / PAGE_SIZE;
-    for (uint64_t i = 0; i < num_pages; i++) {
-        virt = start + (i * PAGE_SIZE);
-        uint64_t phys_addr = phys + (i * PAGE_SIZE);
+    *out = region;
+    return 0;
+}
+
+/**
+ * vm_map_region - Map a memory region into an address space
+ * @as: Address space
+ * @start: Virtual start address
+ * @phys: Physical start address
+ * @size: Size in bytes
+ * @flags: Page table flags
+ * @type: Region type
+ * @name: Region name
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+int vm_map_region(address_space_t *as,
+                  uint64_t start,
+                  uint64_t phys,
+                  uint64_t size,
+                  uint64_t flags,
+                  vm_region_type_t type,
+                  const char *name)
+{
+    vm_region_t *region;
+    uint64_t offset, *pte;
+    int ret;
 
-        /* TODO: Implement full page table walk
-         * For now, this is a stub */
-        (void)phys_addr;
-        (void)virt;
+    klog_debug("VM", "Mapping region %s: virt=%p phys=%p size=%p",
+               name, start, phys, size);
+
+    ret = vm_add_region(as, start, phys, size, flags, type, name, &region);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Map pages into page tables */
+    for (offset = 0; offset < size; offset += PAGE_SIZE) {
+        pte = vm_walk(as, start + offset, 1);
+        if (pte == NULL) {
+            klog_error("VM", "Out of memory for page tables of %s", region->name);
+            vm_unmap_region(as, start, size);
+            return -12;  /* ENOMEM */
+        }
+        *pte = (phys + offset) | PTE_FLAGS(flags);
+        vm_flush_page(as, start + offset);
     }
 
     klog_debug("VM", "Region mapped successfully (%p - %p)", start, start + size);
@@ -293,6 +440,148 @@ int vm_map_region(address_space_t *as,
     return 0;
 }
 
+/**
+ * vm_map_backed_region - Map a region whose pages are faulted in on demand
+ * @as: Address space
+ * @start: Virtual start address
+ * @size: Size in bytes
+ * @phys: Physical address of the backing data for @start
+ * @backed_size: Bytes of backing data; the rest of the region is zero-filled
+ * @flags: Page table flags
+ * @type: Region type
+ * @name: Region name
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+int vm_map_backed_region(address_space_t *as,
+                         uint64_t start,
+                         uint64_t size,
+                         uint64_t phys,
+                         uint64_t backed_size,
+                         uint64_t flags,
+                         vm_region_type_t type,
+                         const char *name)
+{
+    vm_region_t *region;
+    int ret;
+
+    if (backed_size > size) {
+        return -22;  /* EINVAL */
+    }
+
+    ret = vm_add_region(as, start, phys, size, flags, type, name, &region);
+    if (ret != 0) {
+        return ret;
+    }
+    region->backed_size = backed_size;
+    region->cow = 1;
+
+    klog_debug("VM", "Region %s backed on demand (%p - %p, %lX bytes of data)",
+               region->name, start, start + size, backed_size);
+
+    return 0;
+}
+
+/**
+ * vm_fault - Resolve a page fault in an address space
+ * @as: Address space
+ * @addr: Faulting virtual address
+ * @write: Non-zero for a write access
+ *
+ * A process's threads share one address space but processes are single
+ * threaded for now, so two faults never race on the same page table.
+ *
+ * Returns: 0 if the page is now mapped, negative error code otherwise
+ */
+int vm_fault(address_space_t *as, uint64_t addr, int write)
+{
+    vm_region_t *region = vm_find_region(as, addr);
+    uint64_t page = addr & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t offset, src = 0, flags, *pte;
+    uint64_t copy_size = 0;
+    uint8_t *copy;
+
+    if (region == NULL || (write && !(region->flags & PT_WRITE))) {
+        return -14;  /* EFAULT */
+    }
+
+    flags = PTE_FLAGS(region->flags);
+    offset = page - region->start;
+
+    pte = vm_walk(as, page, 1);
+    if (pte == NULL) {
+        return -12;  /* ENOMEM */
+    }
+
+    if (*pte & PT_PRESENT) {
+        /* Raced with another fault, or the first write to a shared frame */
+        if (!write || (*pte & PT_WRITE)) {
+            return 0;
+        }
+        src = *pte & PTE_ADDR_MASK;
+        copy_size = PAGE_SIZE;
+    } else if (offset < region->backed_size) {
+        src = region->phys_base + offset;
+        copy_size = region->backed_size - offset;
+        if (copy_size >= PAGE_SIZE) {
+            copy_size = PAGE_SIZE;
+
+            /* Whole backed pages map straight from the backing until written */
+            if (!region->cow || !write) {
+                *pte = src | (region->cow ? flags & ~PT_WRITE : flags);
+                vm_flush_page(as, page);
+                return 0;
+            }
+        }
+        /* A partly backed page shares its frame with unrelated data: copy it */
+    }
+
+    copy = pmm_alloc(0);
+    if (copy == NULL) {
+        return -12;  /* ENOMEM */
+    }
+    if (copy_size != 0) {
+        memcpy(copy, (void *)src, copy_size);
+    }
+    memset(copy + copy_size, 0, PAGE_SIZE - copy_size);
+
+    *pte = (uint64_t)copy | flags;
+    vm_flush_page(as, page);
+    return 0;
+}
+
+/**
+ * vm_handle_page_fault - Handle a page fault in the current user address space
+ * @fault_addr: Faulting virtual address from CR2
+ * @error_code: Page fault error code
+ *
+ * Returns: 0 if handled, negative error code otherwise
+ */
+int vm_handle_page_fault(uint64_t fault_addr, uint64_t error_code)
+{
+    thread_t *t = thread_get_current();
+
+    if (t == NULL || t->as == NULL) {
+        return -14;  /* EFAULT */
+    }
+
+    return vm_fault(t->as, fault_addr, (error_code & PF_ERR_WRITE) != 0);
+}
+
+/**
+ * vm_lookup_page - Get the page table entry mapping an address
+ * @as: Address space
+ * @addr: Virtual address
+ *
+ * Returns: Page table entry, or 0 if no page is mapped at @addr
+ */
+uint64_t vm_lookup_page(address_space_t *as, uint64_t addr)
+{
+    uint64_t *pte = vm_walk(as, addr, 0);
+
+    return pte != NULL && (*pte & PT_PRESENT) ? *pte : 0;
+}
+
 /**
  * vm_find_region - Find a region containing an address
  * @as: Address space
@@ -347,6 +636,12 @@ address_space_t *vm_clone_address_space(address_space_t *src)
         vm_region_t *region = list_entry(pos, vm_region_t, node);
         vm_region_t *new_region;
 
+        /* Per-process vDSO data must not be shared: the caller maps its own.
+         * Rings belong to the process that set them up. */
+        if (region->type == VM_REGION_VDSO || region->type == VM_REGION_IORING) {
+            continue;
+        }
+
         /* Allocate new region structure */
         new_region = slab_alloc(vm_region_cache);
         if (new_region == NULL) {
@@ -361,6 +656,7 @@ address_space_t *vm_clone_address_space(address_space_t *src)
         /* TODO: For fork(), we need CoW (copy-on-write)
          * For now, just copy the metadata */
         new_region->phys_base = region->phys_base;  /* Shared physical for now */
+        new_region->page_order = -1;                /* Freed by the original */
 
         /* Add to new address space */
         list_push_back(&as->regions, &new_region->node);
@@ -400,6 +696,10 @@ int vm_unmap_region(address_space_t *as, uint64_t start, uint64_t size)
         vm_region_t *region = list_entry(pos, vm_region_t, node);
         if (region->start == start && region->end == start + size) {
             list_remove(pos);
+            vm_release_pages(as, region);
+            if (region->page_order >= 0) {
+                pmm_free((void *)region->phys_base, (uint8_t)region->page_order);
+            }
             slab_free(vm_region_cache, region);
             as->region_count--;
             found = 1;
@@ -414,7 +714,5 @@ int vm_unmap_region(address_space_t *as, uint64_t start, uint64_t size)
         klog_warn("VM", "Unmap: region not found at %p", start);
     }
 
-    /* TODO: Walk page tables and clear PTEs */
-
     return found ? 0 : -2;  /* ENOENT */
 }
@@ -37,6 +37,8 @@ typedef enum {
     VM_REGION_HEAP,       /* Heap (brk managed) */
     VM_REGION_MMAP,       /* Memory-mapped region */
     VM_REGION_SHARED,     /* Shared memory region */
+    VM_REGION_VDSO,       /* vDSO pages (mapped afresh, never cloned) */
+    VM_REGION_IORING,     /* Submission/completion rings (never cloned) */
 } vm_region_type_t;
 
 /* Memory region permissions */
@@ -54,6 +56,9 @@ typedef enum {
  * @start: Virtual start address (page-aligned)
  * @end: Virtual end address (page-aligned, exclusive)
  * @phys_base: Physical base address (for direct mapping)
+ * @page_order: PMM order of the backing block if the region owns it, else -1
+ * @backed_size: Bytes from @start backed by @phys_base; the rest reads as zeros
+ * @cow: Backing frames are shared and never written: copy a page on first write
  * @flags: Page table flags (PT_USER, PT_WRITE, etc.)
  * @perm: Permission bits (VM_PERM_*)
  * @name: Region name for debugging
@@ -68,6 +73,9 @@ struct vm_region {
     uint64_t start;             /* Virtual start address (inclusive) */
     uint64_t end;               /* Virtual end address (exclusive) */
     uint64_t phys_base;         /* Physical base address */
+    int page_order;             /* Owned PMM block order (-1 = not owned) */
+    uint64_t backed_size;       /* Bytes backed by phys_base (rest zero-filled) */
+    int cow;                    /* Backing is shared: copy pages before writing */
     uint64_t flags;             /* Page table entry flags */
     uint32_t perm;              /* Permission bits */
     char name[32];              /* Region name for debugging */
@@ -201,6 +209,65 @@ int vm_map_region(address_space_t *as,
                   vm_region_type_t type,
                   const char *name);
 
+/**
+ * vm_map_backed_region - Map a region whose pages are faulted in on demand
+ * @as: Address space
+ * @start: Virtual start address (must be page-aligned)
+ * @size: Size in bytes (must be multiple of PAGE_SIZE)
+ * @phys: Physical address of the backing data for @start (page-aligned)
+ * @backed_size: Bytes of backing data; pages past it are zero-filled
+ * @flags: Page table flags
+ * @type: Region type for tracking
+ * @name: Region name for debugging
+ *
+ * Returns: 0 on success, negative error code on failure
+ *
+ * Creates no page table entries: vm_fault() maps each page on first
+ * access. The backing frames belong to someone else (a boot module, for
+ * instance) and are never written: a page is mapped straight from them
+ * while it is only read, and copied on its first write.
+ */
+int vm_map_backed_region(address_space_t *as,
+                         uint64_t start,
+                         uint64_t size,
+                         uint64_t phys,
+                         uint64_t backed_size,
+                         uint64_t flags,
+                         vm_region_type_t type,
+                         const char *name);
+
+/**
+ * vm_fault - Resolve a page fault in an address space
+ * @as: Address space
+ * @addr: Faulting virtual address
+ * @write: Non-zero for a write access
+ *
+ * Returns: 0 if the page is now mapped, -14 (EFAULT) if @addr is not in
+ *          a region allowing the access, -12 (ENOMEM) if out of memory
+ *
+ * Maps the page from the region's backing, a fresh zeroed page past
+ * the backing, or a private copy for a write to a shared page.
+ */
+int vm_fault(address_space_t *as, uint64_t addr, int write);
+
+/**
+ * vm_handle_page_fault - Handle a page fault in the current user address space
+ * @fault_addr: Faulting virtual address from CR2
+ * @error_code: Page fault error code
+ *
+ * Returns: 0 if handled, negative error code otherwise
+ */
+int vm_handle_page_fault(uint64_t fault_addr, uint64_t error_code);
+
+/**
+ * vm_lookup_page - Get the page table entry mapping an address
+ * @as: Address space
+ * @addr: Virtual address
+ *
+ * Returns: Page table entry for @addr, or 0 if no page is mapped there
+ */
+uint64_t vm_lookup_page(address_space_t *as, uint64_t addr);
+
 /**
  * vm_unmap_region - Unmap a memory region from an address space
  * @as: Address space
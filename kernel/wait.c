@@ -0,0 +1,168 @@
+/* Emergence Kernel - Wait queues
+ *
+ * Lock order: wait queue lock, then runqueue lock (taken by
+ * wake_up_thread()). The scheduler never takes a wait queue lock.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/wait.h"
+#include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "include/barrier.h"
+
+/**
+ * init_waitqueue_head - Initialize a wait queue head
+ * @wq: Wait queue
+ */
+void init_waitqueue_head(wait_queue_head_t *wq) {
+    spin_lock_init(&wq->lock);
+    list_init(&wq->head);
+}
+
+/**
+ * init_waitqueue_entry - Initialize a wait entry for a given thread
+ * @wait: Entry
+ * @t: Thread that will sleep on it
+ * @flags: WQ_FLAG_*
+ */
+void init_waitqueue_entry(wait_queue_entry_t *wait, thread_t *t, int flags) {
+    list_init(&wait->entry);
+    wait->thread = t;
+    wait->flags = flags;
+}
+
+/**
+ * init_wait_entry - Initialize a wait entry for the current thread
+ * @wait: Entry
+ * @flags: WQ_FLAG_*
+ */
+void init_wait_entry(wait_queue_entry_t *wait, int flags) {
+    init_waitqueue_entry(wait, thread_get_current(), flags);
+}
+
+/* Link an entry (lock held): exclusive waiters queue FIFO behind the rest */
+static void __add_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *wait) {
+    if (wait->flags & WQ_FLAG_EXCLUSIVE) {
+        list_push_back(&wq->head, &wait->entry);
+    } else {
+        list_push_front(&wq->head, &wait->entry);
+    }
+}
+
+/**
+ * add_wait_queue - Link an entry without changing the thread state
+ * @wq: Wait queue
+ * @wait: Entry
+ */
+void add_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *wait) {
+    irq_flags_t flags = spin_lock_irqsave(&wq->lock);
+
+    __add_wait_queue(wq, wait);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+/**
+ * remove_wait_queue - Unlink an entry if it is still linked
+ * @wq: Wait queue
+ * @wait: Entry
+ */
+void remove_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *wait) {
+    irq_flags_t flags = spin_lock_irqsave(&wq->lock);
+
+    list_remove(&wait->entry);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+/**
+ * prepare_to_wait - Queue the current thread and mark it blocked
+ * @wq: Wait queue
+ * @wait: Entry initialized with init_wait_entry()
+ *
+ * The caller must re-check its condition afterwards and call schedule()
+ * only if it is still false. May be called again after each wakeup.
+ */
+void prepare_to_wait(wait_queue_head_t *wq, wait_queue_entry_t *wait) {
+    irq_flags_t flags = spin_lock_irqsave(&wq->lock);
+
+    if (list_empty(&wait->entry)) {
+        __add_wait_queue(wq, wait);
+    }
+    wait->thread->state = THREAD_BLOCKED;
+    spin_unlock_irqrestore(&wq->lock, flags);
+
+    /* Pairs with wq_has_sleeper(): publish the entry before the re-check */
+    smp_mb();
+}
+
+/**
+ * finish_wait - Leave the wait queue after the condition became true
+ * @wq: Wait queue
+ * @wait: Entry
+ */
+void finish_wait(wait_queue_head_t *wq, wait_queue_entry_t *wait) {
+    irq_flags_t flags;
+
+    wait->thread->state = THREAD_RUNNING;
+
+    /* Usually already unlinked by the waker, but it may still be touching
+     * the entry: take the lock before the caller's stack frame goes away */
+    flags = spin_lock_irqsave(&wq->lock);
+    list_remove(&wait->entry);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+/**
+ * __wake_up - Wake threads sleeping on a wait queue
+ * @wq: Wait queue
+ * @nr_exclusive: Number of exclusive sleepers to wake (0 = all)
+ *
+ * Every non-exclusive sleeper ahead of the exclusive ones is woken.
+ * An exclusive sleeper only counts if it was actually still blocked,
+ * so a wakeup is never spent on a thread that is already leaving.
+ * Safe to call from interrupt context.
+ *
+ * Returns: Number of threads woken
+ */
+int __wake_up(wait_queue_head_t *wq, int nr_exclusive) {
+    struct list_head *pos, *next;
+    irq_flags_t flags;
+    int woken = 0;
+
+    flags = spin_lock_irqsave(&wq->lock);
+
+    for (pos = wq->head.next; pos != &wq->head; pos = next) {
+        wait_queue_entry_t *wait = list_entry(pos, wait_queue_entry_t, entry);
+        int exclusive = wait->flags & WQ_FLAG_EXCLUSIVE;
+
+        next = pos->next;
+        list_remove(&wait->entry);
+
+        if (!wake_up_thread(wait->thread)) {
+            continue;
+        }
+        woken++;
+
+        if (exclusive && nr_exclusive > 0 && --nr_exclusive == 0) {
+            break;
+        }
+    }
+
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
+
+/**
+ * wq_has_sleeper - Check for sleepers without taking the lock
+ * @wq: Wait queue
+ *
+ * Lets a waker skip the lock on the common uncontended path. The full
+ * barrier orders the waker's condition update before the list read and
+ * pairs with the one in prepare_to_wait().
+ *
+ * Returns: Non-zero if any entry is linked
+ */
+int wq_has_sleeper(wait_queue_head_t *wq) {
+    smp_mb();
+    return !list_empty(&wq->head);
+}
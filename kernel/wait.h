@@ -0,0 +1,137 @@
+/* Emergence Kernel - Wait queues
+ *
+ * A wait queue holds threads sleeping until some condition becomes true.
+ * A sleeper links an entry, marks itself THREAD_BLOCKED, re-checks the
+ * condition and only then calls schedule(). A waker makes the condition
+ * true before calling wake_up(). Since the sleeper is already BLOCKED when
+ * it does the final check, and wake_up_thread() cancels a sleep that has
+ * not reached schedule() yet, no wakeup can be lost.
+ *
+ * Woken entries are unlinked by the waker. Exclusive entries (mutex or
+ * semaphore waiters) are woken one at a time; all others are woken
+ * together.
+ */
+
+#ifndef _KERNEL_WAIT_H
+#define _KERNEL_WAIT_H
+
+#include <stdint.h>
+#include "include/kernel/thread.h"
+#include "include/kernel/scheduler.h"
+#include "include/spinlock.h"
+#include "kernel/list.h"
+#include "kernel/timer.h"
+
+/* Wait entry flags */
+#define WQ_FLAG_EXCLUSIVE   0x01    /* Counted against the wake_up() budget */
+
+/* A sleeping thread's link into a wait queue */
+typedef struct wait_queue_entry {
+    struct list_head entry;         /* Wait queue linkage (self-linked when idle) */
+    thread_t *thread;               /* Sleeping thread */
+    int flags;                      /* WQ_FLAG_* */
+} wait_queue_entry_t;
+
+/* Wait queue head */
+typedef struct wait_queue_head {
+    spinlock_t lock;                /* Protects the entry list */
+    struct list_head head;          /* Waiting entries */
+} wait_queue_head_t;
+
+/* Static initializer: wait_queue_head_t wq = WAIT_QUEUE_HEAD_INIT(wq); */
+#define WAIT_QUEUE_HEAD_INIT(name) \
+    { .lock = SPIN_LOCK_UNLOCKED, .head = { &(name).head, &(name).head } }
+
+/* Initialize a wait queue head */
+void init_waitqueue_head(wait_queue_head_t *wq);
+
+/* Initialize an entry for thread @t */
+void init_waitqueue_entry(wait_queue_entry_t *wait, thread_t *t, int flags);
+
+/* Initialize an entry for the current thread */
+void init_wait_entry(wait_queue_entry_t *wait, int flags);
+
+/* Link/unlink an entry without changing the thread state */
+void add_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *wait);
+void remove_wait_queue(wait_queue_head_t *wq, wait_queue_entry_t *wait);
+
+/* Link the current thread's entry and mark it THREAD_BLOCKED */
+void prepare_to_wait(wait_queue_head_t *wq, wait_queue_entry_t *wait);
+
+/* Unlink the entry and mark the current thread running again */
+void finish_wait(wait_queue_head_t *wq, wait_queue_entry_t *wait);
+
+/* Wake up to @nr_exclusive exclusive sleepers (0 = all) and every other sleeper */
+int __wake_up(wait_queue_head_t *wq, int nr_exclusive);
+
+/* Check for sleepers without taking the lock (full barrier first) */
+int wq_has_sleeper(wait_queue_head_t *wq);
+
+#define wake_up(wq)             __wake_up(wq, 1)
+#define wake_up_nr(wq, nr)      __wake_up(wq, nr)
+#define wake_up_all(wq)         __wake_up(wq, 0)
+
+/**
+ * wait_event - Sleep until a condition is true
+ * @wq: Wait queue (lvalue) that is woken when @condition may have changed
+ * @condition: C expression, re-evaluated after every wakeup
+ *
+ * Must be called from thread context with interrupts enabled.
+ */
+#define wait_event(wq, condition)                                   \
+    do {                                                            \
+        wait_queue_entry_t __wait;                                  \
+                                                                    \
+        if (condition) {                                            \
+            break;                                                  \
+        }                                                           \
+        init_wait_entry(&__wait, 0);                                \
+        while (1) {                                                 \
+            prepare_to_wait(&(wq), &__wait);                        \
+            if (condition) {                                        \
+                break;                                              \
+            }                                                       \
+            schedule();                                             \
+        }                                                           \
+        finish_wait(&(wq), &__wait);                                \
+    } while (0)
+
+/**
+ * wait_event_timeout - Sleep until a condition is true or a timeout passes
+ * @wq: Wait queue (lvalue) that is woken when @condition may have changed
+ * @condition: C expression, re-evaluated after every wakeup
+ * @timeout_ns: Longest time to sleep
+ *
+ * The timeout is a timer wheel timer (see kernel/timer.h), so the sleep
+ * costs nothing while it lasts. Must be called from thread context with
+ * interrupts enabled.
+ *
+ * Returns: 0 if the timeout passed with @condition still false, otherwise
+ *          the time left in ns (at least 1)
+ */
+#define wait_event_timeout(wq, condition, timeout_ns)               \
+    ({                                                              \
+        uint64_t __left = (timeout_ns);                             \
+        wait_queue_entry_t __wait;                                  \
+                                                                    \
+        if (!(condition)) {                                         \
+            init_wait_entry(&__wait, 0);                            \
+            while (1) {                                             \
+                prepare_to_wait(&(wq), &__wait);                    \
+                if (condition) {                                    \
+                    break;                                          \
+                }                                                   \
+                if (__left == 0) {                                  \
+                    break;                                          \
+                }                                                   \
+                __left = schedule_timeout(__left);                  \
+            }                                                       \
+            finish_wait(&(wq), &__wait);                            \
+        }                                                           \
+        if ((condition) && __left == 0) {                           \
+            __left = 1;                                             \
+        }                                                           \
+        __left;                                                     \
+    })
+
+#endif /* _KERNEL_WAIT_H */
@@ -0,0 +1,369 @@
+/* Emergence Kernel - Workqueues
+ *
+ * Work item state (see kernel/workqueue.h):
+ *
+ *   queue:   0 or LINKED -> PENDING|LINKED, pushed only if it was not
+ *            still LINKED (a cancelled item waiting on a list runs from
+ *            its old spot)
+ *   claim:   the worker clears PENDING|LINKED in one step and runs the
+ *            item only if PENDING was set
+ *   cancel:  clears PENDING; the worker skips and unlinks the item later
+ *
+ * Every transition is a single atomic operation on the state word, so
+ * queueing needs no lock. A pool's pending list only ever has items
+ * pushed onto it and is emptied as a whole by its one worker, so it has
+ * no ABA problem.
+ *
+ * Flushing queues a barrier item behind whatever is being waited for and
+ * sleeps until the worker gets to it.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "kernel/workqueue.h"
+#include "kernel/thread.h"
+#include "kernel/scheduler.h"
+#include "kernel/wait.h"
+#include "kernel/klog.h"
+#include "arch/x86_64/smp.h"
+#include "include/kernel/cpumask.h"
+#include "include/barrier.h"
+#include "include/percpu.h"
+#include "include/string.h"
+
+/* A worker thread and the items queued for it */
+struct worker_pool {
+    struct work_struct *pending;        /* Lock-free stack, newest first */
+    struct work_struct *current_work;   /* Item being run, or NULL */
+    thread_t *worker;                   /* NULL until workqueue_init() */
+    int cpu;                            /* Bound CPU, -1 for the unbound pool */
+    wait_queue_head_t more_work;        /* Worker sleeps here when idle */
+    wait_queue_head_t flush_wait;       /* Flushers sleep here */
+    char name[16];                      /* Worker thread name */
+};
+
+static DEFINE_PER_CPU(struct worker_pool, cpu_worker_pools);
+static struct worker_pool unbound_pool;
+
+static struct workqueue_struct system_wq_struct = {
+    .name = "events",
+    .flags = 0,
+};
+static struct workqueue_struct system_unbound_wq_struct = {
+    .name = "events_unbound",
+    .flags = WQ_UNBOUND,
+};
+
+struct workqueue_struct *system_wq = &system_wq_struct;
+struct workqueue_struct *system_unbound_wq = &system_unbound_wq_struct;
+
+/* Statistics (atomic) */
+static uint64_t nr_queued;
+static uint64_t nr_run;
+static uint64_t nr_cancelled;
+
+/* Flush marker, queued behind the items being waited for */
+struct wq_barrier {
+    struct work_struct work;
+    struct worker_pool *pool;
+    int done;
+};
+
+static void wq_barrier_func(struct work_struct *work) {
+    struct wq_barrier *barr = work_container_of(work, struct wq_barrier, work);
+    struct worker_pool *pool = barr->pool;
+
+    /* The flusher may return and drop barr as soon as this is seen */
+    __atomic_store_n(&barr->done, 1, __ATOMIC_RELEASE);
+    wake_up_all(&pool->flush_wait);
+}
+
+/* Pick the pool for @wq on @cpu; offline CPUs fall back to the unbound pool */
+static struct worker_pool *wq_pool(struct workqueue_struct *wq, int cpu) {
+    if ((wq->flags & WQ_UNBOUND) || cpu < 0 || cpu >= smp_get_cpu_count()) {
+        return &unbound_pool;
+    }
+    return &per_cpu(cpu_worker_pools, cpu);
+}
+
+/* Mark @work pending and link it into @pool; returns 0 if already pending */
+static int __queue_work(struct worker_pool *pool, struct work_struct *work) {
+    struct work_struct *head;
+    unsigned int old, new;
+
+    old = __atomic_load_n(&work->state, __ATOMIC_RELAXED);
+    do {
+        if (old & WORK_PENDING) {
+            return 0;
+        }
+        new = old | WORK_PENDING | WORK_LINKED;
+    } while (!__atomic_compare_exchange_n(&work->state, &old, new, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (old & WORK_LINKED) {
+        /* Cancelled but not yet skipped: the worker will now run it */
+        return 1;
+    }
+
+    work->pool = pool;
+    head = __atomic_load_n(&pool->pending, __ATOMIC_RELAXED);
+    do {
+        work->next = head;
+    } while (!__atomic_compare_exchange_n(&pool->pending, &head, work, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (READ_ONCE(pool->worker) != NULL && wq_has_sleeper(&pool->more_work)) {
+        wake_up(&pool->more_work);
+    }
+    return 1;
+}
+
+/* Wait until @pool's worker has run everything queued on it so far */
+static void flush_pool(struct worker_pool *pool) {
+    struct wq_barrier barr;
+
+    if (READ_ONCE(pool->worker) == NULL) {
+        return;
+    }
+    if (thread_get_current() == pool->worker) {
+        klog_warn("WQ", "%s: flush from its own worker ignored", pool->name);
+        return;
+    }
+
+    init_work(&barr.work, wq_barrier_func);
+    barr.pool = pool;
+    barr.done = 0;
+    __queue_work(pool, &barr.work);
+
+    wait_event(pool->flush_wait, __atomic_load_n(&barr.done, __ATOMIC_ACQUIRE));
+}
+
+/* Worker thread: run the pool's items in queueing order, forever */
+static void worker_thread(void *arg) {
+    struct worker_pool *pool = arg;
+    struct work_struct *list, *work, *next, *prev;
+    work_func_t func;
+    unsigned int old;
+
+    while (1) {
+        wait_event(pool->more_work, READ_ONCE(pool->pending) != NULL);
+
+        list = __atomic_exchange_n(&pool->pending, NULL, __ATOMIC_ACQUIRE);
+
+        /* Newest first on the stack: reverse into queueing order */
+        prev = NULL;
+        while (list != NULL) {
+            next = list->next;
+            list->next = prev;
+            prev = list;
+            list = next;
+        }
+
+        for (work = prev; work != NULL; work = next) {
+            /* Once claimed the item may be queued again or freed */
+            next = work->next;
+            func = work->func;
+
+            /* Published before the claim so flush_work() never misses a run */
+            __atomic_store_n(&pool->current_work, work, __ATOMIC_RELEASE);
+            old = __atomic_fetch_and(&work->state, ~(WORK_PENDING | WORK_LINKED),
+                                     __ATOMIC_ACQ_REL);
+            if (old & WORK_PENDING) {
+                if (func != wq_barrier_func) {
+                    __atomic_add_fetch(&nr_run, 1, __ATOMIC_RELAXED);
+                }
+                func(work);
+            }
+            __atomic_store_n(&pool->current_work, NULL, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/* Set up a pool and start its worker; @cpu < 0 for the unbound pool */
+static void worker_pool_start(struct worker_pool *pool, int cpu) {
+    thread_t *t;
+
+    /* pending is left alone: it may already hold early items */
+    pool->current_work = NULL;
+    pool->cpu = cpu;
+    init_waitqueue_head(&pool->more_work);
+    init_waitqueue_head(&pool->flush_wait);
+    if (cpu < 0) {
+        snprintf(pool->name, sizeof(pool->name), "kworker/u");
+    } else {
+        snprintf(pool->name, sizeof(pool->name), "kworker/%d", cpu);
+    }
+
+    t = thread_create(pool->name, worker_thread, pool,
+                      THREAD_DEFAULT_STACK_SIZE, THREAD_FLAG_KERNEL);
+    if (t == NULL) {
+        klog_error("WQ", "Failed to create %s", pool->name);
+        return;
+    }
+    if (cpu >= 0) {
+        sched_setaffinity(t, cpumask_of(cpu));
+    }
+
+    pool->worker = t;
+    scheduler_add_thread(t);
+}
+
+/**
+ * workqueue_init - Start the worker threads
+ *
+ * One bound worker per online CPU and one unbound worker. Items queued
+ * before this wait on their pool's list and run once it has a worker.
+ */
+void workqueue_init(void) {
+    int cpu;
+
+    for (cpu = 0; cpu < smp_get_cpu_count(); cpu++) {
+        worker_pool_start(&per_cpu(cpu_worker_pools, cpu), cpu);
+    }
+    worker_pool_start(&unbound_pool, -1);
+
+    klog_info("WQ", "Workqueues initialized (%d bound workers + 1 unbound)",
+              smp_get_cpu_count());
+}
+
+/**
+ * init_work - Prepare a work item
+ * @work: Work item, not currently queued
+ * @func: Function the worker calls with @work
+ */
+void init_work(struct work_struct *work, work_func_t func) {
+    work->next = NULL;
+    work->func = func;
+    work->pool = NULL;
+    work->state = 0;
+}
+
+/**
+ * queue_work_on - Queue a work item on a given CPU
+ * @cpu: CPU whose worker runs @work (ignored for WQ_UNBOUND)
+ * @wq: Workqueue
+ * @work: Work item
+ *
+ * Safe from any context, including interrupt handlers.
+ *
+ * Returns: 1 if @work was queued, 0 if it was already pending
+ */
+int queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work) {
+    if (!__queue_work(wq_pool(wq, cpu), work)) {
+        return 0;
+    }
+    __atomic_add_fetch(&nr_queued, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * queue_work - Queue a work item on the current CPU
+ * @wq: Workqueue
+ * @work: Work item
+ *
+ * Safe from any context, including interrupt handlers.
+ *
+ * Returns: 1 if @work was queued, 0 if it was already pending
+ */
+int queue_work(struct workqueue_struct *wq, struct work_struct *work) {
+    return queue_work_on(smp_get_cpu_index(), wq, work);
+}
+
+/**
+ * cancel_work - Cancel a pending work item
+ * @work: Work item
+ *
+ * A run already in progress is not waited for, and the item may still
+ * be on a pool's list, so it must not be freed until cancel_work_sync()
+ * or flush_work() has returned.
+ *
+ * Returns: 1 if @work was pending, 0 otherwise
+ */
+int cancel_work(struct work_struct *work) {
+    unsigned int old;
+
+    old = __atomic_fetch_and(&work->state, ~WORK_PENDING, __ATOMIC_ACQ_REL);
+    if (!(old & WORK_PENDING)) {
+        return 0;
+    }
+    __atomic_add_fetch(&nr_cancelled, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * cancel_work_sync - Cancel a work item and wait for it to be idle
+ * @work: Work item
+ *
+ * On return @work is neither pending, running nor linked, so it may be
+ * freed, provided nothing queues it again. Must be called from thread
+ * context, and not from the worker that would run @work.
+ *
+ * Returns: 1 if @work was pending, 0 otherwise
+ */
+int cancel_work_sync(struct work_struct *work) {
+    struct worker_pool *pool = READ_ONCE(work->pool);
+    int ret = cancel_work(work);
+
+    if (pool != NULL &&
+        ((__atomic_load_n(&work->state, __ATOMIC_ACQUIRE) & WORK_LINKED) ||
+         __atomic_load_n(&pool->current_work, __ATOMIC_ACQUIRE) == work)) {
+        flush_pool(pool);
+    }
+    return ret;
+}
+
+/**
+ * flush_work - Wait for a work item to finish
+ * @work: Work item
+ *
+ * Waits for a pending item to be run and for a run in progress to end.
+ * Must be called from thread context.
+ *
+ * Returns: 1 if it had to wait, 0 if @work was already idle
+ */
+int flush_work(struct work_struct *work) {
+    struct worker_pool *pool = READ_ONCE(work->pool);
+
+    if (pool == NULL) {
+        return 0;
+    }
+    if (!work_pending(work) &&
+        __atomic_load_n(&pool->current_work, __ATOMIC_ACQUIRE) != work) {
+        return 0;
+    }
+
+    flush_pool(pool);
+    return 1;
+}
+
+/**
+ * flush_workqueue - Wait for everything queued on a workqueue
+ * @wq: Workqueue
+ *
+ * Items queued while this runs may or may not be waited for. Must be
+ * called from thread context.
+ */
+void flush_workqueue(struct workqueue_struct *wq) {
+    int cpu;
+
+    if (wq->flags & WQ_UNBOUND) {
+        flush_pool(&unbound_pool);
+        return;
+    }
+
+    for (cpu = 0; cpu < smp_get_cpu_count(); cpu++) {
+        flush_pool(&per_cpu(cpu_worker_pools, cpu));
+    }
+    /* Items queued on offline CPUs went to the unbound pool */
+    flush_pool(&unbound_pool);
+}
+
+/**
+ * workqueue_get_stats - Get workqueue counters
+ * @stats: Filled in with the current counters
+ */
+void workqueue_get_stats(struct workqueue_stats *stats) {
+    stats->nr_queued = __atomic_load_n(&nr_queued, __ATOMIC_RELAXED);
+    stats->nr_run = __atomic_load_n(&nr_run, __ATOMIC_RELAXED);
+    stats->nr_cancelled = __atomic_load_n(&nr_cancelled, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,118 @@
+/* Emergence Kernel - Workqueues
+ *
+ * A work item is a function run later in a kernel thread, for work that
+ * is too slow or may sleep and so does not belong in an interrupt
+ * handler or a latency-sensitive path.
+ *
+ * Each CPU has a bound worker pool whose single worker thread
+ * ("kworker/N") is pinned to that CPU, and there is one unbound pool
+ * ("kworker/u") whose worker may run anywhere:
+ *
+ *   system_wq          - queue_work() runs the item on the queueing CPU,
+ *                        queue_work_on() on a chosen one
+ *   system_unbound_wq  - the item runs wherever the scheduler puts the
+ *                        unbound worker
+ *
+ * Queueing never takes a lock, so it is safe from any context including
+ * interrupt handlers. A pool's pending items form a lock-free stack that
+ * the worker takes over in one exchange and runs in queueing order.
+ *
+ * A work item is queued at most once: queueing a pending item does
+ * nothing. Once the worker has claimed it, its function may queue it
+ * again or free it. Items on one pool run one at a time.
+ */
+
+#ifndef _KERNEL_WORKQUEUE_H
+#define _KERNEL_WORKQUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct work_struct;
+struct worker_pool;
+
+typedef void (*work_func_t)(struct work_struct *work);
+
+/* work_struct.state bits */
+#define WORK_PENDING    0x01        /* Queued and not yet claimed or cancelled */
+#define WORK_LINKED     0x02        /* On a pool's pending list */
+
+/* Work item
+ *
+ * Layout:
+ *   0-7:   next (8 bytes)
+ *   8-15:  func (8 bytes)
+ *   16-23: pool (8 bytes)
+ *   24-27: state (4 bytes)
+ *   28-31: padding (4 bytes)
+ * Total: 32 bytes
+ */
+struct work_struct {
+    struct work_struct *next;       /* Pending list link (while LINKED) */
+    work_func_t func;               /* Called by the worker */
+    struct worker_pool *pool;       /* Pool it was last queued on */
+    unsigned int state;             /* WORK_* bits (atomic) */
+};
+
+/* Get the structure embedding a work item */
+#define work_container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Static initializer: struct work_struct w = WORK_INIT(fn); */
+#define WORK_INIT(fn)   { .next = NULL, .func = (fn), .pool = NULL, .state = 0 }
+
+/* Workqueue: which pools its items go to */
+#define WQ_UNBOUND      0x01        /* Single pool, worker not pinned */
+
+struct workqueue_struct {
+    const char *name;
+    unsigned int flags;             /* WQ_* */
+};
+
+extern struct workqueue_struct *system_wq;
+extern struct workqueue_struct *system_unbound_wq;
+
+/* Create the worker threads (after scheduler_init) */
+void workqueue_init(void);
+
+/* Prepare a work item that will call @func */
+void init_work(struct work_struct *work, work_func_t func);
+
+/* Check whether @work is queued and not yet running */
+static inline int work_pending(struct work_struct *work) {
+    return (__atomic_load_n(&work->state, __ATOMIC_ACQUIRE) & WORK_PENDING) != 0;
+}
+
+/* Queue @work; returns 1 if queued, 0 if it was already pending */
+int queue_work(struct workqueue_struct *wq, struct work_struct *work);
+
+/* Queue @work on @cpu's pool of a bound workqueue */
+int queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work);
+
+/* Queue @work on system_wq */
+static inline int schedule_work(struct work_struct *work) {
+    return queue_work(system_wq, work);
+}
+
+/* Stop @work from running if it has not started; returns 1 if it was pending */
+int cancel_work(struct work_struct *work);
+
+/* Like cancel_work(), and wait for a run already in progress to finish */
+int cancel_work_sync(struct work_struct *work);
+
+/* Wait until @work is neither pending nor running; returns 1 if it waited */
+int flush_work(struct work_struct *work);
+
+/* Wait until everything queued on @wq before the call has run */
+void flush_workqueue(struct workqueue_struct *wq);
+
+/* Pool counters for tests and debugging */
+struct workqueue_stats {
+    uint64_t nr_queued;             /* Items queued */
+    uint64_t nr_run;                /* Items run */
+    uint64_t nr_cancelled;          /* Items cancelled before running */
+};
+
+void workqueue_get_stats(struct workqueue_stats *stats);
+
+#endif /* _KERNEL_WORKQUEUE_H */
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""
+Build the kernel's initramfs: a "newc" cpio archive.
+
+Each file's name is NUL-padded so that its data starts on a page
+boundary in the archive. The kernel maps programs straight out of the
+boot module (kernel/elf.c), which only works for page-aligned data.
+
+Usage: mkinitramfs.py OUTPUT NAME=PATH [NAME=PATH ...]
+"""
+
+import os
+import sys
+
+PAGE_SIZE = 4096
+HEADER_SIZE = 110
+
+
+def newc_header(ino, mode, size, namesize):
+    """Format a newc header: magic then 13 eight-digit hex fields."""
+    fields = [ino, mode, 0, 0, 1, 0, size, 0, 0, 0, 0, namesize, 0]
+    return b"070701" + b"".join(b"%08X" % f for f in fields)
+
+
+def add_entry(out, ino, name, mode, data, align):
+    """Append one entry, padding its name so the data lands on @align."""
+    name = name.encode() + b"\0"
+    start = len(out) + HEADER_SIZE
+    end = start + len(name)
+    end += -end % 4
+    if data and align > 4:
+        end += -end % align
+    out += newc_header(ino, mode, len(data), end - start)
+    out += name + b"\0" * (end - start - len(name))
+    out += data
+    out += b"\0" * (-len(out) % 4)
+
+
+def main():
+    if len(sys.argv) < 3:
+        print(__doc__.strip().splitlines()[-1], file=sys.stderr)
+        return 1
+
+    out = bytearray()
+    for ino, spec in enumerate(sys.argv[2:], start=1):
+        name, _, path = spec.partition("=")
+        with open(path, "rb") as f:
+            data = f.read()
+        mode = 0o100755 if os.access(path, os.X_OK) else 0o100644
+        add_entry(out, ino, name.lstrip("/"), mode, data, PAGE_SIZE)
+    add_entry(out, 0, "TRAILER!!!", 0, b"", 4)
+
+    with open(sys.argv[1], "wb") as f:
+        f.write(out)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -14,6 +14,10 @@
 #   tests/minilibc/          - Minilibc tests
 #   tests/usermode/          - User mode tests
 #   tests/kmap/              - KMAP memory region tracking tests
+#   tests/idle/              - Idle wakeup latency benchmark
+#   tests/process/           - Process subsystem tests
+#   tests/vdso/              - vDSO tests
+#   tests/ioring/            - Submission/completion ring tests
 #   tests/nested-kernel/     - All Nested Kernel tests
 
 TESTS_DIR := tests
@@ -90,6 +94,22 @@ NK_MONITOR_TRAMPOLINE_TEST_OBJ := $(BUILD_DIR)/nk_monitor_trampoline_test.o
 NK_INVARIANTS_VERIFY_TEST_SRC := tests/nested-kernel/nk_invariants_verify_test.c
 NK_INVARIANTS_VERIFY_TEST_OBJ := $(BUILD_DIR)/nk_invariants_verify_test.o
 
+# Idle wakeup benchmark (always compiled - provides stubs when disabled)
+IDLE_TEST_SRC := tests/idle/idle_test.c
+IDLE_TEST_OBJ := $(BUILD_DIR)/kernel_idle_test.o
+
+# Process tests (always compiled - provides stubs when disabled)
+PROCESS_TEST_SRC := tests/process/process_test.c
+PROCESS_TEST_OBJ := $(BUILD_DIR)/kernel_process_test.o
+
+# vDSO tests (always compiled - provides stubs when disabled)
+VDSO_TEST_SRC := tests/vdso/vdso_test.c
+VDSO_TEST_OBJ := $(BUILD_DIR)/kernel_vdso_test.o
+
+# Submission/completion ring tests (always compiled - provides stubs when disabled)
+IORING_TEST_SRC := tests/ioring/ioring_test.c
+IORING_TEST_OBJ := $(BUILD_DIR)/kernel_ioring_test.o
+
 # Scheduler test (conditionally compiled)
 SCHED_TEST_SRC := tests/sched/sched_test.c
 SCHED_TEST_OBJ := $(BUILD_DIR)/kernel_sched_test.o
@@ -116,6 +136,10 @@ TESTS_OBJS += $(NK_INVARIANTS_VERIFY_TEST_OBJ)
 TESTS_OBJS += $(USERMODE_TEST_OBJ)
 TESTS_OBJS += $(MINILIBC_TEST_OBJ)
 TESTS_OBJS += $(SYSCALL_TEST_OBJ)
+TESTS_OBJS += $(IDLE_TEST_OBJ)
+TESTS_OBJS += $(PROCESS_TEST_OBJ)
+TESTS_OBJS += $(VDSO_TEST_OBJ)
+TESTS_OBJS += $(IORING_TEST_OBJ)
 
 
 # Conditionally compiled tests
@@ -190,6 +214,22 @@ $(MINILIBC_TEST_OBJ): $(MINILIBC_TEST_SRC) $(CONFIG_DEP) | $(BUILD_DIR)
 	@echo "  CC      $<"
 	$(Q)$(CC) $(CFLAGS) -c $< -o $@
 
+$(IDLE_TEST_OBJ): $(IDLE_TEST_SRC) $(CONFIG_DEP) | $(BUILD_DIR)
+	@echo "  CC      $<"
+	$(Q)$(CC) $(CFLAGS) -c $< -o $@
+
+$(PROCESS_TEST_OBJ): $(PROCESS_TEST_SRC) $(CONFIG_DEP) | $(BUILD_DIR)
+	@echo "  CC      $<"
+	$(Q)$(CC) $(CFLAGS) -c $< -o $@
+
+$(VDSO_TEST_OBJ): $(VDSO_TEST_SRC) $(CONFIG_DEP) | $(BUILD_DIR)
+	@echo "  CC      $<"
+	$(Q)$(CC) $(CFLAGS) -c $< -o $@
+
+$(IORING_TEST_OBJ): $(IORING_TEST_SRC) $(CONFIG_DEP) | $(BUILD_DIR)
+	@echo "  CC      $<"
+	$(Q)$(CC) $(CFLAGS) -c $< -o $@
+
 # Syscall test program compilation rule (assembly file)
 $(SYSCALL_TEST_OBJ): $(SYSCALL_TEST_SRC) | $(BUILD_DIR)
 	@echo "  AS      $<"
@@ -0,0 +1,240 @@
+/* Emergence Kernel - Idle Wakeup Benchmark
+ *
+ * Measures how long an idle CPU takes to notice a cross-CPU wakeup:
+ *
+ *   hlt   - the BSP halts; CPU 1 stores the wake word and sends a
+ *           reschedule IPI, as resched_curr() does for a halted CPU
+ *   mwait - the BSP waits with MONITOR/MWAIT on the wake word; CPU 1
+ *           only stores it
+ *
+ * Latency is from CPU 1's TSC stamp just before the store to the BSP's
+ * TSC stamp after it woke, so it assumes synchronized TSCs (true under
+ * QEMU/KVM). MWAIT is usually only exposed to KVM guests started with
+ * -overcommit cpu-pm=on; without it only HLT is measured.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "test_idle.h"
+#include "kernel/test.h"
+#include "kernel/klog.h"
+#include "include/barrier.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/tsc.h"
+#include "arch/x86_64/ipi.h"
+#include "arch/x86_64/idle.h"
+#include "arch/x86_64/include/cpu_context.h"
+
+/* Benchmark progress, polled by the APs */
+#define IDLE_TEST_WAIT          0       /* BSP has not decided yet */
+#define IDLE_TEST_RUN           1       /* Benchmark running, CPU 1 is the waker */
+#define IDLE_TEST_DONE          2       /* APs may move on */
+
+volatile int idle_test_state = IDLE_TEST_WAIT;
+
+#if CONFIG_TESTS_IDLE
+
+#define IDLE_TEST_ROUNDS        200
+#define IDLE_TEST_DELAY_NS      (20 * NSEC_PER_USEC)    /* Let the sleeper really sleep */
+#define IDLE_TEST_REKICK_NS     NSEC_PER_MSEC           /* Re-send a lost IPI */
+#define IDLE_TEST_TIMEOUT_NS    (100 * NSEC_PER_MSEC)   /* Waker start-up */
+
+#define IDLE_METHOD_HLT         0
+#define IDLE_METHOD_MWAIT       1
+
+static volatile int waker_ready;
+static volatile int round_method;
+static volatile int round_armed;
+static volatile uint64_t wake_stamp;
+
+/* Wake word, alone on its cache line so only the waker's store ends MWAIT */
+static struct {
+    volatile int flag;
+    char pad[60];
+} wake __attribute__((aligned(64)));
+
+/* Spin for @ns */
+static void idle_test_delay(uint64_t ns) {
+    uint64_t start = sched_clock();
+
+    while (sched_clock() - start < ns) {
+        cpu_relax();
+    }
+}
+
+/**
+ * idle_test_ap_entry - Wake the BSP once per armed round
+ *
+ * Runs on CPU 1 with interrupts disabled, which smp_send_reschedule()
+ * needs.
+ */
+void idle_test_ap_entry(void) {
+    int state;
+
+    if (smp_get_cpu_index() != 1) {
+        return;
+    }
+
+    while ((state = READ_ONCE(idle_test_state)) == IDLE_TEST_WAIT) {
+        cpu_relax();
+    }
+    if (state != IDLE_TEST_RUN) {
+        return;
+    }
+
+    waker_ready = 1;
+
+    while (READ_ONCE(idle_test_state) == IDLE_TEST_RUN) {
+        uint64_t kicked;
+
+        if (!READ_ONCE(round_armed)) {
+            cpu_relax();
+            continue;
+        }
+
+        idle_test_delay(IDLE_TEST_DELAY_NS);
+
+        wake_stamp = arch_rdtsc();
+        barrier();
+        wake.flag = 1;
+        if (round_method == IDLE_METHOD_HLT) {
+            smp_send_reschedule(0);
+        }
+
+        /* Wait for the BSP to take the round */
+        kicked = sched_clock();
+        while (READ_ONCE(round_armed)) {
+            cpu_relax();
+            if (sched_clock() - kicked > IDLE_TEST_REKICK_NS) {
+                smp_send_reschedule(0);
+                kicked = sched_clock();
+            }
+        }
+    }
+}
+
+/**
+ * idle_bench - Measure wakeup latency of one idle method
+ * @method: IDLE_METHOD_HLT or IDLE_METHOD_MWAIT
+ *
+ * Returns: 0 on success, -1 if a round measured nothing
+ */
+static int idle_bench(int method) {
+    const char *name = method == IDLE_METHOD_MWAIT ? "mwait" : "hlt";
+    uint64_t min = UINT64_MAX, max = 0, sum = 0;
+
+    for (int r = 0; r < IDLE_TEST_ROUNDS; r++) {
+        uint64_t flags, now, ns;
+
+        wake.flag = 0;
+        round_method = method;
+
+        flags = arch_disable_interrupts();
+        smp_mb();
+        round_armed = 1;
+
+        while (!READ_ONCE(wake.flag)) {
+            if (method == IDLE_METHOD_MWAIT) {
+                idle_enter_mwait(&wake.flag);
+            } else {
+                idle_enter_hlt();
+            }
+            arch_disable_interrupts();
+        }
+        now = arch_rdtsc();
+        arch_restore_interrupts(flags);
+
+        ns = now > wake_stamp ? tsc_cycles_to_ns(now - wake_stamp) : 0;
+        round_armed = 0;
+
+        sum += ns;
+        if (ns < min) {
+            min = ns;
+        }
+        if (ns > max) {
+            max = ns;
+        }
+    }
+
+    klog_info("IDLE_TEST", "IDLE_BENCH method=%s rounds=%d min_ns=%lu avg_ns=%lu max_ns=%lu",
+              name, IDLE_TEST_ROUNDS, (unsigned long)min,
+              (unsigned long)(sum / IDLE_TEST_ROUNDS), (unsigned long)max);
+
+    if (max == 0) {
+        klog_error("IDLE_TEST", "FAILED: No %s wakeup latency measured", name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * run_idle_tests - Run the idle wakeup benchmark
+ *
+ * Returns: Number of failures (0 = all passed)
+ */
+int run_idle_tests(void) {
+    int failures = 0;
+    uint64_t start;
+
+    klog_info("IDLE_TEST", "=== Idle Wakeup Benchmark ===");
+
+    if (smp_get_cpu_count() < 2) {
+        klog_info("IDLE_TEST", "Skipped: needs 2 CPUs");
+        klog_info("IDLE_TEST", "IDLE: All tests PASSED");
+        return 0;
+    }
+
+    idle_test_state = IDLE_TEST_RUN;
+    start = sched_clock();
+    while (!READ_ONCE(waker_ready)) {
+        if (sched_clock() - start > IDLE_TEST_TIMEOUT_NS) {
+            klog_error("IDLE_TEST", "FAILED: CPU 1 did not join the benchmark");
+            klog_error("IDLE_TEST", "IDLE: Some tests FAILED (1 failures)");
+            return 1;
+        }
+        cpu_relax();
+    }
+
+    if (idle_bench(IDLE_METHOD_HLT) != 0) {
+        failures++;
+    }
+
+    if (idle_mwait_supported()) {
+        if (idle_bench(IDLE_METHOD_MWAIT) != 0) {
+            failures++;
+        }
+    } else {
+        klog_info("IDLE_TEST", "IDLE_BENCH method=mwait unsupported");
+    }
+
+    if (failures == 0) {
+        klog_info("IDLE_TEST", "IDLE: All tests PASSED");
+    } else {
+        klog_error("IDLE_TEST", "IDLE: Some tests FAILED (%d failures)", failures);
+    }
+    return failures;
+}
+
+#endif /* CONFIG_TESTS_IDLE */
+
+/* ============================================================================
+ * Test Wrappers
+ * ============================================================================ */
+
+#if CONFIG_TESTS_IDLE
+void test_idle_bsp_setup(void) {
+    if (test_should_run("idle")) {
+        test_run_by_name("idle");
+    }
+
+    /* Release CPU 1 (still waiting if the benchmark did not run) */
+    idle_test_state = IDLE_TEST_DONE;
+}
+#else
+void test_idle_bsp_setup(void) {
+    idle_test_state = IDLE_TEST_DONE;
+}
+
+void idle_test_ap_entry(void) { }
+#endif
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Idle Wakeup Benchmark
+
+Runs the kernel idle wakeup benchmark and reports the cross-CPU wakeup
+latency of each idle method from its "IDLE_BENCH method=..." line. The
+kernel must be built with CONFIG_TESTS_IDLE=1 (make tests-idle does).
+MWAIT is only measured where the guest CPU exposes it, e.g. under KVM
+with -overcommit cpu-pm=on.
+"""
+
+import sys
+import argparse
+from pathlib import Path
+
+# Add lib directory to path for imports
+lib_path = Path(__file__).parent.parent / "lib"
+sys.path.insert(0, str(lib_path))
+
+from test_framework import TestFramework, TestConfig, create_framework
+from output import TerminalOutput
+
+
+BENCH_PATTERN = (
+    r"IDLE_BENCH method=(\w+) rounds=(\d+) min_ns=(\d+) avg_ns=(\d+) max_ns=(\d+)"
+)
+
+
+def parse_arguments():
+    """Parse command line arguments."""
+    parser = argparse.ArgumentParser(
+        description="Idle Wakeup Benchmark",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+  %(prog)s              Run with 2 CPUs (default)
+  %(prog)s --verbose    Show detailed output
+        """
+    )
+    parser.add_argument(
+        "-v", "--verbose",
+        action="store_true",
+        help="Show detailed test output"
+    )
+    parser.add_argument(
+        "--keep-output",
+        action="store_true",
+        help="Keep test output files for debugging"
+    )
+    parser.add_argument(
+        "--timeout",
+        type=int,
+        default=5,
+        metavar="SECONDS",
+        help="QEMU timeout in seconds (default: 5)"
+    )
+    parser.add_argument(
+        "--cpus",
+        type=int,
+        default=2,
+        metavar="COUNT",
+        help="Number of CPUs to use (default: 2)"
+    )
+    parser.add_argument(
+        "-q", "--quiet",
+        action="store_true",
+        help="Suppress header/footer, show only result"
+    )
+    return parser.parse_args()
+
+
+def run_custom_checks(assertions, output):
+    """Run custom assertions for the idle benchmark.
+
+    Args:
+        assertions: Assertions object
+        output: TerminalOutput object
+
+    Returns:
+        True if all checks pass, False otherwise
+    """
+    all_passed = True
+
+    # Check 1: Benchmark completed
+    if assertions.assert_pattern_exists(r"IDLE: All tests PASSED"):
+        output.print_success("Idle benchmark completed")
+    else:
+        output.print_failure("Idle benchmark completed")
+        all_passed = False
+
+    # Check 2: HLT was measured, with sane values
+    results = {g[0]: g for g in assertions.get_pattern_groups(BENCH_PATTERN)}
+    if "hlt" in results:
+        output.print_success("HLT wakeup latency measured")
+    else:
+        output.print_failure("HLT wakeup latency measured")
+        all_passed = False
+
+    for method, g in results.items():
+        lo, avg, hi = int(g[2]), int(g[3]), int(g[4])
+        if not lo <= avg <= hi:
+            output.print_failure(
+                f"{method} latency consistent",
+                f"min_ns={lo} avg_ns={avg} max_ns={hi}"
+            )
+            all_passed = False
+            continue
+        print(f"  {method:5s}: min {lo} ns, avg {avg} ns, max {hi} ns")
+
+    # Report the comparison when both methods ran
+    if "hlt" in results and "mwait" in results:
+        hlt_avg, mwait_avg = int(results["hlt"][3]), int(results["mwait"][3])
+        if mwait_avg > 0:
+            print(f"  HLT/MWAIT average latency ratio: {hlt_avg / mwait_avg:.2f}")
+    elif assertions.assert_pattern_exists(r"IDLE_BENCH method=mwait unsupported"):
+        output.print_warning("MWAIT not exposed to the guest, only HLT measured")
+
+    return all_passed
+
+
+def main():
+    """Main test execution."""
+    args = parse_arguments()
+
+    output = TerminalOutput()
+
+    # Print test header (skip in quiet mode)
+    if not args.quiet:
+        output.print_header("Idle Wakeup Benchmark", width=40)
+        print(f"CPU Count: {args.cpus}")
+        print(f"Timeout: {args.timeout} seconds")
+        print()
+
+    # Create framework and run test
+    framework = create_framework(
+        test_name="idle",
+        cpu_count=args.cpus,
+        timeout=args.timeout,
+        verbose=args.verbose,
+        keep_output=args.keep_output,
+        quiet=args.quiet
+    )
+
+    # Check prerequisites
+    if not framework.check_prerequisites():
+        output.print_error("Prerequisites not met")
+        sys.exit(1)
+
+    # Run the test
+    if not args.quiet:
+        print(f"Starting QEMU with {args.cpus} CPU(s)...")
+        print()
+
+    if framework.run_test_with_assertions(
+        "idle",
+        lambda a: run_custom_checks(a, output),
+        cpu_count=args.cpus
+    ):
+        exit_code = framework.print_summary()
+    else:
+        exit_code = 1
+
+    sys.exit(exit_code)
+
+
+if __name__ == "__main__":
+    main()
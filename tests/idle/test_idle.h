@@ -0,0 +1,22 @@
+/* Emergence Kernel - Idle Test Wrapper Header */
+
+#ifndef TEST_IDLE_H
+#define TEST_IDLE_H
+
+/**
+ * test_idle_bsp_setup - BSP side of the idle wakeup benchmark
+ *
+ * Runs the benchmark if it is selected, then releases the APs waiting in
+ * idle_test_ap_entry(). Must be called by the BSP after AP startup.
+ */
+void test_idle_bsp_setup(void);
+
+/**
+ * idle_test_ap_entry - AP entry point for the idle wakeup benchmark
+ *
+ * Called by every AP before the other AP test hooks. CPU 1 acts as the
+ * waker until the BSP is done; other APs return at once.
+ */
+void idle_test_ap_entry(void);
+
+#endif /* TEST_IDLE_H */
@@ -0,0 +1,245 @@
+/* Emergence Kernel - Submission/Completion Ring Tests
+ *
+ * Drives the rings from the kernel side of their mapping, as a process
+ * would from its own, without entering ring 3.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "test_ioring.h"
+#include "kernel/test.h"
+#include "kernel/klog.h"
+#include "kernel/ioring.h"
+#include "kernel/process.h"
+#include "kernel/pmm.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/power.h"
+#include "arch/x86_64/include/syscall.h"
+#include "include/string.h"
+
+#if CONFIG_TESTS_IORING
+
+/* ============================================================================
+ * Test 1: Submission/Completion Rings
+ * ============================================================================ */
+
+#define IORING_TEST_BENCH_ROUNDS    16
+
+/* Queue an SQE the way a process would, through the ring's kernel address */
+static void ioring_test_queue(struct ioring_rings *rings, uint32_t opcode,
+                              uint64_t user_data) {
+    struct ioring_sqe *sqe = (struct ioring_sqe *)((uint8_t *)rings + rings->sqes_off) +
+                             (rings->sq_tail & rings->sq_mask);
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    __atomic_store_n(&rings->sq_tail, rings->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Find the ring block of @p's address space, at its kernel address */
+static struct ioring_rings *ioring_test_rings(process_t *p) {
+    vm_region_t *region = vm_find_region(p->vm, IORING_MAP_BASE);
+
+    return region != NULL ? (struct ioring_rings *)region->phys_base : NULL;
+}
+
+/**
+ * test_ioring_batch - Test batched syscalls through the rings
+ *
+ * Drives the rings from the kernel side of the mapping, as a process
+ * would from its own: a batch of allowed, forbidden and unknown
+ * operations, a full CQ, and teardown without leaks. The SQ poller does
+ * not run during the tests, so polled mode is only set up and torn down.
+ */
+static int test_ioring_batch(void) {
+    static const struct {
+        uint32_t opcode;
+        int64_t res;
+    } batch[] = {
+        { IORING_OP_NOP, 0 },
+        { SYS_getcpu, 0 },          /* NULL pointers: nothing to store */
+        { SYS_exit, -22 },          /* Not allowed in an SQE */
+        { 999, -22 },               /* Not a syscall */
+    };
+    process_t *p;
+    struct ioring_rings *rings;
+    struct ioring_cqe *cqes;
+    uint64_t free_pages, start, cycles = 0;
+    uint32_t i;
+    int round, ret = -1;
+
+    klog_info("IORING_TEST", "Test 1: Submission/completion rings...");
+
+    p = process_create("ioring_test", 0);
+    if (p == NULL) {
+        klog_error("IORING_TEST", "FAILED: No process");
+        return -1;
+    }
+    p->vm = vm_create_address_space(AS_SHARE_KERNEL);
+    if (p->vm == NULL) {
+        klog_error("IORING_TEST", "FAILED: No address space");
+        goto out;
+    }
+
+    if (ioring_setup(p, 0, 0) != -22 || ioring_setup(p, IORING_MAX_ENTRIES + 1, 0) != -22 ||
+        ioring_setup(p, 4, 0x80) != -22 || ioring_enter(p, 1, 0, 0) != -22) {
+        klog_error("IORING_TEST", "FAILED: Bad setup accepted");
+        goto out;
+    }
+
+    /* 3 entries round up to 4, with twice that many CQEs */
+    if (ioring_setup(p, 3, 0) != (int64_t)IORING_MAP_BASE || ioring_setup(p, 4, 0) != -16) {
+        klog_error("IORING_TEST", "FAILED: Rings not set up exactly once");
+        goto out;
+    }
+    rings = ioring_test_rings(p);
+    if (rings == NULL || rings->sq_mask != 3 || rings->cq_mask != 7 ||
+        (vm_lookup_page(p->vm, IORING_MAP_BASE) & (PT_USER | PT_WRITE)) != (PT_USER | PT_WRITE)) {
+        klog_error("IORING_TEST", "FAILED: Rings not mapped writable for user mode");
+        goto out;
+    }
+    cqes = (struct ioring_cqe *)((uint8_t *)rings + rings->cqes_off);
+
+    for (i = 0; i < sizeof(batch) / sizeof(batch[0]); i++) {
+        ioring_test_queue(rings, batch[i].opcode, 100 + i);
+    }
+    if (ioring_enter(p, 8, 4, IORING_ENTER_GETEVENTS) != 4 ||
+        rings->sq_head != 4 || rings->cq_tail != 4) {
+        klog_error("IORING_TEST", "FAILED: Batch not consumed (head %u, tail %u)",
+                   rings->sq_head, rings->cq_tail);
+        goto out;
+    }
+    for (i = 0; i < sizeof(batch) / sizeof(batch[0]); i++) {
+        if (cqes[i].user_data != 100 + i || cqes[i].res != batch[i].res) {
+            klog_error("IORING_TEST", "FAILED: CQE %u is %lu/%ld", i,
+                       (unsigned long)cqes[i].user_data, (long)cqes[i].res);
+            goto out;
+        }
+    }
+
+    /* Fill the CQ: what does not fit stays queued */
+    for (i = 0; i < 4; i++) {
+        ioring_test_queue(rings, IORING_OP_NOP, i);
+    }
+    ioring_enter(p, 4, 0, 0);
+    ioring_test_queue(rings, IORING_OP_NOP, 0);
+    if (rings->cq_tail != 8 || ioring_enter(p, 1, 0, 0) != -16 || rings->sq_head != 8) {
+        klog_error("IORING_TEST", "FAILED: Full CQ overwritten");
+        goto out;
+    }
+    __atomic_store_n(&rings->cq_head, 8, __ATOMIC_RELEASE);
+    if (ioring_enter(p, 1, 0, 0) != 1 || rings->cq_tail != 9) {
+        klog_error("IORING_TEST", "FAILED: SQE not run once the CQ drained");
+        goto out;
+    }
+    ioring_destroy(p);
+
+    /* Second time round the page tables exist: all that is left is the block */
+    free_pages = pmm_get_free_pages();
+    if (ioring_setup(p, IORING_MAX_ENTRIES, 0) != (int64_t)IORING_MAP_BASE) {
+        klog_error("IORING_TEST", "FAILED: Largest rings not set up");
+        goto out;
+    }
+    rings = ioring_test_rings(p);
+    for (round = 0; round < IORING_TEST_BENCH_ROUNDS; round++) {
+        for (i = 0; i < IORING_MAX_ENTRIES; i++) {
+            ioring_test_queue(rings, IORING_OP_NOP, i);
+        }
+        start = arch_rdtsc();
+        if (ioring_enter(p, IORING_MAX_ENTRIES, 0, 0) != IORING_MAX_ENTRIES) {
+            klog_error("IORING_TEST", "FAILED: Full batch not consumed");
+            goto out;
+        }
+        cycles += arch_rdtsc() - start;
+        __atomic_store_n(&rings->cq_head, rings->cq_tail, __ATOMIC_RELEASE);
+    }
+    ioring_destroy(p);
+    ioring_destroy(p);
+    if (pmm_get_free_pages() != free_pages || vm_find_region(p->vm, IORING_MAP_BASE) != NULL) {
+        klog_error("IORING_TEST", "FAILED: Leaked %ld pages",
+                   (long)(free_pages - pmm_get_free_pages()));
+        goto out;
+    }
+
+    /* Polled: enter leaves the SQ to the poller */
+    if (ioring_setup(p, 4, IORING_SETUP_SQPOLL) != (int64_t)IORING_MAP_BASE) {
+        klog_error("IORING_TEST", "FAILED: Polled rings not set up");
+        goto out;
+    }
+    rings = ioring_test_rings(p);
+    ioring_test_queue(rings, IORING_OP_NOP, 0);
+    if (ioring_enter(p, 1, 0, 0) != 1 || rings->sq_head != 0 ||
+        (rings->sq_flags & IORING_SQ_NEED_WAKEUP)) {
+        klog_error("IORING_TEST", "FAILED: Enter consumed a polled SQ");
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("IORING_TEST", "IORINGBENCH nop batch=%u cycles/op=%lu", IORING_MAX_ENTRIES,
+              (unsigned long)(cycles / (IORING_TEST_BENCH_ROUNDS * IORING_MAX_ENTRIES)));
+    klog_info("IORING_TEST", "Test 1: PASSED");
+out:
+    /* The poller, once it runs, frees the polled rings and its address
+     * space reference */
+    ioring_destroy(p);
+    if (p->parent != NULL) {
+        list_remove(&p->siblings);
+    }
+    process_reap(p);
+    return ret;
+}
+
+/* ============================================================================
+ * Main Test Runner
+ * ============================================================================ */
+
+/**
+ * run_ioring_tests - Run all submission/completion ring tests
+ *
+ * Returns: Number of test failures (0 = all passed)
+ */
+int run_ioring_tests(void) {
+    int failures = 0;
+
+    klog_info("IORING_TEST", "=== Submission/Completion Ring Test Suite ===");
+
+    /* Test 1: Submission/Completion Rings */
+    if (test_ioring_batch() != 0) {
+        failures++;
+    }
+
+    /* Summary */
+    if (failures == 0) {
+        klog_info("IORING_TEST", "IORING: All tests PASSED");
+    } else {
+        klog_error("IORING_TEST", "IORING: Some tests FAILED (%d failures)", failures);
+    }
+
+    return failures;
+}
+
+#endif /* CONFIG_TESTS_IORING */
+
+/* ============================================================================
+ * Test Wrapper
+ * ============================================================================ */
+
+#if CONFIG_TESTS_IORING
+void test_ioring(void) {
+    if (test_should_run("ioring")) {
+        if (!test_did_run("ioring")) {
+            int result = run_ioring_tests();
+            test_mark_run("ioring", result);
+            if (result == 0) {
+                klog_info("TEST", "PASSED: ioring");
+            } else {
+                klog_error("TEST", "FAILED: ioring (failures: %d)", result);
+                system_shutdown();
+            }
+        }
+    }
+}
+#else
+void test_ioring(void) { }
+#endif
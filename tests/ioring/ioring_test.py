@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""
+Submission/Completion Ring Test
+
+Runs the kernel ring test suite and reports the per-operation cost of a
+full batch of NOP SQEs from its "IORINGBENCH nop ..." line.
+"""
+
+import sys
+import argparse
+from pathlib import Path
+
+# Add lib directory to path for imports
+lib_path = Path(__file__).parent.parent / "lib"
+sys.path.insert(0, str(lib_path))
+
+from test_framework import TestFramework, TestConfig, create_framework
+from output import TerminalOutput
+
+
+BENCH_PATTERN = r"IORINGBENCH nop batch=(\d+) cycles/op=(\d+)"
+
+
+def parse_arguments():
+    """Parse command line arguments."""
+    parser = argparse.ArgumentParser(
+        description="Submission/Completion Ring Test",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+  %(prog)s              Run with 2 CPUs (default)
+  %(prog)s --verbose    Show detailed output
+        """
+    )
+    parser.add_argument(
+        "-v", "--verbose",
+        action="store_true",
+        help="Show detailed test output"
+    )
+    parser.add_argument(
+        "--keep-output",
+        action="store_true",
+        help="Keep test output files for debugging"
+    )
+    parser.add_argument(
+        "--timeout",
+        type=int,
+        default=5,
+        metavar="SECONDS",
+        help="QEMU timeout in seconds (default: 5)"
+    )
+    parser.add_argument(
+        "--cpus",
+        type=int,
+        default=2,
+        metavar="COUNT",
+        help="Number of CPUs to use (default: 2)"
+    )
+    parser.add_argument(
+        "-q", "--quiet",
+        action="store_true",
+        help="Suppress header/footer, show only result"
+    )
+    return parser.parse_args()
+
+
+def run_custom_checks(assertions, output):
+    """Run custom assertions for the ioring test.
+
+    Args:
+        assertions: Assertions object
+        output: TerminalOutput object
+
+    Returns:
+        True if all checks pass, False otherwise
+    """
+    all_passed = True
+
+    # Check 1: Kernel test suite passed
+    if assertions.assert_pattern_exists(r"IORING: All tests PASSED"):
+        output.print_success("Ring test suite passed")
+    else:
+        output.print_failure("Ring test suite passed")
+        all_passed = False
+
+    # Check 2: Batch benchmark result
+    bench = assertions.get_pattern_groups(BENCH_PATTERN)
+    if bench:
+        batch, cycles = int(bench[0][0]), int(bench[0][1])
+        output.print_success(f"Batch of {batch} NOPs: {cycles} cycles/op")
+    else:
+        output.print_failure("Batch benchmark result", "no IORINGBENCH line")
+        all_passed = False
+
+    return all_passed
+
+
+def main():
+    """Main test execution."""
+    args = parse_arguments()
+
+    output = TerminalOutput()
+
+    # Print test header (skip in quiet mode)
+    if not args.quiet:
+        output.print_header("Submission/Completion Ring Test", width=40)
+        print(f"CPU Count: {args.cpus}")
+        print(f"Timeout: {args.timeout} seconds")
+        print()
+
+    # Create framework and run test
+    framework = create_framework(
+        test_name="ioring",
+        cpu_count=args.cpus,
+        timeout=args.timeout,
+        verbose=args.verbose,
+        keep_output=args.keep_output,
+        quiet=args.quiet
+    )
+
+    # Check prerequisites
+    if not framework.check_prerequisites():
+        output.print_error("Prerequisites not met")
+        sys.exit(1)
+
+    # Run the test
+    if not args.quiet:
+        print(f"Starting QEMU with {args.cpus} CPU(s)...")
+        print()
+
+    if framework.run_test_with_assertions(
+        "ioring",
+        lambda a: run_custom_checks(a, output),
+        cpu_count=args.cpus
+    ):
+        exit_code = framework.print_summary()
+    else:
+        exit_code = 1
+
+    sys.exit(exit_code)
+
+
+if __name__ == "__main__":
+    main()
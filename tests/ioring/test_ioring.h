@@ -0,0 +1,15 @@
+/* Emergence Kernel - Submission/Completion Ring Test Wrapper Header */
+
+#ifndef TEST_IORING_H
+#define TEST_IORING_H
+
+/**
+ * test_ioring - Run the submission/completion ring tests
+ *
+ * Runs the suite if it is selected. Must be called by the BSP before the
+ * APs start: polled mode is only set up and torn down, so its poller
+ * thread must not get to run during the tests.
+ */
+void test_ioring(void);
+
+#endif /* TEST_IORING_H */
@@ -6,6 +6,7 @@
 #include "kernel/klog.h"
 #include "arch/x86_64/serial.h"
 #include "kernel/pcd.h"
+#include "arch/x86_64/smp.h"
 
 /* External monitor functions */
 extern void monitor_init(void);
@@ -121,7 +122,6 @@ int run_nk_invariants_tests(void) {
 
     /* Test 4: Verify CPU index is valid */
     klog_info("NK_INV_TEST", "Test 4: CPU identification");
-    extern int smp_get_cpu_index(void);
     cpu_index = smp_get_cpu_index();
     klog_info("NK_INV_TEST", "CPU index: %d", cpu_index);
 
@@ -54,9 +54,9 @@ void nk_smp_monitor_stress_ap_entry(void) {
         asm volatile("pause");
     }
 
-    /* Verify GS base points to our per_cpu_data */
+    /* Verify GS base points to our per-CPU area */
     uint64_t gs_base = rdmsr_gs_base();
-    uint64_t expected_base = (uint64_t)&per_cpu_data[cpu_id];
+    uint64_t expected_base = __per_cpu_offset[cpu_id];
 
     if (gs_base != expected_base) {
         klog_error("NK_SMP_STRESS_TEST", "CPU%d GS base mismatch! Expected %x got %x",
@@ -64,8 +64,8 @@ void nk_smp_monitor_stress_ap_entry(void) {
         errors_detected++;
     }
 
-    /* Verify per_cpu_data has correct cpu_index */
-    if (per_cpu_data[cpu_id].cpu_index != cpu_id) {
+    /* Verify our per-CPU area has the correct cpu_number */
+    if (smp_get_cpu_index() != cpu_id) {
         klog_error("NK_SMP_STRESS_TEST", "CPU%d cpu_index mismatch!", cpu_id);
         errors_detected++;
     }
@@ -128,7 +128,7 @@ int run_nk_smp_monitor_stress_tests(void) {
 
     /* Verify BSP GS base */
     uint64_t gs_base = rdmsr_gs_base();
-    uint64_t expected_base = (uint64_t)&per_cpu_data[cpu_id];
+    uint64_t expected_base = __per_cpu_offset[cpu_id];
     klog_info("NK_SMP_STRESS_TEST", "BSP (CPU0) GS base: %x (expected: %x)", gs_base, expected_base);
 
     if (gs_base != expected_base) {
@@ -138,12 +138,12 @@ int run_nk_smp_monitor_stress_tests(void) {
         klog_info("NK_SMP_STRESS_TEST", "BSP GS base correct (PASS)");
     }
 
-    /* Verify per_cpu_data initialization */
-    klog_info("NK_SMP_STRESS_TEST", "Verifying per_cpu_data initialization:");
+    /* Verify per-CPU area initialization */
+    klog_info("NK_SMP_STRESS_TEST", "Verifying per-CPU area initialization:");
     for (int i = 0; i < cpu_count; i++) {
-        klog_info("NK_SMP_STRESS_TEST", "  per_cpu_data[%d].cpu_index = %d", i, per_cpu_data[i].cpu_index);
+        klog_info("NK_SMP_STRESS_TEST", "  per_cpu(cpu_number, %d) = %d", i, per_cpu(cpu_number, i));
 
-        if (per_cpu_data[i].cpu_index != i) {
+        if (per_cpu(cpu_number, i) != i) {
             klog_error("NK_SMP_STRESS_TEST", "  ERROR: cpu_index mismatch!");
             errors_detected++;
         }
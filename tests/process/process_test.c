@@ -0,0 +1,526 @@
+/* Emergence Kernel - Process Tests
+ *
+ * Tests for the pieces processes are built from: PID and TID allocation,
+ * file descriptor tables, and address spaces built straight from an image
+ * or from an ELF program found in an initramfs.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "test_process.h"
+#include "kernel/test.h"
+#include "kernel/klog.h"
+#include "kernel/thread.h"
+#include "kernel/idr.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include "kernel/pmm.h"
+#include "kernel/elf.h"
+#include "kernel/initramfs.h"
+#include "arch/x86_64/power.h"
+#include "include/string.h"
+
+#if CONFIG_TESTS_PROCESS
+
+#define TEST_STACK_SIZE 4096
+
+/* Entry point of threads that are created but never run */
+static void test_thread_entry(void *arg) {
+    (void)arg;
+}
+
+/* ============================================================================
+ * Test 1: ID Allocation
+ * ============================================================================ */
+
+static struct idr test_idr;
+
+/**
+ * test_idr_alloc - Test ID allocation, recycling and lookup
+ *
+ * IDs come out in order from the cursor, a freed ID is not reused until
+ * the allocator wraps, a full allocator fails, and TIDs map to threads
+ * until they are destroyed.
+ */
+static int test_idr_alloc(void) {
+    static int marker;
+    thread_t *t, *ref;
+    int found, tid, i, ret = -1;
+
+    klog_info("PROCESS_TEST", "Test 1: ID allocation...");
+
+    idr_init(&test_idr, 1);
+
+    if (idr_alloc(&test_idr, &marker) != 1 || idr_alloc(&test_idr, NULL) != 2 ||
+        idr_find(&test_idr, 1) != &marker || idr_find(&test_idr, 2) != NULL ||
+        idr_find(&test_idr, 0) != NULL || idr_find(&test_idr, IDR_MAX) != NULL) {
+        klog_error("PROCESS_TEST", "FAILED: First IDs or lookups wrong");
+        goto out;
+    }
+    if (idr_replace(&test_idr, 2, &marker) != NULL || idr_find(&test_idr, 2) != &marker) {
+        klog_error("PROCESS_TEST", "FAILED: idr_replace() did not map ID 2");
+        goto out;
+    }
+
+    /* A freed ID waits until the cursor wraps */
+    idr_remove(&test_idr, 1);
+    if (idr_find(&test_idr, 1) != NULL || idr_alloc(&test_idr, NULL) != 3) {
+        klog_error("PROCESS_TEST", "FAILED: Freed ID reused before wrapping");
+        goto out;
+    }
+
+    for (i = 4; i < IDR_MAX; i++) {
+        if (idr_alloc(&test_idr, NULL) != i) {
+            klog_error("PROCESS_TEST", "FAILED: Expected ID %d", i);
+            goto out;
+        }
+    }
+    if (idr_alloc(&test_idr, NULL) != 1 || idr_alloc(&test_idr, NULL) != -1 ||
+        idr_count(&test_idr) != IDR_MAX - 1) {
+        klog_error("PROCESS_TEST", "FAILED: Wrap-around or full allocator wrong");
+        goto out;
+    }
+    idr_remove(&test_idr, 1000);
+    if (idr_alloc(&test_idr, NULL) != 1000) {
+        klog_error("PROCESS_TEST", "FAILED: Freed ID not reused when full");
+        goto out;
+    }
+
+    t = thread_create("tid_test", test_thread_entry, NULL, TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    if (t == NULL) {
+        klog_error("PROCESS_TEST", "FAILED: Could not create thread");
+        goto out;
+    }
+    tid = t->tid;
+    ref = thread_find_by_tid(tid);
+    t->state = THREAD_TERMINATED;
+    thread_destroy(t);
+
+    /* The lookup's reference keeps the structure until it is dropped */
+    found = ref == t && ref->tid == tid;
+    thread_put(ref);
+    if (!found || thread_find_by_tid(tid) != NULL) {
+        klog_error("PROCESS_TEST", "FAILED: TID %d lookup wrong", tid);
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("PROCESS_TEST", "Test 1: PASSED");
+out:
+    idr_destroy(&test_idr);
+    return ret;
+}
+
+/* ============================================================================
+ * Test 2: File Descriptor Tables
+ * ============================================================================ */
+
+#define TEST_NR_FDS     12
+
+/**
+ * test_fdtable - Test descriptor allocation and copy-on-fork sharing
+ *
+ * Descriptors past the inline part must grow the table, closed ones
+ * must be reused lowest first, and a table shared by fork must be
+ * copied by the first side that changes it.
+ */
+static int test_fdtable(void) {
+    static int files[TEST_NR_FDS + 1];
+    process_t *parent, *child;
+    int fd, ret = -1;
+
+    klog_info("PROCESS_TEST", "Test 2: File descriptor tables...");
+
+    parent = process_create("fd_parent", 0);
+    child = process_create("fd_child", 0);
+    if (parent == NULL || child == NULL) {
+        klog_error("PROCESS_TEST", "FAILED: Could not create processes");
+        goto out;
+    }
+
+    for (fd = 0; fd < TEST_NR_FDS; fd++) {
+        if (process_fd_install(parent, &files[fd], 0) != fd) {
+            klog_error("PROCESS_TEST", "FAILED: Expected descriptor %d", fd);
+            goto out;
+        }
+    }
+    if (parent->files->chunks[0] == NULL || process_fd_get(parent, TEST_NR_FDS - 1) !=
+        &files[TEST_NR_FDS - 1] || process_fd_get(parent, TEST_NR_FDS) != NULL) {
+        klog_error("PROCESS_TEST", "FAILED: Table did not grow past %d inline descriptors",
+                   FDTABLE_INLINE_FDS);
+        goto out;
+    }
+    if (process_fd_close(parent, 3) != 0 || process_fd_close(parent, 3) != -1 ||
+        process_fd_install(parent, &files[3], 0) != 3) {
+        klog_error("PROCESS_TEST", "FAILED: Closed descriptor not reused");
+        goto out;
+    }
+
+    /* What process_fork() does */
+    fdtable_put(child->files);
+    child->files = fdtable_share(parent->files);
+
+    if (process_fd_get(child, 5) != &files[5] || process_fd_close(child, 5) != 0 ||
+        child->files == parent->files) {
+        klog_error("PROCESS_TEST", "FAILED: Child did not copy the shared table");
+        goto out;
+    }
+    if (process_fd_get(child, 5) != NULL || process_fd_get(parent, 5) != &files[5] ||
+        parent->files->refcount != 1 || child->files->nr_open != TEST_NR_FDS - 1) {
+        klog_error("PROCESS_TEST", "FAILED: Close in child changed the parent");
+        goto out;
+    }
+    if (process_fd_install(child, &files[TEST_NR_FDS], 0) != 5 ||
+        process_fd_get(parent, 5) != &files[5]) {
+        klog_error("PROCESS_TEST", "FAILED: Install in child changed the parent");
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("PROCESS_TEST", "Test 2: PASSED (process_t %lu bytes, table %lu bytes)",
+              (unsigned long)sizeof(process_t), (unsigned long)sizeof(struct fdtable));
+out:
+    if (child != NULL) {
+        process_reap(child);
+    }
+    if (parent != NULL) {
+        process_reap(parent);
+    }
+    return ret;
+}
+
+/* ============================================================================
+ * Test 3: Spawning From an Image
+ * ============================================================================ */
+
+/**
+ * test_spawn - Test building a process straight from an image
+ *
+ * The child must get a fresh address space holding only the image, a
+ * stack laid out with argc and argv and the three vDSO pages, and a
+ * failed spawn must give back every page it took.
+ */
+static int test_spawn(void) {
+    static const uint8_t image[] = { 0x90, 0x90, 0xeb, 0xfe };   /* nop; nop; jmp . */
+    static const char *const argv[] = { "spawn_test", "arg1", NULL };
+    static const char *too_many[SPAWN_ARG_MAX + 2];
+    process_t *parent = process_get_current();
+    process_t *child;
+    thread_t *t;
+    vm_region_t *text, *stack;
+    uint64_t *sp, free_pages;
+    int i, ret = -1;
+
+    klog_info("PROCESS_TEST", "Test 3: Spawning from an image...");
+
+    child = process_spawn("spawn_test", image, sizeof(image), argv, 0);
+    if (child == NULL || child->main_thread == NULL) {
+        klog_error("PROCESS_TEST", "FAILED: process_spawn returned no process");
+        return -1;
+    }
+    t = child->main_thread;
+
+    text = vm_find_region(child->vm, SPAWN_LOAD_BASE);
+    stack = vm_find_region(child->vm, USER_STACK_BASE - 1);
+    if ((parent != NULL && child->vm == parent->vm) || child->vm->region_count != 5 ||
+        text == NULL || stack == NULL || text->page_order < 0 || stack->page_order < 0) {
+        klog_error("PROCESS_TEST", "FAILED: Child address space not built from the image");
+        goto out;
+    }
+    for (i = 0; i < (int)sizeof(image); i++) {
+        if (((uint8_t *)text->phys_base)[i] != image[i]) {
+            break;
+        }
+    }
+    if (i != (int)sizeof(image) || ((uint8_t *)text->phys_base)[i] != 0) {
+        klog_error("PROCESS_TEST", "FAILED: Image not copied into the text region");
+        goto out;
+    }
+
+    /* Read the initial stack through its kernel mapping */
+    if ((t->user_rsp & 0xF) != 0 || t->user_rsp < stack->start || t->user_rsp >= stack->end) {
+        klog_error("PROCESS_TEST", "FAILED: Bad initial RSP %p", (void *)t->user_rsp);
+        goto out;
+    }
+    sp = (uint64_t *)(stack->phys_base + (t->user_rsp - stack->start));
+    if (sp[0] != 2 || sp[3] != 0 ||
+        strcmp((char *)(stack->phys_base + (sp[1] - stack->start)), argv[0]) != 0 ||
+        strcmp((char *)(stack->phys_base + (sp[2] - stack->start)), argv[1]) != 0) {
+        klog_error("PROCESS_TEST", "FAILED: argc/argv not laid out on the stack");
+        goto out;
+    }
+
+    /* A spawn failing after the stack is built must not leak pages */
+    for (i = 0; i < SPAWN_ARG_MAX + 1; i++) {
+        too_many[i] = "x";
+    }
+    free_pages = pmm_get_free_pages();
+    if (process_spawn("spawn_fail", image, sizeof(image), too_many, 0) != NULL ||
+        pmm_get_free_pages() != free_pages) {
+        klog_error("PROCESS_TEST", "FAILED: Oversized argv not rejected cleanly");
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("PROCESS_TEST", "Test 3: PASSED (PID %d, RSP %p)", child->pid, (void *)t->user_rsp);
+out:
+    scheduler_remove_thread(t);
+    process_remove_thread(child, t);
+    thread_destroy(t);
+    if (child->parent != NULL) {
+        list_remove(&child->siblings);
+    }
+    process_reap(child);
+    return ret;
+}
+
+/* ============================================================================
+ * Test 4: Loading ELF Programs
+ * ============================================================================ */
+
+#define ELF_TEST_TEXT   0x401000ULL
+#define ELF_TEST_DATA   0x402000ULL
+#define ELF_TEST_FRAME(pte)  ((pte) & ~(uint64_t)(PAGE_SIZE - 1) & ~PT_NX)
+
+/* Executable image: headers, one text page, one data page (+ one bss page) */
+static uint8_t elf_test_image[3 * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+/* Archive holding elf_test_image as "init", laid out as mkinitramfs.py does */
+static uint8_t elf_test_archive[5 * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+static void elf_test_build_image(void) {
+    elf64_ehdr_t *ehdr = (elf64_ehdr_t *)elf_test_image;
+    elf64_phdr_t *ph = (elf64_phdr_t *)(ehdr + 1);
+
+    memset(elf_test_image, 0, sizeof(elf_test_image));
+    memcpy(ehdr->e_ident, ELF_MAGIC, sizeof(ELF_MAGIC) - 1);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_type = ET_EXEC;
+    ehdr->e_machine = EM_X86_64;
+    ehdr->e_entry = ELF_TEST_TEXT;
+    ehdr->e_phoff = sizeof(*ehdr);
+    ehdr->e_phentsize = sizeof(*ph);
+    ehdr->e_phnum = 2;
+
+    ph[0].p_type = PT_LOAD;
+    ph[0].p_flags = PF_R | PF_X;
+    ph[0].p_offset = PAGE_SIZE;
+    ph[0].p_vaddr = ELF_TEST_TEXT;
+    ph[0].p_filesz = ph[0].p_memsz = PAGE_SIZE;
+
+    ph[1].p_type = PT_LOAD;
+    ph[1].p_flags = PF_R | PF_W;
+    ph[1].p_offset = 2 * PAGE_SIZE;
+    ph[1].p_vaddr = ELF_TEST_DATA;
+    ph[1].p_filesz = PAGE_SIZE;
+    ph[1].p_memsz = 2 * PAGE_SIZE;
+
+    elf_test_image[PAGE_SIZE] = 0xeb;           /* jmp . */
+    elf_test_image[PAGE_SIZE + 1] = 0xfe;
+    elf_test_image[2 * PAGE_SIZE] = 0x5a;       /* First data byte */
+}
+
+/* Append a newc entry whose data starts at @data_offset */
+static size_t elf_test_add_entry(size_t offset, const char *name, uint32_t mode,
+                                 size_t data_offset, size_t size) {
+    static const char hex[] = "0123456789ABCDEF";
+    char *header = (char *)elf_test_archive + offset;
+    size_t namesize = data_offset - offset - 110;
+    uint32_t fields[13] = { 1, mode, 0, 0, 1, 0, (uint32_t)size, 0, 0, 0, 0,
+                            (uint32_t)namesize, 0 };
+    int i, j;
+
+    /* minilibc's printf has no field widths */
+    memcpy(header, "070701", 6);
+    for (i = 0; i < 13; i++) {
+        for (j = 0; j < 8; j++) {
+            header[6 + i * 8 + j] = hex[(fields[i] >> (28 - 4 * j)) & 0xF];
+        }
+    }
+    memset(header + 110, 0, namesize);
+    strcpy(header + 110, name);
+    return (data_offset + size + 3) & ~(size_t)3;
+}
+
+/**
+ * test_elf_load - Test mapping an executable straight from its image
+ *
+ * Segments must map nothing until touched. Text must then map the
+ * image's own frame, data must share it until written and bss must
+ * come up zeroed, with every page given back when the address space
+ * goes. Also finds the image in a newc archive.
+ */
+static int test_elf_load(void) {
+    struct initramfs_file file;
+    address_space_t *as;
+    uint64_t entry, pte, free_pages;
+    uint8_t *page;
+    size_t end;
+    int ret = -1;
+
+    klog_info("PROCESS_TEST", "Test 4: Loading ELF programs...");
+
+    elf_test_build_image();
+    end = elf_test_add_entry(0, "init", INITRAMFS_S_IFREG | 0755, PAGE_SIZE,
+                             sizeof(elf_test_image));
+    elf_test_add_entry(end, "TRAILER!!!", 0, end + 124, 0);
+    memcpy(elf_test_archive + PAGE_SIZE, elf_test_image, sizeof(elf_test_image));
+
+    if (initramfs_find(elf_test_archive, sizeof(elf_test_archive), "/init", &file) != 0 ||
+        file.data != elf_test_archive + PAGE_SIZE || file.size != sizeof(elf_test_image) ||
+        initramfs_find(elf_test_archive, sizeof(elf_test_archive), "/sbin/init", &file) == 0) {
+        klog_error("PROCESS_TEST", "FAILED: initramfs lookup");
+        return -1;
+    }
+
+    free_pages = pmm_get_free_pages();
+    as = vm_create_address_space(AS_SHARE_KERNEL);
+    if (as == NULL) {
+        klog_error("PROCESS_TEST", "FAILED: No address space");
+        return -1;
+    }
+
+    /* Load from the archive, where the frames must be shared from */
+    if (elf_load(as, file.data, file.size, &entry) != 0 || entry != ELF_TEST_TEXT ||
+        vm_lookup_page(as, ELF_TEST_TEXT) != 0 || vm_lookup_page(as, ELF_TEST_DATA) != 0) {
+        klog_error("PROCESS_TEST", "FAILED: elf_load did not map lazily");
+        goto out;
+    }
+
+    /* Text: the image's own frame, never writable */
+    if (vm_fault(as, ELF_TEST_TEXT, 0) != 0 ||
+        ELF_TEST_FRAME(vm_lookup_page(as, ELF_TEST_TEXT)) !=
+            (uint64_t)elf_test_archive + 2 * PAGE_SIZE ||
+        vm_fault(as, ELF_TEST_TEXT, 1) != -14) {
+        klog_error("PROCESS_TEST", "FAILED: Text not mapped from the image");
+        goto out;
+    }
+
+    /* Data: shared read-only until the first write, then a private copy */
+    if (vm_fault(as, ELF_TEST_DATA, 0) != 0) {
+        klog_error("PROCESS_TEST", "FAILED: Data read fault");
+        goto out;
+    }
+    pte = vm_lookup_page(as, ELF_TEST_DATA);
+    if (ELF_TEST_FRAME(pte) != (uint64_t)elf_test_archive + 3 * PAGE_SIZE || (pte & PT_WRITE)) {
+        klog_error("PROCESS_TEST", "FAILED: Data not shared read-only before a write");
+        goto out;
+    }
+    if (vm_fault(as, ELF_TEST_DATA, 1) != 0) {
+        klog_error("PROCESS_TEST", "FAILED: Data write fault");
+        goto out;
+    }
+    pte = vm_lookup_page(as, ELF_TEST_DATA);
+    page = (uint8_t *)ELF_TEST_FRAME(pte);
+    if (!(pte & PT_WRITE) || page == elf_test_archive + 3 * PAGE_SIZE || page[0] != 0x5a) {
+        klog_error("PROCESS_TEST", "FAILED: Data write did not make a private copy");
+        goto out;
+    }
+    page[0] = 0xa5;
+    if (elf_test_archive[3 * PAGE_SIZE] != 0x5a) {
+        klog_error("PROCESS_TEST", "FAILED: Write reached the image");
+        goto out;
+    }
+
+    /* Bss: a fresh zeroed page */
+    if (vm_fault(as, ELF_TEST_DATA + PAGE_SIZE, 1) != 0) {
+        klog_error("PROCESS_TEST", "FAILED: Bss fault");
+        goto out;
+    }
+    page = (uint8_t *)ELF_TEST_FRAME(vm_lookup_page(as, ELF_TEST_DATA + PAGE_SIZE));
+    for (end = 0; end < PAGE_SIZE && page[end] == 0; end++) {
+    }
+    if (end != PAGE_SIZE) {
+        klog_error("PROCESS_TEST", "FAILED: Bss page not zeroed");
+        goto out;
+    }
+
+    /* Nothing but the loader's own mappings may be touched */
+    if (vm_fault(as, ELF_TEST_DATA + 2 * PAGE_SIZE, 0) != -14) {
+        klog_error("PROCESS_TEST", "FAILED: Fault outside the segments resolved");
+        goto out;
+    }
+
+    ret = 0;
+out:
+    vm_destroy_address_space(as);
+    if (ret == 0 && pmm_get_free_pages() != free_pages) {
+        klog_error("PROCESS_TEST", "FAILED: Leaked %ld pages",
+                   (long)(free_pages - pmm_get_free_pages()));
+        ret = -1;
+    }
+    if (ret == 0) {
+        klog_info("PROCESS_TEST", "Test 4: PASSED");
+    }
+    return ret;
+}
+
+/* ============================================================================
+ * Main Test Runner
+ * ============================================================================ */
+
+/**
+ * run_process_tests - Run all process tests
+ *
+ * Returns: Number of test failures (0 = all passed)
+ */
+int run_process_tests(void) {
+    int failures = 0;
+
+    klog_info("PROCESS_TEST", "=== Process Test Suite ===");
+
+    /* Test 1: ID Allocation */
+    if (test_idr_alloc() != 0) {
+        failures++;
+    }
+
+    /* Test 2: File Descriptor Tables */
+    if (test_fdtable() != 0) {
+        failures++;
+    }
+
+    /* Test 3: Spawning From an Image */
+    if (test_spawn() != 0) {
+        failures++;
+    }
+
+    /* Test 4: Loading ELF Programs */
+    if (test_elf_load() != 0) {
+        failures++;
+    }
+
+    /* Summary */
+    if (failures == 0) {
+        klog_info("PROCESS_TEST", "PROCESS: All tests PASSED");
+    } else {
+        klog_error("PROCESS_TEST", "PROCESS: Some tests FAILED (%d failures)", failures);
+    }
+
+    return failures;
+}
+
+#endif /* CONFIG_TESTS_PROCESS */
+
+/* ============================================================================
+ * Test Wrapper
+ * ============================================================================ */
+
+#if CONFIG_TESTS_PROCESS
+void test_process(void) {
+    if (test_should_run("process")) {
+        if (!test_did_run("process")) {
+            int result = run_process_tests();
+            test_mark_run("process", result);
+            if (result == 0) {
+                klog_info("TEST", "PASSED: process");
+            } else {
+                klog_error("TEST", "FAILED: process (failures: %d)", result);
+                system_shutdown();
+            }
+        }
+    }
+}
+#else
+void test_process(void) { }
+#endif
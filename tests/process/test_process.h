@@ -0,0 +1,15 @@
+/* Emergence Kernel - Process Test Wrapper Header */
+
+#ifndef TEST_PROCESS_H
+#define TEST_PROCESS_H
+
+/**
+ * test_process - Run the process subsystem tests
+ *
+ * Runs the suite if it is selected. Must be called by the BSP after
+ * scheduler_init() and before the APs start, while page tables may
+ * still be written directly.
+ */
+void test_process(void);
+
+#endif /* TEST_PROCESS_H */
@@ -1,6 +1,6 @@
 /* Emergence Kernel - Scheduler Tests
  *
- * Tests for thread creation and FIFO scheduling, and context switching.
+ * Tests for thread creation, fair scheduling, and context switching.
  */
 
 #include <stdint.h>
@@ -9,9 +9,21 @@
 #include "kernel/klog.h"
 #include "kernel/thread.h"
 #include "kernel/scheduler.h"
+#include "kernel/rbtree.h"
+#include "kernel/wait.h"
+#include "kernel/sync.h"
+#include "kernel/timer.h"
+#include "kernel/stack.h"
+#include "kernel/workqueue.h"
+#include "kernel/fiber.h"
 #include "arch/x86_64/smp.h"
+#include "arch/x86_64/cpu.h"
+#include "arch/x86_64/tsc.h"
 #include "arch/x86_64/power.h"
+#include "arch/x86_64/include/cpu_context.h"
 #include "include/string.h"
+#include "include/spinlock.h"
+#include "include/preempt.h"
 
 #if CONFIG_TESTS_SCHED
 
@@ -19,6 +31,15 @@
 #define NUM_TEST_THREADS 3
 #define TEST_STACK_SIZE 4096
 
+/* Real-time latency test configuration */
+#define NUM_RT_THREADS 8
+#define NUM_RT_FAIR_LOAD 8
+#define RT_LATENCY_ITERATIONS 256
+#define RT_LATENCY_MAX_CYCLES 1000000ULL  /* Generous bound for emulated CPUs */
+
+/* Wait queue test configuration */
+#define NUM_WAIT_THREADS 2
+
 /* Test state */
 static volatile int test_threads_created = 0;
 static volatile int test_threads_run[NUM_TEST_THREADS];
@@ -104,8 +125,8 @@ static int test_fifo_ordering(void) {
         test_threads_created++;
     }
 
-    /* Verify runqueue state */
-    runqueue_t *rq = scheduler_get_runqueue();
+    /* Verify runqueue state (threads that never ran go to the local CPU) */
+    runqueue_t *rq = scheduler_get_runqueue(smp_get_cpu_index());
     if (rq == NULL) {
         klog_error("SCHED_TEST", "FAILED: Could not get runqueue");
         return -1;
@@ -117,14 +138,38 @@ static int test_fifo_ordering(void) {
         return -1;
     }
 
+    if (scheduler_get_nr_running() != NUM_TEST_THREADS) {
+        klog_error("SCHED_TEST", "FAILED: Expected %d runnable threads system-wide, got %d",
+                 NUM_TEST_THREADS, scheduler_get_nr_running());
+        return -1;
+    }
+
+    /* New threads share min_vruntime, so ties must keep creation order */
+    i = 0;
+    struct rb_node *node;
+    for (node = rb_first_cached(&rq->cfs.timeline); node != NULL; node = rb_next(node)) {
+        if (i >= NUM_TEST_THREADS || rb_entry(node, thread_t, se.run_node) != threads[i]) {
+            klog_error("SCHED_TEST", "FAILED: Runqueue out of FIFO order at position %d", i);
+            return -1;
+        }
+        i++;
+    }
+
     klog_info("SCHED_TEST", "Runqueue has %d threads (correct)", rq->nr_running);
 
     /* Clean up */
     for (i = 0; i < NUM_TEST_THREADS; i++) {
+        scheduler_remove_thread(threads[i]);
         threads[i]->state = THREAD_TERMINATED;
         thread_destroy(threads[i]);
     }
 
+    if (rq->nr_running != 0) {
+        klog_error("SCHED_TEST", "FAILED: Runqueue not empty after removal (%d left)",
+                 rq->nr_running);
+        return -1;
+    }
+
     klog_info("SCHED_TEST", "Test 2: PASSED");
     return 0;
 }
@@ -212,6 +257,1195 @@ static int test_context_switch(void) {
     return 0;
 }
 
+/**
+ * test_fair_weights - Test nice weights and vruntime ordering
+ */
+static int test_fair_weights(void) {
+    static const uint64_t offsets[NUM_TEST_THREADS] = { 3000000, 1000000, 2000000 };
+    static const int order[NUM_TEST_THREADS] = { 1, 2, 0 };
+    thread_t *threads[NUM_TEST_THREADS];
+    runqueue_t *rq = scheduler_get_runqueue(smp_get_cpu_index());
+    uint64_t base, expected_load = 0;
+    struct rb_node *node;
+    char name[16];
+    int i, ret = -1;
+
+    klog_info("SCHED_TEST", "Test 5: Fair weights and vruntime ordering...");
+
+    /* Lower nice must accumulate vruntime more slowly */
+    if (!(sched_calc_delta_fair(NSEC_PER_MSEC, 335) > NSEC_PER_MSEC &&
+          sched_calc_delta_fair(NSEC_PER_MSEC, NICE_0_LOAD) == NSEC_PER_MSEC &&
+          sched_calc_delta_fair(NSEC_PER_MSEC, 3121) < NSEC_PER_MSEC)) {
+        klog_error("SCHED_TEST", "FAILED: vruntime scaling not inversely proportional to weight");
+        return -1;
+    }
+
+    base = rq->cfs.min_vruntime;
+    for (i = 0; i < NUM_TEST_THREADS; i++) {
+        snprintf(name, sizeof(name), "fair_thread_%d", i);
+        threads[i] = thread_create(name, test_thread_entry, (void *)(uintptr_t)i,
+                                  TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+        if (threads[i] == NULL) {
+            klog_error("SCHED_TEST", "FAILED: Could not create thread %d", i);
+            while (--i >= 0) {
+                threads[i]->state = THREAD_TERMINATED;
+                thread_destroy(threads[i]);
+            }
+            return -1;
+        }
+
+        /* Pretend the threads ran before: queue order must follow vruntime,
+         * not insertion order */
+        threads[i]->se.vruntime = base + offsets[i];
+        scheduler_add_thread(threads[i]);
+    }
+
+    if (sched_set_nice(threads[0], -5) != 0 || sched_set_nice(threads[2], 5) != 0 ||
+        sched_set_nice(threads[1], NICE_MAX + 1) == 0) {
+        klog_error("SCHED_TEST", "FAILED: sched_set_nice range checking");
+        goto out;
+    }
+
+    for (i = 0; i < NUM_TEST_THREADS; i++) {
+        expected_load += threads[i]->se.weight;
+    }
+    if (rq->cfs.load_weight != expected_load || sched_get_nice(threads[0]) != -5) {
+        klog_error("SCHED_TEST", "FAILED: Runqueue load %lu, expected %lu",
+                 (unsigned long)rq->cfs.load_weight, (unsigned long)expected_load);
+        goto out;
+    }
+
+    i = 0;
+    for (node = rb_first_cached(&rq->cfs.timeline); node != NULL; node = rb_next(node)) {
+        if (i >= NUM_TEST_THREADS || rb_entry(node, thread_t, se.run_node) != threads[order[i]]) {
+            klog_error("SCHED_TEST", "FAILED: Timeline not ordered by vruntime at position %d", i);
+            goto out;
+        }
+        i++;
+    }
+
+    ret = 0;
+    klog_info("SCHED_TEST", "Test 5: PASSED");
+
+out:
+    for (i = 0; i < NUM_TEST_THREADS; i++) {
+        scheduler_remove_thread(threads[i]);
+        threads[i]->state = THREAD_TERMINATED;
+        thread_destroy(threads[i]);
+    }
+    return ret;
+}
+
+/**
+ * test_rt_wakeup_latency - Test RT class priority and worst-case wakeup latency
+ *
+ * With the fair class loaded, repeatedly wakes RT threads of varying
+ * priority and measures, in TSC cycles, the time from scheduler_add_thread()
+ * until the scheduler's pick returns the woken thread. The pick must always
+ * be the highest-priority RT thread, ahead of every fair thread.
+ */
+static int test_rt_wakeup_latency(void) {
+    thread_t *fair[NUM_RT_FAIR_LOAD];
+    thread_t *rt[NUM_RT_THREADS];
+    runqueue_t *rq = scheduler_get_runqueue(smp_get_cpu_index());
+    uint64_t worst = 0, total = 0;
+    int nr_fair = 0, nr_rt = 0;
+    char name[16];
+    int i, iter, ret = -1;
+
+    klog_info("SCHED_TEST", "Test 6: RT priority and wakeup latency...");
+
+    if (sched_setscheduler(NULL, SCHED_FIFO, 0) == 0) {
+        klog_error("SCHED_TEST", "FAILED: sched_setscheduler accepted NULL thread");
+        return -1;
+    }
+
+    for (i = 0; i < NUM_RT_FAIR_LOAD; i++, nr_fair++) {
+        snprintf(name, sizeof(name), "rt_load_%d", i);
+        fair[i] = thread_create(name, test_thread_entry, (void *)0,
+                               TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+        if (fair[i] == NULL) {
+            klog_error("SCHED_TEST", "FAILED: Could not create fair thread %d", i);
+            goto out;
+        }
+        scheduler_add_thread(fair[i]);
+    }
+
+    /* Priorities spread over the whole range, even ones FIFO, odd ones RR */
+    for (i = 0; i < NUM_RT_THREADS; i++, nr_rt++) {
+        int prio = (i * 37) % SCHED_RT_PRIO_NR;
+        int policy = (i & 1) ? THREAD_FLAG_SCHED_RR : THREAD_FLAG_SCHED_FIFO;
+
+        snprintf(name, sizeof(name), "rt_%d", i);
+        rt[i] = thread_create(name, test_thread_entry, (void *)0, TEST_STACK_SIZE,
+                             THREAD_FLAG_KERNEL | policy | THREAD_FLAG_RT_PRIO(prio));
+        if (rt[i] == NULL) {
+            klog_error("SCHED_TEST", "FAILED: Could not create RT thread %d", i);
+            goto out;
+        }
+        if (sched_getscheduler(rt[i]) != ((i & 1) ? SCHED_RR : SCHED_FIFO) ||
+            rt[i]->rt.prio != prio) {
+            klog_error("SCHED_TEST", "FAILED: RT creation flags not applied to thread %d", i);
+            goto out;
+        }
+    }
+
+    for (iter = 0; iter < RT_LATENCY_ITERATIONS; iter++) {
+        thread_t *woken = rt[iter % NUM_RT_THREADS];
+        thread_t *picked;
+        uint64_t start, cycles;
+
+        /* Keep a few lower-priority RT threads queued behind the woken one */
+        for (i = 0; i < NUM_RT_THREADS; i++) {
+            if (rt[i] != woken && rt[i]->rt.prio < woken->rt.prio) {
+                scheduler_add_thread(rt[i]);
+            }
+        }
+
+        start = arch_rdtsc();
+        scheduler_add_thread(woken);
+        picked = scheduler_peek_next(rq);
+        cycles = arch_rdtsc() - start;
+
+        for (i = 0; i < NUM_RT_THREADS; i++) {
+            scheduler_remove_thread(rt[i]);
+        }
+
+        if (picked != woken) {
+            klog_error("SCHED_TEST", "FAILED: Woke prio %d, scheduler picked '%s'",
+                     woken->rt.prio, picked ? picked->name : "(none)");
+            goto out;
+        }
+
+        total += cycles;
+        if (cycles > worst) {
+            worst = cycles;
+        }
+    }
+
+    /* Dropping back to the fair class hands the CPU back to fair threads */
+    if (sched_setscheduler(rt[0], SCHED_NORMAL, 0) != 0 ||
+        sched_setscheduler(rt[0], SCHED_FIFO, SCHED_RT_PRIO_MAX + 1) == 0) {
+        klog_error("SCHED_TEST", "FAILED: sched_setscheduler policy checks");
+        goto out;
+    }
+    if (scheduler_peek_next(rq) != fair[0]) {
+        klog_error("SCHED_TEST", "FAILED: Fair thread not picked with no RT threads queued");
+        goto out;
+    }
+
+    klog_info("SCHED_TEST", "RT wakeup-to-pick latency: worst %lu cycles, avg %lu cycles",
+             (unsigned long)worst, (unsigned long)(total / RT_LATENCY_ITERATIONS));
+
+    if (worst > RT_LATENCY_MAX_CYCLES) {
+        klog_error("SCHED_TEST", "FAILED: Worst-case latency %lu exceeds %lu cycles",
+                 (unsigned long)worst, (unsigned long)RT_LATENCY_MAX_CYCLES);
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("SCHED_TEST", "Test 6: PASSED");
+
+out:
+    for (i = 0; i < nr_rt; i++) {
+        scheduler_remove_thread(rt[i]);
+        rt[i]->state = THREAD_TERMINATED;
+        thread_destroy(rt[i]);
+    }
+    for (i = 0; i < nr_fair; i++) {
+        scheduler_remove_thread(fair[i]);
+        fair[i]->state = THREAD_TERMINATED;
+        thread_destroy(fair[i]);
+    }
+    return ret;
+}
+
+/**
+ * test_wait_queues - Test wakeups and the non-sleeping sync paths
+ *
+ * Sleepers are parked on a wait queue by hand (the scheduler is not
+ * switching yet), then woken: exclusive entries one at a time in FIFO
+ * order, each ending up READY on its runqueue.
+ */
+static int test_wait_queues(void) {
+    wait_queue_head_t wq;
+    wait_queue_entry_t wait[NUM_WAIT_THREADS];
+    thread_t *sleepers[NUM_WAIT_THREADS];
+    semaphore_t sem;
+    struct completion done;
+    int cpu = smp_get_cpu_index();
+    int nr = 0, before, i, ret = -1;
+    char name[16];
+
+    klog_info("SCHED_TEST", "Test 7: Wait queues, semaphores and completions...");
+
+    init_waitqueue_head(&wq);
+    for (i = 0; i < NUM_WAIT_THREADS; i++, nr++) {
+        snprintf(name, sizeof(name), "sleeper_%d", i);
+        sleepers[i] = thread_create(name, test_thread_entry, (void *)0,
+                                   TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+        if (sleepers[i] == NULL) {
+            klog_error("SCHED_TEST", "FAILED: Could not create sleeper %d", i);
+            goto out;
+        }
+        sleepers[i]->cpu = cpu;
+        sleepers[i]->state = THREAD_BLOCKED;
+        init_waitqueue_entry(&wait[i], sleepers[i], WQ_FLAG_EXCLUSIVE);
+        add_wait_queue(&wq, &wait[i]);
+    }
+
+    before = scheduler_get_nr_running_cpu(cpu);
+
+    if (wake_up(&wq) != 1 || sleepers[0]->state != THREAD_READY ||
+        sleepers[0]->on_rq != cpu || sleepers[1]->state != THREAD_BLOCKED) {
+        klog_error("SCHED_TEST", "FAILED: wake_up() did not wake exactly the first sleeper");
+        goto out;
+    }
+    if (wake_up_thread(sleepers[0]) != 0) {
+        klog_error("SCHED_TEST", "FAILED: Runnable thread woken twice");
+        goto out;
+    }
+    if (wake_up_all(&wq) != 1 || !list_empty(&wq.head) ||
+        scheduler_get_nr_running_cpu(cpu) != before + NUM_WAIT_THREADS) {
+        klog_error("SCHED_TEST", "FAILED: wake_up_all() left sleepers behind");
+        goto out;
+    }
+
+    sema_init(&sem, 2);
+    if (!down_trylock(&sem) || !down_trylock(&sem) || down_trylock(&sem)) {
+        klog_error("SCHED_TEST", "FAILED: Semaphore count not honoured");
+        goto out;
+    }
+    up(&sem);
+    if (!down_trylock(&sem)) {
+        klog_error("SCHED_TEST", "FAILED: up() did not release a unit");
+        goto out;
+    }
+
+    init_completion(&done);
+    if (try_wait_for_completion(&done) || completion_done(&done)) {
+        klog_error("SCHED_TEST", "FAILED: Fresh completion already done");
+        goto out;
+    }
+    complete(&done);
+    wait_for_completion(&done);     /* Must not sleep */
+    if (try_wait_for_completion(&done)) {
+        klog_error("SCHED_TEST", "FAILED: complete() released more than one waiter");
+        goto out;
+    }
+    complete_all(&done);
+    if (!try_wait_for_completion(&done) || !try_wait_for_completion(&done)) {
+        klog_error("SCHED_TEST", "FAILED: complete_all() did not release every waiter");
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("SCHED_TEST", "Test 7: PASSED");
+
+out:
+    for (i = 0; i < nr; i++) {
+        scheduler_remove_thread(sleepers[i]);
+        sleepers[i]->state = THREAD_TERMINATED;
+        thread_destroy(sleepers[i]);
+    }
+    return ret;
+}
+
+/**
+ * test_wakeup_cpu_selection - Test that wakeups go to an idle CPU
+ *
+ * Pretends this CPU is idling while the sleeper's previous CPU has not
+ * entered the scheduler and so counts as busy. The wakeup must move the
+ * sleeper here and flag this CPU for rescheduling. Interrupts stay off so
+ * the faked idle state is never acted on.
+ */
+static int test_wakeup_cpu_selection(void) {
+    int cpu = smp_get_cpu_index();
+    runqueue_t *rq = scheduler_get_runqueue(cpu);
+    thread_t *saved_curr, *sleeper;
+    int saved_resched, ret = -1;
+    uint64_t flags;
+
+    klog_info("SCHED_TEST", "Test 8: Wakeup CPU selection...");
+
+    if (smp_get_cpu_count() < 2) {
+        klog_info("SCHED_TEST", "Test 8: SKIPPED (single CPU)");
+        return 0;
+    }
+
+    sleeper = thread_create("wake_target", test_thread_entry, (void *)0,
+                            TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    if (sleeper == NULL) {
+        klog_error("SCHED_TEST", "FAILED: Could not create sleeper");
+        return -1;
+    }
+    sleeper->cpu = (cpu + 1) % smp_get_cpu_count();
+    sleeper->state = THREAD_BLOCKED;
+
+    flags = arch_disable_interrupts();
+    saved_curr = rq->curr;
+    saved_resched = rq->need_resched;
+    rq->curr = rq->idle;
+    rq->need_resched = 0;
+
+    if (wake_up_thread(sleeper) != 1) {
+        klog_error("SCHED_TEST", "FAILED: Sleeper was not woken");
+    } else if (sleeper->on_rq != cpu || sleeper->cpu != cpu) {
+        klog_error("SCHED_TEST", "FAILED: Woken on CPU %d, idle CPU is %d",
+                   sleeper->on_rq, cpu);
+    } else if (!rq->need_resched) {
+        klog_error("SCHED_TEST", "FAILED: Idle CPU not asked to reschedule");
+    } else {
+        ret = 0;
+    }
+
+    scheduler_remove_thread(sleeper);
+    rq->curr = saved_curr;
+    rq->need_resched = saved_resched;
+    arch_restore_interrupts(flags);
+
+    sleeper->state = THREAD_TERMINATED;
+    thread_destroy(sleeper);
+
+    if (ret == 0) {
+        klog_info("SCHED_TEST", "Test 8: PASSED");
+    }
+    return ret;
+}
+
+/**
+ * test_affinity - Test affinity masks and cache-hot wakeup placement
+ *
+ * A pinned thread is queued on its CPU and moved as soon as its mask
+ * excludes that CPU. A sleeper that just left another CPU stays there
+ * even though this CPU pretends to be idle.
+ */
+static int test_affinity(void) {
+    int cpu = smp_get_cpu_index();
+    int other = (cpu + 1) % smp_get_cpu_count();
+    runqueue_t *rq = scheduler_get_runqueue(cpu);
+    thread_t *saved_curr, *t;
+    int saved_resched, ret = -1;
+    uint64_t flags;
+
+    klog_info("SCHED_TEST", "Test 9: CPU affinity...");
+
+    t = thread_create("pinned", test_thread_entry, (void *)0,
+                      TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    if (t == NULL) {
+        klog_error("SCHED_TEST", "FAILED: Could not create thread");
+        return -1;
+    }
+
+    if (sched_getaffinity(t) != cpumask_first_n(smp_get_cpu_count())) {
+        klog_error("SCHED_TEST", "FAILED: New thread not allowed on every CPU");
+        goto out;
+    }
+    if (sched_setaffinity(NULL, cpumask_of(cpu)) == 0 ||
+        sched_setaffinity(t, cpumask_of(CPUMASK_MAX_CPUS - 1)) == 0) {
+        klog_error("SCHED_TEST", "FAILED: Invalid affinity accepted");
+        goto out;
+    }
+
+    if (sched_setaffinity(t, cpumask_of(cpu)) != 0 ||
+        sched_getaffinity(t) != cpumask_of(cpu)) {
+        klog_error("SCHED_TEST", "FAILED: Could not pin thread to CPU %d", cpu);
+        goto out;
+    }
+    scheduler_add_thread(t);
+    if (t->on_rq != cpu) {
+        klog_error("SCHED_TEST", "FAILED: Pinned thread queued on CPU %d", t->on_rq);
+        goto out;
+    }
+
+    if (other == cpu) {
+        ret = 0;
+        klog_info("SCHED_TEST", "Test 9: PASSED (single CPU, migration skipped)");
+        goto out;
+    }
+
+    if (sched_setaffinity(t, cpumask_of(other)) != 0 || t->on_rq != other) {
+        klog_error("SCHED_TEST", "FAILED: Queued thread not moved to CPU %d", other);
+        goto out;
+    }
+
+    /* Cache hot on @other: the idle local CPU must not take it */
+    scheduler_remove_thread(t);
+    sched_setaffinity(t, CPU_MASK_ALL);
+    t->state = THREAD_BLOCKED;
+    t->cpu = other;
+    t->last_ran = sched_clock();
+
+    flags = arch_disable_interrupts();
+    saved_curr = rq->curr;
+    saved_resched = rq->need_resched;
+    rq->curr = rq->idle;
+    rq->need_resched = 0;
+
+    if (wake_up_thread(t) != 1 || t->on_rq != other) {
+        klog_error("SCHED_TEST", "FAILED: Cache-hot thread woken on CPU %d", t->on_rq);
+    } else {
+        ret = 0;
+    }
+
+    rq->curr = saved_curr;
+    rq->need_resched = saved_resched;
+    arch_restore_interrupts(flags);
+
+    if (ret == 0) {
+        klog_info("SCHED_TEST", "Test 9: PASSED");
+    }
+
+out:
+    scheduler_remove_thread(t);
+    t->state = THREAD_TERMINATED;
+    thread_destroy(t);
+    return ret;
+}
+
+/**
+ * test_schedstats - Test scheduler statistics snapshots
+ *
+ * Queuing a thread starts its enqueue->run delay and raises the queue
+ * length high-water mark; taking it off again cancels the delay.
+ */
+static int test_schedstats(void) {
+    int cpu = smp_get_cpu_index();
+    struct sched_cpu_stats cs;
+    struct sched_thread_stats ts;
+    thread_t *t;
+    int ret = -1;
+
+    klog_info("SCHED_TEST", "Test 10: Scheduler statistics...");
+
+#if !CONFIG_SCHEDSTATS
+    (void)cpu; (void)cs; (void)ts; (void)t; (void)ret;
+    klog_info("SCHED_TEST", "Test 10: PASSED (CONFIG_SCHEDSTATS=0, skipped)");
+    return 0;
+#else
+    if (sched_get_cpu_stats(-1, &cs) == 0 ||
+        sched_get_cpu_stats(smp_get_cpu_count(), &cs) == 0) {
+        klog_error("SCHED_TEST", "FAILED: Invalid CPU accepted");
+        return -1;
+    }
+
+    t = thread_create("stats", test_thread_entry, (void *)0,
+                      TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    if (t == NULL) {
+        klog_error("SCHED_TEST", "FAILED: Could not create thread");
+        return -1;
+    }
+
+    if (sched_get_thread_stats(t, &ts) != 0 || ts.tid != t->tid ||
+        ts.wait_count != 0 || ts.wait_current_ns != 0 ||
+        ts.nr_voluntary_switches != 0 || ts.nr_involuntary_switches != 0) {
+        klog_error("SCHED_TEST", "FAILED: New thread has non-zero statistics");
+        goto out;
+    }
+
+    sched_setaffinity(t, cpumask_of(cpu));
+    scheduler_add_thread(t);
+
+    if (t->stats.wait_start == 0) {
+        klog_error("SCHED_TEST", "FAILED: Enqueue did not start the wait");
+        goto out;
+    }
+    if (sched_get_cpu_stats(cpu, &cs) != 0 || cs.nr_running < 1 ||
+        cs.nr_running_max < cs.nr_running || cs.clock_ns == 0 || cs.tsc == 0) {
+        klog_error("SCHED_TEST", "FAILED: Bad CPU snapshot (nr_running=%d max=%d)",
+                   cs.nr_running, cs.nr_running_max);
+        goto out;
+    }
+
+    scheduler_remove_thread(t);
+    if (t->stats.wait_start != 0 || t->stats.wait_count != 0) {
+        klog_error("SCHED_TEST", "FAILED: Dequeue did not cancel the wait");
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("SCHED_TEST", "Test 10: PASSED");
+
+out:
+    scheduler_remove_thread(t);
+    t->state = THREAD_TERMINATED;
+    thread_destroy(t);
+    return ret;
+#endif
+}
+
+/**
+ * test_preempt_count - Test preemption count nesting and preemption points
+ *
+ * Spin locks and interrupt-disable sections must nest the count, and a
+ * pending reschedule must not switch us out while the count is raised or
+ * interrupts are off. This CPU pretends to be running its idle thread, so
+ * a wrong switch would be onto a thread with no saved state: the test
+ * would not survive it.
+ */
+static int test_preempt_count(void) {
+    static DEFINE_SPINLOCK(lock);
+    int cpu = smp_get_cpu_index();
+    runqueue_t *rq = scheduler_get_runqueue(cpu);
+    thread_t *saved_curr;
+    int base, saved_resched, ret = 0;
+    irq_flags_t flags;
+    uint64_t irqs;
+
+    klog_info("SCHED_TEST", "Test 11: Preemption count...");
+
+    base = preempt_count();
+
+    spin_lock(&lock);
+    if (preempt_count() != base + 1 || preemptible()) {
+        klog_error("SCHED_TEST", "FAILED: spin_lock did not disable preemption");
+        ret = -1;
+    }
+    flags = spin_lock_irqsave(&rq->lock);
+    if (preempt_count() < base + 2) {
+        klog_error("SCHED_TEST", "FAILED: spin_lock_irqsave did not nest");
+        ret = -1;
+    }
+    spin_unlock_irqrestore(&rq->lock, flags);
+    spin_unlock(&lock);
+
+    /* irq_restore() only re-enables interrupts if they were on before */
+    flags = irq_save(1);
+    if (preempt_count() != base + 1) {
+        klog_error("SCHED_TEST", "FAILED: irq_save did not disable preemption");
+        ret = -1;
+    }
+    irq_restore(flags);
+
+    if (preempt_count() != base) {
+        klog_error("SCHED_TEST", "FAILED: Count %d after release, expected %d",
+                   preempt_count(), base);
+        return -1;
+    }
+
+    /* A reschedule is pending, but every preemption point must decline */
+    irqs = arch_disable_interrupts();
+    saved_curr = rq->curr;
+    saved_resched = rq->need_resched;
+    rq->curr = rq->idle;
+    rq->need_resched = 1;
+
+    preempt_disable();
+    scheduler_irq_exit();
+    preempt_enable();
+
+    if (rq->need_resched != 1 || rq->curr != rq->idle) {
+        klog_error("SCHED_TEST", "FAILED: Preempted with preemption disabled");
+        ret = -1;
+    }
+
+    rq->curr = saved_curr;
+    rq->need_resched = saved_resched;
+    arch_restore_interrupts(irqs);
+
+    if (ret == 0) {
+        klog_info("SCHED_TEST", "Test 11: PASSED");
+    }
+    return ret;
+}
+
+static volatile int timer_fired;
+static volatile int hrtimer_order[NUM_TEST_THREADS];
+static volatile int hrtimer_nr_fired;
+
+static void test_timer_fn(struct timer_list *timer) {
+    (void)timer;
+    timer_fired++;
+}
+
+struct test_hrtimer {
+    struct hrtimer timer;
+    int id;
+};
+
+static void test_hrtimer_fn(struct hrtimer *timer) {
+    struct test_hrtimer *t = timer_container_of(timer, struct test_hrtimer, timer);
+
+    if (hrtimer_nr_fired < NUM_TEST_THREADS) {
+        hrtimer_order[hrtimer_nr_fired] = t->id;
+    }
+    hrtimer_nr_fired++;
+}
+
+/* Spin until sched_clock() reaches @ns */
+static void spin_until(uint64_t ns) {
+    while (sched_clock() < ns) {
+        cpu_relax();
+    }
+}
+
+/**
+ * test_timers - Test the timer wheel and hrtimer queues
+ *
+ * Interrupts are not running yet, so expiry is driven by calling
+ * run_local_timers() by hand after the deadlines have passed.
+ */
+static int test_timers(void) {
+    static const uint64_t offsets[NUM_TEST_THREADS] = { 3000000, 1000000, 2000000 };
+    static const int order[NUM_TEST_THREADS] = { 1, 2, 0 };
+    struct test_hrtimer hrt[NUM_TEST_THREADS];
+    struct timer_list timer;
+    uint64_t now, expires, next;
+    irq_flags_t flags;
+    int i, ret = 0;
+
+    klog_info("SCHED_TEST", "Test 12: Kernel timers...");
+
+    /* Wheel: add, cancel, and a short timer firing no earlier than asked */
+    timer_fired = 0;
+    timer_setup(&timer, test_timer_fn);
+    now = sched_clock();
+    expires = now + 2 * TIMER_WHEEL_TICK_NS;
+    timer_add(&timer, expires);
+    next = timer_next_expiry();
+    if (!timer_pending(&timer) || next < expires || next > expires + 2 * TIMER_WHEEL_TICK_NS) {
+        klog_error("SCHED_TEST", "FAILED: Short timer queued for %lu, expected %lu",
+                   (unsigned long)next, (unsigned long)expires);
+        ret = -1;
+    }
+    if (timer_delete(&timer) != 1 || timer_pending(&timer) ||
+        timer_next_expiry() != TIMER_NO_EXPIRY) {
+        klog_error("SCHED_TEST", "FAILED: Timer still queued after timer_delete");
+        ret = -1;
+    }
+
+    timer_add(&timer, expires);
+    flags = irq_save(1);
+    run_local_timers();
+    if (timer_fired != 0) {
+        klog_error("SCHED_TEST", "FAILED: Timer fired early");
+        ret = -1;
+    }
+    spin_until(timer_next_expiry());
+    run_local_timers();
+    irq_restore(flags);
+    if (timer_fired != 1 || timer_pending(&timer) || sched_clock() < expires) {
+        klog_error("SCHED_TEST", "FAILED: Timer fired %d times, expected 1", timer_fired);
+        ret = -1;
+    }
+
+    /* A long timeout sits on a coarser level: late by under 1/8th, never early */
+    expires = sched_clock() + 1000 * TIMER_WHEEL_TICK_NS;
+    timer_add(&timer, expires);
+    next = timer_next_expiry();
+    if (next < expires || next > expires + (expires - now) / 8 + TIMER_WHEEL_TICK_NS) {
+        klog_error("SCHED_TEST", "FAILED: Long timer queued for %lu, expected %lu",
+                   (unsigned long)next, (unsigned long)expires);
+        ret = -1;
+    }
+    timer_delete_sync(&timer);
+
+    /* hrtimers fire in expiry order, and a cancelled one not at all */
+    hrtimer_nr_fired = 0;
+    now = sched_clock();
+    for (i = 0; i < NUM_TEST_THREADS; i++) {
+        hrt[i].id = i;
+        hrtimer_init(&hrt[i].timer, test_hrtimer_fn);
+        hrtimer_start(&hrt[i].timer, now + offsets[i]);
+    }
+    if (hrtimer_next_expiry() != now + offsets[order[0]]) {
+        klog_error("SCHED_TEST", "FAILED: Earliest hrtimer not first");
+        ret = -1;
+    }
+
+    hrtimer_start(&hrt[order[1]].timer, now + 10 * offsets[0]);
+    if (hrtimer_cancel(&hrt[order[1]].timer) != 1 || hrtimer_active(&hrt[order[1]].timer)) {
+        klog_error("SCHED_TEST", "FAILED: hrtimer_cancel");
+        ret = -1;
+    }
+
+    spin_until(now + offsets[0]);
+    flags = irq_save(1);
+    run_local_timers();
+    irq_restore(flags);
+
+    if (hrtimer_nr_fired != NUM_TEST_THREADS - 1 ||
+        hrtimer_order[0] != order[0] || hrtimer_order[1] != order[2]) {
+        klog_error("SCHED_TEST", "FAILED: %d hrtimers fired, order %d %d",
+                   hrtimer_nr_fired, hrtimer_order[0], hrtimer_order[1]);
+        ret = -1;
+    }
+    for (i = 0; i < NUM_TEST_THREADS; i++) {
+        hrtimer_cancel(&hrt[i].timer);
+    }
+
+    if (ret == 0) {
+        klog_info("SCHED_TEST", "Test 12: PASSED");
+    }
+    return ret;
+}
+
+/**
+ * test_fpu - Test per-thread FPU state and kernel FPU sections
+ *
+ * New threads carry no state until their first FPU instruction. Inside
+ * kernel_fpu_begin()/end() SSE registers are usable and hold their values.
+ */
+static int test_fpu(void) {
+    static const uint64_t pattern[2] = { 0x0123456789abcdefULL, 0xfedcba9876543210ULL };
+    uint64_t readback[2] = { 0, 0 };
+    thread_t *thread, *copy;
+    int ret = 0;
+
+    klog_info("SCHED_TEST", "Test 13: FPU state (%s, %lu bytes)...",
+              fpu_save_method(), (unsigned long)fpu_state_size());
+
+    if (fpu_state_size() < 512 || fpu_state_size() > PAGE_SIZE) {
+        klog_error("SCHED_TEST", "FAILED: Bad FPU state size %lu",
+                   (unsigned long)fpu_state_size());
+        return -1;
+    }
+
+    thread = thread_create("fpu_test", test_thread_entry, (void *)0,
+                           TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    copy = thread_create("fpu_copy", test_thread_entry, (void *)0,
+                         TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    if (thread == NULL || copy == NULL) {
+        klog_error("SCHED_TEST", "FAILED: Thread creation failed");
+        ret = -1;
+        goto out;
+    }
+
+    if (thread->fpu.state != NULL || thread->fpu.last_cpu != -1) {
+        klog_error("SCHED_TEST", "FAILED: New thread has FPU state");
+        ret = -1;
+    }
+
+    /* Copying a thread that never used the FPU allocates nothing */
+    if (fpu_thread_copy(copy, thread) != 0 || copy->fpu.state != NULL) {
+        klog_error("SCHED_TEST", "FAILED: FPU state copied from unused thread");
+        ret = -1;
+    }
+
+    kernel_fpu_begin();
+    if (preempt_count() == 0) {
+        klog_error("SCHED_TEST", "FAILED: kernel_fpu_begin left preemption on");
+        ret = -1;
+    }
+    /* The kernel is built without SSE, so the compiler keeps nothing in
+     * xmm registers and they need no clobbers */
+    asm volatile ("movdqu %1, %%xmm0\n\t"
+                  "pxor %%xmm1, %%xmm1\n\t"
+                  "por %%xmm0, %%xmm1\n\t"
+                  "movdqu %%xmm1, %0"
+                  : "=m"(readback) : "m"(pattern));
+    kernel_fpu_end();
+
+    if (readback[0] != pattern[0] || readback[1] != pattern[1]) {
+        klog_error("SCHED_TEST", "FAILED: SSE registers did not hold their value");
+        ret = -1;
+    }
+
+out:
+    if (thread != NULL) {
+        thread->state = THREAD_TERMINATED;
+        thread_destroy(thread);
+    }
+    if (copy != NULL) {
+        copy->state = THREAD_TERMINATED;
+        thread_destroy(copy);
+    }
+
+    if (ret == 0) {
+        klog_info("SCHED_TEST", "Test 13: PASSED");
+    }
+    return ret;
+}
+
+/* ============================================================================
+ * Test 14: Stack Pool
+ * ============================================================================ */
+
+/**
+ * test_stack_pool - Test guarded, recycled thread stacks
+ *
+ * Small stacks come from the stack area with a guard below them, and a
+ * destroyed thread's stack is handed to the next thread.
+ */
+static int test_stack_pool(void) {
+    struct stack_pool_stats before, after;
+    thread_t *thread;
+    uint64_t stack;
+    int ret = 0;
+
+    klog_info("SCHED_TEST", "Test 14: Stack pool...");
+
+    thread = thread_create("stack_test", test_thread_entry, (void *)0,
+                           TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    if (thread == NULL) {
+        klog_error("SCHED_TEST", "FAILED: Thread creation failed");
+        return -1;
+    }
+
+    stack = (uint64_t)thread->kernel_stack;
+    if (!stack_in_pool(stack) || stack_is_guard(stack) || !stack_is_guard(stack - 1)) {
+        klog_error("SCHED_TEST", "FAILED: Stack %p is not guarded", (void *)stack);
+        ret = -1;
+    }
+    if (thread->kernel_stack_size != STACK_POOL_STACK_SIZE) {
+        klog_error("SCHED_TEST", "FAILED: Stack size %lu, expected %d",
+                   (unsigned long)thread->kernel_stack_size, STACK_POOL_STACK_SIZE);
+        ret = -1;
+    }
+
+    thread->state = THREAD_TERMINATED;
+    thread_destroy(thread);
+
+    stack_pool_get_stats(&before);
+    thread = thread_create("stack_reuse", test_thread_entry, (void *)0,
+                           TEST_STACK_SIZE, THREAD_FLAG_KERNEL);
+    stack_pool_get_stats(&after);
+    if (thread == NULL) {
+        klog_error("SCHED_TEST", "FAILED: Thread creation failed");
+        return -1;
+    }
+
+    if ((uint64_t)thread->kernel_stack != stack ||
+        after.nr_reused != before.nr_reused + 1 ||
+        after.nr_slots != before.nr_slots) {
+        klog_error("SCHED_TEST", "FAILED: Freed stack was not reused");
+        ret = -1;
+    }
+
+    thread->state = THREAD_TERMINATED;
+    thread_destroy(thread);
+
+    if (ret == 0) {
+        klog_info("SCHED_TEST", "Test 14: PASSED (%lu slots, %lu reused)",
+                  (unsigned long)after.nr_slots, (unsigned long)after.nr_reused);
+    }
+    return ret;
+}
+
+/* ============================================================================
+ * Test 15: Context Switch Cost
+ * ============================================================================ */
+
+#define PINGPONG_ROUNDS 10000
+
+static cpu_context_t pingpong_main_ctx;
+static cpu_context_t pingpong_peer_ctx;
+static void (*pingpong_switch)(cpu_context_t *prev, cpu_context_t *next);
+static volatile uint64_t pingpong_count;
+
+/* Peer side: bump the counter and switch straight back, forever */
+static void pingpong_peer(void) {
+    while (1) {
+        pingpong_count++;
+        pingpong_switch(&pingpong_peer_ctx, &pingpong_main_ctx);
+    }
+}
+
+/* Run PINGPONG_ROUNDS round trips; returns TSC cycles per switch */
+static uint64_t pingpong_run(void (*switch_fn)(cpu_context_t *, cpu_context_t *),
+                             void *peer_stack) {
+    uint8_t *top = (uint8_t *)peer_stack + STACK_POOL_STACK_SIZE;
+    uint64_t start, end;
+
+    /* Enter the peer as if called: RSP is 8 off 16-byte alignment */
+    arch_context_init(&pingpong_peer_ctx, top, (void *)pingpong_peer, 0);
+    pingpong_peer_ctx.rsp = (uint64_t)top - 8;
+    pingpong_switch = switch_fn;
+    pingpong_count = 0;
+
+    /* Warm up caches and the branch predictor */
+    for (int i = 0; i < 100; i++) {
+        switch_fn(&pingpong_main_ctx, &pingpong_peer_ctx);
+    }
+
+    start = arch_rdtsc();
+    for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+        switch_fn(&pingpong_main_ctx, &pingpong_peer_ctx);
+    }
+    end = arch_rdtsc();
+
+    return (end - start) / (2 * PINGPONG_ROUNDS);
+}
+
+/**
+ * test_context_switch_cost - Ping-pong between two contexts
+ *
+ * Switches back and forth between this stack and a peer with both the
+ * callee-saved fast path and the full-frame path, and reports the cycles
+ * per switch. Interrupts stay disabled, as in __schedule().
+ */
+static int test_context_switch_cost(void) {
+    uint64_t fast, full, flags;
+    void *peer_stack;
+    int ret = 0;
+
+    klog_info("SCHED_TEST", "Test 15: Context switch cost...");
+
+    peer_stack = stack_alloc();
+    if (peer_stack == NULL) {
+        klog_error("SCHED_TEST", "FAILED: No stack for ping-pong peer");
+        return -1;
+    }
+
+    flags = arch_disable_interrupts();
+    full = pingpong_run(context_switch_full, peer_stack);
+    if (pingpong_count != PINGPONG_ROUNDS + 100) {
+        ret = -1;
+    }
+    fast = pingpong_run(context_switch, peer_stack);
+    if (pingpong_count != PINGPONG_ROUNDS + 100) {
+        ret = -1;
+    }
+    arch_restore_interrupts(flags);
+
+    stack_free(peer_stack);
+
+    if (ret != 0) {
+        klog_error("SCHED_TEST", "FAILED: Peer ran %lu times, expected %d",
+                   (unsigned long)pingpong_count, PINGPONG_ROUNDS + 100);
+        return ret;
+    }
+
+    klog_info("SCHED_TEST", "Test 15: PASSED (%lu cycles/switch, full frame %lu)",
+              (unsigned long)fast, (unsigned long)full);
+    return 0;
+}
+
+/* ============================================================================
+ * Test 16: Per-CPU Variables
+ * ============================================================================ */
+
+static DEFINE_PER_CPU(uint64_t, test_percpu_counter);
+
+/**
+ * test_percpu - Test GS-relative per-CPU variable access
+ *
+ * this_cpu_*() must reach the same copy as per_cpu_ptr() for this CPU,
+ * leave the other CPUs' copies and the template alone.
+ */
+static int test_percpu(void) {
+    int cpu = smp_get_cpu_index();
+    int other = (cpu + 1) % SMP_MAX_CPUS;
+
+    klog_info("SCHED_TEST", "Test 16: Per-CPU variables...");
+
+    if (this_cpu_ptr(&test_percpu_counter) != per_cpu_ptr(&test_percpu_counter, cpu)) {
+        klog_error("SCHED_TEST", "FAILED: this_cpu_ptr() is not CPU %d's copy", cpu);
+        return -1;
+    }
+
+    this_cpu_write(test_percpu_counter, 40);
+    this_cpu_inc(test_percpu_counter);
+    this_cpu_add(test_percpu_counter, 2);
+    this_cpu_dec(test_percpu_counter);
+
+    if (this_cpu_read(test_percpu_counter) != 42 ||
+        per_cpu(test_percpu_counter, cpu) != 42) {
+        klog_error("SCHED_TEST", "FAILED: Counter is %lu, expected 42",
+                   (unsigned long)per_cpu(test_percpu_counter, cpu));
+        return -1;
+    }
+    if (per_cpu(test_percpu_counter, other) != 0) {
+        klog_error("SCHED_TEST", "FAILED: CPU %d's copy was modified", other);
+        return -1;
+    }
+
+    klog_info("SCHED_TEST", "Test 16: PASSED (CPU %d, area at %p)",
+              cpu, (void *)this_cpu_ptr(&test_percpu_counter));
+    return 0;
+}
+
+/* ============================================================================
+ * Test 17: Workqueues
+ * ============================================================================ */
+
+static int test_work_runs;
+
+static void test_work_func(struct work_struct *work) {
+    (void)work;
+    test_work_runs++;
+}
+
+/* Static: cancelled items stay on their pool's list until a worker runs */
+static struct work_struct test_work = WORK_INIT(test_work_func);
+static struct work_struct test_unbound_work = WORK_INIT(test_work_func);
+
+/**
+ * test_workqueue - Test work item queueing and cancelling
+ *
+ * Workers do not run during the tests, so this checks the state
+ * transitions: an item is queued once, cancelling clears it, and
+ * requeueing a cancelled item reuses its spot on the pool's list.
+ */
+static int test_workqueue(void) {
+    struct workqueue_stats before, after;
+    struct work_struct idle_work;
+
+    klog_info("SCHED_TEST", "Test 17: Workqueues...");
+
+    workqueue_get_stats(&before);
+    init_work(&idle_work, test_work_func);
+    if (flush_work(&idle_work) != 0 || cancel_work(&idle_work) != 0) {
+        klog_error("SCHED_TEST", "FAILED: Idle work item was not idle");
+        return -1;
+    }
+
+    if (schedule_work(&test_work) != 1 || !work_pending(&test_work)) {
+        klog_error("SCHED_TEST", "FAILED: Work item not queued");
+        return -1;
+    }
+    if (schedule_work(&test_work) != 0 ||
+        queue_work(system_unbound_wq, &test_work) != 0) {
+        klog_error("SCHED_TEST", "FAILED: Pending work item queued twice");
+        return -1;
+    }
+
+    if (cancel_work(&test_work) != 1 || work_pending(&test_work) ||
+        cancel_work(&test_work) != 0) {
+        klog_error("SCHED_TEST", "FAILED: Cancel did not clear pending");
+        return -1;
+    }
+    if (!(test_work.state & WORK_LINKED)) {
+        klog_error("SCHED_TEST", "FAILED: Cancelled item left its list early");
+        return -1;
+    }
+
+    /* Still linked: queued again in place, wherever it is asked to go */
+    if (queue_work(system_unbound_wq, &test_work) != 1 ||
+        test_work.pool == NULL || test_work.state != (WORK_PENDING | WORK_LINKED)) {
+        klog_error("SCHED_TEST", "FAILED: Cancelled item not requeued");
+        return -1;
+    }
+    cancel_work(&test_work);
+
+    if (queue_work(system_unbound_wq, &test_unbound_work) != 1 ||
+        test_unbound_work.pool == test_work.pool) {
+        klog_error("SCHED_TEST", "FAILED: Unbound item queued on a bound pool");
+        return -1;
+    }
+    cancel_work(&test_unbound_work);
+
+    workqueue_get_stats(&after);
+    if (after.nr_queued - before.nr_queued != 3 ||
+        after.nr_cancelled - before.nr_cancelled != 3 ||
+        test_work_runs != 0) {
+        klog_error("SCHED_TEST", "FAILED: Stats queued %lu, cancelled %lu",
+                   (unsigned long)(after.nr_queued - before.nr_queued),
+                   (unsigned long)(after.nr_cancelled - before.nr_cancelled));
+        return -1;
+    }
+
+    klog_info("SCHED_TEST", "Test 17: PASSED");
+    return 0;
+}
+
+/* ============================================================================
+ * Test 18: Fibers
+ * ============================================================================ */
+
+#define TEST_NR_FIBERS      64
+#define TEST_FIBER_ROUNDS   8
+
+static int fiber_trace[TEST_NR_FIBERS * TEST_FIBER_ROUNDS];
+static int fiber_trace_len;
+static struct fiber *test_parker_self;
+static int test_parker_state;
+
+/* Log each turn and yield, so the trace shows the run order */
+static void test_fiber_func(void *arg) {
+    int round;
+
+    for (round = 0; round < TEST_FIBER_ROUNDS; round++) {
+        if (fiber_trace_len < TEST_NR_FIBERS * TEST_FIBER_ROUNDS) {
+            fiber_trace[fiber_trace_len++] = (int)(uintptr_t)arg;
+        }
+        fiber_yield();
+    }
+}
+
+static void test_fiber_parker(void *arg) {
+    (void)arg;
+    test_parker_self = fiber_current();
+    test_parker_state = 1;
+    fiber_park();
+    test_parker_state = 2;
+}
+
+/**
+ * test_fibers - Test fiber scheduling on the current thread
+ *
+ * Fibers must run round robin, a parked fiber must wait for
+ * fiber_wake(), and a second batch must reuse the first batch's stacks.
+ */
+static int test_fibers(void) {
+    struct fiber_sched s;
+    struct fiber_stats before, after;
+    struct fiber *parker;
+    uint64_t start, cycles, switches;
+    int i, batch;
+
+    klog_info("SCHED_TEST", "Test 18: Fibers...");
+
+    for (batch = 0; batch < 2; batch++) {
+        fiber_sched_init(&s);
+        fiber_trace_len = 0;
+        for (i = 0; i < TEST_NR_FIBERS; i++) {
+            if (fiber_create(&s, test_fiber_func, (void *)(uintptr_t)i) == NULL) {
+                klog_error("SCHED_TEST", "FAILED: Could not create fiber %d", i);
+                return -1;
+            }
+        }
+        fiber_get_stats(&before);
+
+        start = arch_rdtsc();
+        if (fiber_sched_run(&s) != 0) {
+            klog_error("SCHED_TEST", "FAILED: %d fibers did not finish", s.nr_fibers);
+            return -1;
+        }
+        cycles = arch_rdtsc() - start;
+        switches = s.nr_switches;
+
+        for (i = 0; i < TEST_NR_FIBERS * TEST_FIBER_ROUNDS; i++) {
+            if (i >= fiber_trace_len || fiber_trace[i] != i % TEST_NR_FIBERS) {
+                klog_error("SCHED_TEST", "FAILED: Fibers not run round robin at turn %d", i);
+                return -1;
+            }
+        }
+
+        fiber_get_stats(&after);
+        if (after.nr_free != before.nr_free + TEST_NR_FIBERS) {
+            klog_error("SCHED_TEST", "FAILED: Fiber stacks not returned (%lu free, was %lu)",
+                       (unsigned long)after.nr_free, (unsigned long)before.nr_free);
+            return -1;
+        }
+    }
+
+    /* The second batch ran entirely on recycled stacks */
+    if (after.nr_stacks != before.nr_stacks) {
+        klog_error("SCHED_TEST", "FAILED: Second batch carved new stacks");
+        return -1;
+    }
+
+    fiber_sched_init(&s);
+    test_parker_state = 0;
+    parker = fiber_create(&s, test_fiber_parker, NULL);
+    if (parker == NULL || fiber_sched_run(&s) != 1 || test_parker_state != 1 ||
+        test_parker_self != parker || parker->state != FIBER_PARKED) {
+        klog_error("SCHED_TEST", "FAILED: Fiber did not park");
+        return -1;
+    }
+    fiber_wake(parker);
+    if (fiber_sched_run(&s) != 0 || test_parker_state != 2) {
+        klog_error("SCHED_TEST", "FAILED: Parked fiber did not finish after wake");
+        return -1;
+    }
+
+    klog_info("SCHED_TEST", "Test 18: PASSED (%d fibers, %lu cycles/switch, %lu stacks)",
+              TEST_NR_FIBERS, (unsigned long)(cycles / switches),
+              (unsigned long)after.nr_stacks);
+    return 0;
+}
+
 /* ============================================================================
  * Main Test Runner
  * ============================================================================ */
@@ -225,7 +1459,7 @@ int run_sched_tests(void) {
     int failures = 0;
 
     klog_info("SCHED_TEST", "=== Scheduler Test Suite ===");
-    klog_info("SCHED_TEST", "Testing thread creation and FIFO scheduling");
+    klog_info("SCHED_TEST", "Testing thread creation and fair scheduling");
 
     /* Test 1: Thread Creation */
     if (test_thread_creation() != 0) {
@@ -247,6 +1481,79 @@ int run_sched_tests(void) {
         failures++;
     }
 
+    /* Test 5: Fair Weights */
+    if (test_fair_weights() != 0) {
+        failures++;
+    }
+
+    /* Test 6: Real-Time Class */
+    if (test_rt_wakeup_latency() != 0) {
+        failures++;
+    }
+
+    /* Test 7: Wait Queues */
+    if (test_wait_queues() != 0) {
+        failures++;
+    }
+
+    /* Test 8: Wakeup CPU Selection */
+    if (test_wakeup_cpu_selection() != 0) {
+        failures++;
+    }
+
+    /* Test 9: CPU Affinity */
+    if (test_affinity() != 0) {
+        failures++;
+    }
+
+    /* Test 10: Scheduler Statistics */
+    if (test_schedstats() != 0) {
+        failures++;
+    }
+
+    /* Test 11: Preemption Count */
+    if (test_preempt_count() != 0) {
+        failures++;
+    }
+
+    /* Test 12: Kernel Timers */
+    if (test_timers() != 0) {
+        failures++;
+    }
+
+    /* Test 13: FPU State */
+    if (test_fpu() != 0) {
+        failures++;
+    }
+
+    /* Test 14: Stack Pool */
+    if (test_stack_pool() != 0) {
+        failures++;
+    }
+
+    /* Test 15: Context Switch Cost */
+    if (test_context_switch_cost() != 0) {
+        failures++;
+    }
+
+    /* Test 16: Per-CPU Variables */
+    if (test_percpu() != 0) {
+        failures++;
+    }
+
+    /* Test 17: Workqueues */
+    if (test_workqueue() != 0) {
+        failures++;
+    }
+
+    /* Test 18: Fibers */
+    if (test_fibers() != 0) {
+        failures++;
+    }
+
+    /* Per-CPU and per-thread statistics for sched_test.py */
+    sched_dump_stats();
+
     /* Summary */
     if (failures == 0) {
         klog_info("SCHED_TEST", "SCHED: All tests PASSED");
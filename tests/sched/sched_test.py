@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""
+Scheduler Test
+
+Runs the kernel scheduler test suite and checks the statistics that
+sched_dump_stats() logs afterwards: one "SCHEDSTAT cpu=..." line per CPU
+and one "SCHEDSTAT tid=..." line per live thread, as key=value pairs.
+"""
+
+import sys
+import argparse
+from pathlib import Path
+
+# Add lib directory to path for imports
+lib_path = Path(__file__).parent.parent / "lib"
+sys.path.insert(0, str(lib_path))
+
+from test_framework import TestFramework, TestConfig, create_framework
+from output import TerminalOutput
+
+
+CPU_STAT_PATTERN = (
+    r"SCHEDSTAT cpu=(\d+) tsc=(\d+) clock_ns=(\d+) switches=(\d+) "
+    r"idle_ns=(\d+) nr_running=(\d+) nr_running_max=(\d+) rq_len_sum=(\d+)"
+)
+
+THREAD_STAT_PATTERN = (
+    r"SCHEDSTAT tid=(\d+) cpu=(-?\d+) runtime_ns=(\d+) wait_ns=(\d+) "
+    r"wait_max_ns=(\d+) waits=(\d+) wait_now_ns=(\d+) vcsw=(\d+) ivcsw=(\d+) "
+    r"name=(\S+)"
+)
+
+
+def parse_arguments():
+    """Parse command line arguments."""
+    parser = argparse.ArgumentParser(
+        description="Scheduler Test",
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+  %(prog)s              Run with 2 CPUs (default)
+  %(prog)s --verbose    Show detailed output
+        """
+    )
+    parser.add_argument(
+        "-v", "--verbose",
+        action="store_true",
+        help="Show detailed test output"
+    )
+    parser.add_argument(
+        "--keep-output",
+        action="store_true",
+        help="Keep test output files for debugging"
+    )
+    parser.add_argument(
+        "--timeout",
+        type=int,
+        default=5,
+        metavar="SECONDS",
+        help="QEMU timeout in seconds (default: 5)"
+    )
+    parser.add_argument(
+        "--cpus",
+        type=int,
+        default=2,
+        metavar="COUNT",
+        help="Number of CPUs to use (default: 2)"
+    )
+    parser.add_argument(
+        "-q", "--quiet",
+        action="store_true",
+        help="Suppress header/footer, show only result"
+    )
+    return parser.parse_args()
+
+
+def run_custom_checks(assertions, output, cpu_count):
+    """Run custom assertions for the sched test.
+
+    Args:
+        assertions: Assertions object
+        output: TerminalOutput object
+        cpu_count: Number of CPUs QEMU was started with
+
+    Returns:
+        True if all checks pass, False otherwise
+    """
+    all_passed = True
+
+    # Check 1: Kernel test suite passed
+    if assertions.assert_pattern_exists(r"SCHED: All tests PASSED"):
+        output.print_success("Scheduler test suite passed")
+    else:
+        output.print_failure("Scheduler test suite passed")
+        all_passed = False
+
+    # Check 2: One statistics line per CPU, with sane values
+    cpu_stats = assertions.get_pattern_groups(CPU_STAT_PATTERN)
+    cpus = sorted(int(g[0]) for g in cpu_stats)
+    if cpus == list(range(cpu_count)):
+        output.print_success(f"Per-CPU statistics for {cpu_count} CPU(s)")
+    else:
+        output.print_failure("Per-CPU statistics", f"got CPUs {cpus}")
+        all_passed = False
+
+    for g in cpu_stats:
+        cpu, clock_ns, idle_ns = int(g[0]), int(g[2]), int(g[4])
+        nr_running, nr_running_max = int(g[5]), int(g[6])
+        if idle_ns > clock_ns or nr_running > nr_running_max:
+            output.print_failure(
+                f"CPU {cpu} statistics consistent",
+                f"idle_ns={idle_ns} clock_ns={clock_ns} "
+                f"nr_running={nr_running} nr_running_max={nr_running_max}"
+            )
+            all_passed = False
+
+    # Check 3: Per-thread statistics, including every idle thread
+    thread_stats = assertions.get_pattern_groups(THREAD_STAT_PATTERN)
+    idle_threads = [g for g in thread_stats if g[9].startswith("idle")]
+    if len(idle_threads) >= cpu_count:
+        output.print_success(f"Per-thread statistics for {len(thread_stats)} thread(s)")
+    else:
+        output.print_failure(
+            "Per-thread statistics",
+            f"{len(idle_threads)} idle thread line(s) for {cpu_count} CPU(s)"
+        )
+        all_passed = False
+
+    for g in thread_stats:
+        wait_ns, wait_max_ns, waits = int(g[3]), int(g[4]), int(g[5])
+        if wait_max_ns > wait_ns or (waits == 0 and wait_ns != 0):
+            output.print_failure(
+                f"Thread {g[0]} wait statistics consistent",
+                f"wait_ns={wait_ns} wait_max_ns={wait_max_ns} waits={waits}"
+            )
+            all_passed = False
+
+    return all_passed
+
+
+def main():
+    """Main test execution."""
+    args = parse_arguments()
+
+    output = TerminalOutput()
+
+    # Print test header (skip in quiet mode)
+    if not args.quiet:
+        output.print_header("Scheduler Test", width=40)
+        print(f"CPU Count: {args.cpus}")
+        print(f"Timeout: {args.timeout} seconds")
+        print()
+
+    # Create framework and run test
+    framework = create_framework(
+        test_name="sched",
+        cpu_count=args.cpus,
+        timeout=args.timeout,
+        verbose=args.verbose,
+        keep_output=args.keep_output,
+        quiet=args.quiet
+    )
+
+    # Check prerequisites
+    if not framework.check_prerequisites():
+        output.print_error("Prerequisites not met")
+        sys.exit(1)
+
+    # Run the test
+    if not args.quiet:
+        print(f"Starting QEMU with {args.cpus} CPU(s)...")
+        print()
+
+    if framework.run_test_with_assertions(
+        "sched",
+        lambda a: run_custom_checks(a, output, args.cpus),
+        cpu_count=args.cpus
+    ):
+        exit_code = framework.print_summary()
+    else:
+        exit_code = 1
+
+    sys.exit(exit_code)
+
+
+if __name__ == "__main__":
+    main()
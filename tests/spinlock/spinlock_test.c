@@ -13,7 +13,6 @@
 
 /* External functions */
 extern void serial_putc(char c);
-extern int smp_get_cpu_index(void);
 extern uint8_t smp_get_apic_id(void);
 
 /* ============================================================================
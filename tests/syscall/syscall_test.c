@@ -12,6 +12,12 @@
 #include "kernel/test.h"
 #include "kernel/klog.h"
 #include "arch/x86_64/include/syscall.h"
+#include "arch/x86_64/include/ptrace.h"
+#include "arch/x86_64/cpu.h"
+#include "kernel/process.h"
+#include "kernel/thread.h"
+#include "arch/x86_64/idt.h"
+#include "arch/x86_64/smp.h"
 
 #if CONFIG_TESTS_SYSCALL
 
@@ -32,6 +38,119 @@ static int test_syscall_init(void) {
     return 0;
 }
 
+/* Dispatch iterations timed by test_syscall_dispatch() */
+#define SYSCALL_BENCH_ITERATIONS    10000
+
+/* Test: Table dispatch bounds and in-kernel dispatch cost
+ *
+ * Calls syscall_handler() on a hand-built frame, so the cost measured is
+ * the dispatch and handler alone, without the SYSCALL/SYSRET round trip
+ * that the ring 3 program times. */
+static int test_syscall_dispatch(void) {
+    static const uint64_t bad_nr[] = { 0, NR_syscalls, ~0ULL };
+    struct pt_regs regs = { 0 };
+    struct syscall_stat before, after;
+    uint64_t nr, start, cycles;
+    unsigned int i;
+
+    klog_info("SYSCALL_TEST", "Testing table dispatch...");
+
+    /* Numbers outside the table or without a handler fail with ENOSYS */
+    for (i = 0; i < sizeof(bad_nr) / sizeof(bad_nr[0]); i++) {
+        regs.orig_rax = bad_nr[i];
+        regs.rax = 0;
+        syscall_handler(&regs);
+        if ((int64_t)regs.rax != -38) {
+            klog_error("SYSCALL_TEST", "nr=%lx returned %ld, expected ENOSYS",
+                       (unsigned long)bad_nr[i], (long)regs.rax);
+            return -1;
+        }
+    }
+
+    /* getpid needs a current process; before one exists, time the
+     * rejected path instead */
+    nr = process_get_current() != NULL ? SYS_getpid : 0;
+    syscall_get_stats((unsigned int)nr, &before);
+
+    start = arch_rdtsc();
+    for (i = 0; i < SYSCALL_BENCH_ITERATIONS; i++) {
+        regs.orig_rax = nr;
+        syscall_handler(&regs);
+    }
+    cycles = arch_rdtsc() - start;
+
+    klog_info("SYSCALL_TEST", "SYSCALLBENCH dispatch nr=%lu cycles/call=%lu",
+              (unsigned long)nr, (unsigned long)(cycles / SYSCALL_BENCH_ITERATIONS));
+
+#if CONFIG_SYSCALL_STATS
+    syscall_get_stats((unsigned int)nr, &after);
+    if (nr != 0 && after.count - before.count != SYSCALL_BENCH_ITERATIONS) {
+        klog_error("SYSCALL_TEST", "getpid counted %lu calls, expected %d",
+                   (unsigned long)(after.count - before.count),
+                   SYSCALL_BENCH_ITERATIONS);
+        return -1;
+    }
+#else
+    (void)after;
+#endif
+
+    klog_info("SYSCALL_TEST", "Table dispatch: PASSED");
+    return 0;
+}
+
+/* Entry point of the thread test_syscall_entry_stack() creates, never run */
+static void entry_stack_thread(void *arg) {
+    (void)arg;
+}
+
+/* Test: Choosing the stack syscalls enter on
+ *
+ * A thread's syscalls must enter on its own kernel stack, 16-byte
+ * aligned, and a CPU with no such thread on its own syscall stack. */
+static int test_syscall_entry_stack(void) {
+    uint64_t saved, fallback, top;
+    irq_flags_t flags;
+    thread_t *thread;
+    int ret = -1;
+
+    klog_info("SYSCALL_TEST", "Testing syscall entry stacks...");
+
+    thread = thread_create("entry_stack", entry_stack_thread, NULL, 4096, THREAD_FLAG_KERNEL);
+    if (thread == NULL) {
+        klog_error("SYSCALL_TEST", "Thread creation failed");
+        return -1;
+    }
+    top = (uint64_t)thread->kernel_stack + thread->kernel_stack_size;
+
+    flags = irq_save(1);
+    saved = this_cpu_read(syscall_entry_rsp);
+
+    syscall_set_entry_stack((uint8_t *)thread->kernel_stack + thread->kernel_stack_size);
+    if (this_cpu_read(syscall_entry_rsp) != (top & ~0xFULL)) {
+        klog_error("SYSCALL_TEST", "Entry stack %p is not the thread's (top %p)",
+                   (void *)this_cpu_read(syscall_entry_rsp), (void *)top);
+        goto out;
+    }
+
+    syscall_set_entry_stack(NULL);
+    fallback = this_cpu_read(syscall_entry_rsp);
+    if (fallback == 0 || (fallback & 0xF) != 0 ||
+        (fallback > (uint64_t)thread->kernel_stack && fallback <= top)) {
+        klog_error("SYSCALL_TEST", "Bad per-CPU syscall stack %p", (void *)fallback);
+        goto out;
+    }
+
+    ret = 0;
+    klog_info("SYSCALL_TEST", "Syscall entry stacks: PASSED (CPU %d stack top %p)",
+              smp_get_cpu_index(), (void *)fallback);
+out:
+    this_cpu_write(syscall_entry_rsp, saved);
+    irq_restore(flags);
+    thread->state = THREAD_TERMINATED;
+    thread_destroy(thread);
+    return ret;
+}
+
 /* Test: Ring 3 transition with syscall test program */
 static int test_syscall_ring3_test(void) {
     void *user_stack;
@@ -73,7 +192,21 @@ int run_syscall_tests(void) {
         klog_error("SYSCALL_TEST", "Test 1 FAILED");
     }
 
-    /* Test 2: Ring 3 syscall test program */
+    /* Test 2: Table dispatch */
+    tests_run++;
+    if (test_syscall_dispatch() < 0) {
+        tests_failed++;
+        klog_error("SYSCALL_TEST", "Test 2 FAILED");
+    }
+
+    /* Test 3: Syscall entry stacks */
+    tests_run++;
+    if (test_syscall_entry_stack() < 0) {
+        tests_failed++;
+        klog_error("SYSCALL_TEST", "Test 3 FAILED");
+    }
+
+    /* Test 4: Ring 3 syscall test program */
     tests_run++;
     klog_info("SYSCALL_TEST", "Testing ring 3 syscall test program...");
     test_syscall_ring3_test();
@@ -19,6 +19,10 @@
 #include "tests/usermode/test_usermode.h"
 #include "tests/syscall/test_syscall.h"
 #include "tests/kmap/test_kmap.h"
+#include "tests/idle/test_idle.h"
+#include "tests/process/test_process.h"
+#include "tests/vdso/test_vdso.h"
+#include "tests/ioring/test_ioring.h"
 
 /* Nested Kernel tests */
 #include "tests/nested-kernel/test_nk_invariants.h"
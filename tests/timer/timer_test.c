@@ -6,6 +6,9 @@
 #include "kernel/klog.h"
 #include "arch/x86_64/timer.h"
 #include "arch/x86_64/serial.h"
+#include "arch/x86_64/apic.h"
+#include "arch/x86_64/msr.h"
+#include "include/kernel/scheduler.h"
 
 /* External APIC timer functions from arch/x86_64/timer.c */
 extern void apic_timer_init(void);
@@ -16,6 +19,45 @@ extern volatile int apic_timer_count;  /* Access timer state for verification */
 
 #define NUM_QUOTES 5  /* Expected number of quotes */
 
+#if CONFIG_NO_HZ
+/**
+ * test_oneshot_program - Check one-shot arming and cancel
+ *
+ * Runs with the LVT still masked, so the expiry never interrupts.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+static int test_oneshot_program(void) {
+    uint64_t armed;
+
+    timer_program_oneshot(SCHED_TICK_NS);
+    if (timer_has_tsc_deadline()) {
+        armed = arch_msr_read(IA32_TSC_DEADLINE_MSR);
+    } else {
+        armed = lapic_read(LAPIC_TIMER_CCR);
+    }
+    if (armed == 0) {
+        klog_error("TIMER_TEST", "One-shot not armed (FAIL)");
+        return -1;
+    }
+
+    timer_cancel();
+    if (timer_has_tsc_deadline()) {
+        armed = arch_msr_read(IA32_TSC_DEADLINE_MSR);
+    } else {
+        armed = lapic_read(LAPIC_TIMER_CCR);
+    }
+    if (armed != 0) {
+        klog_error("TIMER_TEST", "One-shot still armed after cancel (FAIL)");
+        return -1;
+    }
+
+    klog_info("TIMER_TEST", "One-shot %s timer armed and cancelled (PASS)",
+              timer_has_tsc_deadline() ? "TSC-deadline" : "count");
+    return 0;
+}
+#endif
+
 /**
  * run_apic_timer_tests - Run APIC timer interrupt tests
  *
@@ -35,6 +77,13 @@ int run_apic_timer_tests(void) {
     apic_timer_init();
     klog_info("TIMER_TEST", "APIC timer initialized");
 
+#if CONFIG_NO_HZ
+    klog_info("TIMER_TEST", "Test 1b: One-shot programming (NO_HZ)");
+    if (test_oneshot_program() != 0) {
+        return -1;
+    }
+#endif
+
     /* Test 2: Start timer to verify it can run */
     klog_info("TIMER_TEST", "Test 2: Start timer");
     timer_start();
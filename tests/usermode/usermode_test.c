@@ -15,6 +15,7 @@
 #include "arch/x86_64/serial.h"
 #include "arch/x86_64/include/syscall.h"
 #include "arch/x86_64/include/gdt.h"
+#include "arch/x86_64/include/ptrace.h"
 
 #if CONFIG_TESTS_USERMODE
 
@@ -31,10 +32,10 @@ static int test_syscall_ring0(void) {
     /* Call syscall handler directly to test the C logic
      * Note: We don't use SYSCALL instruction here because sysretq
      * always returns to ring 3, which would break ring 0 execution. */
-    extern void syscall_handler(uint64_t nr, uint64_t a1, uint64_t a2, uint64_t a3);
+    struct pt_regs regs = { .orig_rax = SYS_write };
 
     /* Test sys_write with minimal args */
-    syscall_handler(1, 0, 0, 0);
+    syscall_handler(&regs);
 
     klog_info("USERMODE_TEST", "Syscall handler direct call: PASSED");
     return 0;
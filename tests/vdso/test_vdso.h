@@ -0,0 +1,15 @@
+/* Emergence Kernel - vDSO Test Wrapper Header */
+
+#ifndef TEST_VDSO_H
+#define TEST_VDSO_H
+
+/**
+ * test_vdso - Run the vDSO tests
+ *
+ * Runs the suite if it is selected. Must be called by the BSP after
+ * vdso_init() and tsc_init() and before the APs start, while page tables
+ * may still be written directly.
+ */
+void test_vdso(void);
+
+#endif /* TEST_VDSO_H */
@@ -0,0 +1,218 @@
+/* Emergence Kernel - vDSO Tests
+ *
+ * Runs the shared vDSO text at its kernel address, where the same data
+ * page sits below it, so clock_gettime and getcpu are exercised without
+ * a trip to ring 3, and checks how the pages are mapped into user
+ * address spaces.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "test_vdso.h"
+#include "kernel/test.h"
+#include "kernel/klog.h"
+#include "kernel/vm.h"
+#include "kernel/pmm.h"
+#include "arch/x86_64/smp.h"
+#include "arch/x86_64/tsc.h"
+#include "arch/x86_64/power.h"
+#include "arch/x86_64/include/syscall.h"
+#include "arch/x86_64/include/vdso.h"
+
+#if CONFIG_TESTS_VDSO
+
+/* Frame a PTE maps */
+#define VDSO_TEST_FRAME(pte)    ((pte) & ~(uint64_t)(PAGE_SIZE - 1) & ~PT_NX)
+
+/* Entry points called at their kernel address (same layout as in user space) */
+typedef int (*vdso_clock_gettime_t)(int clk, struct timespec *ts);
+typedef int (*vdso_getcpu_t)(unsigned int *cpu, unsigned int *node);
+
+/* ============================================================================
+ * Test 1: vDSO Code
+ * ============================================================================ */
+
+/**
+ * test_vdso_code - Test clock_gettime and getcpu against the kernel's view
+ *
+ * Paths that would fall back to SYSCALL are skipped: from ring 0 it
+ * would return to ring 3.
+ */
+static int test_vdso_code(void) {
+    uint8_t *text = vdso_text();
+    struct vdso_data *data;
+    struct timespec ts;
+    uint64_t before, after, ns;
+    unsigned int cpu = ~0U, node = ~0U;
+
+    klog_info("VDSO_TEST", "Test 1: vDSO code...");
+
+    if (text == NULL) {
+        klog_error("VDSO_TEST", "FAILED: No vDSO pages");
+        return -1;
+    }
+    data = (struct vdso_data *)(text - PAGE_SIZE);
+    if ((data->seq & 1) != 0 || data->ns_mult == 0) {
+        klog_error("VDSO_TEST", "FAILED: TSC calibration not published (seq %u)", data->seq);
+        return -1;
+    }
+
+    /* clock_gettime must agree with sched_clock(), which it mirrors */
+    before = sched_clock();
+    if (((vdso_clock_gettime_t)(text + VDSO_OFF_CLOCK_GETTIME))(CLOCK_MONOTONIC, &ts) != 0) {
+        klog_error("VDSO_TEST", "FAILED: clock_gettime failed");
+        return -1;
+    }
+    after = sched_clock();
+    ns = (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+    if (ts.tv_nsec < 0 || ts.tv_nsec >= (int64_t)NSEC_PER_SEC || ns < before || ns > after) {
+        klog_error("VDSO_TEST", "FAILED: clock_gettime %lu ns outside [%lu, %lu]",
+                   (unsigned long)ns, (unsigned long)before, (unsigned long)after);
+        return -1;
+    }
+
+    if (data->flags & VDSO_F_RDTSCP) {
+        if (((vdso_getcpu_t)(text + VDSO_OFF_GETCPU))(&cpu, &node) != 0 ||
+            cpu != (unsigned int)smp_get_cpu_index() || node != 0) {
+            klog_error("VDSO_TEST", "FAILED: getcpu returned CPU %u node %u", cpu, node);
+            return -1;
+        }
+    }
+
+    klog_info("VDSO_TEST", "Test 1: PASSED (clock %lu ns, getcpu via %s)",
+              (unsigned long)ns, (data->flags & VDSO_F_RDTSCP) ? "RDTSCP" : "syscall");
+    return 0;
+}
+
+/* ============================================================================
+ * Test 2: vDSO Mappings
+ * ============================================================================ */
+
+/**
+ * test_vdso_map - Test mapping the vDSO into an address space
+ *
+ * The text and data pages must be shared and read-only for user mode,
+ * the PID page private to the address space, and a clone must not
+ * inherit any of them.
+ */
+static int test_vdso_map(void) {
+    uint8_t *text = vdso_text();
+    address_space_t *as, *clone = NULL;
+    vm_region_t *proc;
+    uint64_t free_pages;
+    int ret = -1;
+
+    klog_info("VDSO_TEST", "Test 2: vDSO mappings...");
+
+    if (text == NULL) {
+        klog_error("VDSO_TEST", "FAILED: No vDSO pages");
+        return -1;
+    }
+
+    free_pages = pmm_get_free_pages();
+    as = vm_create_address_space(AS_SHARE_KERNEL);
+    if (as == NULL) {
+        klog_error("VDSO_TEST", "FAILED: No address space");
+        return -1;
+    }
+    if (vdso_map(as, 1234) != 0 ||
+        VDSO_TEST_FRAME(vm_lookup_page(as, VDSO_TEXT_BASE)) != (uint64_t)text ||
+        VDSO_TEST_FRAME(vm_lookup_page(as, VDSO_VVAR_BASE)) != (uint64_t)(text - PAGE_SIZE) ||
+        (vm_lookup_page(as, VDSO_TEXT_BASE) & (PT_USER | PT_WRITE)) != PT_USER ||
+        (vm_lookup_page(as, VDSO_PROC_BASE) & (PT_USER | PT_WRITE)) != PT_USER) {
+        klog_error("VDSO_TEST", "FAILED: vDSO not mapped read-only for user mode");
+        goto out;
+    }
+    proc = vm_find_region(as, VDSO_PROC_BASE);
+    if (proc == NULL || ((struct vdso_proc *)proc->phys_base)->pid != 1234) {
+        klog_error("VDSO_TEST", "FAILED: PID page does not hold the PID");
+        goto out;
+    }
+    vdso_set_pid(as, 4321);
+    if (((struct vdso_proc *)proc->phys_base)->pid != 4321) {
+        klog_error("VDSO_TEST", "FAILED: vdso_set_pid did not update the PID page");
+        goto out;
+    }
+
+    clone = vm_clone_address_space(as);
+    if (clone == NULL || vm_find_region(clone, VDSO_PROC_BASE) != NULL ||
+        vm_find_region(clone, VDSO_TEXT_BASE) != NULL) {
+        klog_error("VDSO_TEST", "FAILED: Clone inherited the vDSO mappings");
+        goto out;
+    }
+
+    ret = 0;
+out:
+    if (clone != NULL) {
+        vm_destroy_address_space(clone);
+    }
+    vm_destroy_address_space(as);
+    if (ret == 0 && pmm_get_free_pages() != free_pages) {
+        klog_error("VDSO_TEST", "FAILED: Leaked %ld pages",
+                   (long)(free_pages - pmm_get_free_pages()));
+        ret = -1;
+    }
+    if (ret == 0) {
+        klog_info("VDSO_TEST", "Test 2: PASSED");
+    }
+    return ret;
+}
+
+/* ============================================================================
+ * Main Test Runner
+ * ============================================================================ */
+
+/**
+ * run_vdso_tests - Run all vDSO tests
+ *
+ * Returns: Number of test failures (0 = all passed)
+ */
+int run_vdso_tests(void) {
+    int failures = 0;
+
+    klog_info("VDSO_TEST", "=== vDSO Test Suite ===");
+
+    /* Test 1: vDSO Code */
+    if (test_vdso_code() != 0) {
+        failures++;
+    }
+
+    /* Test 2: vDSO Mappings */
+    if (test_vdso_map() != 0) {
+        failures++;
+    }
+
+    /* Summary */
+    if (failures == 0) {
+        klog_info("VDSO_TEST", "VDSO: All tests PASSED");
+    } else {
+        klog_error("VDSO_TEST", "VDSO: Some tests FAILED (%d failures)", failures);
+    }
+
+    return failures;
+}
+
+#endif /* CONFIG_TESTS_VDSO */
+
+/* ============================================================================
+ * Test Wrapper
+ * ============================================================================ */
+
+#if CONFIG_TESTS_VDSO
+void test_vdso(void) {
+    if (test_should_run("vdso")) {
+        if (!test_did_run("vdso")) {
+            int result = run_vdso_tests();
+            test_mark_run("vdso", result);
+            if (result == 0) {
+                klog_info("TEST", "PASSED: vdso");
+            } else {
+                klog_error("TEST", "FAILED: vdso (failures: %d)", result);
+                system_shutdown();
+            }
+        }
+    }
+}
+#else
+void test_vdso(void) { }
+#endif